@@ -0,0 +1,160 @@
+#include "cascade_controller.h"
+
+#include <cmath>
+
+using namespace mavsdk;
+
+namespace {
+
+constexpr float gravity_m_s2 = 9.80665f;
+constexpr float deg_to_rad = static_cast<float>(M_PI / 180.0);
+constexpr float rad_to_deg = static_cast<float>(180.0 / M_PI);
+
+// Steps further apart than this are a restart, not a step to integrate.
+constexpr float max_dt_s = 0.1f;
+
+Float4 to_float4(const Telemetry::PositionNed &position) {
+  return Float4{{position.north_m, position.east_m, position.down_m, 0.0f}};
+}
+
+Float4 to_float4(const Telemetry::VelocityNed &velocity) {
+  return Float4{
+      {velocity.north_m_s, velocity.east_m_s, velocity.down_m_s, 0.0f}};
+}
+
+} // namespace
+
+CascadeController::CascadeController(const CascadeGains &gains)
+    : _gains(gains),
+      _velocity_low{{-gains.max_speed_xy_m_s, -gains.max_speed_xy_m_s,
+                     -gains.max_speed_up_m_s, 0.0f}},
+      _velocity_high{{gains.max_speed_xy_m_s, gains.max_speed_xy_m_s,
+                      gains.max_speed_down_m_s, 0.0f}},
+      _min_lift(gravity_m_s2 * gains.min_thrust / gains.hover_thrust),
+      _max_lift(gravity_m_s2 * gains.max_thrust / gains.hover_thrust),
+      _tan_max_tilt(std::tan(gains.max_tilt_deg * deg_to_rad)),
+      _integral(Float4::zero()) {}
+
+Offboard::Attitude CascadeController::step(const Float4 &position_setpoint,
+                                           const Float4 &velocity_feedforward,
+                                           float yaw_setpoint_deg,
+                                           const Float4 &position,
+                                           const Float4 &velocity, float dt_s) {
+  // Outer loop: position error to a bounded velocity setpoint.
+  Float4 velocity_setpoint =
+      (position_setpoint - position) * _gains.position_p + velocity_feedforward;
+  const float speed_xy = norm_xy(velocity_setpoint);
+  if (speed_xy > _gains.max_speed_xy_m_s) {
+    const float scale = _gains.max_speed_xy_m_s / speed_xy;
+    velocity_setpoint[0] *= scale;
+    velocity_setpoint[1] *= scale;
+  }
+  velocity_setpoint = clamp(velocity_setpoint, _velocity_low, _velocity_high);
+
+  // Inner loop: velocity error to an acceleration setpoint.
+  const Float4 error = velocity_setpoint - velocity;
+  Float4 acceleration = error * _gains.velocity_p + _integral;
+
+  // Lift is the upward specific force; it bounds the thrust and, through
+  // the tilt limit, the horizontal acceleration.
+  const float wanted_lift = gravity_m_s2 - acceleration[2];
+  const float lift = std::min(std::max(wanted_lift, _min_lift), _max_lift);
+  const float max_lateral = lift * _tan_max_tilt;
+  const float lateral = norm_xy(acceleration);
+  const bool saturated_xy = lateral > max_lateral;
+  if (saturated_xy) {
+    const float scale = max_lateral / lateral;
+    acceleration[0] *= scale;
+    acceleration[1] *= scale;
+  }
+  const bool saturated_z = lift != wanted_lift;
+
+  // Anti-windup: axes whose output is saturated stop integrating, and the
+  // integral terms stay bounded regardless.
+  if (dt_s > 0.0f && dt_s <= max_dt_s) {
+    const float xy = saturated_xy ? 0.0f : dt_s;
+    const float z = saturated_z ? 0.0f : dt_s;
+    const Float4 integrate{{xy, xy, z, 0.0f}};
+    _integral = clamp(_integral + error * _gains.velocity_i * integrate,
+                      Float4::zero() - _gains.integral_limit,
+                      _gains.integral_limit);
+  }
+
+  // Rotate into the heading frame and tilt the thrust vector onto the
+  // acceleration.
+  const float yaw = yaw_setpoint_deg * deg_to_rad;
+  const float cos_yaw = std::cos(yaw);
+  const float sin_yaw = std::sin(yaw);
+  const float forward = cos_yaw * acceleration[0] + sin_yaw * acceleration[1];
+  const float right = -sin_yaw * acceleration[0] + cos_yaw * acceleration[1];
+
+  const float vertical = std::sqrt(forward * forward + lift * lift);
+  const float total = std::sqrt(vertical * vertical + right * right);
+
+  Offboard::Attitude attitude{};
+  attitude.pitch_deg = -std::atan2(forward, lift) * rad_to_deg;
+  attitude.roll_deg = std::atan2(right, vertical) * rad_to_deg;
+  attitude.yaw_deg = yaw_setpoint_deg;
+  attitude.thrust_value =
+      std::min(std::max(_gains.hover_thrust * total / gravity_m_s2,
+                        _gains.min_thrust),
+               _gains.max_thrust);
+  return attitude;
+}
+
+CascadeSource::CascadeSource(const VehicleState &state, const Waypoint &target,
+                             const CascadeGains &gains,
+                             std::chrono::milliseconds max_state_age)
+    : _state(state), _gains(gains), _max_state_age(max_state_age),
+      _controller(gains), _targets(target), _target(target),
+      _step_time_metric(metrics().histogram("controller.step_time")) {}
+
+void CascadeSource::next(Clock::time_point tick, Setpoint &setpoint) {
+  const auto start = Clock::now();
+  _targets.read(_target);
+  // Ages are taken at the tick, the time the setpoint is meant for, which
+  // also keeps the step independent of the clock under replay.
+  const auto sample = _state.read(tick);
+
+  Offboard::Attitude attitude{};
+  if (sample.position_age > _max_state_age) {
+    // Nothing to close the loop on: stay level and let the integral terms
+    // start over once the state is back.
+    attitude.yaw_deg = _target.yaw_deg;
+    attitude.thrust_value = _gains.hover_thrust;
+    _controller.reset();
+    _stale_steps.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    const float dt_s =
+        _last_tick == Clock::time_point{}
+            ? 0.0f
+            : std::chrono::duration<float>(tick - _last_tick).count();
+    const Float4 target{
+        {_target.north_m, _target.east_m, _target.down_m, 0.0f}};
+    attitude = _controller.step(
+        target, Float4::zero(), _target.yaw_deg,
+        to_float4(sample.state.position_velocity.position),
+        to_float4(sample.state.position_velocity.velocity), dt_s);
+  }
+  _last_tick = tick;
+  setpoint = Setpoint::make_attitude(attitude);
+
+  _steps.fetch_add(1, std::memory_order_relaxed);
+  const auto step_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                           start)
+          .count();
+  _step_time_metric.record(std::chrono::nanoseconds(step_ns));
+  if (step_ns > _max_step_time_ns.load(std::memory_order_relaxed)) {
+    _max_step_time_ns.store(step_ns, std::memory_order_relaxed);
+  }
+}
+
+CascadeSource::Stats CascadeSource::stats() const {
+  Stats stats{};
+  stats.steps = _steps.load(std::memory_order_relaxed);
+  stats.stale_steps = _stale_steps.load(std::memory_order_relaxed);
+  stats.max_step_time = std::chrono::nanoseconds(
+      _max_step_time_ns.load(std::memory_order_relaxed));
+  return stats;
+}
@@ -0,0 +1,115 @@
+//
+// Companion-side cascaded position controller.
+//
+// Position error -> velocity setpoint -> acceleration (PI with anti-windup)
+// -> roll, pitch and collective thrust, sent as offboard attitude setpoints.
+// All state lives in fixed-size Float4 lanes: a controller step neither
+// allocates nor branches on sizes, and costs well under a microsecond
+// (see controller_bench).
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include <mavsdk/plugins/offboard/offboard.h>
+
+#include "float4.h"
+#include "mailbox.h"
+#include "metrics.h"
+#include "setpoint_streamer.h"
+#include "trajectory.h"
+#include "vehicle_state.h"
+
+struct CascadeGains {
+  // North, east, down; the fourth lane is unused.
+  Float4 position_p{{0.95f, 0.95f, 1.0f, 0.0f}};
+  Float4 velocity_p{{1.8f, 1.8f, 4.0f, 0.0f}};
+  Float4 velocity_i{{0.4f, 0.4f, 2.0f, 0.0f}};
+  // Bound on the integral terms, in m/s^2.
+  Float4 integral_limit{{2.0f, 2.0f, 3.0f, 0.0f}};
+
+  float max_speed_xy_m_s{2.0f};
+  float max_speed_up_m_s{1.0f};
+  float max_speed_down_m_s{0.7f};
+  float max_tilt_deg{25.0f};
+  // Normalized thrust that holds the vehicle in a hover.
+  float hover_thrust{0.5f};
+  float min_thrust{0.1f};
+  float max_thrust{0.9f};
+};
+
+class CascadeController {
+public:
+  explicit CascadeController(const CascadeGains &gains = {});
+
+  // One control step. Positions and velocities are NED, lane 3 is ignored.
+  //
+  // returns the attitude and thrust to command.
+  mavsdk::Offboard::Attitude step(const Float4 &position_setpoint,
+                                  const Float4 &velocity_feedforward,
+                                  float yaw_setpoint_deg,
+                                  const Float4 &position,
+                                  const Float4 &velocity, float dt_s);
+
+  // Clear the integral terms.
+  void reset() { _integral = Float4::zero(); }
+  const Float4 &integral() const { return _integral; }
+
+private:
+  const CascadeGains _gains;
+  // Precomputed from the gains.
+  const Float4 _velocity_low;
+  const Float4 _velocity_high;
+  const float _min_lift;
+  const float _max_lift;
+  const float _tan_max_tilt;
+
+  Float4 _integral{};
+};
+
+//
+// Runs the cascaded controller on the streaming thread: every tick reads the
+// vehicle state, steps the controller towards the current target and sends
+// the resulting attitude.
+//
+class CascadeSource : public SetpointSource {
+public:
+  using Clock = SetpointStreamer::Clock;
+
+  struct Stats {
+    uint64_t steps{0};
+    // Ticks without a fresh enough position, flown level at hover thrust.
+    uint64_t stale_steps{0};
+    std::chrono::nanoseconds max_step_time{0};
+  };
+
+  CascadeSource(const VehicleState &state, const Waypoint &target,
+                const CascadeGains &gains = {},
+                std::chrono::milliseconds max_state_age =
+                    std::chrono::milliseconds(200));
+
+  // Thread-safe, picked up on the next tick.
+  void set_target(const Waypoint &target) { _targets.write(target); }
+
+  void next(Clock::time_point tick, Setpoint &setpoint) override;
+
+  Stats stats() const;
+
+private:
+  const VehicleState &_state;
+  const CascadeGains _gains;
+  const Clock::duration _max_state_age;
+  CascadeController _controller;
+
+  Mailbox<Waypoint> _targets;
+  Waypoint _target{};
+  Clock::time_point _last_tick{};
+
+  std::atomic<uint64_t> _steps{0};
+  std::atomic<uint64_t> _stale_steps{0};
+  std::atomic<int64_t> _max_step_time_ns{0};
+  LatencyHistogram &_step_time_metric;
+};
@@ -0,0 +1,417 @@
+//
+// Benchmark of the connection transports for the control loop.
+//
+// Connects to the same vehicle over each given URL in turn (UDP, TCP or
+// serial, anything add_any_connection takes) and runs increasing load
+// steps. At each step setpoints are sent and the position stream is
+// requested at the step rate, while a second thread keeps measuring the
+// command round trip with acknowledged message interval requests. Per step
+// it reports the achieved send and receive rates, the time a send takes,
+// the ack round trip and the CPU time of the process, and per transport the
+// first step it could no longer keep up with.
+//
+// Setpoints are sent without starting offboard mode or arming, so the
+// vehicle only receives them. It can stay on the ground. The stream rates
+// the bench sets go back to the autopilot's defaults when it is done.
+//
+// A step the receive rate falls short on is not necessarily beyond the
+// transport: autopilots cap how fast they publish a stream (PX4 by the
+// link's configured data rate, among others), and that cap shows up the
+// same way. A receive limit that is the same on every transport is most
+// likely the autopilot's.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <mavsdk/mavsdk.h>
+#include <mavsdk/plugins/offboard/offboard.h>
+#include <mavsdk/plugins/telemetry/telemetry.h>
+
+#include "metrics.h"
+#include "offboard_core.h"
+#include "rate_profile.h"
+#include "setpoint.h"
+
+using namespace mavsdk;
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+using std::this_thread::sleep_for;
+using Clock = std::chrono::steady_clock;
+
+const std::vector<double> load_rates_hz = {25.0,  50.0,  100.0, 200.0,
+                                           400.0, 800.0, 1600.0};
+constexpr double default_step_s = 5.0;
+// New stream rates take a moment to show up.
+constexpr auto settle_time = milliseconds(500);
+constexpr auto ack_period = milliseconds(100);
+// What the probe requests, the battery rate of the control profile.
+constexpr double probe_battery_rate_hz = 1.0;
+// A step is kept up with while both rates reach this share of the load.
+constexpr double saturation_fraction = 0.9;
+
+void usage(const std::string &bin_name) {
+  print_usage(bin_name, "[--url <connection_url>]... [--step-s <s>] "
+                        "[report.json]");
+  std::cerr << "Every --url is benchmarked after the first connection URL, "
+               "each should reach the same vehicle over another transport, "
+               "e.g. udp://:14540 --url serial:///dev/ttyACM0:921600\n";
+}
+
+struct LoadResult {
+  double load_hz{0.0};
+  double sent_hz{0.0};
+  double send_p99_us{0.0};
+  double received_hz{0.0};
+  double ack_p50_ms{0.0};
+  double ack_p99_ms{0.0};
+  unsigned ack_failures{0};
+  // Of one core, all threads of the process.
+  double cpu_percent{0.0};
+};
+
+struct TransportReport {
+  std::string url{};
+  bool connected{false};
+  double discovery_ms{0.0};
+  std::vector<LoadResult> loads{};
+  // Zero if every step was kept up with.
+  double saturation_hz{0.0};
+  std::string saturated_by{};
+};
+
+double to_ms(Clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+double cpu_seconds() {
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+         static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) /
+             1e6;
+}
+
+double percentile(std::vector<double> values, double fraction) {
+  if (values.empty()) {
+    return 0.0;
+  }
+  std::sort(values.begin(), values.end());
+  const auto rank = static_cast<size_t>(
+      std::ceil(fraction * static_cast<double>(values.size())));
+  return values[std::min(values.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+//
+// Keeps timing acknowledged commands until stopped. A message interval
+// request is a COMMAND_LONG answered by a COMMAND_ACK. The probe asks for
+// the same battery rate every time, so only its first request can change
+// anything, and the battery stream is not part of the load.
+//
+class AckProbe {
+public:
+  explicit AckProbe(Telemetry &telemetry)
+      : _telemetry(telemetry), _thread([this]() { run(); }) {}
+
+  ~AckProbe() {
+    _running.store(false, std::memory_order_release);
+    _thread.join();
+  }
+
+  // Round trips and failures since the last call.
+  void take(std::vector<double> &round_trips_ms, unsigned &failures) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    round_trips_ms.swap(_round_trips_ms);
+    _round_trips_ms.clear();
+    failures = _failures;
+    _failures = 0;
+  }
+
+private:
+  void run() {
+    while (_running.load(std::memory_order_acquire)) {
+      const auto sent = Clock::now();
+      const auto result = _telemetry.set_rate_battery(probe_battery_rate_hz);
+      const double round_trip_ms = to_ms(Clock::now() - sent);
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (result == Telemetry::Result::Success) {
+          _round_trips_ms.push_back(round_trip_ms);
+        } else {
+          ++_failures;
+        }
+      }
+      sleep_for(ack_period);
+    }
+  }
+
+  Telemetry &_telemetry;
+  std::mutex _mutex{};
+  std::vector<double> _round_trips_ms{};
+  unsigned _failures{0};
+  std::atomic<bool> _running{true};
+  std::thread _thread;
+};
+
+LoadResult run_load(Offboard &offboard, Telemetry &telemetry, AckProbe &probe,
+                    const std::atomic<uint64_t> &received, double load_hz,
+                    Clock::duration step_time) {
+  LoadResult result{};
+  result.load_hz = load_hz;
+
+  if (telemetry.set_rate_position_velocity_ned(load_hz) !=
+      Telemetry::Result::Success) {
+    std::cerr << "Setting the position rate to " << load_hz
+              << " Hz failed\n";
+  }
+  sleep_for(settle_time);
+
+  Offboard::VelocityNedYaw velocity{};
+  const Setpoint setpoint = Setpoint::make_velocity_ned(velocity);
+  const auto period = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(1.0 / load_hz));
+
+  std::vector<double> ignored;
+  unsigned ignored_failures = 0;
+  probe.take(ignored, ignored_failures);
+  LatencyHistogram send_time;
+  uint64_t sent = 0;
+  const uint64_t received_before = received.load(std::memory_order_relaxed);
+  const double cpu_before = cpu_seconds();
+  const auto start = Clock::now();
+  auto deadline = start;
+
+  while (Clock::now() - start < step_time) {
+    deadline += period;
+    std::this_thread::sleep_until(deadline);
+    const auto before = Clock::now();
+    send_setpoint(offboard, setpoint);
+    const auto after = Clock::now();
+    send_time.record(after - before);
+    ++sent;
+    // Do not catch up on sends that could not be made in time, that would
+    // hide the saturation.
+    if (after - deadline > period) {
+      deadline = after;
+    }
+  }
+
+  const double elapsed_s =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  result.cpu_percent = (cpu_seconds() - cpu_before) / elapsed_s * 100.0;
+  result.sent_hz = static_cast<double>(sent) / elapsed_s;
+  result.received_hz =
+      static_cast<double>(received.load(std::memory_order_relaxed) -
+                          received_before) /
+      elapsed_s;
+
+  LatencyHistogram::Counts counts;
+  send_time.counts(counts);
+  result.send_p99_us =
+      static_cast<double>(percentile_ns(counts, 0.99)) / 1000.0;
+
+  std::vector<double> round_trips_ms;
+  probe.take(round_trips_ms, result.ack_failures);
+  result.ack_p50_ms = percentile(round_trips_ms, 0.50);
+  result.ack_p99_ms = percentile(round_trips_ms, 0.99);
+  return result;
+}
+
+TransportReport run_transport(const ConnectionOptions &options,
+                              Clock::duration step_time) {
+  TransportReport report{};
+  report.url = options.connection_url;
+  std::cout << "Benchmarking " << report.url << '\n';
+
+  Mavsdk mavsdk;
+  const auto connect_start = Clock::now();
+  auto system = connect(mavsdk, options);
+  if (!system) {
+    return report;
+  }
+  report.connected = true;
+  report.discovery_ms = to_ms(Clock::now() - connect_start);
+
+  auto offboard = Offboard{system};
+  auto telemetry = Telemetry{system};
+
+  // The load steps end on the fastest position rate; it and the probe's
+  // battery rate are handed back however this returns.
+  RateProfile touched{};
+  touched.name = "connection_bench";
+  touched.rates = {{Stream::PositionVelocityNed, load_rates_hz.back()},
+                   {Stream::Battery, probe_battery_rate_hz}};
+  touched.disable_unused = false;
+  DefaultRateRestorer restorer{telemetry, touched};
+
+  std::atomic<uint64_t> received{0};
+  telemetry.subscribe_position_velocity_ned(
+      [&received](Telemetry::PositionVelocityNed) {
+        received.fetch_add(1, std::memory_order_relaxed);
+      });
+
+  {
+    AckProbe probe{telemetry};
+    for (const double load_hz : load_rates_hz) {
+      const auto load =
+          run_load(offboard, telemetry, probe, received, load_hz, step_time);
+      report.loads.push_back(load);
+
+      std::cout << std::fixed << std::setprecision(1) << "  " << std::setw(6)
+                << load.load_hz << " Hz: sent " << load.sent_hz
+                << " Hz (p99 " << load.send_p99_us << " us), received "
+                << load.received_hz << " Hz, ack p50 " << load.ack_p50_ms
+                << " ms p99 " << load.ack_p99_ms << " ms, "
+                << load.ack_failures << " failed, cpu " << load.cpu_percent
+                << "%\n";
+      std::cout.unsetf(std::ios::fixed);
+
+      if (report.saturation_hz == 0.0) {
+        if (load.sent_hz < saturation_fraction * load_hz) {
+          report.saturated_by = "send";
+        } else if (load.received_hz < saturation_fraction * load_hz) {
+          report.saturated_by = "receive";
+        } else if (load.ack_failures > 0) {
+          report.saturated_by = "ack";
+        }
+        if (!report.saturated_by.empty()) {
+          report.saturation_hz = load_hz;
+        }
+      }
+    }
+  }
+
+  telemetry.subscribe_position_velocity_ned(nullptr);
+  return report;
+}
+
+void write_report(std::ostream &out,
+                  const std::vector<TransportReport> &reports) {
+  out << "{\n"
+      << "  \"note\": \"receive saturation includes the autopilot's own "
+         "publish rate cap, compare it across transports\",\n"
+      << "  \"transports\": [\n";
+  for (size_t i = 0; i < reports.size(); ++i) {
+    const auto &report = reports[i];
+    out << "    {\n"
+        << "      \"connection\": \"" << report.url << "\",\n"
+        << "      \"connected\": " << (report.connected ? "true" : "false")
+        << ",\n"
+        << "      \"discovery_ms\": " << report.discovery_ms << ",\n"
+        << "      \"saturation_hz\": " << report.saturation_hz << ",\n"
+        << "      \"saturated_by\": \"" << report.saturated_by << "\",\n"
+        << "      \"loads\": [\n";
+    for (size_t j = 0; j < report.loads.size(); ++j) {
+      const auto &load = report.loads[j];
+      out << "        {\"load_hz\": " << load.load_hz
+          << ", \"sent_hz\": " << load.sent_hz
+          << ", \"send_p99_us\": " << load.send_p99_us
+          << ", \"received_hz\": " << load.received_hz
+          << ", \"ack_p50_ms\": " << load.ack_p50_ms
+          << ", \"ack_p99_ms\": " << load.ack_p99_ms
+          << ", \"ack_failures\": " << load.ack_failures
+          << ", \"cpu_percent\": " << load.cpu_percent << "}"
+          << (j + 1 < report.loads.size() ? "," : "") << '\n';
+    }
+    out << "      ]\n"
+        << "    }" << (i + 1 < reports.size() ? "," : "") << '\n';
+  }
+  out << "  ]\n"
+      << "}\n";
+}
+
+void print_summary(const std::vector<TransportReport> &reports) {
+  std::cout << "Transport summary:\n";
+  for (const auto &report : reports) {
+    std::cout << "  " << report.url << ": ";
+    if (!report.connected) {
+      std::cout << "no connection\n";
+    } else if (report.saturation_hz == 0.0) {
+      std::cout << "kept up to " << load_rates_hz.back() << " Hz\n";
+    } else {
+      std::cout << report.saturated_by << " saturates at "
+                << report.saturation_hz << " Hz"
+                << (report.saturated_by == "receive"
+                        ? " (or the autopilot caps the stream there)"
+                        : "")
+                << '\n';
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  ConnectionOptions options;
+  std::vector<std::string> arguments;
+  if (!parse_arguments(argc, argv, options, arguments)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  std::vector<std::string> urls{options.connection_url};
+  double step_s = default_step_s;
+  std::string report_path = "connection_report.json";
+  bool have_report_path = false;
+  for (size_t i = 0; i < arguments.size(); ++i) {
+    const std::string &argument = arguments[i];
+    if (argument == "--url" || argument == "--step-s") {
+      if (i + 1 >= arguments.size()) {
+        std::cerr << argument << " needs a value\n";
+        usage(argv[0]);
+        return 1;
+      }
+      if (argument == "--url") {
+        urls.push_back(arguments[++i]);
+      } else {
+        step_s = std::strtod(arguments[++i].c_str(), nullptr);
+        if (!(step_s > 0.0)) {
+          std::cerr << "--step-s must be positive\n";
+          return 1;
+        }
+      }
+    } else if (!have_report_path) {
+      report_path = argument;
+      have_report_path = true;
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  const auto step_time = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(step_s));
+
+  MetricsExporter exporter{metrics(), options.metrics_target};
+  if (!exporter.start()) {
+    return 1;
+  }
+
+  std::vector<TransportReport> reports;
+  for (const auto &url : urls) {
+    ConnectionOptions transport = options;
+    transport.connection_url = url;
+    reports.push_back(run_transport(transport, step_time));
+  }
+
+  print_summary(reports);
+  std::ofstream report_file(report_path);
+  if (report_file) {
+    write_report(report_file, reports);
+    std::cout << "Report written to " << report_path << '\n';
+  } else {
+    std::cerr << "Could not write report to " << report_path << '\n';
+  }
+
+  return 0;
+}
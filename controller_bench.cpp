@@ -0,0 +1,136 @@
+//
+// Microbenchmark of one cascaded controller step, no vehicle needed.
+//
+// The controller flies a point-mass model through a 1 m step so that the
+// timed steps see realistic inputs, including saturation. Then the bench
+// reports the per-step time distribution against a budget and the
+// closed-loop error of the simulated flight.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "cascade_controller.h"
+
+using Clock = std::chrono::steady_clock;
+
+constexpr double default_budget_us = 5.0;
+constexpr float sim_rate_hz = 250.0f;
+constexpr float sim_duration_s = 10.0f;
+constexpr size_t timed_steps = 1000000;
+constexpr float gravity_m_s2 = 9.80665f;
+
+//
+// Point mass pushed along the body z axis of the commanded attitude.
+//
+struct PointMass {
+  Float4 position{};
+  Float4 velocity{};
+
+  void apply(const mavsdk::Offboard::Attitude &attitude, float hover_thrust,
+             float dt_s) {
+    const float roll = attitude.roll_deg * static_cast<float>(M_PI / 180.0);
+    const float pitch = attitude.pitch_deg * static_cast<float>(M_PI / 180.0);
+    const float yaw = attitude.yaw_deg * static_cast<float>(M_PI / 180.0);
+    const float lift = attitude.thrust_value / hover_thrust * gravity_m_s2;
+
+    // Third column of the NED rotation matrix, i.e. body z in NED.
+    const Float4 body_z{
+        {std::cos(yaw) * std::sin(pitch) * std::cos(roll) +
+             std::sin(yaw) * std::sin(roll),
+         std::sin(yaw) * std::sin(pitch) * std::cos(roll) -
+             std::cos(yaw) * std::sin(roll),
+         std::cos(pitch) * std::cos(roll), 0.0f}};
+    const Float4 acceleration =
+        body_z * -lift + Float4{{0.0f, 0.0f, gravity_m_s2, 0.0f}};
+
+    velocity = velocity + acceleration * dt_s;
+    position = position + velocity * dt_s;
+  }
+};
+
+double percentile(std::vector<double> values, double fraction) {
+  if (values.empty()) {
+    return 0.0;
+  }
+  std::sort(values.begin(), values.end());
+  const auto rank = static_cast<size_t>(
+      std::ceil(fraction * static_cast<double>(values.size())));
+  return values[std::min(values.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+int main(int argc, char **argv) {
+  if (argc > 2) {
+    std::cerr << "Usage : " << argv[0] << " [step_budget_us]\n";
+    return 1;
+  }
+  const double budget_us =
+      argc == 2 ? std::strtod(argv[1], nullptr) : default_budget_us;
+
+  const CascadeGains gains{};
+  CascadeController controller{gains};
+  PointMass vehicle{};
+  vehicle.position = Float4{{0.0f, 0.0f, -2.0f, 0.0f}};
+
+  const Float4 target{{1.0f, 0.0f, -2.0f, 0.0f}};
+  const float dt_s = 1.0f / sim_rate_hz;
+  const auto sim_steps = static_cast<size_t>(sim_duration_s * sim_rate_hz);
+
+  // Each step is timed on its own, so the numbers include one clock read
+  // per step.
+  std::vector<double> step_ns;
+  step_ns.reserve(timed_steps);
+  float max_error_m = 0.0f;
+
+  const auto batch_start = Clock::now();
+  for (size_t i = 0; i < timed_steps; ++i) {
+    // Restart the simulated flight every sim_duration_s.
+    if (i % sim_steps == 0) {
+      vehicle = PointMass{};
+      vehicle.position = Float4{{0.0f, 0.0f, -2.0f, 0.0f}};
+      controller.reset();
+    }
+
+    const auto start = Clock::now();
+    const auto attitude =
+        controller.step(target, Float4::zero(), 0.0f, vehicle.position,
+                        vehicle.velocity, dt_s);
+    step_ns.push_back(static_cast<double>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                             start)
+            .count()));
+
+    vehicle.apply(attitude, gains.hover_thrust, dt_s);
+    if (i % sim_steps == sim_steps - 1) {
+      const Float4 error = target - vehicle.position;
+      max_error_m = std::max(
+          max_error_m, std::sqrt(error[0] * error[0] + error[1] * error[1] +
+                                 error[2] * error[2]));
+    }
+  }
+  const double total_ns = static_cast<double>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                           batch_start)
+          .count());
+
+  const double p99_ns = percentile(step_ns, 0.99);
+  std::cout << "Controller step over " << timed_steps << " steps:\n"
+            << "  p50 " << percentile(step_ns, 0.50) << " ns, p99 " << p99_ns
+            << " ns, max " << percentile(step_ns, 1.0) << " ns\n"
+            << "  whole loop, with timing and simulation, "
+            << total_ns / static_cast<double>(timed_steps) << " ns per step\n"
+            << "Closed loop: error " << max_error_m << " m after "
+            << sim_duration_s << " s of a 1 m step\n";
+
+  if (p99_ns > budget_us * 1000.0) {
+    std::cerr << "p99 step time exceeds the " << budget_us << " us budget\n";
+    return 1;
+  }
+  std::cout << "Within the " << budget_us << " us budget\n";
+  return 0;
+}
@@ -0,0 +1,258 @@
+#include "failsafe_watchdog.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "link_monitor.h"
+
+using namespace mavsdk;
+
+namespace {
+
+int64_t ns_of(FailsafeWatchdog::Clock::time_point time) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             time.time_since_epoch())
+      .count();
+}
+
+FailsafeWatchdog::Clock::time_point time_of(int64_t ns) {
+  return FailsafeWatchdog::Clock::time_point(
+      std::chrono::duration_cast<FailsafeWatchdog::Clock::duration>(
+          std::chrono::nanoseconds(ns)));
+}
+
+double us_of(FailsafeWatchdog::Clock::duration duration) {
+  return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+} // namespace
+
+// Shared with the command callbacks, which may run after the watchdog is
+// gone.
+struct FailsafeWatchdog::Acknowledgements {
+  std::atomic<int64_t> first_ack_ns{0};
+  // Level whose command failed, None if none did.
+  std::atomic<int> failed_level{static_cast<int>(Level::None)};
+};
+
+FailsafeWatchdog::FailsafeWatchdog(Action &action, const VehicleState &state,
+                                   const SetpointStreamer &streamer,
+                                   const FailsafeThresholds &thresholds)
+    : _action(action), _state(state), _streamer(streamer),
+      _thresholds(thresholds),
+      _check_gap_metric(metrics().histogram("watchdog.check_gap")),
+      _escalations_metric(metrics().counter("watchdog.escalations")),
+      _acknowledgements(std::make_shared<Acknowledgements>()) {}
+
+FailsafeWatchdog::~FailsafeWatchdog() {
+  stop();
+  if (_rc_telemetry) {
+    _rc_telemetry->subscribe_rc_status(nullptr);
+  }
+}
+
+void FailsafeWatchdog::watch_rc(Telemetry &telemetry) {
+  _rc_telemetry = &telemetry;
+  telemetry.subscribe_rc_status([this](Telemetry::RcStatus status) {
+    if (status.is_available) {
+      _rc_available.store(true);
+      _rc_seen.store(true);
+    } else if (_rc_available.exchange(false)) {
+      _rc_lost_ns.store(ns_of(Clock::now()));
+    }
+  });
+}
+
+bool FailsafeWatchdog::start() {
+  if (_running.exchange(true)) {
+    std::cerr << "Failsafe watchdog already running\n";
+    return false;
+  }
+  _thread = std::thread(&FailsafeWatchdog::run, this);
+  return true;
+}
+
+void FailsafeWatchdog::stop() {
+  _running.store(false);
+  if (_thread.joinable()) {
+    _thread.join();
+  }
+}
+
+FailsafeWatchdog::Stats FailsafeWatchdog::stats() const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  Stats stats = _stats;
+  stats.level = level();
+  const int64_t ack_ns = _acknowledgements->first_ack_ns.load();
+  if (ack_ns != 0) {
+    stats.acknowledge_latency = time_of(ack_ns) - _detected;
+  }
+  return stats;
+}
+
+FailsafeWatchdog::Fault FailsafeWatchdog::check(Clock::time_point now,
+                                                Clock::time_point &crossed) {
+  const auto sample = _state.read(now);
+  if (sample.position_age > _thresholds.max_state_age &&
+      !(_link && !_link->link_up())) {
+    crossed = sample.has_position()
+                  ? now - (sample.position_age - _thresholds.max_state_age)
+                  : now;
+    return Fault::StateAge;
+  }
+
+  if (_streamer.is_running()) {
+    const uint64_t ticks = _streamer.ticks();
+    if (ticks != _last_ticks) {
+      _last_ticks = ticks;
+      _last_tick_seen = now;
+    } else if (now - _last_tick_seen > _thresholds.max_setpoint_gap) {
+      crossed = _last_tick_seen + _thresholds.max_setpoint_gap;
+      return Fault::SetpointGap;
+    }
+  } else {
+    // A streamer stopped on purpose is not a stall.
+    _last_tick_seen = now;
+  }
+
+  if (_rc_seen.load() && !_rc_available.load()) {
+    const auto lost = time_of(_rc_lost_ns.load());
+    if (now - lost > _thresholds.max_rc_loss) {
+      crossed = lost + _thresholds.max_rc_loss;
+      return Fault::RcLoss;
+    }
+  }
+  return Fault::None;
+}
+
+void FailsafeWatchdog::escalate(Level level, Clock::time_point now) {
+  _level.store(static_cast<int>(level), std::memory_order_release);
+  _escalations_metric.add();
+  std::cerr << "Failsafe: " << to_string(level) << '\n';
+
+  auto acknowledgements = _acknowledgements;
+  const auto callback = [acknowledgements, level](Action::Result result) {
+    if (result != Action::Result::Success) {
+      acknowledgements->failed_level.store(static_cast<int>(level));
+      return;
+    }
+    int64_t none = 0;
+    acknowledgements->first_ack_ns.compare_exchange_strong(
+        none, ns_of(Clock::now()));
+  };
+  switch (level) {
+  case Level::None:
+    return;
+  case Level::Hold:
+    _action.hold_async(callback);
+    break;
+  case Level::Land:
+    _action.land_async(callback);
+    break;
+  case Level::Kill:
+    _action.kill_async(callback);
+    break;
+  }
+
+  if (level == Level::Hold) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stats.action_latency = Clock::now() - now;
+  }
+}
+
+void FailsafeWatchdog::run() {
+  apply_thread_options(_thread_options, "Failsafe watchdog");
+
+  auto deadline = Clock::now();
+  auto last_check = deadline;
+  _last_ticks = _streamer.ticks();
+  _last_tick_seen = deadline;
+
+  while (_running.load(std::memory_order_relaxed)) {
+    const auto now = Clock::now();
+    Clock::time_point crossed{};
+    const Fault fault = check(now, crossed);
+    const Level current = level();
+    const auto failed = static_cast<Level>(
+        _acknowledgements->failed_level.load(std::memory_order_relaxed));
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      ++_stats.checks;
+      _stats.max_check_gap = std::max(_stats.max_check_gap, now - last_check);
+      if (current == Level::None && fault != Fault::None) {
+        _detected = now;
+        _stats.fault = fault;
+        _stats.detection_latency = now - crossed;
+      }
+    }
+    _check_gap_metric.record(now - last_check);
+    last_check = now;
+
+    if (current == Level::None && fault != Fault::None) {
+      escalate(Level::Hold, now);
+    } else if (current == Level::Hold &&
+               (failed == Level::Hold ||
+                (fault != Fault::None &&
+                 now - _detected >= _thresholds.land_after))) {
+      escalate(Level::Land, now);
+    } else if (current == Level::Land && failed == Level::Land) {
+      escalate(Level::Kill, now);
+    }
+
+    deadline += _thresholds.check_period;
+    if (deadline <= now) {
+      deadline = now + _thresholds.check_period;
+    }
+    std::this_thread::sleep_until(deadline);
+    _jitter.record(Clock::now() - deadline);
+  }
+}
+
+const char *to_string(FailsafeWatchdog::Level level) {
+  switch (level) {
+  case FailsafeWatchdog::Level::None:
+    return "none";
+  case FailsafeWatchdog::Level::Hold:
+    return "hold";
+  case FailsafeWatchdog::Level::Land:
+    return "land";
+  case FailsafeWatchdog::Level::Kill:
+    return "kill";
+  }
+  return "unknown";
+}
+
+const char *to_string(FailsafeWatchdog::Fault fault) {
+  switch (fault) {
+  case FailsafeWatchdog::Fault::None:
+    return "none";
+  case FailsafeWatchdog::Fault::StateAge:
+    return "telemetry dropout";
+  case FailsafeWatchdog::Fault::SetpointGap:
+    return "setpoint stream stalled";
+  case FailsafeWatchdog::Fault::RcLoss:
+    return "RC lost";
+  }
+  return "unknown";
+}
+
+void print_failsafe(const FailsafeWatchdog::Stats &stats) {
+  std::cout << "Failsafe watchdog: " << stats.checks
+            << " checks, longest gap " << us_of(stats.max_check_gap)
+            << " us\n";
+  if (stats.level == FailsafeWatchdog::Level::None) {
+    std::cout << "  not triggered\n";
+    return;
+  }
+  std::cout << "  " << to_string(stats.fault) << ", escalated to "
+            << to_string(stats.level) << "\n  detected "
+            << us_of(stats.detection_latency) << " us after the threshold, "
+            << "hold sent " << us_of(stats.action_latency) << " us later, ";
+  if (stats.acknowledge_latency == FailsafeWatchdog::Clock::duration{}) {
+    std::cout << "never acknowledged\n";
+  } else {
+    std::cout << "acknowledged after " << us_of(stats.acknowledge_latency)
+              << " us\n";
+  }
+}
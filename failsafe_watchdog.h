@@ -0,0 +1,153 @@
+//
+// Companion-side failsafe.
+//
+// A watchdog thread checks, every few milliseconds, the age of the vehicle
+// state, the heartbeat of the setpoint streamer and, optionally, the RC
+// link. Once any of them is past its threshold it escalates:
+//
+//   hold  on detection,
+//   land  if the fault is still there after `land_after` or hold failed,
+//   kill  if the land command failed.
+//
+// Detection is bounded by the check period, and commands go out on the
+// *_async calls so a slow link never stalls the check loop; the measured
+// latencies are part of the stats.
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <mavsdk/plugins/action/action.h>
+#include <mavsdk/plugins/telemetry/telemetry.h>
+
+#include "metrics.h"
+#include "realtime.h"
+#include "setpoint_streamer.h"
+#include "vehicle_state.h"
+
+class LinkMonitor;
+
+struct FailsafeThresholds {
+  // Position samples older than this are a telemetry dropout.
+  std::chrono::milliseconds max_state_age{300};
+  // A running streamer that has not ticked for this long has stalled.
+  std::chrono::milliseconds max_setpoint_gap{100};
+  // Only checked once watch_rc() was called and RC was seen.
+  std::chrono::milliseconds max_rc_loss{500};
+  std::chrono::milliseconds land_after{3000};
+  std::chrono::milliseconds check_period{5};
+};
+
+class FailsafeWatchdog {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  enum class Level { None, Hold, Land, Kill };
+  enum class Fault { None, StateAge, SetpointGap, RcLoss };
+
+  struct Stats {
+    uint64_t checks{0};
+    Level level{Level::None};
+    Fault fault{Fault::None};
+    // From the threshold being crossed until the watchdog saw it.
+    Clock::duration detection_latency{};
+    // From detection until the first command was handed to MAVSDK.
+    Clock::duration action_latency{};
+    // From detection until the autopilot acknowledged the first command,
+    // zero while no acknowledgement came.
+    Clock::duration acknowledge_latency{};
+    // Longest gap between two checks, the bound on detection_latency.
+    Clock::duration max_check_gap{};
+  };
+
+  FailsafeWatchdog(mavsdk::Action &action, const VehicleState &state,
+                   const SetpointStreamer &streamer,
+                   const FailsafeThresholds &thresholds = {});
+  ~FailsafeWatchdog();
+
+  FailsafeWatchdog(const FailsafeWatchdog &) = delete;
+  FailsafeWatchdog &operator=(const FailsafeWatchdog &) = delete;
+
+  // Also watch the RC link. The watchdog owns the rc_status subscription
+  // until it is destroyed.
+  void watch_rc(mavsdk::Telemetry &telemetry);
+
+  // Leave telemetry dropouts to `link`, which must outlive the watchdog:
+  // while it reports the link lost, old state is no fault. Nothing the
+  // watchdog commands would reach the vehicle then, and the autopilot's own
+  // link-loss failsafe is in charge. Its loss threshold must be below
+  // max_state_age.
+  void watch_link(const LinkMonitor &link) { _link = &link; }
+
+  // Takes effect on the next start().
+  void set_thread_options(const ThreadOptions &options) {
+    _thread_options = options;
+  }
+
+  // Start watching, e.g. once in the air. The thread asks for real-time
+  // priority, default_watchdog_priority unless set otherwise, and carries
+  // on without it if that is not permitted.
+  //
+  // returns false if the watchdog already runs.
+  bool start();
+  // Stop watching, e.g. before a planned landing. Does not undo a failsafe.
+  void stop();
+
+  bool triggered() const { return level() != Level::None; }
+  Level level() const {
+    return static_cast<Level>(_level.load(std::memory_order_acquire));
+  }
+  Stats stats() const;
+  const JitterHistogram &jitter() const { return _jitter; }
+
+private:
+  void run();
+  // The fault present at `now` and when its threshold was crossed.
+  Fault check(Clock::time_point now, Clock::time_point &crossed);
+  void escalate(Level level, Clock::time_point now);
+
+  struct Acknowledgements;
+
+  mavsdk::Action &_action;
+  const VehicleState &_state;
+  const SetpointStreamer &_streamer;
+  const FailsafeThresholds _thresholds;
+  mavsdk::Telemetry *_rc_telemetry{nullptr};
+  const LinkMonitor *_link{nullptr};
+
+  std::atomic<bool> _running{false};
+  ThreadOptions _thread_options{default_watchdog_priority, -1, false};
+  std::thread _thread{};
+  std::atomic<int> _level{static_cast<int>(Level::None)};
+
+  // Only touched by the watchdog thread.
+  uint64_t _last_ticks{0};
+  Clock::time_point _last_tick_seen{};
+
+  // Written by the RC callback.
+  std::atomic<bool> _rc_seen{false};
+  std::atomic<bool> _rc_available{false};
+  std::atomic<int64_t> _rc_lost_ns{0};
+
+  JitterHistogram _jitter{};
+  LatencyHistogram &_check_gap_metric;
+  Counter &_escalations_metric;
+
+  std::shared_ptr<Acknowledgements> _acknowledgements;
+
+  // Written by the watchdog thread under the mutex, read by stats().
+  mutable std::mutex _mutex{};
+  Stats _stats{};
+  Clock::time_point _detected{};
+};
+
+const char *to_string(FailsafeWatchdog::Level level);
+const char *to_string(FailsafeWatchdog::Fault fault);
+
+void print_failsafe(const FailsafeWatchdog::Stats &stats);
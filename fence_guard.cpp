@@ -0,0 +1,196 @@
+#include "fence_guard.h"
+
+#include <cmath>
+#include <iostream>
+
+using namespace mavsdk;
+
+namespace {
+
+constexpr float deg_to_rad = static_cast<float>(M_PI / 180.0);
+
+} // namespace
+
+const char *const fence_usage = "[--fence <file>]";
+
+bool parse_fence_arguments(std::vector<std::string> &arguments,
+                           Geofence &fence) {
+  std::vector<std::string> remaining;
+  for (size_t i = 0; i < arguments.size(); ++i) {
+    if (arguments[i] == "--fence") {
+      if (i + 1 >= arguments.size()) {
+        std::cerr << "--fence needs a value\n";
+        return false;
+      }
+      if (!load_geofence(arguments[++i], fence)) {
+        return false;
+      }
+      std::cout << "Geofence of " << fence.fence_count() << " fences in "
+                << fence.cell_count() << " cells of " << fence.cell_m()
+                << " m\n";
+    } else {
+      remaining.push_back(arguments[i]);
+    }
+  }
+  arguments = remaining;
+  return true;
+}
+
+FenceGuard::FenceGuard(const Geofence &fence, const VehicleState &state,
+                       std::chrono::milliseconds horizon,
+                       std::chrono::milliseconds max_state_age)
+    : _fence(fence), _state(state), _horizon(horizon),
+      _horizon_s(std::chrono::duration<float>(horizon).count()),
+      _max_state_age(max_state_age),
+      _breaches_metric(metrics().counter("fence.breaches")),
+      _check_time_metric(metrics().histogram("fence.check_time")) {}
+
+void FenceGuard::set_traffic(TrafficTable &traffic, size_t slot,
+                             float separation_m) {
+  _traffic = &traffic;
+  _slot = slot;
+  _separation_m = separation_m;
+}
+
+Breach FenceGuard::check(Clock::time_point tick,
+                         const VehicleState::Sample &sample, bool fresh,
+                         const Setpoint &setpoint) {
+  const auto &position = sample.state.position_velocity.position;
+  float north = 0.0f;
+  float east = 0.0f;
+  float down = 0.0f;
+  switch (setpoint.type) {
+  case Setpoint::Type::PositionNed:
+  case Setpoint::Type::PositionVelocityNed:
+    north = setpoint.position_ned.north_m;
+    east = setpoint.position_ned.east_m;
+    down = setpoint.position_ned.down_m;
+    break;
+  case Setpoint::Type::VelocityNed:
+    if (!fresh) {
+      _unchecked.fetch_add(1, std::memory_order_relaxed);
+      return Breach::None;
+    }
+    north = position.north_m + setpoint.velocity_ned.north_m_s * _horizon_s;
+    east = position.east_m + setpoint.velocity_ned.east_m_s * _horizon_s;
+    down = position.down_m + setpoint.velocity_ned.down_m_s * _horizon_s;
+    break;
+  case Setpoint::Type::VelocityBody: {
+    if (!fresh || !sample.has_attitude()) {
+      _unchecked.fetch_add(1, std::memory_order_relaxed);
+      return Breach::None;
+    }
+    // Body coordinates are NED rotated by the yaw only.
+    const auto &velocity = setpoint.velocity_body;
+    const float yaw_rad = sample.state.attitude.yaw_deg * deg_to_rad;
+    const float cos_yaw = std::cos(yaw_rad);
+    const float sin_yaw = std::sin(yaw_rad);
+    north = position.north_m +
+            (velocity.forward_m_s * cos_yaw - velocity.right_m_s * sin_yaw) *
+                _horizon_s;
+    east = position.east_m +
+           (velocity.forward_m_s * sin_yaw + velocity.right_m_s * cos_yaw) *
+               _horizon_s;
+    down = position.down_m + velocity.down_m_s * _horizon_s;
+    break;
+  }
+  case Setpoint::Type::Attitude:
+    return Breach::None;
+  }
+
+  const Breach breach = _fence.check(north, east, down);
+  if (breach != Breach::None || !_traffic) {
+    return breach;
+  }
+  return _traffic->clearance(_slot, north, east, down, tick + _horizon) <
+                 _separation_m
+             ? Breach::Traffic
+             : Breach::None;
+}
+
+void FenceGuard::latch_hold(const VehicleState::Sample &sample, bool fresh) {
+  if (!fresh) {
+    // Stopping is all that is left without knowing where we are.
+    _hold = Setpoint::make_velocity_ned(Offboard::VelocityNedYaw{});
+    return;
+  }
+  const auto &position = sample.state.position_velocity.position;
+  Offboard::PositionNedYaw hold{};
+  hold.north_m = position.north_m;
+  hold.east_m = position.east_m;
+  hold.down_m = position.down_m;
+  hold.yaw_deg = sample.has_attitude() ? sample.state.attitude.yaw_deg : 0.0f;
+  _hold = Setpoint::make_position_ned(hold);
+}
+
+void FenceGuard::admit(Clock::time_point tick, Setpoint &setpoint) {
+  const auto start = Clock::now();
+  _checks.fetch_add(1, std::memory_order_relaxed);
+
+  const auto sample = _state.read(tick);
+  const bool fresh =
+      sample.has_position() && sample.position_age <= _max_state_age;
+  if (_traffic) {
+    if (fresh) {
+      const auto &position_velocity = sample.state.position_velocity;
+      TrafficTable::Track track{};
+      track.valid = true;
+      track.north_m = position_velocity.position.north_m;
+      track.east_m = position_velocity.position.east_m;
+      track.down_m = position_velocity.position.down_m;
+      track.north_m_s = position_velocity.velocity.north_m_s;
+      track.east_m_s = position_velocity.velocity.east_m_s;
+      track.down_m_s = position_velocity.velocity.down_m_s;
+      track.time = sample.state.position_time;
+      _traffic->publish(_slot, track);
+    } else {
+      _traffic->clear(_slot);
+    }
+  }
+
+  const Breach breach = check(tick, sample, fresh, setpoint);
+  if (breach == Breach::None) {
+    _holding = false;
+  } else {
+    if (!_holding) {
+      latch_hold(sample, fresh);
+      _holding = true;
+    }
+    setpoint = _hold;
+    _breaches.fetch_add(1, std::memory_order_relaxed);
+    _last_breach.store(breach, std::memory_order_relaxed);
+    _breaches_metric.add();
+  }
+
+  const auto check_time = Clock::now() - start;
+  _check_time_metric.record(check_time);
+  const int64_t check_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(check_time)
+          .count();
+  if (check_ns > _max_check_time_ns.load(std::memory_order_relaxed)) {
+    _max_check_time_ns.store(check_ns, std::memory_order_relaxed);
+  }
+}
+
+FenceGuard::Stats FenceGuard::stats() const {
+  Stats stats{};
+  stats.checks = _checks.load(std::memory_order_relaxed);
+  stats.breaches = _breaches.load(std::memory_order_relaxed);
+  stats.unchecked = _unchecked.load(std::memory_order_relaxed);
+  stats.last_breach = _last_breach.load(std::memory_order_relaxed);
+  stats.max_check_time = std::chrono::nanoseconds(
+      _max_check_time_ns.load(std::memory_order_relaxed));
+  return stats;
+}
+
+void print_fence(const FenceGuard::Stats &stats) {
+  std::cout << "Geofence: " << stats.checks << " setpoints checked, "
+            << stats.unchecked << " unchecked, longest check "
+            << stats.max_check_time.count() << " ns\n";
+  if (stats.breaches == 0) {
+    std::cout << "  no breaches\n";
+    return;
+  }
+  std::cout << "  " << stats.breaches << " setpoints held back, last one "
+            << to_string(stats.last_breach) << '\n';
+}
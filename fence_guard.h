@@ -0,0 +1,99 @@
+//
+// Geofence and traffic guard on the setpoint stream.
+//
+// Every position or velocity setpoint is checked on the streaming thread
+// before transmission: a position target where it points, a velocity where
+// it would carry the vehicle within the horizon. A setpoint that breaches
+// the fence, or comes closer than the separation to where another vehicle
+// of the fleet is heading, is replaced by holding the position the vehicle
+// had when the breach began, until an acceptable setpoint comes along.
+// Attitude setpoints are not checked.
+//
+// A check is a grid lookup and a few reads, it never blocks and never
+// prints; breaches are counted and reported afterwards.
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "geofence.h"
+#include "metrics.h"
+#include "setpoint_streamer.h"
+#include "vehicle_state.h"
+
+// Usage text of the flag parse_fence_arguments() takes.
+extern const char *const fence_usage;
+
+// Take --fence <file> out of the tool-specific `arguments` and load the
+// fence file into `fence`, before anything connects.
+//
+// returns false if the value is missing or the file does not load.
+bool parse_fence_arguments(std::vector<std::string> &arguments,
+                           Geofence &fence);
+
+class FenceGuard : public SetpointGuard {
+public:
+  using Clock = SetpointStreamer::Clock;
+
+  static constexpr std::chrono::milliseconds default_horizon{1000};
+  static constexpr float default_separation_m = 2.0f;
+
+  struct Stats {
+    uint64_t checks{0};
+    // Setpoints replaced by a hold.
+    uint64_t breaches{0};
+    // Velocity setpoints without a fresh enough state to project.
+    uint64_t unchecked{0};
+    Breach last_breach{Breach::None};
+    std::chrono::nanoseconds max_check_time{0};
+  };
+
+  // `fence` and `state` must outlive the guard.
+  FenceGuard(const Geofence &fence, const VehicleState &state,
+             std::chrono::milliseconds horizon = default_horizon,
+             std::chrono::milliseconds max_state_age =
+                 std::chrono::milliseconds(200));
+
+  // Also keep `separation_m` from the other vehicles of `traffic`, and
+  // publish this one in `slot`. Before streaming starts.
+  void set_traffic(TrafficTable &traffic, size_t slot,
+                   float separation_m = default_separation_m);
+
+  void admit(Clock::time_point tick, Setpoint &setpoint) override;
+
+  Stats stats() const;
+
+private:
+  Breach check(Clock::time_point tick, const VehicleState::Sample &sample,
+               bool fresh, const Setpoint &setpoint);
+  void latch_hold(const VehicleState::Sample &sample, bool fresh);
+
+  const Geofence &_fence;
+  const VehicleState &_state;
+  const Clock::duration _horizon;
+  const float _horizon_s;
+  const Clock::duration _max_state_age;
+
+  TrafficTable *_traffic{nullptr};
+  size_t _slot{0};
+  float _separation_m{default_separation_m};
+
+  // Only touched by the streaming thread.
+  bool _holding{false};
+  Setpoint _hold{};
+
+  std::atomic<uint64_t> _checks{0};
+  std::atomic<uint64_t> _breaches{0};
+  std::atomic<uint64_t> _unchecked{0};
+  std::atomic<Breach> _last_breach{Breach::None};
+  std::atomic<int64_t> _max_check_time_ns{0};
+  Counter &_breaches_metric;
+  LatencyHistogram &_check_time_metric;
+};
+
+void print_fence(const FenceGuard::Stats &stats);
@@ -0,0 +1,201 @@
+//
+// Cost and accuracy of the state filter, no vehicle needed.
+//
+// Times a StateFilter correction and a VehicleState read with and without
+// the filter, then flies a simulated circle: samples arrive at the
+// telemetry rate with jittered delivery and measurement noise, and a
+// control loop reads the state at the control rate. The error is against
+// the true position at the time of each read, so the raw samples are
+// charged for their age as well as their noise.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "state_filter.h"
+#include "vehicle_state.h"
+
+using Clock = std::chrono::steady_clock;
+using mavsdk::Telemetry;
+
+constexpr size_t default_samples = 1000000;
+constexpr unsigned rounds = 5;
+
+constexpr double telemetry_rate_hz = 50.0;
+constexpr double control_rate_hz = 250.0;
+constexpr double jitter_s = 0.004;
+constexpr double circle_radius_m = 10.0;
+constexpr double circle_speed_m_s = 5.0;
+constexpr double flight_s = 60.0;
+constexpr float position_noise_m = 0.05f;
+constexpr float velocity_noise_m_s = 0.1f;
+
+Telemetry::PositionVelocityNed circle_at(double t_s) {
+  const double rate = circle_speed_m_s / circle_radius_m;
+  Telemetry::PositionVelocityNed truth{};
+  truth.position.north_m =
+      static_cast<float>(circle_radius_m * std::cos(rate * t_s));
+  truth.position.east_m =
+      static_cast<float>(circle_radius_m * std::sin(rate * t_s));
+  truth.position.down_m = -5.0f;
+  truth.velocity.north_m_s =
+      static_cast<float>(-circle_speed_m_s * std::sin(rate * t_s));
+  truth.velocity.east_m_s =
+      static_cast<float>(circle_speed_m_s * std::cos(rate * t_s));
+  return truth;
+}
+
+Clock::time_point at(Clock::time_point start, double t_s) {
+  return start + std::chrono::duration_cast<Clock::duration>(
+                     std::chrono::duration<double>(t_s));
+}
+
+float error_m(const Telemetry::PositionNed &a,
+              const Telemetry::PositionNed &b) {
+  const float north = a.north_m - b.north_m;
+  const float east = a.east_m - b.east_m;
+  const float down = a.down_m - b.down_m;
+  return std::sqrt(north * north + east * east + down * down);
+}
+
+// Noisy samples of the circle at the telemetry rate.
+std::vector<Telemetry::PositionVelocityNed>
+noisy_samples(size_t count, std::mt19937 &random) {
+  std::normal_distribution<float> position_noise(0.0f, position_noise_m);
+  std::normal_distribution<float> velocity_noise(0.0f, velocity_noise_m_s);
+  std::vector<Telemetry::PositionVelocityNed> samples(count);
+  for (size_t i = 0; i < count; ++i) {
+    auto &sample = samples[i];
+    sample = circle_at(static_cast<double>(i) / telemetry_rate_hz);
+    sample.position.north_m += position_noise(random);
+    sample.position.east_m += position_noise(random);
+    sample.position.down_m += position_noise(random);
+    sample.velocity.north_m_s += velocity_noise(random);
+    sample.velocity.east_m_s += velocity_noise(random);
+    sample.velocity.down_m_s += velocity_noise(random);
+  }
+  return samples;
+}
+
+template <typename Run> double best_ns(size_t count, Run &&run) {
+  double best = 1e9;
+  for (unsigned round = 0; round < rounds; ++round) {
+    const auto start = Clock::now();
+    run();
+    best = std::min(best, std::chrono::duration<double, std::nano>(
+                              Clock::now() - start)
+                                  .count() /
+                              static_cast<double>(count));
+  }
+  return best;
+}
+
+void time_correction(
+    const std::vector<Telemetry::PositionVelocityNed> &samples) {
+  float sum = 0.0f;
+  const auto start = Clock::now();
+  const double ns = best_ns(samples.size(), [&]() {
+    StateFilter filter;
+    for (size_t i = 0; i < samples.size(); ++i) {
+      filter.correct(samples[i], at(start, static_cast<double>(i) /
+                                               telemetry_rate_hz));
+      sum += filter.estimate().position[0];
+    }
+  });
+  std::cout << "Correction: " << ns << " ns (checksum " << sum << ")\n";
+}
+
+void time_read(const std::vector<Telemetry::PositionVelocityNed> &samples) {
+  for (const bool filtered : {false, true}) {
+    VehicleState state;
+    if (filtered) {
+      state.set_filter(FilterOptions{});
+    }
+    const auto start = Clock::now();
+    for (size_t i = 0; i < 100; ++i) {
+      state.update(samples[i],
+                   at(start, static_cast<double>(i) / telemetry_rate_hz));
+    }
+    float sum = 0.0f;
+    auto now = at(start, 100.0 / telemetry_rate_hz);
+    const double ns = best_ns(samples.size(), [&]() {
+      for (size_t i = 0; i < samples.size(); ++i) {
+        now += std::chrono::microseconds(1);
+        sum += state.read(now).state.position_velocity.position.north_m;
+      }
+    });
+    std::cout << (filtered ? "Filtered" : "Raw") << " read: " << ns
+              << " ns (checksum " << sum << ")\n";
+  }
+}
+
+void fly_circle(std::mt19937 &random) {
+  const size_t sample_count =
+      static_cast<size_t>(flight_s * telemetry_rate_hz);
+  const auto samples = noisy_samples(sample_count, random);
+  std::uniform_real_distribution<double> jitter(0.0, jitter_s);
+  std::vector<double> arrivals_s(sample_count);
+  for (size_t i = 0; i < sample_count; ++i) {
+    arrivals_s[i] = static_cast<double>(i) / telemetry_rate_hz + jitter(random);
+  }
+
+  VehicleState state;
+  state.set_filter(FilterOptions{});
+  const auto start = Clock::now();
+  size_t next = 0;
+  double raw_squares = 0.0;
+  double filtered_squares = 0.0;
+  float raw_max = 0.0f;
+  float filtered_max = 0.0f;
+  size_t reads = 0;
+  // Skip the first second, the filter is still settling.
+  for (double t_s = 1.0; t_s < flight_s; t_s += 1.0 / control_rate_hz) {
+    while (next < sample_count && arrivals_s[next] <= t_s) {
+      state.update(samples[next], at(start, arrivals_s[next]));
+      ++next;
+    }
+    const auto sample = state.read(at(start, t_s));
+    const auto truth = circle_at(t_s);
+    const float raw = error_m(sample.measured.position, truth.position);
+    const float filtered =
+        error_m(sample.state.position_velocity.position, truth.position);
+    raw_squares += raw * raw;
+    filtered_squares += filtered * filtered;
+    raw_max = std::max(raw_max, raw);
+    filtered_max = std::max(filtered_max, filtered);
+    ++reads;
+  }
+
+  std::cout << "Circle at " << circle_speed_m_s << " m/s, " << telemetry_rate_hz
+            << " Hz telemetry read at " << control_rate_hz << " Hz:\n"
+            << "  raw samples  rms " << std::sqrt(raw_squares / reads)
+            << " m, max " << raw_max << " m\n"
+            << "  filtered     rms " << std::sqrt(filtered_squares / reads)
+            << " m, max " << filtered_max << " m\n";
+}
+
+int main(int argc, char **argv) {
+  if (argc > 2) {
+    std::cerr << "Usage : " << argv[0] << " [samples]\n";
+    return 1;
+  }
+  const size_t count =
+      argc == 2 ? static_cast<size_t>(std::strtoul(argv[1], nullptr, 10))
+                : default_samples;
+  if (count < 100) {
+    std::cerr << "Needs at least 100 samples\n";
+    return 1;
+  }
+
+  std::mt19937 random(1);
+  const auto samples = noisy_samples(count, random);
+  time_correction(samples);
+  time_read(samples);
+  fly_circle(random);
+  return 0;
+}
@@ -0,0 +1,158 @@
+//
+// Converts binary flight recorder chunks into one CSV file per record type.
+//
+
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+
+#include "flight_log_reader.h"
+
+namespace fr = flight_record;
+
+void usage(const std::string &bin_name) {
+  std::cerr << "Usage : " << bin_name
+            << " <output_prefix> <chunk.ofl> [<chunk.ofl> ...]\n"
+            << "Writes <output_prefix>_<record>.csv for every record type, "
+               "chunks should be given in recording order\n";
+}
+
+struct CsvOutputs {
+  std::ofstream position_velocity_ned;
+  std::ofstream quaternion;
+  std::ofstream euler_angle;
+  std::ofstream battery;
+  std::ofstream gps_info;
+  std::ofstream position;
+};
+
+bool open_csv(std::ofstream &out, const std::string &path,
+              const char *columns) {
+  out.open(path);
+  if (!out) {
+    std::cerr << "Could not create " << path << '\n';
+    return false;
+  }
+  // Enough digits to read every value back exactly; the default six round
+  // latitude and longitude to about 10 m.
+  out << std::setprecision(std::numeric_limits<double>::max_digits10);
+  out << "unix_time_us,steady_time_us,sequence," << columns << '\n';
+  return true;
+}
+
+bool open_outputs(CsvOutputs &outputs, const std::string &prefix) {
+  return open_csv(outputs.position_velocity_ned,
+                  prefix + "_position_velocity_ned.csv",
+                  "north_m,east_m,down_m,north_m_s,east_m_s,down_m_s") &&
+         open_csv(outputs.quaternion, prefix + "_quaternion.csv",
+                  "w,x,y,z,autopilot_timestamp_us") &&
+         open_csv(outputs.euler_angle, prefix + "_euler_angle.csv",
+                  "roll_deg,pitch_deg,yaw_deg,autopilot_timestamp_us") &&
+         open_csv(outputs.battery, prefix + "_battery.csv",
+                  "voltage_v,remaining_percent") &&
+         open_csv(outputs.gps_info, prefix + "_gps_info.csv",
+                  "num_satellites,fix_type") &&
+         open_csv(outputs.position, prefix + "_position.csv",
+                  "latitude_deg,longitude_deg,absolute_altitude_m,"
+                  "relative_altitude_m");
+}
+
+void write_record(CsvOutputs &outputs, const fr::RecordHeader &header,
+                  const char *data, uint64_t unix_time_us) {
+  auto row = [&](std::ofstream &out) -> std::ofstream & {
+    out << unix_time_us << ',' << header.timestamp_us << ','
+        << header.sequence << ',';
+    return out;
+  };
+
+  switch (static_cast<fr::RecordType>(header.type)) {
+  case fr::RecordType::PositionVelocityNed: {
+    fr::PositionVelocityNed p{};
+    if (fr::read_payload(header, data, p)) {
+      row(outputs.position_velocity_ned)
+          << p.north_m << ',' << p.east_m << ',' << p.down_m << ','
+          << p.north_m_s << ',' << p.east_m_s << ',' << p.down_m_s << '\n';
+    }
+    break;
+  }
+  case fr::RecordType::Quaternion: {
+    fr::Quaternion p{};
+    if (fr::read_payload(header, data, p)) {
+      row(outputs.quaternion) << p.w << ',' << p.x << ',' << p.y << ','
+                              << p.z << ',' << p.autopilot_timestamp_us
+                              << '\n';
+    }
+    break;
+  }
+  case fr::RecordType::EulerAngle: {
+    fr::EulerAngle p{};
+    if (fr::read_payload(header, data, p)) {
+      row(outputs.euler_angle) << p.roll_deg << ',' << p.pitch_deg << ','
+                               << p.yaw_deg << ',' << p.autopilot_timestamp_us
+                               << '\n';
+    }
+    break;
+  }
+  case fr::RecordType::Battery: {
+    fr::Battery p{};
+    if (fr::read_payload(header, data, p)) {
+      row(outputs.battery) << p.voltage_v << ',' << p.remaining_percent
+                           << '\n';
+    }
+    break;
+  }
+  case fr::RecordType::GpsInfo: {
+    fr::GpsInfo p{};
+    if (fr::read_payload(header, data, p)) {
+      row(outputs.gps_info) << p.num_satellites << ',' << p.fix_type << '\n';
+    }
+    break;
+  }
+  case fr::RecordType::Position: {
+    fr::Position p{};
+    if (fr::read_payload(header, data, p)) {
+      row(outputs.position) << p.latitude_deg << ',' << p.longitude_deg << ','
+                            << p.absolute_altitude_m << ','
+                            << p.relative_altitude_m << '\n';
+    }
+    break;
+  }
+  }
+}
+
+// returns the number of records converted, or -1 if the chunk is unreadable.
+long convert_chunk(const std::string &path, CsvOutputs &outputs) {
+  return fr::read_chunk(path, [&outputs](const fr::RecordHeader &header,
+                                         const char *data,
+                                         uint64_t unix_time_us) {
+    write_record(outputs, header, data, unix_time_us);
+  });
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  CsvOutputs outputs;
+  if (!open_outputs(outputs, argv[1])) {
+    return 1;
+  }
+
+  long total = 0;
+  for (int i = 2; i < argc; ++i) {
+    const long count = convert_chunk(argv[i], outputs);
+    if (count < 0) {
+      return 1;
+    }
+    std::cout << argv[i] << ": " << count << " records\n";
+    total += count;
+  }
+  std::cout << "Converted " << total << " records\n";
+
+  return 0;
+}
@@ -0,0 +1,56 @@
+#include "flight_log_reader.h"
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+namespace flight_record {
+
+long read_chunk(const std::string &path, const RecordVisitor &visit) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    std::cerr << "Could not open " << path << '\n';
+    return -1;
+  }
+  const std::vector<char> bytes{std::istreambuf_iterator<char>(in),
+                                std::istreambuf_iterator<char>()};
+
+  FileHeader file_header{};
+  if (bytes.size() < sizeof(file_header)) {
+    std::cerr << path << " is too short to be a flight log\n";
+    return -1;
+  }
+  std::memcpy(&file_header, bytes.data(), sizeof(file_header));
+  if (std::memcmp(file_header.magic, magic, sizeof(magic)) != 0 ||
+      file_header.version != version) {
+    std::cerr << path << " is not a version " << version << " flight log\n";
+    return -1;
+  }
+
+  long count = 0;
+  size_t offset = sizeof(file_header);
+  while (offset + sizeof(RecordHeader) <= bytes.size()) {
+    RecordHeader header{};
+    std::memcpy(&header, bytes.data() + offset, sizeof(header));
+    if (header.type == 0 || header.size == 0) {
+      // The zeroed tail of a chunk that was not closed.
+      break;
+    }
+    offset += sizeof(header);
+    if (offset + header.size > bytes.size()) {
+      std::cerr << path << ": truncated record at offset " << offset << '\n';
+      break;
+    }
+
+    const uint64_t unix_time_us =
+        file_header.unix_time_us +
+        (header.timestamp_us - file_header.steady_time_us);
+    visit(header, bytes.data() + offset, unix_time_us);
+    offset += header.size;
+    ++count;
+  }
+  return count;
+}
+
+} // namespace flight_record
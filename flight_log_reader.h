@@ -0,0 +1,41 @@
+//
+// Reading of flight recorder chunks.
+//
+// Shared by the offline converter and the replay engine, and just as free of
+// MAVSDK as flight_record.h.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+
+#include "flight_record.h"
+
+namespace flight_record {
+
+// Called for every record with its payload and the wall-clock time it was
+// recorded at.
+using RecordVisitor = std::function<void(
+    const RecordHeader &header, const char *payload, uint64_t unix_time_us)>;
+
+// Visit the records of one chunk in order. A zeroed record header ends the
+// chunk, as in one whose recorder never closed it.
+//
+// returns the number of records read, or -1 if the chunk is unreadable.
+long read_chunk(const std::string &path, const RecordVisitor &visit);
+
+// returns false if the payload is not a `Payload`.
+template <typename Payload>
+bool read_payload(const RecordHeader &header, const char *data,
+                  Payload &payload) {
+  if (header.size != sizeof(Payload)) {
+    return false;
+  }
+  std::memcpy(&payload, data, sizeof(payload));
+  return true;
+}
+
+} // namespace flight_record
@@ -0,0 +1,94 @@
+//
+// On-disk layout of flight recorder logs.
+//
+// A log is a sequence of chunk files. Each chunk starts with a FileHeader and
+// is followed by packed records, each a RecordHeader plus a fixed-size
+// payload. Everything is little-endian and tightly packed so the recorder can
+// memcpy records straight into the mapped file and the converter can read
+// them back without any parsing.
+//
+// This header is deliberately free of MAVSDK so offline tools can use it.
+//
+
+#pragma once
+
+#include <cstdint>
+
+namespace flight_record {
+
+constexpr char magic[8] = {'O', 'F', 'B', 'L', 'O', 'G', '0', '1'};
+constexpr uint32_t version = 1;
+
+enum class RecordType : uint16_t {
+  PositionVelocityNed = 1,
+  Quaternion = 2,
+  EulerAngle = 3,
+  Battery = 4,
+  GpsInfo = 5,
+  Position = 6,
+};
+
+#pragma pack(push, 1)
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t chunk_index;
+  // Record timestamps are steady clock microseconds, these allow converting
+  // them to wall-clock time.
+  uint64_t steady_time_us;
+  uint64_t unix_time_us;
+};
+
+struct RecordHeader {
+  uint16_t type;
+  // Payload size in bytes, not counting this header.
+  uint16_t size;
+  uint32_t sequence;
+  uint64_t timestamp_us;
+};
+
+struct PositionVelocityNed {
+  float north_m;
+  float east_m;
+  float down_m;
+  float north_m_s;
+  float east_m_s;
+  float down_m_s;
+};
+
+struct Quaternion {
+  float w;
+  float x;
+  float y;
+  float z;
+  uint64_t autopilot_timestamp_us;
+};
+
+struct EulerAngle {
+  float roll_deg;
+  float pitch_deg;
+  float yaw_deg;
+  uint64_t autopilot_timestamp_us;
+};
+
+struct Battery {
+  float voltage_v;
+  float remaining_percent;
+};
+
+struct GpsInfo {
+  int32_t num_satellites;
+  int32_t fix_type;
+};
+
+struct Position {
+  double latitude_deg;
+  double longitude_deg;
+  float absolute_altitude_m;
+  float relative_altitude_m;
+};
+
+#pragma pack(pop)
+
+} // namespace flight_record
@@ -0,0 +1,289 @@
+#include "flight_recorder.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace mavsdk;
+namespace fr = flight_record;
+
+namespace {
+
+uint64_t steady_time_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+uint64_t unix_time_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+} // namespace
+
+FlightRecorder::FlightRecorder(std::string path_prefix, size_t chunk_size)
+    : _path_prefix(std::move(path_prefix)), _chunk_size(chunk_size),
+      _records_metric(metrics().counter("recorder.records")),
+      _dropped_metric(metrics().counter("recorder.dropped")) {}
+
+FlightRecorder::~FlightRecorder() { close(); }
+
+bool FlightRecorder::open() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (_current.base != nullptr) {
+    return true;
+  }
+  if (_chunk_size < sizeof(fr::FileHeader) + 1024) {
+    std::cerr << "Recorder chunk size " << _chunk_size << " too small\n";
+    return false;
+  }
+  if (!map_chunk(0, _current)) {
+    return false;
+  }
+  _prepare_failed = false;
+  _stopping = false;
+  _preparer = std::thread(&FlightRecorder::prepare, this);
+  return true;
+}
+
+void FlightRecorder::close() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stopping = true;
+  }
+  _wake.notify_one();
+  if (_preparer.joinable()) {
+    _preparer.join();
+  }
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  // A rollover after the preparer stopped leaves its full chunk here.
+  unmap_chunk(_full);
+  unmap_chunk(_current);
+  if (_next.base != nullptr) {
+    const std::string path = chunk_path(_next.index);
+    unmap_chunk(_next);
+    ::unlink(path.c_str());
+  }
+}
+
+FlightRecorder::Stats FlightRecorder::stats() const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  Stats stats{};
+  stats.records = _records.load(std::memory_order_relaxed);
+  stats.bytes = _bytes.load(std::memory_order_relaxed);
+  stats.dropped = _dropped.load(std::memory_order_relaxed);
+  stats.chunks = _current.index + 1;
+  return stats;
+}
+
+void FlightRecorder::record(const Telemetry::PositionVelocityNed &sample) {
+  fr::PositionVelocityNed payload{};
+  payload.north_m = sample.position.north_m;
+  payload.east_m = sample.position.east_m;
+  payload.down_m = sample.position.down_m;
+  payload.north_m_s = sample.velocity.north_m_s;
+  payload.east_m_s = sample.velocity.east_m_s;
+  payload.down_m_s = sample.velocity.down_m_s;
+  append(fr::RecordType::PositionVelocityNed, payload);
+}
+
+void FlightRecorder::record(const Telemetry::Quaternion &sample) {
+  fr::Quaternion payload{};
+  payload.w = sample.w;
+  payload.x = sample.x;
+  payload.y = sample.y;
+  payload.z = sample.z;
+  payload.autopilot_timestamp_us = sample.timestamp_us;
+  append(fr::RecordType::Quaternion, payload);
+}
+
+void FlightRecorder::record(const Telemetry::EulerAngle &sample) {
+  fr::EulerAngle payload{};
+  payload.roll_deg = sample.roll_deg;
+  payload.pitch_deg = sample.pitch_deg;
+  payload.yaw_deg = sample.yaw_deg;
+  payload.autopilot_timestamp_us = sample.timestamp_us;
+  append(fr::RecordType::EulerAngle, payload);
+}
+
+void FlightRecorder::record(const Telemetry::Battery &sample) {
+  fr::Battery payload{};
+  payload.voltage_v = sample.voltage_v;
+  payload.remaining_percent = sample.remaining_percent;
+  append(fr::RecordType::Battery, payload);
+}
+
+void FlightRecorder::record(const Telemetry::GpsInfo &sample) {
+  fr::GpsInfo payload{};
+  payload.num_satellites = sample.num_satellites;
+  payload.fix_type = static_cast<int32_t>(sample.fix_type);
+  append(fr::RecordType::GpsInfo, payload);
+}
+
+void FlightRecorder::record(const Telemetry::Position &sample) {
+  fr::Position payload{};
+  payload.latitude_deg = sample.latitude_deg;
+  payload.longitude_deg = sample.longitude_deg;
+  payload.absolute_altitude_m = sample.absolute_altitude_m;
+  payload.relative_altitude_m = sample.relative_altitude_m;
+  append(fr::RecordType::Position, payload);
+}
+
+template <typename Payload>
+void FlightRecorder::append(fr::RecordType type, const Payload &payload) {
+  static_assert(sizeof(Payload) <= UINT16_MAX, "record payload too large");
+  constexpr size_t record_size = sizeof(fr::RecordHeader) + sizeof(Payload);
+
+  fr::RecordHeader header{};
+  header.type = static_cast<uint16_t>(type);
+  header.size = sizeof(Payload);
+  header.timestamp_us = steady_time_us();
+
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  if (_current.base == nullptr) {
+    drop();
+    return;
+  }
+
+  if (_current.offset + record_size > _chunk_size) {
+    // Swap in the chunk prepare() has mapped ahead, and leave the full one
+    // for it to trim.
+    if (_next.base == nullptr) {
+      drop();
+      return;
+    }
+    _full = _current;
+    _current = _next;
+    _next = Chunk{};
+    _wake.notify_one();
+  }
+
+  header.sequence = _sequence++;
+  unsigned char *const at = _current.base + _current.offset;
+  std::memcpy(at, &header, sizeof(header));
+  std::memcpy(at + sizeof(header), &payload, sizeof(payload));
+  _current.offset += record_size;
+
+  _records.fetch_add(1, std::memory_order_relaxed);
+  _records_metric.add();
+  _bytes.fetch_add(record_size, std::memory_order_relaxed);
+}
+
+void FlightRecorder::drop() {
+  _dropped.fetch_add(1, std::memory_order_relaxed);
+  _dropped_metric.add();
+}
+
+void FlightRecorder::prepare() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (true) {
+    _wake.wait(lock, [this]() {
+      return _stopping || _full.base != nullptr ||
+             (_next.base == nullptr && !_prepare_failed);
+    });
+    if (_full.base != nullptr) {
+      Chunk full = _full;
+      _full = Chunk{};
+      lock.unlock();
+      unmap_chunk(full);
+      lock.lock();
+    } else if (_stopping) {
+      return;
+    } else {
+      const uint32_t index = _current.index + 1;
+      lock.unlock();
+      Chunk next{};
+      const bool mapped = map_chunk(index, next);
+      lock.lock();
+      if (mapped) {
+        _next = next;
+      } else {
+        _prepare_failed = true;
+      }
+    }
+  }
+}
+
+std::string FlightRecorder::chunk_path(uint32_t index) const {
+  char path[4096];
+  std::snprintf(path, sizeof(path), "%s.%04u.ofl", _path_prefix.c_str(),
+                index);
+  return path;
+}
+
+bool FlightRecorder::map_chunk(uint32_t index, Chunk &chunk) const {
+  const std::string path = chunk_path(index);
+
+  const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    std::cerr << "Could not create " << path << ": " << std::strerror(errno)
+              << '\n';
+    return false;
+  }
+
+  // Reserve the whole chunk up front so appending never has to extend the
+  // file or fault on a sparse region running out of disk.
+  const int fallocate_result =
+      posix_fallocate(fd, 0, static_cast<off_t>(_chunk_size));
+  if (fallocate_result != 0) {
+    std::cerr << "Could not preallocate " << path << ": "
+              << std::strerror(fallocate_result) << '\n';
+    ::close(fd);
+    return false;
+  }
+
+  void *base =
+      mmap(nullptr, _chunk_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) {
+    std::cerr << "Could not map " << path << ": " << std::strerror(errno)
+              << '\n';
+    ::close(fd);
+    return false;
+  }
+
+  chunk.fd = fd;
+  chunk.base = static_cast<unsigned char *>(base);
+  chunk.index = index;
+
+  // The clock pair only relates steady to unix time, so it may be taken
+  // before the chunk is used.
+  fr::FileHeader file_header{};
+  std::memcpy(file_header.magic, fr::magic, sizeof(file_header.magic));
+  file_header.version = fr::version;
+  file_header.chunk_index = index;
+  file_header.steady_time_us = steady_time_us();
+  file_header.unix_time_us = unix_time_us();
+  std::memcpy(chunk.base, &file_header, sizeof(file_header));
+  chunk.offset = sizeof(file_header);
+
+  return true;
+}
+
+void FlightRecorder::unmap_chunk(Chunk &chunk) const {
+  if (chunk.base == nullptr) {
+    return;
+  }
+
+  munmap(chunk.base, _chunk_size);
+  chunk.base = nullptr;
+
+  // Drop the unused preallocated tail so readers see only whole records.
+  if (ftruncate(chunk.fd, static_cast<off_t>(chunk.offset)) != 0) {
+    std::cerr << "Could not trim recorder chunk: " << std::strerror(errno)
+              << '\n';
+  }
+  ::close(chunk.fd);
+  chunk.fd = -1;
+  chunk.offset = 0;
+}
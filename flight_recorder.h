@@ -0,0 +1,111 @@
+//
+// Binary flight telemetry recorder.
+//
+// Appends timestamped fixed-layout records (see flight_record.h) to a
+// preallocated, memory-mapped chunk file. When a chunk is full the recorder
+// rolls over to the next one, named <prefix>.<index>.ofl. Recording a sample
+// is a memcpy into the mapping: no formatting and no heap allocation.
+//
+// A background thread keeps the next chunk created and mapped ahead of
+// time and trims the full ones, so rolling over is a pointer swap. Should
+// the next chunk not be ready yet, samples are dropped until it is.
+//
+// Use flight_log_convert to turn the chunks into CSV offline.
+//
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <mavsdk/plugins/telemetry/telemetry.h>
+
+#include "flight_record.h"
+#include "metrics.h"
+
+class FlightRecorder {
+public:
+  static constexpr size_t default_chunk_size = 64 * 1024 * 1024;
+
+  struct Stats {
+    uint64_t records{0};
+    uint64_t bytes{0};
+    uint32_t chunks{0};
+    // Records lost because the next chunk could not be created, or was not
+    // ready yet.
+    uint64_t dropped{0};
+  };
+
+  explicit FlightRecorder(std::string path_prefix,
+                          size_t chunk_size = default_chunk_size);
+  ~FlightRecorder();
+
+  FlightRecorder(const FlightRecorder &) = delete;
+  FlightRecorder &operator=(const FlightRecorder &) = delete;
+
+  // Create and map the first chunk, and start preparing the next.
+  //
+  // returns false if the file could not be created or mapped.
+  bool open();
+
+  // Trim the current chunk to the bytes actually written and unmap it. The
+  // prepared next chunk is removed.
+  void close();
+
+  // Thread-safe, may be called straight from subscription callbacks.
+  // Samples recorded while the recorder is not open are counted as dropped.
+  void record(const mavsdk::Telemetry::PositionVelocityNed &sample);
+  void record(const mavsdk::Telemetry::Quaternion &sample);
+  void record(const mavsdk::Telemetry::EulerAngle &sample);
+  void record(const mavsdk::Telemetry::Battery &sample);
+  void record(const mavsdk::Telemetry::GpsInfo &sample);
+  void record(const mavsdk::Telemetry::Position &sample);
+
+  Stats stats() const;
+
+private:
+  struct Chunk {
+    int fd{-1};
+    unsigned char *base{nullptr};
+    size_t offset{0};
+    uint32_t index{0};
+  };
+
+  template <typename Payload>
+  void append(flight_record::RecordType type, const Payload &payload);
+  void drop();
+
+  // Maps and trims chunks off the recording threads.
+  void prepare();
+
+  std::string chunk_path(uint32_t index) const;
+  bool map_chunk(uint32_t index, Chunk &chunk) const;
+  void unmap_chunk(Chunk &chunk) const;
+
+  const std::string _path_prefix;
+  const size_t _chunk_size;
+
+  mutable std::mutex _mutex{};
+  Chunk _current{};
+  // Mapped ahead by prepare(), empty until it is ready.
+  Chunk _next{};
+  // Full, waiting for prepare() to trim it.
+  Chunk _full{};
+  // Set once a chunk could not be created; nothing is prepared after it.
+  bool _prepare_failed{false};
+  bool _stopping{false};
+  std::condition_variable _wake{};
+  std::thread _preparer{};
+  uint32_t _sequence{0};
+
+  std::atomic<uint64_t> _records{0};
+  std::atomic<uint64_t> _bytes{0};
+  std::atomic<uint64_t> _dropped{0};
+  Counter &_records_metric;
+  Counter &_dropped_metric;
+};
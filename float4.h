@@ -0,0 +1,80 @@
+//
+// Fixed-size 4-lane float vector for the controller math.
+//
+// Three lanes carry north/east/down (or x/y/z), the fourth is spare or yaw.
+// Every operation is a plain loop over the four lanes of a 16-byte aligned
+// array, which compilers turn into single SIMD instructions. Nothing here
+// allocates.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+struct alignas(16) Float4 {
+  float v[4];
+
+  float &operator[](int i) { return v[i]; }
+  float operator[](int i) const { return v[i]; }
+
+  static Float4 zero() { return Float4{{0.0f, 0.0f, 0.0f, 0.0f}}; }
+  static Float4 splat(float value) {
+    return Float4{{value, value, value, value}};
+  }
+};
+
+inline Float4 operator+(const Float4 &a, const Float4 &b) {
+  Float4 r;
+  for (int i = 0; i < 4; ++i) {
+    r.v[i] = a.v[i] + b.v[i];
+  }
+  return r;
+}
+
+inline Float4 operator-(const Float4 &a, const Float4 &b) {
+  Float4 r;
+  for (int i = 0; i < 4; ++i) {
+    r.v[i] = a.v[i] - b.v[i];
+  }
+  return r;
+}
+
+// Lane-wise product.
+inline Float4 operator*(const Float4 &a, const Float4 &b) {
+  Float4 r;
+  for (int i = 0; i < 4; ++i) {
+    r.v[i] = a.v[i] * b.v[i];
+  }
+  return r;
+}
+
+inline Float4 operator*(const Float4 &a, float s) {
+  Float4 r;
+  for (int i = 0; i < 4; ++i) {
+    r.v[i] = a.v[i] * s;
+  }
+  return r;
+}
+
+// Lane-wise quotient.
+inline Float4 operator/(const Float4 &a, const Float4 &b) {
+  Float4 r;
+  for (int i = 0; i < 4; ++i) {
+    r.v[i] = a.v[i] / b.v[i];
+  }
+  return r;
+}
+
+inline Float4 clamp(const Float4 &a, const Float4 &low, const Float4 &high) {
+  Float4 r;
+  for (int i = 0; i < 4; ++i) {
+    r.v[i] = std::min(std::max(a.v[i], low.v[i]), high.v[i]);
+  }
+  return r;
+}
+
+// Length of the north/east (x/y) part.
+inline float norm_xy(const Float4 &a) {
+  return std::sqrt(a.v[0] * a.v[0] + a.v[1] * a.v[1]);
+}
@@ -0,0 +1,438 @@
+#include "geofence.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+namespace {
+
+struct Box {
+  float north_min;
+  float north_max;
+  float east_min;
+  float east_max;
+};
+
+Box footprint(const Fence &fence) {
+  if (fence.shape == Fence::Shape::Cylinder) {
+    return Box{fence.center_north_m - fence.radius_m,
+               fence.center_north_m + fence.radius_m,
+               fence.center_east_m - fence.radius_m,
+               fence.center_east_m + fence.radius_m};
+  }
+  Box box{fence.vertices[0][0], fence.vertices[0][0], fence.vertices[0][1],
+          fence.vertices[0][1]};
+  for (const auto &vertex : fence.vertices) {
+    box.north_min = std::min(box.north_min, vertex[0]);
+    box.north_max = std::max(box.north_max, vertex[0]);
+    box.east_min = std::min(box.east_min, vertex[1]);
+    box.east_max = std::max(box.east_max, vertex[1]);
+  }
+  return box;
+}
+
+bool overlaps(const Box &a, const Box &b) {
+  return a.north_min <= b.north_max && b.north_min <= a.north_max &&
+         a.east_min <= b.east_max && b.east_min <= a.east_max;
+}
+
+// Even-odd rule.
+bool in_polygon(const std::vector<std::array<float, 2>> &vertices,
+                float north_m, float east_m) {
+  bool inside = false;
+  for (size_t i = 0, j = vertices.size() - 1; i < vertices.size(); j = i++) {
+    const auto &a = vertices[i];
+    const auto &b = vertices[j];
+    if ((a[1] > east_m) != (b[1] > east_m) &&
+        north_m < a[0] + (b[0] - a[0]) * (east_m - a[1]) / (b[1] - a[1])) {
+      inside = !inside;
+    }
+  }
+  return inside;
+}
+
+enum class Cover { None, Partial, Full };
+
+// How much of `cell` the fence footprint covers. Partial may be returned
+// for cells that are in fact fully covered or not at all, which only costs
+// an exact test per check.
+Cover cover(const Fence &fence, const Box &cell) {
+  if (fence.shape == Fence::Shape::Cylinder) {
+    const float north = fence.center_north_m;
+    const float east = fence.center_east_m;
+    const float near_north =
+        std::min(std::max(north, cell.north_min), cell.north_max) - north;
+    const float near_east =
+        std::min(std::max(east, cell.east_min), cell.east_max) - east;
+    const float r2 = fence.radius_m * fence.radius_m;
+    if (near_north * near_north + near_east * near_east > r2) {
+      return Cover::None;
+    }
+    const float far_north = std::max(std::fabs(cell.north_min - north),
+                                     std::fabs(cell.north_max - north));
+    const float far_east = std::max(std::fabs(cell.east_min - east),
+                                    std::fabs(cell.east_max - east));
+    return far_north * far_north + far_east * far_east <= r2 ? Cover::Full
+                                                             : Cover::Partial;
+  }
+
+  // An edge that may run through the cell leaves it partial, otherwise the
+  // whole cell is on the side of its center.
+  const auto &vertices = fence.vertices;
+  for (size_t i = 0, j = vertices.size() - 1; i < vertices.size(); j = i++) {
+    const Box edge{std::min(vertices[i][0], vertices[j][0]),
+                   std::max(vertices[i][0], vertices[j][0]),
+                   std::min(vertices[i][1], vertices[j][1]),
+                   std::max(vertices[i][1], vertices[j][1])};
+    if (overlaps(edge, cell)) {
+      return Cover::Partial;
+    }
+  }
+  return in_polygon(vertices, 0.5f * (cell.north_min + cell.north_max),
+                    0.5f * (cell.east_min + cell.east_max))
+             ? Cover::Full
+             : Cover::None;
+}
+
+} // namespace
+
+const char *to_string(Breach breach) {
+  switch (breach) {
+  case Breach::None:
+    return "none";
+  case Breach::Invalid:
+    return "not a number";
+  case Breach::OutsideInclusion:
+    return "outside the fence";
+  case Breach::InsideExclusion:
+    return "inside an exclusion";
+  case Breach::Traffic:
+    return "too close to traffic";
+  }
+  return "unknown";
+}
+
+bool Geofence::compile(std::vector<Fence> fences, float cell_m) {
+  if (fences.size() > std::numeric_limits<uint16_t>::max()) {
+    std::cerr << "Too many fences\n";
+    return false;
+  }
+  for (const auto &fence : fences) {
+    const bool flat = fence.shape == Fence::Shape::Polygon
+                          ? fence.vertices.size() < 3
+                          : !(fence.radius_m > 0.0f);
+    if (flat || !(fence.max_altitude_m > fence.min_altitude_m)) {
+      std::cerr << "Degenerate fence\n";
+      return false;
+    }
+  }
+  if (!(cell_m > 0.0f)) {
+    cell_m = default_cell_m;
+  }
+
+  Geofence compiled;
+  compiled._fences = std::move(fences);
+  if (compiled._fences.empty()) {
+    *this = std::move(compiled);
+    return true;
+  }
+
+  Box bounds = footprint(compiled._fences[0]);
+  for (const auto &fence : compiled._fences) {
+    const Box box = footprint(fence);
+    bounds.north_min = std::min(bounds.north_min, box.north_min);
+    bounds.north_max = std::max(bounds.north_max, box.north_max);
+    bounds.east_min = std::min(bounds.east_min, box.east_min);
+    bounds.east_max = std::max(bounds.east_max, box.east_max);
+    compiled._include_count += fence.include ? 1 : 0;
+  }
+  const float north_span = bounds.north_max - bounds.north_min;
+  const float east_span = bounds.east_max - bounds.east_min;
+  while ((std::floor(north_span / cell_m) + 1) *
+             (std::floor(east_span / cell_m) + 1) >
+         static_cast<float>(max_cells)) {
+    cell_m *= 2.0f;
+  }
+  compiled._cell_m = cell_m;
+  compiled._north_min_m = bounds.north_min;
+  compiled._east_min_m = bounds.east_min;
+  compiled._rows = static_cast<size_t>(north_span / cell_m) + 1;
+  compiled._columns = static_cast<size_t>(east_span / cell_m) + 1;
+
+  // One pass per fence over the cells of its footprint, then everything is
+  // packed into one flat array.
+  const size_t cells = compiled._rows * compiled._columns;
+  std::vector<std::vector<Entry>> per_cell(cells);
+  for (size_t f = 0; f < compiled._fences.size(); ++f) {
+    const Fence &fence = compiled._fences[f];
+    const Box box = footprint(fence);
+    const size_t row_begin =
+        static_cast<size_t>((box.north_min - bounds.north_min) / cell_m);
+    const size_t column_begin =
+        static_cast<size_t>((box.east_min - bounds.east_min) / cell_m);
+    const size_t row_end = std::min(
+        compiled._rows - 1,
+        static_cast<size_t>((box.north_max - bounds.north_min) / cell_m));
+    const size_t column_end = std::min(
+        compiled._columns - 1,
+        static_cast<size_t>((box.east_max - bounds.east_min) / cell_m));
+    for (size_t row = row_begin; row <= row_end; ++row) {
+      for (size_t column = column_begin; column <= column_end; ++column) {
+        const float north = bounds.north_min + row * cell_m;
+        const float east = bounds.east_min + column * cell_m;
+        const Cover covered =
+            cover(fence, Box{north, north + cell_m, east, east + cell_m});
+        if (covered != Cover::None) {
+          per_cell[row * compiled._columns + column].push_back(
+              Entry{static_cast<uint16_t>(f), covered == Cover::Full});
+        }
+      }
+    }
+  }
+
+  compiled._cell_begin.reserve(cells + 1);
+  for (const auto &entries : per_cell) {
+    compiled._cell_begin.push_back(
+        static_cast<uint32_t>(compiled._entries.size()));
+    compiled._entries.insert(compiled._entries.end(), entries.begin(),
+                             entries.end());
+  }
+  compiled._cell_begin.push_back(
+      static_cast<uint32_t>(compiled._entries.size()));
+
+  *this = std::move(compiled);
+  return true;
+}
+
+bool Geofence::contains(const Fence &fence, float north_m,
+                        float east_m) const {
+  if (fence.shape == Fence::Shape::Cylinder) {
+    const float north = north_m - fence.center_north_m;
+    const float east = east_m - fence.center_east_m;
+    return north * north + east * east <= fence.radius_m * fence.radius_m;
+  }
+  return in_polygon(fence.vertices, north_m, east_m);
+}
+
+Breach Geofence::check(float north_m, float east_m, float down_m) const {
+  if (!std::isfinite(north_m) || !std::isfinite(east_m) ||
+      !std::isfinite(down_m)) {
+    return Breach::Invalid;
+  }
+  bool included = _include_count == 0;
+  const float row = (north_m - _north_min_m) / _cell_m;
+  const float column = (east_m - _east_min_m) / _cell_m;
+  if (row < 0.0f || column < 0.0f || row >= static_cast<float>(_rows) ||
+      column >= static_cast<float>(_columns)) {
+    return included ? Breach::None : Breach::OutsideInclusion;
+  }
+
+  const size_t cell =
+      static_cast<size_t>(row) * _columns + static_cast<size_t>(column);
+  const float altitude_m = -down_m;
+  for (uint32_t i = _cell_begin[cell]; i < _cell_begin[cell + 1]; ++i) {
+    const Entry entry = _entries[i];
+    const Fence &fence = _fences[entry.fence];
+    if (altitude_m < fence.min_altitude_m ||
+        altitude_m > fence.max_altitude_m) {
+      continue;
+    }
+    if (!entry.full && !contains(fence, north_m, east_m)) {
+      continue;
+    }
+    if (!fence.include) {
+      return Breach::InsideExclusion;
+    }
+    included = true;
+  }
+  return included ? Breach::None : Breach::OutsideInclusion;
+}
+
+namespace {
+
+class FenceParser {
+public:
+  explicit FenceParser(const std::string &source) : _source(source) {}
+
+  bool parse(std::istream &input, Geofence &geofence);
+
+private:
+  bool fail(const std::string &message) const {
+    std::cerr << _source << ':' << _line << ": " << message << '\n';
+    return false;
+  }
+
+  // Read exactly `count` numbers.
+  bool numbers(std::istringstream &words, const std::string &keyword,
+               size_t count, std::vector<float> &values) const;
+  bool kind(std::istringstream &words, const std::string &keyword,
+            bool &include) const;
+
+  const std::string &_source;
+  unsigned _line{0};
+};
+
+bool FenceParser::numbers(std::istringstream &words,
+                          const std::string &keyword, size_t count,
+                          std::vector<float> &values) const {
+  values.clear();
+  std::string word;
+  while (words >> word) {
+    char *end = nullptr;
+    const float value = std::strtof(word.c_str(), &end);
+    if (end == word.c_str() || *end != '\0' || !std::isfinite(value)) {
+      return fail("'" + word + "' is not a number");
+    }
+    values.push_back(value);
+  }
+  if (values.size() != count) {
+    return fail(keyword + " takes " + std::to_string(count) + " numbers, got " +
+                std::to_string(values.size()));
+  }
+  return true;
+}
+
+bool FenceParser::kind(std::istringstream &words, const std::string &keyword,
+                       bool &include) const {
+  std::string word;
+  words >> word;
+  if (word != "include" && word != "exclude") {
+    return fail(keyword + " must be include or exclude");
+  }
+  include = word == "include";
+  return true;
+}
+
+bool FenceParser::parse(std::istream &input, Geofence &geofence) {
+  std::vector<Fence> fences;
+  float cell_m = Geofence::default_cell_m;
+  bool in_polygon = false;
+
+  std::string text;
+  std::vector<float> v;
+  while (std::getline(input, text)) {
+    ++_line;
+    std::istringstream words(text.substr(0, text.find('#')));
+    std::string keyword;
+    if (!(words >> keyword)) {
+      continue;
+    }
+
+    if (in_polygon) {
+      if (keyword == "vertex") {
+        if (!numbers(words, keyword, 2, v)) {
+          return false;
+        }
+        fences.back().vertices.push_back({v[0], v[1]});
+      } else if (keyword == "end") {
+        if (fences.back().vertices.size() < 3) {
+          return fail("a polygon needs at least 3 vertices");
+        }
+        in_polygon = false;
+      } else {
+        return fail("expected vertex or end, got '" + keyword + "'");
+      }
+      continue;
+    }
+
+    Fence fence{};
+    if (keyword == "cell_m") {
+      if (!numbers(words, keyword, 1, v)) {
+        return false;
+      }
+      if (!(v[0] > 0.0f)) {
+        return fail("cell_m must be positive");
+      }
+      cell_m = v[0];
+      continue;
+    } else if (keyword == "polygon") {
+      if (!kind(words, keyword, fence.include) ||
+          !numbers(words, keyword, 2, v)) {
+        return false;
+      }
+      fence.shape = Fence::Shape::Polygon;
+      fence.min_altitude_m = v[0];
+      fence.max_altitude_m = v[1];
+      in_polygon = true;
+    } else if (keyword == "cylinder") {
+      if (!kind(words, keyword, fence.include) ||
+          !numbers(words, keyword, 5, v)) {
+        return false;
+      }
+      if (!(v[2] > 0.0f)) {
+        return fail("radius must be positive");
+      }
+      fence.shape = Fence::Shape::Cylinder;
+      fence.center_north_m = v[0];
+      fence.center_east_m = v[1];
+      fence.radius_m = v[2];
+      fence.min_altitude_m = v[3];
+      fence.max_altitude_m = v[4];
+    } else {
+      return fail("unknown keyword '" + keyword + "'");
+    }
+    if (!(fence.max_altitude_m > fence.min_altitude_m)) {
+      return fail("maximum altitude must be above the minimum");
+    }
+    fences.push_back(std::move(fence));
+  }
+
+  if (in_polygon) {
+    return fail("polygon without end");
+  }
+  return geofence.compile(std::move(fences), cell_m);
+}
+
+} // namespace
+
+bool parse_geofence(std::istream &input, const std::string &source,
+                    Geofence &fence) {
+  Geofence parsed;
+  FenceParser parser{source};
+  if (!parser.parse(input, parsed)) {
+    return false;
+  }
+  fence = std::move(parsed);
+  return true;
+}
+
+bool load_geofence(const std::string &path, Geofence &fence) {
+  std::ifstream file(path);
+  if (!file) {
+    std::cerr << "Cannot open geofence " << path << '\n';
+    return false;
+  }
+  return parse_geofence(file, path, fence);
+}
+
+void TrafficTable::publish(size_t slot, const Track &track) {
+  _tracks[slot].write(track);
+}
+
+void TrafficTable::clear(size_t slot) { _tracks[slot].write(Track{}); }
+
+float TrafficTable::clearance(size_t own_slot, float north_m, float east_m,
+                              float down_m, Clock::time_point time) const {
+  float nearest = std::numeric_limits<float>::infinity();
+  Track track{};
+  for (size_t slot = 0; slot < max_vehicles; ++slot) {
+    if (slot == own_slot) {
+      continue;
+    }
+    _tracks[slot].read(track);
+    if (!track.valid) {
+      continue;
+    }
+    const float dt_s = std::chrono::duration<float>(time - track.time).count();
+    const float north = track.north_m + track.north_m_s * dt_s - north_m;
+    const float east = track.east_m + track.east_m_s * dt_s - east_m;
+    const float down = track.down_m + track.down_m_s * dt_s - down_m;
+    nearest =
+        std::min(nearest, std::sqrt(north * north + east * east + down * down));
+  }
+  return nearest;
+}
@@ -0,0 +1,157 @@
+//
+// Geofence and traffic checks for outgoing setpoints.
+//
+// Fences are vertical prisms in the local NED frame: polygons or cylinders
+// over an altitude band, each one either a region to stay in (include) or
+// to stay out of (exclude). A point is allowed when it lies in at least one
+// include fence, if there are any, and in no exclude fence.
+//
+// compile() rasterizes all fences onto a uniform north/east grid. Every cell
+// lists the fences that cover it entirely or cross it, so a check is one
+// cell lookup plus exact tests against only the fences whose edges run
+// through that cell. Nothing is allocated once compiled.
+//
+// A fence file is one fence per block, with '#' comments:
+//
+//   cell_m <size>
+//   polygon include|exclude <min_altitude_m> <max_altitude_m>
+//     vertex <north_m> <east_m>        (at least 3)
+//   end
+//   cylinder include|exclude <north_m> <east_m> <radius_m> <min_altitude_m>
+//            <max_altitude_m>         (on one line)
+//
+// Altitudes are metres up from the local origin, i.e. -down_m.
+//
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+#include "seqlock.h"
+
+struct Fence {
+  enum class Shape { Polygon, Cylinder };
+
+  Shape shape{Shape::Polygon};
+  // Include fences are regions to stay in, exclude fences regions to keep
+  // out of.
+  bool include{true};
+  // Polygon corners as north/east pairs, in order.
+  std::vector<std::array<float, 2>> vertices{};
+  float center_north_m{0.0f};
+  float center_east_m{0.0f};
+  float radius_m{0.0f};
+  float min_altitude_m{0.0f};
+  float max_altitude_m{0.0f};
+};
+
+enum class Breach {
+  None,
+  // NaN or infinite coordinates.
+  Invalid,
+  // In no include fence.
+  OutsideInclusion,
+  // In an exclude fence.
+  InsideExclusion,
+  // Too close to where another vehicle will be.
+  Traffic,
+};
+
+const char *to_string(Breach breach);
+
+class Geofence {
+public:
+  static constexpr float default_cell_m = 1.0f;
+  // Coarser cells are used if the fences would need more.
+  static constexpr size_t max_cells = 1 << 20;
+
+  // Without fences every point is allowed.
+  Geofence() = default;
+
+  // Index `fences` for checking.
+  //
+  // returns false if a fence is degenerate, or there are more than 65535.
+  bool compile(std::vector<Fence> fences, float cell_m = default_cell_m);
+
+  // Constant time in the number of fences, apart from the few whose edges
+  // cross the cell of the point.
+  Breach check(float north_m, float east_m, float down_m) const;
+
+  size_t fence_count() const { return _fences.size(); }
+  size_t cell_count() const { return _columns * _rows; }
+  float cell_m() const { return _cell_m; }
+
+private:
+  struct Entry {
+    uint16_t fence;
+    // The fence covers the whole cell, no exact test needed.
+    bool full;
+  };
+
+  bool contains(const Fence &fence, float north_m, float east_m) const;
+
+  std::vector<Fence> _fences{};
+  size_t _include_count{0};
+
+  float _cell_m{default_cell_m};
+  float _north_min_m{0.0f};
+  float _east_min_m{0.0f};
+  size_t _columns{0};
+  size_t _rows{0};
+  // Entries of cell i are _entries[_cell_begin[i] .. _cell_begin[i + 1]).
+  std::vector<uint32_t> _cell_begin{};
+  std::vector<Entry> _entries{};
+};
+
+// Parse and compile a fence file. Errors are printed as
+// `source:line: message`.
+//
+// returns false on the first error; `fence` is left unchanged then.
+bool parse_geofence(std::istream &input, const std::string &source,
+                    Geofence &fence);
+
+// parse_geofence() on the file at `path`.
+bool load_geofence(const std::string &path, Geofence &fence);
+
+//
+// Where every vehicle of a fleet is heading, for keeping them apart.
+//
+// Each vehicle publishes its own position and velocity into its slot and
+// checks against the others' positions extrapolated to the time of
+// interest. Positions must share one local frame. Lock-free on both sides.
+//
+class TrafficTable {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr size_t max_vehicles = 16;
+
+  struct Track {
+    bool valid;
+    float north_m;
+    float east_m;
+    float down_m;
+    float north_m_s;
+    float east_m_s;
+    float down_m_s;
+    Clock::time_point time;
+  };
+
+  // Called by the owner of `slot` only.
+  void publish(size_t slot, const Track &track);
+  void clear(size_t slot);
+
+  // Distance from the point to the nearest vehicle other than `own_slot`,
+  // each predicted to `time`; infinity if there is none.
+  float clearance(size_t own_slot, float north_m, float east_m, float down_m,
+                  Clock::time_point time) const;
+
+private:
+  std::array<Seqlock<Track>, max_vehicles> _tracks{};
+};
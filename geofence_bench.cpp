@@ -0,0 +1,190 @@
+//
+// Microbenchmark of the geofence checks, no vehicle needed.
+//
+// Checks random points against a fence file, or against a built-in field
+// with a round boundary and a scatter of obstacles, and reports the cost
+// per check against a budget. Every answer is compared with the same fences
+// compiled into a single cell, i.e. checked one by one, and the time of the
+// whole guard step the streamer runs is reported alongside.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "fence_guard.h"
+#include "geofence.h"
+
+using Clock = std::chrono::steady_clock;
+
+constexpr double default_budget_us = 1.0;
+constexpr size_t checks = 1000000;
+
+// A 60 m wide round field up to 20 m, with a tower and a ring of trees.
+std::vector<Fence> built_in_fences() {
+  std::vector<Fence> fences;
+
+  Fence field{};
+  field.shape = Fence::Shape::Polygon;
+  field.include = true;
+  field.min_altitude_m = 0.5f;
+  field.max_altitude_m = 20.0f;
+  for (int i = 0; i < 48; ++i) {
+    const float angle = static_cast<float>(2.0 * M_PI * i / 48.0);
+    field.vertices.push_back({30.0f * std::cos(angle),
+                              30.0f * std::sin(angle)});
+  }
+  fences.push_back(field);
+
+  Fence tower{};
+  tower.shape = Fence::Shape::Polygon;
+  tower.include = false;
+  tower.min_altitude_m = 0.0f;
+  tower.max_altitude_m = 100.0f;
+  tower.vertices = {{10.0f, 10.0f}, {14.0f, 10.0f}, {14.0f, 13.0f},
+                    {10.0f, 13.0f}};
+  fences.push_back(tower);
+
+  for (int i = 0; i < 24; ++i) {
+    const float angle = static_cast<float>(2.0 * M_PI * i / 24.0);
+    Fence tree{};
+    tree.shape = Fence::Shape::Cylinder;
+    tree.include = false;
+    tree.center_north_m = 20.0f * std::cos(angle);
+    tree.center_east_m = 20.0f * std::sin(angle);
+    tree.radius_m = 1.5f;
+    tree.min_altitude_m = 0.0f;
+    tree.max_altitude_m = 8.0f;
+    fences.push_back(tree);
+  }
+  return fences;
+}
+
+double percentile(std::vector<double> values, double fraction) {
+  if (values.empty()) {
+    return 0.0;
+  }
+  std::sort(values.begin(), values.end());
+  const auto rank = static_cast<size_t>(
+      std::ceil(fraction * static_cast<double>(values.size())));
+  return values[std::min(values.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+int main(int argc, char **argv) {
+  if (argc > 3) {
+    std::cerr << "Usage : " << argv[0] << " [fence_file] [budget_us]\n";
+    return 1;
+  }
+  const double budget_us =
+      argc == 3 ? std::strtod(argv[2], nullptr) : default_budget_us;
+
+  Geofence fence;
+  std::vector<Fence> fences;
+  if (argc >= 2) {
+    if (!load_geofence(argv[1], fence)) {
+      return 1;
+    }
+  }
+  if (argc < 2 && !fence.compile(built_in_fences())) {
+    return 1;
+  }
+  std::cout << fence.fence_count() << " fences in " << fence.cell_count()
+            << " cells of " << fence.cell_m() << " m\n";
+
+  // Points over the fenced area and a margin around it, at all altitudes
+  // of interest.
+  std::mt19937 random{1};
+  std::uniform_real_distribution<float> horizontal(-40.0f, 40.0f);
+  std::uniform_real_distribution<float> down(-25.0f, 1.0f);
+  struct Point {
+    float north, east, down;
+  };
+  std::vector<Point> points(checks);
+  for (auto &point : points) {
+    point = Point{horizontal(random), horizontal(random), down(random)};
+  }
+
+  std::vector<Breach> breaches(checks);
+  std::vector<double> check_ns;
+  check_ns.reserve(checks);
+  const auto batch_start = Clock::now();
+  for (size_t i = 0; i < checks; ++i) {
+    const auto start = Clock::now();
+    breaches[i] = fence.check(points[i].north, points[i].east, points[i].down);
+    check_ns.push_back(static_cast<double>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                             start)
+            .count()));
+  }
+  const double total_ns = static_cast<double>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                           batch_start)
+          .count());
+
+  // One cell holding every fence makes each check test all of them.
+  size_t mismatches = 0;
+  size_t blocked = 0;
+  if (argc < 2) {
+    Geofence reference;
+    reference.compile(built_in_fences(), 1e6f);
+    for (size_t i = 0; i < checks; ++i) {
+      mismatches += reference.check(points[i].north, points[i].east,
+                                    points[i].down) != breaches[i];
+    }
+  }
+  for (const Breach breach : breaches) {
+    blocked += breach != Breach::None;
+  }
+
+  // The whole step the streamer runs per setpoint, state read included.
+  VehicleState state;
+  mavsdk::Telemetry::PositionVelocityNed position_velocity{};
+  position_velocity.position.down_m = -5.0f;
+  position_velocity.velocity.north_m_s = 2.0f;
+  state.update(position_velocity);
+  FenceGuard guard{fence, state};
+  std::vector<double> admit_ns;
+  admit_ns.reserve(checks / 10);
+  for (size_t i = 0; i < checks / 10; ++i) {
+    mavsdk::Offboard::PositionNedYaw target{};
+    target.north_m = points[i].north;
+    target.east_m = points[i].east;
+    target.down_m = points[i].down;
+    Setpoint setpoint = Setpoint::make_position_ned(target);
+    const auto start = Clock::now();
+    guard.admit(start, setpoint);
+    admit_ns.push_back(static_cast<double>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                             start)
+            .count()));
+  }
+
+  const double p99_ns = percentile(check_ns, 0.99);
+  std::cout << "Fence check over " << checks << " points, " << blocked
+            << " blocked:\n"
+            << "  p50 " << percentile(check_ns, 0.50) << " ns, p99 " << p99_ns
+            << " ns, max " << percentile(check_ns, 1.0) << " ns\n"
+            << "  whole loop, with timing, "
+            << total_ns / static_cast<double>(checks) << " ns per check\n"
+            << "Guard step: p50 " << percentile(admit_ns, 0.50) << " ns, p99 "
+            << percentile(admit_ns, 0.99) << " ns\n";
+  if (argc < 2) {
+    std::cout << mismatches << " answers differ from checking every fence\n";
+  }
+
+  if (mismatches > 0) {
+    std::cerr << "The grid index disagrees with the fences\n";
+    return 1;
+  }
+  if (p99_ns > budget_us * 1000.0) {
+    std::cerr << "p99 check time exceeds the " << budget_us << " us budget\n";
+    return 1;
+  }
+  std::cout << "Within the " << budget_us << " us budget\n";
+  return 0;
+}
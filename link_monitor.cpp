@@ -0,0 +1,251 @@
+#include "link_monitor.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "failsafe_watchdog.h"
+
+using namespace mavsdk;
+
+namespace {
+
+int64_t ns_of(LinkMonitor::Clock::time_point time) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             time.time_since_epoch())
+      .count();
+}
+
+LinkMonitor::Clock::time_point time_of(int64_t ns) {
+  return LinkMonitor::Clock::time_point(
+      std::chrono::duration_cast<LinkMonitor::Clock::duration>(
+          std::chrono::nanoseconds(ns)));
+}
+
+double ms_of(LinkMonitor::Clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+} // namespace
+
+LinkMonitor::LinkMonitor(const VehicleState &state,
+                         const LinkThresholds &thresholds)
+    : _state(state), _thresholds(thresholds),
+      _resumption(std::make_shared<Resumption>()),
+      _outages_metric(metrics().counter("link.outages")),
+      _outage_metric(metrics().histogram("link.outage")),
+      _recovery_metric(metrics().histogram("link.recovery")) {}
+
+LinkMonitor::~LinkMonitor() { stop(); }
+
+void LinkMonitor::resume_offboard(Offboard &offboard,
+                                  SetpointStreamer &streamer,
+                                  const FailsafeWatchdog *watchdog) {
+  _offboard = &offboard;
+  _streamer = &streamer;
+  _watchdog = watchdog;
+}
+
+bool LinkMonitor::start() {
+  if (_running.exchange(true)) {
+    std::cerr << "Link monitor already running\n";
+    return false;
+  }
+  _phase = Phase::Up;
+  _link_up.store(true, std::memory_order_release);
+  _thread = std::thread(&LinkMonitor::run, this);
+  return true;
+}
+
+void LinkMonitor::stop() {
+  _running.store(false);
+  if (_thread.joinable()) {
+    _thread.join();
+  }
+}
+
+LinkMonitor::Stats LinkMonitor::stats() const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _stats;
+}
+
+void LinkMonitor::lose(Clock::time_point now, Clock::time_point lost) {
+  if (_phase != Phase::Up && _phase != Phase::Down) {
+    // Lost again while resuming: that outage is over, unresumed.
+    finish(false, now);
+  }
+  _phase = Phase::Down;
+  _link_up.store(false, std::memory_order_release);
+  _outage = Outage{};
+  _outage.lost = lost;
+  _outage.detection = now - lost;
+  _outages_metric.add();
+  std::lock_guard<std::mutex> lock(_mutex);
+  ++_stats.outages;
+}
+
+void LinkMonitor::restore(Clock::time_point now, Clock::time_point restored) {
+  _link_up.store(true, std::memory_order_release);
+  _outage.duration = restored - _outage.lost;
+  _outage_metric.record(_outage.duration);
+  _restored = restored;
+
+  if (!_offboard || !_streamer->is_running()) {
+    finish(false, now);
+    return;
+  }
+  if (_outage.duration > _thresholds.max_resume_outage ||
+      failsafe_triggered()) {
+    // Deliberately left to the autopilot, not a failed resumption.
+    finish(false, now);
+    return;
+  }
+  _attempts = 0;
+  prime();
+}
+
+bool LinkMonitor::failsafe_triggered() const {
+  return _watchdog && _watchdog->triggered();
+}
+
+void LinkMonitor::prime() {
+  // The autopilot only accepts offboard while setpoints are coming in, so
+  // the next tick sends the current one without waiting for a heartbeat.
+  _streamer->resend();
+  _prime_ticks = _streamer->ticks();
+  _phase = Phase::Priming;
+}
+
+void LinkMonitor::finish(bool resumed, Clock::time_point now) {
+  if (_phase == Phase::Down) {
+    // Still lost, e.g. on stop().
+    _outage.duration = now - _outage.lost;
+  }
+  _phase = Phase::Up;
+  _outage.resumed = resumed;
+  if (resumed) {
+    _recovery_metric.record(_outage.recovery);
+  }
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (resumed) {
+    ++_stats.resumed;
+    _stats.slowest_recovery =
+        std::max(_stats.slowest_recovery, _outage.recovery);
+  }
+  _stats.longest_outage = std::max(_stats.longest_outage, _outage.duration);
+  if (_stats.recent_count == recent_outages) {
+    std::rotate(_stats.recent.begin(), _stats.recent.begin() + 1,
+                _stats.recent.end());
+    --_stats.recent_count;
+  }
+  _stats.recent[_stats.recent_count++] = _outage;
+}
+
+void LinkMonitor::run() {
+  apply_thread_options(_thread_options, "Link monitor");
+
+  auto deadline = Clock::now();
+  while (_running.load(std::memory_order_relaxed)) {
+    const auto now = Clock::now();
+    const auto sample = _state.read(now);
+    const bool fresh = sample.has_position() &&
+                       sample.position_age <= _thresholds.loss_after;
+    const auto arrival = now - sample.position_age;
+
+    if (!fresh && _phase != Phase::Down) {
+      // Before the first sample there is no link to lose.
+      if (sample.has_position()) {
+        lose(now, arrival);
+      }
+    } else if (fresh && _phase == Phase::Down) {
+      restore(now, arrival);
+    } else if (_phase == Phase::Priming && !_streamer->is_running()) {
+      // Offboard was ended on purpose meanwhile.
+      finish(false, now);
+    } else if ((_phase == Phase::Priming || _phase == Phase::Starting) &&
+               failsafe_triggered()) {
+      // The watchdog's Hold or Land has the vehicle; starting offboard or
+      // priming for another attempt would take it back.
+      finish(false, now);
+    } else if (_phase == Phase::Priming &&
+               _streamer->ticks() >= _prime_ticks + 2) {
+      // The tick after the one in flight has sent the setpoint.
+      ++_attempts;
+      const uint64_t attempt = ++_attempt;
+      auto resumption = _resumption;
+      resumption->result.store(0, std::memory_order_relaxed);
+      resumption->attempt.store(attempt, std::memory_order_release);
+      _phase = Phase::Starting;
+      _offboard->start_async([resumption, attempt](Offboard::Result result) {
+        if (resumption->attempt.load(std::memory_order_acquire) != attempt) {
+          return;
+        }
+        if (result == Offboard::Result::Success) {
+          resumption->acknowledged_ns.store(ns_of(Clock::now()),
+                                            std::memory_order_relaxed);
+        }
+        resumption->result.store(result == Offboard::Result::Success ? 1 : 2,
+                                 std::memory_order_release);
+      });
+    } else if (_phase == Phase::Starting) {
+      const int result = _resumption->result.load(std::memory_order_acquire);
+      if (result == 1) {
+        _outage.recovery =
+            time_of(_resumption->acknowledged_ns.load(
+                std::memory_order_relaxed)) -
+            _restored;
+        finish(true, now);
+      } else if (result == 2) {
+        if (_attempts < _thresholds.resume_attempts &&
+            _streamer->is_running()) {
+          prime();
+        } else {
+          {
+            std::lock_guard<std::mutex> lock(_mutex);
+            ++_stats.resume_failures;
+          }
+          finish(false, now);
+        }
+      }
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      ++_stats.checks;
+    }
+
+    deadline += _thresholds.check_period;
+    if (deadline <= now) {
+      deadline = now + _thresholds.check_period;
+    }
+    std::this_thread::sleep_until(deadline);
+  }
+
+  if (_phase != Phase::Up) {
+    finish(false, Clock::now());
+  }
+}
+
+void print_link(const LinkMonitor::Stats &stats) {
+  std::cout << "Link monitor: " << stats.checks << " checks, "
+            << stats.outages << " outages, " << stats.resumed
+            << " resumed, " << stats.resume_failures
+            << " failed to resume\n";
+  if (stats.outages == 0) {
+    return;
+  }
+  std::cout << "  longest outage " << ms_of(stats.longest_outage)
+            << " ms, slowest recovery " << ms_of(stats.slowest_recovery)
+            << " ms\n";
+  for (size_t i = 0; i < stats.recent_count; ++i) {
+    const auto &outage = stats.recent[i];
+    std::cout << "  lost for " << ms_of(outage.duration) << " ms, noticed "
+              << ms_of(outage.detection) << " ms in, ";
+    if (outage.resumed) {
+      std::cout << "offboard back " << ms_of(outage.recovery)
+                << " ms after the link\n";
+    } else {
+      std::cout << "not resumed\n";
+    }
+  }
+}
@@ -0,0 +1,158 @@
+//
+// Link loss detection and offboard resumption.
+//
+// A monitor thread checks, every few milliseconds, how old the newest
+// position sample is. The position stream runs at the control rate, so its
+// age tells a lost link long before the 1 Hz heartbeat would, and long
+// before MAVSDK gives up on the system after seconds of silence. Nothing
+// is torn down when the link goes: the System, the plugins and the
+// setpoint stream stay, and MAVSDK picks the link up again by itself once
+// messages arrive.
+//
+// An outage ends on the first fresh sample. With resume_offboard() the
+// monitor then re-primes the autopilot with the current setpoint and, once
+// it went out, restarts offboard, which the autopilot will have left for
+// its own link-loss failsafe. The outage, the time to notice it and the
+// time to get offboard back are all recorded.
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <mavsdk/plugins/offboard/offboard.h>
+
+#include "metrics.h"
+#include "realtime.h"
+#include "setpoint_streamer.h"
+#include "vehicle_state.h"
+
+class FailsafeWatchdog;
+
+struct LinkThresholds {
+  // No position sample for this long is a lost link. Keep it below the
+  // failsafe watchdog's max_state_age.
+  std::chrono::milliseconds loss_after{250};
+  // Offboard is only restarted after shorter outages. After longer ones
+  // the autopilot's failsafe has had the vehicle for good.
+  std::chrono::milliseconds max_resume_outage{10000};
+  // Offboard start attempts per outage.
+  unsigned resume_attempts{3};
+  std::chrono::milliseconds check_period{5};
+};
+
+class LinkMonitor {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr size_t recent_outages = 16;
+
+  struct Outage {
+    // Arrival of the last sample before the outage.
+    Clock::time_point lost{};
+    // From `lost` until the monitor noticed.
+    Clock::duration detection{};
+    // From `lost` until samples arrived again.
+    Clock::duration duration{};
+    // From samples arriving again until offboard was acknowledged, zero if
+    // it was not resumed.
+    Clock::duration recovery{};
+    bool resumed{false};
+  };
+
+  struct Stats {
+    uint64_t checks{0};
+    uint64_t outages{0};
+    uint64_t resumed{0};
+    // Outages offboard could have been resumed after but was not.
+    uint64_t resume_failures{0};
+    Clock::duration longest_outage{};
+    Clock::duration slowest_recovery{};
+    // Up to recent_outages, oldest first.
+    std::array<Outage, recent_outages> recent{};
+    size_t recent_count{0};
+  };
+
+  explicit LinkMonitor(const VehicleState &state,
+                       const LinkThresholds &thresholds = {});
+  ~LinkMonitor();
+
+  LinkMonitor(const LinkMonitor &) = delete;
+  LinkMonitor &operator=(const LinkMonitor &) = delete;
+
+  // Restart offboard after every outage while `streamer` runs. Nothing is
+  // resumed once `watchdog`, if given, has triggered. All of them must
+  // outlive the monitor. Takes effect on the next start().
+  void resume_offboard(mavsdk::Offboard &offboard, SetpointStreamer &streamer,
+                       const FailsafeWatchdog *watchdog = nullptr);
+
+  // Takes effect on the next start().
+  void set_thread_options(const ThreadOptions &options) {
+    _thread_options = options;
+  }
+
+  // returns false if the monitor already runs.
+  bool start();
+  void stop();
+
+  // False from detecting an outage until samples arrive again.
+  bool link_up() const { return _link_up.load(std::memory_order_acquire); }
+  Stats stats() const;
+
+private:
+  enum class Phase { Up, Down, Priming, Starting };
+
+  // Shared with the offboard start callbacks, which may run after the
+  // monitor is gone.
+  struct Resumption {
+    // Attempt the callback answers; older answers are ignored.
+    std::atomic<uint64_t> attempt{0};
+    // 0 while pending, 1 on success, 2 on failure.
+    std::atomic<int> result{0};
+    std::atomic<int64_t> acknowledged_ns{0};
+  };
+
+  void run();
+  void lose(Clock::time_point now, Clock::time_point lost);
+  void restore(Clock::time_point now, Clock::time_point restored);
+  void prime();
+  void finish(bool resumed, Clock::time_point now);
+  bool failsafe_triggered() const;
+
+  const VehicleState &_state;
+  const LinkThresholds _thresholds;
+  mavsdk::Offboard *_offboard{nullptr};
+  SetpointStreamer *_streamer{nullptr};
+  const FailsafeWatchdog *_watchdog{nullptr};
+
+  std::atomic<bool> _running{false};
+  ThreadOptions _thread_options{default_watchdog_priority, -1, false};
+  std::thread _thread{};
+  std::atomic<bool> _link_up{true};
+
+  // Only touched by the monitor thread.
+  Phase _phase{Phase::Up};
+  Outage _outage{};
+  Clock::time_point _restored{};
+  uint64_t _prime_ticks{0};
+  unsigned _attempts{0};
+  uint64_t _attempt{0};
+
+  std::shared_ptr<Resumption> _resumption;
+  Counter &_outages_metric;
+  LatencyHistogram &_outage_metric;
+  LatencyHistogram &_recovery_metric;
+
+  // Written by the monitor thread under the mutex, read by stats().
+  mutable std::mutex _mutex{};
+  Stats _stats{};
+};
+
+void print_link(const LinkMonitor::Stats &stats);
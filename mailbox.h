@@ -0,0 +1,57 @@
+//
+// Lock-free single-slot mailbox.
+//
+// One writer publishes values, one reader always gets the most recent one.
+// Internally this is a triple buffer: the writer and the reader each own a
+// slot and hand the third one back and forth with a single atomic exchange,
+// so neither side ever blocks or waits for the other.
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+
+template <typename T> class Mailbox {
+public:
+  Mailbox() = default;
+  explicit Mailbox(const T &initial) { _slots.fill(initial); }
+
+  Mailbox(const Mailbox &) = delete;
+  Mailbox &operator=(const Mailbox &) = delete;
+
+  // Publish a new value, replacing whatever has not been read yet.
+  void write(const T &value) {
+    _slots[_back] = value;
+    const unsigned previous =
+        _middle.exchange(_back | fresh_bit, std::memory_order_acq_rel);
+    _back = previous & index_mask;
+  }
+
+  // Copy the latest value into `value`.
+  //
+  // returns true if the value was published since the previous read.
+  bool read(T &value) {
+    bool fresh = false;
+    if (_middle.load(std::memory_order_acquire) & fresh_bit) {
+      const unsigned previous =
+          _middle.exchange(_front, std::memory_order_acq_rel);
+      _front = previous & index_mask;
+      fresh = true;
+    }
+    value = _slots[_front];
+    return fresh;
+  }
+
+private:
+  static constexpr unsigned index_mask = 0x3;
+  static constexpr unsigned fresh_bit = 0x4;
+
+  std::array<T, 3> _slots{};
+
+  // Writer and reader indices live on separate cache lines so the two
+  // threads do not false-share.
+  alignas(64) unsigned _back{0};
+  alignas(64) std::atomic<unsigned> _middle{1};
+  alignas(64) unsigned _front{2};
+};
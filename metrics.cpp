@@ -0,0 +1,452 @@
+#include "metrics.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+const char *const statsd_scheme = "statsd://";
+const char log_magic[8] = {'O', 'F', 'B', 'M', 'T', 'R', 'C', '1'};
+
+// Stay below the Ethernet MTU, StatsD servers read one datagram at a time.
+constexpr size_t max_datagram_bytes = 1400;
+
+unsigned most_significant_bit(uint64_t value) {
+#if defined(__GNUC__)
+  return 63u - static_cast<unsigned>(__builtin_clzll(value));
+#else
+  unsigned bit = 0;
+  while (value >>= 1) {
+    ++bit;
+  }
+  return bit;
+#endif
+}
+
+void put(std::string &record, uint64_t value, size_t bytes) {
+  for (size_t i = 0; i < bytes; ++i) {
+    record.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+  }
+}
+
+uint64_t wall_time_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+uint64_t get(const unsigned char *data, size_t bytes) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < bytes; ++i) {
+    value |= static_cast<uint64_t>(data[i]) << (8 * i);
+  }
+  return value;
+}
+
+std::string microseconds(uint64_t ns) {
+  return std::to_string(ns / 1000) + '.' +
+         std::to_string(ns % 1000 / 100);
+}
+
+} // namespace
+
+size_t LatencyHistogram::bucket_of(uint64_t ns) {
+  if (ns < sub_bucket_count) {
+    return static_cast<size_t>(ns);
+  }
+  const unsigned magnitude = most_significant_bit(ns);
+  if (magnitude >= max_magnitude) {
+    return bucket_count - 1;
+  }
+  // 16 buckets of 2^(magnitude - 4) each within [2^magnitude, 2^(m + 1)).
+  const unsigned shift = magnitude - sub_bucket_bits;
+  return (shift + 1) * sub_bucket_count +
+         static_cast<size_t>((ns >> shift) - sub_bucket_count);
+}
+
+uint64_t LatencyHistogram::value_of(size_t bucket) {
+  if (bucket < sub_bucket_count) {
+    return bucket;
+  }
+  const size_t shift = bucket / sub_bucket_count - 1;
+  return (sub_bucket_count + bucket % sub_bucket_count) << shift;
+}
+
+void LatencyHistogram::counts(Counts &counts) const {
+  counts.resize(bucket_count);
+  for (size_t i = 0; i < bucket_count; ++i) {
+    counts[i] = _counts[i].load(std::memory_order_relaxed);
+  }
+}
+
+uint64_t total(const LatencyHistogram::Counts &counts) {
+  uint64_t sum = 0;
+  for (const auto count : counts) {
+    sum += count;
+  }
+  return sum;
+}
+
+uint64_t percentile_ns(const LatencyHistogram::Counts &counts,
+                       double fraction) {
+  const uint64_t samples = total(counts);
+  if (samples == 0) {
+    return 0;
+  }
+  // The rank of the sample wanted, counting from 1.
+  auto rank = static_cast<uint64_t>(fraction * static_cast<double>(samples));
+  if (rank < 1) {
+    rank = 1;
+  }
+  uint64_t seen = 0;
+  for (size_t i = 0; i < counts.size(); ++i) {
+    seen += counts[i];
+    if (seen >= rank) {
+      return LatencyHistogram::value_of(i);
+    }
+  }
+  return LatencyHistogram::value_of(counts.size() - 1);
+}
+
+Counter &MetricsRegistry::counter(const std::string &name) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  for (const auto &entry : _entries) {
+    if (entry.counter && entry.name == name) {
+      return const_cast<Counter &>(*entry.counter);
+    }
+  }
+  _counters.emplace_back();
+  _entries.push_back({name, &_counters.back(), nullptr});
+  return _counters.back();
+}
+
+LatencyHistogram &MetricsRegistry::histogram(const std::string &name) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  for (const auto &entry : _entries) {
+    if (entry.histogram && entry.name == name) {
+      return const_cast<LatencyHistogram &>(*entry.histogram);
+    }
+  }
+  _histograms.emplace_back();
+  _entries.push_back({name, nullptr, &_histograms.back()});
+  return _histograms.back();
+}
+
+std::vector<MetricsRegistry::Entry> MetricsRegistry::entries() const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _entries;
+}
+
+MetricsRegistry &metrics() {
+  static MetricsRegistry registry;
+  return registry;
+}
+
+MetricsExporter::MetricsExporter(MetricsRegistry &registry,
+                                 const std::string &target,
+                                 std::chrono::milliseconds period)
+    : _registry(registry), _target(target), _period(period) {}
+
+MetricsExporter::~MetricsExporter() { stop(); }
+
+bool MetricsExporter::start() {
+  if (_target.empty() || _thread.joinable()) {
+    return true;
+  }
+  if (!open()) {
+    return false;
+  }
+  _running = true;
+  _thread = std::thread(&MetricsExporter::run, this);
+  return true;
+}
+
+void MetricsExporter::stop() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_running) {
+      return;
+    }
+    _running = false;
+  }
+  _stop_cv.notify_all();
+  _thread.join();
+
+  // What happened since the last period still goes out.
+  export_once();
+
+  if (_socket >= 0) {
+    close(_socket);
+    _socket = -1;
+  }
+  if (_log) {
+    std::fclose(_log);
+    _log = nullptr;
+  }
+}
+
+bool MetricsExporter::open() {
+  if (_target.rfind(statsd_scheme, 0) != 0) {
+    _log = std::fopen(_target.c_str(), "wb");
+    if (!_log) {
+      std::cerr << "Could not open metrics log " << _target << ": "
+                << std::strerror(errno) << '\n';
+      return false;
+    }
+    std::fwrite(log_magic, 1, sizeof(log_magic), _log);
+    return true;
+  }
+
+  const std::string address = _target.substr(std::strlen(statsd_scheme));
+  const auto colon = address.rfind(':');
+  if (colon == std::string::npos || colon + 1 == address.size()) {
+    std::cerr << "Metrics target needs a port: " << _target << '\n';
+    return false;
+  }
+  const std::string host =
+      colon == 0 ? std::string("127.0.0.1") : address.substr(0, colon);
+  const std::string port = address.substr(colon + 1);
+
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+  addrinfo *found = nullptr;
+  const int error = getaddrinfo(host.c_str(), port.c_str(), &hints, &found);
+  if (error != 0) {
+    std::cerr << "Could not resolve " << _target << ": "
+              << gai_strerror(error) << '\n';
+    return false;
+  }
+
+  // Connected, so that every export is a plain send().
+  for (addrinfo *candidate = found; candidate;
+       candidate = candidate->ai_next) {
+    _socket = socket(candidate->ai_family, candidate->ai_socktype,
+                     candidate->ai_protocol);
+    if (_socket < 0) {
+      continue;
+    }
+    if (connect(_socket, candidate->ai_addr, candidate->ai_addrlen) == 0) {
+      break;
+    }
+    close(_socket);
+    _socket = -1;
+  }
+  freeaddrinfo(found);
+
+  if (_socket < 0) {
+    std::cerr << "Could not open a socket to " << _target << ": "
+              << std::strerror(errno) << '\n';
+    return false;
+  }
+  return true;
+}
+
+void MetricsExporter::run() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  auto deadline = std::chrono::steady_clock::now() + _period;
+  while (!_stop_cv.wait_until(lock, deadline, [this]() { return !_running; })) {
+    lock.unlock();
+    export_once();
+    lock.lock();
+    deadline += _period;
+  }
+}
+
+void MetricsExporter::export_once() {
+  const auto entries = _registry.entries();
+  // Metrics registered since the last export start from zero.
+  _previous.resize(entries.size());
+  const uint64_t now_ns = wall_time_ns();
+
+  std::string record;
+  for (size_t id = 0; id < entries.size(); ++id) {
+    const auto &entry = entries[id];
+    Previous &previous = _previous[id];
+
+    if (_log && !previous.named) {
+      record.push_back('N');
+      put(record, id, 2);
+      put(record, entry.counter ? 0 : 1, 1);
+      put(record, entry.name.size(), 2);
+      record += entry.name;
+      previous.named = true;
+    }
+
+    if (entry.counter) {
+      const uint64_t value = entry.counter->value();
+      const uint64_t delta = value - previous.counter;
+      previous.counter = value;
+      if (_log) {
+        record.push_back('C');
+        put(record, now_ns, 8);
+        put(record, id, 2);
+        put(record, delta, 8);
+      } else {
+        send_statsd(entry.name + ':' + std::to_string(delta) + "|c");
+      }
+      continue;
+    }
+
+    entry.histogram->counts(_counts);
+    previous.histogram.resize(_counts.size());
+    for (size_t i = 0; i < _counts.size(); ++i) {
+      const uint64_t count = _counts[i];
+      _counts[i] -= previous.histogram[i];
+      previous.histogram[i] = count;
+    }
+    const uint64_t count = total(_counts);
+    const uint64_t p50 = percentile_ns(_counts, 0.50);
+    const uint64_t p99 = percentile_ns(_counts, 0.99);
+    const uint64_t max = entry.histogram->max_ns();
+    if (_log) {
+      record.push_back('H');
+      put(record, now_ns, 8);
+      put(record, id, 2);
+      put(record, count, 8);
+      put(record, p50, 8);
+      put(record, p99, 8);
+      put(record, max, 8);
+    } else {
+      send_statsd(entry.name + ".count:" + std::to_string(count) + "|c");
+      if (count > 0) {
+        send_statsd(entry.name + ".p50_us:" + microseconds(p50) + "|g");
+        send_statsd(entry.name + ".p99_us:" + microseconds(p99) + "|g");
+      }
+      send_statsd(entry.name + ".max_us:" + microseconds(max) + "|g");
+    }
+  }
+
+  if (_log) {
+    std::fwrite(record.data(), 1, record.size(), _log);
+    std::fflush(_log);
+  } else {
+    flush_statsd();
+  }
+}
+
+void MetricsExporter::send_statsd(const std::string &line) {
+  if (!_datagram.empty() &&
+      _datagram.size() + 1 + line.size() > max_datagram_bytes) {
+    flush_statsd();
+  }
+  if (!_datagram.empty()) {
+    _datagram.push_back('\n');
+  }
+  _datagram += line;
+}
+
+void MetricsExporter::flush_statsd() {
+  if (_datagram.empty()) {
+    return;
+  }
+  // Best effort: nobody listening must not stall or stop the export.
+  send(_socket, _datagram.data(), _datagram.size(), MSG_DONTWAIT);
+  _datagram.clear();
+}
+
+void print_metrics(const MetricsRegistry &registry) {
+  LatencyHistogram::Counts counts;
+  for (const auto &entry : registry.entries()) {
+    std::cout << "  " << std::left << std::setw(28) << entry.name
+              << std::right;
+    if (entry.counter) {
+      std::cout << ' ' << entry.counter->value() << '\n';
+      continue;
+    }
+    entry.histogram->counts(counts);
+    std::cout << ' ' << total(counts) << " samples, p50 "
+              << microseconds(percentile_ns(counts, 0.50)) << " us, p99 "
+              << microseconds(percentile_ns(counts, 0.99)) << " us, max "
+              << microseconds(entry.histogram->max_ns()) << " us\n";
+  }
+}
+
+const MetricsLog::Series *MetricsLog::find(const std::string &name) const {
+  for (const auto &entry : series) {
+    if (entry.name == name) {
+      return &entry;
+    }
+  }
+  return nullptr;
+}
+
+bool read_metrics_log(const std::string &path, MetricsLog &log) {
+  std::FILE *file = std::fopen(path.c_str(), "rb");
+  if (!file) {
+    std::cerr << "Could not open metrics log " << path << ": "
+              << std::strerror(errno) << '\n';
+    return false;
+  }
+  std::vector<unsigned char> data;
+  unsigned char buffer[4096];
+  size_t read = 0;
+  while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    data.insert(data.end(), buffer, buffer + read);
+  }
+  std::fclose(file);
+
+  if (data.size() < sizeof(log_magic) ||
+      std::memcmp(data.data(), log_magic, sizeof(log_magic)) != 0) {
+    std::cerr << path << " is not a metrics log\n";
+    return false;
+  }
+
+  MetricsLog result;
+  size_t offset = sizeof(log_magic);
+  const auto remaining = [&]() { return data.size() - offset; };
+  while (remaining() > 0) {
+    const unsigned char type = data[offset];
+    const unsigned char *record = data.data() + offset + 1;
+    if (type == 'N') {
+      if (remaining() < 6) {
+        break;
+      }
+      const size_t id = get(record, 2);
+      const size_t length = get(record + 3, 2);
+      if (remaining() < 6 + length) {
+        break;
+      }
+      if (result.series.size() <= id) {
+        result.series.resize(id + 1);
+      }
+      result.series[id].histogram = record[2] == 1;
+      result.series[id].name.assign(
+          reinterpret_cast<const char *>(record + 5), length);
+      offset += 6 + length;
+    } else if (type == 'C' || type == 'H') {
+      const size_t size = type == 'C' ? 1 + 8 + 2 + 8 : 1 + 8 + 2 + 4 * 8;
+      if (remaining() < size) {
+        break;
+      }
+      const size_t id = get(record + 8, 2);
+      if (id >= result.series.size()) {
+        std::cerr << path << ": sample of an unnamed metric\n";
+        return false;
+      }
+      MetricsLog::Sample sample{};
+      sample.time_ns = get(record, 8);
+      sample.count = get(record + 10, 8);
+      if (type == 'H') {
+        sample.p50_ns = get(record + 18, 8);
+        sample.p99_ns = get(record + 26, 8);
+        sample.max_ns = get(record + 34, 8);
+      }
+      result.series[id].samples.push_back(sample);
+      offset += size;
+    } else {
+      std::cerr << path << ": unknown record type at byte " << offset
+                << '\n';
+      return false;
+    }
+  }
+
+  log = std::move(result);
+  return true;
+}
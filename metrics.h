@@ -0,0 +1,209 @@
+//
+// Process-wide counters and latency histograms.
+//
+// Hot paths (setpoint sends, telemetry callbacks, mocap sends, controller
+// steps) look their metrics up once, at construction, and then update them
+// with relaxed atomic adds only: no locks, no allocation. Metrics are
+// named, and components of the same kind share a name, so several
+// streamers add up to one send rate.
+//
+// A MetricsExporter thread snapshots the registry periodically and ships
+// the deltas as StatsD datagrams or appends them to a compact binary log.
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Counter {
+public:
+  void add(uint64_t count = 1) {
+    _value.fetch_add(count, std::memory_order_relaxed);
+  }
+  uint64_t value() const { return _value.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<uint64_t> _value{0};
+};
+
+//
+// HDR-style histogram of nanosecond values: every power of two is split
+// into 16 linear buckets, so a bucket is never more than 1/16 wide relative
+// to its value, from 1 ns up to about a minute.
+//
+class LatencyHistogram {
+public:
+  static constexpr unsigned sub_bucket_bits = 4;
+  static constexpr unsigned sub_bucket_count = 1u << sub_bucket_bits;
+  // Values from 2^36 ns (69 s) up land in the last bucket.
+  static constexpr unsigned max_magnitude = 36;
+  static constexpr size_t bucket_count =
+      (max_magnitude - sub_bucket_bits + 1) * sub_bucket_count;
+
+  using Counts = std::vector<uint64_t>;
+
+  void record(std::chrono::nanoseconds value) {
+    record_ns(value.count() > 0 ? static_cast<uint64_t>(value.count()) : 0);
+  }
+  void record_ns(uint64_t ns) {
+    _counts[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+    // Histograms are shared by name between writers, so a plain store
+    // could lose a larger maximum written concurrently.
+    uint64_t max_ns = _max_ns.load(std::memory_order_relaxed);
+    while (ns > max_ns &&
+           !_max_ns.compare_exchange_weak(max_ns, ns,
+                                          std::memory_order_relaxed)) {
+    }
+  }
+
+  void counts(Counts &counts) const;
+  uint64_t max_ns() const { return _max_ns.load(std::memory_order_relaxed); }
+
+  static size_t bucket_of(uint64_t ns);
+  // Lowest value of the bucket.
+  static uint64_t value_of(size_t bucket);
+
+private:
+  std::array<std::atomic<uint64_t>, bucket_count> _counts{};
+  std::atomic<uint64_t> _max_ns{0};
+};
+
+// Samples in `counts` and the value at `fraction` of them.
+uint64_t total(const LatencyHistogram::Counts &counts);
+uint64_t percentile_ns(const LatencyHistogram::Counts &counts,
+                       double fraction);
+
+class MetricsRegistry {
+public:
+  // Find or create the metric. References stay valid for the registry's
+  // lifetime. Takes a lock: call at construction, not per update.
+  Counter &counter(const std::string &name);
+  LatencyHistogram &histogram(const std::string &name);
+
+  struct Entry {
+    std::string name;
+    const Counter *counter;
+    const LatencyHistogram *histogram;
+  };
+  // Every metric registered so far, in registration order.
+  std::vector<Entry> entries() const;
+
+private:
+  mutable std::mutex _mutex{};
+  std::deque<Counter> _counters{};
+  std::deque<LatencyHistogram> _histograms{};
+  std::vector<Entry> _entries{};
+};
+
+// The registry all components report to.
+MetricsRegistry &metrics();
+
+//
+// Periodic export of a registry.
+//
+// Targets are `statsd://<host>:<port>` or a file path for the binary log,
+// which starts with the 8 bytes "OFBMTRC1" followed by little-endian
+// records:
+//
+//   'N' u16 id, u8 kind (0 counter, 1 histogram), u16 length, name
+//   'C' u64 time_ns, u16 id, u64 delta
+//   'H' u64 time_ns, u16 id, u64 count, u64 p50_ns, u64 p99_ns, u64 max_ns
+//
+// Times are wall clock. Counts and percentiles cover the last period, the
+// max is since start. Each name record comes before the first sample of
+// its metric. StatsD gets counters as `|c` deltas, and histograms as a
+// count plus p50, p99 and max gauges in microseconds.
+//
+class MetricsExporter {
+public:
+  static constexpr std::chrono::milliseconds default_period{1000};
+
+  MetricsExporter(MetricsRegistry &registry, const std::string &target,
+                  std::chrono::milliseconds period = default_period);
+  ~MetricsExporter();
+
+  MetricsExporter(const MetricsExporter &) = delete;
+  MetricsExporter &operator=(const MetricsExporter &) = delete;
+
+  // Open the target and start exporting. An empty target exports nothing.
+  //
+  // returns false if the target could not be opened.
+  bool start();
+  // Export once more and stop.
+  void stop();
+
+private:
+  struct Previous {
+    uint64_t counter{0};
+    LatencyHistogram::Counts histogram{};
+    bool named{false};
+  };
+
+  bool open();
+  void run();
+  void export_once();
+  void send_statsd(const std::string &line);
+  void flush_statsd();
+
+  MetricsRegistry &_registry;
+  const std::string _target;
+  const std::chrono::milliseconds _period;
+
+  int _socket{-1};
+  std::string _datagram{};
+  std::FILE *_log{nullptr};
+  std::vector<Previous> _previous{};
+  LatencyHistogram::Counts _counts{};
+
+  std::mutex _mutex{};
+  std::condition_variable _stop_cv{};
+  bool _running{false};
+  std::thread _thread{};
+};
+
+// Print every metric: counters with their value, histograms with count,
+// p50, p99 and max.
+void print_metrics(const MetricsRegistry &registry);
+
+//
+// A binary metrics log read back, one series per metric.
+//
+struct MetricsLog {
+  struct Sample {
+    uint64_t time_ns;
+    // The delta of a counter, the sample count of a histogram.
+    uint64_t count;
+    // Histograms only.
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t max_ns;
+  };
+
+  struct Series {
+    std::string name{};
+    bool histogram{false};
+    std::vector<Sample> samples{};
+  };
+
+  // Indexed by metric id.
+  std::vector<Series> series{};
+
+  // returns nullptr if the log has no metric of that name.
+  const Series *find(const std::string &name) const;
+};
+
+// Read the log a MetricsExporter wrote to `path`. A truncated last record,
+// as left by a process that was killed, is dropped.
+//
+// returns false if the file cannot be read or is not a metrics log.
+bool read_metrics_log(const std::string &path, MetricsLog &log);
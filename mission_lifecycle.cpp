@@ -0,0 +1,227 @@
+#include "mission_lifecycle.h"
+
+#include <future>
+#include <iostream>
+#include <memory>
+
+using namespace mavsdk;
+
+namespace {
+
+// Send one Action command and wait for its result. The promise is shared
+// with the callback so that a late result after a timeout is harmless.
+Action::Result
+command(const std::function<void(const Action::ResultCallback &)> &send,
+        MissionLifecycle::Clock::time_point deadline) {
+  auto promise = std::make_shared<std::promise<Action::Result>>();
+  auto future = promise->get_future();
+  send([promise](Action::Result result) { promise->set_value(result); });
+
+  if (future.wait_until(deadline) == std::future_status::timeout) {
+    return Action::Result::Timeout;
+  }
+  return future.get();
+}
+
+double seconds_of(MissionLifecycle::Clock::duration duration) {
+  return std::chrono::duration<double>(duration).count();
+}
+
+} // namespace
+
+MissionLifecycle::MissionLifecycle(
+    Action &action, Telemetry &telemetry,
+    const std::vector<ReadinessMonitor::Flag> &required)
+    : _action(action), _telemetry(telemetry), _readiness(required) {
+  _telemetry.subscribe_health([this](Telemetry::Health health) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (!_readiness.update(health)) {
+        return;
+      }
+    }
+    // Only the edge into ready can complete a wait.
+    _changed.notify_all();
+  });
+  _telemetry.subscribe_home([this](Telemetry::Position) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _have_home = true;
+    }
+    _changed.notify_all();
+  });
+  _telemetry.subscribe_armed([this](bool armed) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _armed = armed;
+    }
+    _changed.notify_all();
+  });
+  _telemetry.subscribe_landed_state([this](Telemetry::LandedState state) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _landed_state = state;
+    }
+    _changed.notify_all();
+  });
+  _telemetry.subscribe_flight_mode([this](Telemetry::FlightMode mode) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _flight_mode = mode;
+      if (mode == Telemetry::FlightMode::Takeoff) {
+        _takeoff_mode_seen = true;
+      }
+    }
+    _changed.notify_all();
+  });
+}
+
+MissionLifecycle::~MissionLifecycle() {
+  _telemetry.subscribe_health(nullptr);
+  _telemetry.subscribe_home(nullptr);
+  _telemetry.subscribe_armed(nullptr);
+  _telemetry.subscribe_landed_state(nullptr);
+  _telemetry.subscribe_flight_mode(nullptr);
+}
+
+bool MissionLifecycle::wait(const std::string &phase,
+                            Clock::time_point deadline,
+                            const std::function<bool()> &done) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  if (!_changed.wait_until(lock, deadline, done)) {
+    std::cerr << phase << " timed out\n";
+    return false;
+  }
+  return true;
+}
+
+bool MissionLifecycle::prepare(const std::vector<RateRequest> &rates,
+                               std::chrono::milliseconds timeout) {
+  const auto start = Clock::now();
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _rates_pending = rates.size();
+    _rates_failed = 0;
+  }
+
+  for (const auto &rate : rates) {
+    rate(_telemetry, [this](Telemetry::Result result) {
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        --_rates_pending;
+        if (result != Telemetry::Result::Success) {
+          std::cerr << "Setting rate failed: " << result << '\n';
+          ++_rates_failed;
+        }
+      }
+      _changed.notify_all();
+    });
+  }
+
+  const bool done = wait("Pre-flight", start + timeout, [this]() {
+    return _rates_failed > 0 ||
+           (_rates_pending == 0 && _readiness.ready() && _have_home);
+  });
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _timings.preflight = Clock::now() - start;
+  if (!done) {
+    std::vector<std::string> waiting;
+    if (_rates_pending > 0) {
+      waiting.emplace_back("rates");
+    }
+    for (const auto flag : _readiness.missing()) {
+      waiting.emplace_back(to_string(flag));
+    }
+    if (!_have_home) {
+      waiting.emplace_back("home position");
+    }
+    std::cerr << "Waiting for:";
+    for (size_t i = 0; i < waiting.size(); ++i) {
+      std::cerr << (i == 0 ? " " : ", ") << waiting[i];
+    }
+    std::cerr << '\n';
+  }
+  return done && _rates_failed == 0;
+}
+
+bool MissionLifecycle::take_off(std::chrono::milliseconds timeout) {
+  const auto start = Clock::now();
+  const auto deadline = start + timeout;
+
+  const auto arm_result = command(
+      [this](const Action::ResultCallback &callback) {
+        _action.arm_async(callback);
+      },
+      deadline);
+  if (arm_result != Action::Result::Success) {
+    std::cerr << "Arming failed: " << arm_result << '\n';
+    return false;
+  }
+  std::cout << "Armed\n";
+
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _takeoff_mode_seen = _flight_mode == Telemetry::FlightMode::Takeoff;
+  }
+  const auto takeoff_result = command(
+      [this](const Action::ResultCallback &callback) {
+        _action.takeoff_async(callback);
+      },
+      deadline);
+  if (takeoff_result != Action::Result::Success) {
+    std::cerr << "Takeoff failed: " << takeoff_result << '\n';
+    return false;
+  }
+
+  // The autopilot leaves the take-off mode once it reaches the take-off
+  // altitude. Until Takeoff has been reported, the latest mode may still be
+  // the one from before the command, so only leaving Takeoff counts.
+  const bool done = wait("Takeoff", deadline, [this]() {
+    return _landed_state == Telemetry::LandedState::InAir &&
+           _takeoff_mode_seen &&
+           _flight_mode != Telemetry::FlightMode::Takeoff;
+  });
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _timings.takeoff = Clock::now() - start;
+  return done;
+}
+
+bool MissionLifecycle::land(std::chrono::milliseconds timeout) {
+  const auto start = Clock::now();
+  const auto deadline = start + timeout;
+
+  const auto land_result = command(
+      [this](const Action::ResultCallback &callback) {
+        _action.land_async(callback);
+      },
+      deadline);
+  if (land_result != Action::Result::Success) {
+    std::cerr << "Landing failed: " << land_result << '\n';
+    return false;
+  }
+
+  // We are relying on auto-disarming after touchdown.
+  const bool done = wait("Landing", deadline, [this]() { return !_armed; });
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _timings.landing = Clock::now() - start;
+  return done;
+}
+
+MissionLifecycle::Timings MissionLifecycle::timings() const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _timings;
+}
+
+ReadinessMonitor MissionLifecycle::readiness() const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _readiness;
+}
+
+void print_timings(const MissionLifecycle::Timings &timings) {
+  std::cout << "Pre-flight " << seconds_of(timings.preflight)
+            << " s, take-off " << seconds_of(timings.takeoff)
+            << " s, land to disarm " << seconds_of(timings.landing) << " s\n";
+}
@@ -0,0 +1,98 @@
+//
+// Event-driven take-off and landing.
+//
+// The pre-flight steps that do not depend on each other (telemetry rate
+// configuration, the health checks and the home position) all run at once
+// on the *_async calls and subscriptions, and every phase completes on the
+// telemetry event that ends it instead of on a polling loop or a fixed
+// sleep.
+//
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <mavsdk/plugins/action/action.h>
+#include <mavsdk/plugins/telemetry/telemetry.h>
+
+#include "readiness_monitor.h"
+
+class MissionLifecycle {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // Ask for one telemetry rate and report the outcome through the callback,
+  // e.g. with one of the Telemetry::set_rate_*_async() calls.
+  using RateRequest = std::function<void(
+      mavsdk::Telemetry &, const mavsdk::Telemetry::ResultCallback &)>;
+
+  struct Timings {
+    // From prepare() until every pre-flight step is done.
+    Clock::duration preflight{};
+    // From the arm command until the take-off has finished.
+    Clock::duration takeoff{};
+    // From the land command until the vehicle has disarmed.
+    Clock::duration landing{};
+  };
+
+  // Subscribes to health, home, landed state, flight mode and armed state
+  // for the lifecycle's lifetime. Readiness is timed from here.
+  MissionLifecycle(mavsdk::Action &action, mavsdk::Telemetry &telemetry,
+                   const std::vector<ReadinessMonitor::Flag> &required =
+                       ReadinessMonitor::default_required());
+  ~MissionLifecycle();
+
+  MissionLifecycle(const MissionLifecycle &) = delete;
+  MissionLifecycle &operator=(const MissionLifecycle &) = delete;
+
+  // Request all `rates` and wait, at the same time, for them, for the
+  // required health flags and for the home position. Returns on the health
+  // update that completes the set, so take_off() can arm right away.
+  //
+  // returns false if a rate was rejected or a step was not done in time.
+  bool prepare(const std::vector<RateRequest> &rates,
+               std::chrono::milliseconds timeout = std::chrono::seconds(30));
+
+  // Arm, take off, and wait until the vehicle is in the air and the
+  // take-off mode has finished.
+  //
+  // returns false if a command failed or the take-off timed out.
+  bool take_off(std::chrono::milliseconds timeout = std::chrono::seconds(20));
+
+  // Land and wait until the vehicle has disarmed.
+  //
+  // returns false if the command failed or the landing timed out.
+  bool land(std::chrono::milliseconds timeout = std::chrono::seconds(60));
+
+  Timings timings() const;
+  ReadinessMonitor readiness() const;
+
+private:
+  bool wait(const std::string &phase, Clock::time_point deadline,
+            const std::function<bool()> &done);
+
+  mavsdk::Action &_action;
+  mavsdk::Telemetry &_telemetry;
+
+  mutable std::mutex _mutex{};
+  std::condition_variable _changed{};
+  ReadinessMonitor _readiness;
+  bool _have_home{false};
+  bool _armed{false};
+  mavsdk::Telemetry::LandedState _landed_state{
+      mavsdk::Telemetry::LandedState::Unknown};
+  mavsdk::Telemetry::FlightMode _flight_mode{
+      mavsdk::Telemetry::FlightMode::Unknown};
+  // Whether the take-off mode was reported since take_off() commanded it.
+  bool _takeoff_mode_seen{false};
+  size_t _rates_pending{0};
+  size_t _rates_failed{0};
+  Timings _timings{};
+};
+
+void print_timings(const MissionLifecycle::Timings &timings);
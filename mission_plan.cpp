@@ -0,0 +1,280 @@
+#include "mission_plan.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace mavsdk;
+
+namespace {
+
+class Parser {
+public:
+  explicit Parser(const std::string &source) : _source(source) {}
+
+  bool parse(std::istream &input, MissionPlan &plan);
+
+private:
+  bool fail(const std::string &message) const {
+    std::cerr << _source << ':' << _line << ": " << message << '\n';
+    return false;
+  }
+
+  // Read exactly `count` numbers after the keyword.
+  bool numbers(std::istringstream &words, const std::string &keyword,
+               size_t count, std::vector<float> &values) const;
+  bool seconds(float value, std::chrono::milliseconds &duration) const;
+
+  bool setting(const std::string &keyword, std::istringstream &words,
+               MissionPlan &plan) const;
+  bool segment(const std::string &keyword, std::istringstream &words,
+               MissionPlan &plan);
+
+  const std::string &_source;
+  unsigned _line{0};
+  bool _landed{false};
+};
+
+bool Parser::numbers(std::istringstream &words, const std::string &keyword,
+                     size_t count, std::vector<float> &values) const {
+  values.clear();
+  std::string word;
+  while (words >> word) {
+    char *end = nullptr;
+    const float value = std::strtof(word.c_str(), &end);
+    if (end == word.c_str() || *end != '\0' || !std::isfinite(value)) {
+      return fail("'" + word + "' is not a number");
+    }
+    values.push_back(value);
+  }
+  if (values.size() != count) {
+    return fail(keyword + " takes " + std::to_string(count) + " numbers, got " +
+                std::to_string(values.size()));
+  }
+  return true;
+}
+
+bool Parser::seconds(float value, std::chrono::milliseconds &duration) const {
+  if (!(value > 0.0f)) {
+    return fail("duration must be positive");
+  }
+  duration = std::chrono::milliseconds(std::lround(value * 1000.0f));
+  return true;
+}
+
+bool Parser::setting(const std::string &keyword, std::istringstream &words,
+                     MissionPlan &plan) const {
+  std::string field;
+  words >> field;
+  std::vector<float> value;
+  if (!numbers(words, keyword + " " + field, 1, value)) {
+    return false;
+  }
+  if (!(value[0] > 0.0f)) {
+    return fail(keyword + " " + field + " must be positive");
+  }
+
+  auto &tolerances = plan.tolerances;
+  auto &limits = plan.limits;
+  auto &ramp = plan.ramp;
+  const auto ms = std::chrono::milliseconds(std::lround(value[0]));
+  if (keyword == "tolerance" && field == "position_m") {
+    tolerances.position_m = value[0];
+  } else if (keyword == "tolerance" && field == "speed_m_s") {
+    tolerances.speed_m_s = value[0];
+  } else if (keyword == "tolerance" && field == "settle_timeout_ms") {
+    tolerances.settle_timeout = ms;
+  } else if (keyword == "tolerance" && field == "max_sample_age_ms") {
+    tolerances.max_sample_age = ms;
+  } else if (keyword == "limit" && field == "max_speed_m_s") {
+    limits.max_speed_m_s = value[0];
+  } else if (keyword == "limit" && field == "max_acceleration_m_s2") {
+    limits.max_acceleration_m_s2 = value[0];
+  } else if (keyword == "limit" && field == "max_yaw_rate_deg_s") {
+    limits.max_yaw_rate_deg_s = value[0];
+  } else if (keyword == "ramp" && field == "max_acceleration_m_s2") {
+    ramp.max_acceleration_m_s2 = value[0];
+  } else if (keyword == "ramp" && field == "max_jerk_m_s3") {
+    ramp.max_jerk_m_s3 = value[0];
+  } else {
+    return fail("unknown " + keyword + " '" + field + "'");
+  }
+  return true;
+}
+
+bool Parser::segment(const std::string &keyword, std::istringstream &words,
+                     MissionPlan &plan) {
+  const bool first = plan.steps.empty();
+  if (_landed) {
+    return fail("nothing may follow land");
+  }
+  if (first != (keyword == "takeoff")) {
+    return fail(first ? "a plan starts with takeoff"
+                      : "takeoff may only come first");
+  }
+
+  MissionStep step{};
+  step.line = _line;
+  std::vector<float> v;
+  if (keyword == "takeoff" || keyword == "land") {
+    if (!numbers(words, keyword, 0, v)) {
+      return false;
+    }
+    step.kind = keyword == "takeoff" ? MissionStep::Kind::TakeOff
+                                     : MissionStep::Kind::Land;
+    _landed = keyword == "land";
+  } else if (keyword == "position") {
+    if (!numbers(words, keyword, 4, v)) {
+      return false;
+    }
+    const Waypoint waypoint{v[0], v[1], v[2], v[3]};
+    if (plan.steps.back().kind == MissionStep::Kind::Waypoints) {
+      plan.steps.back().waypoints.push_back(waypoint);
+      return true;
+    }
+    step.kind = MissionStep::Kind::Waypoints;
+    step.waypoints.push_back(waypoint);
+  } else if (keyword == "velocity_ned") {
+    if (!numbers(words, keyword, 5, v) || !seconds(v[4], step.duration)) {
+      return false;
+    }
+    Offboard::VelocityNedYaw velocity{};
+    velocity.north_m_s = v[0];
+    velocity.east_m_s = v[1];
+    velocity.down_m_s = v[2];
+    velocity.yaw_deg = v[3];
+    step.kind = MissionStep::Kind::Timed;
+    step.setpoint = Setpoint::make_velocity_ned(velocity);
+  } else if (keyword == "velocity_body") {
+    if (!numbers(words, keyword, 5, v) || !seconds(v[4], step.duration)) {
+      return false;
+    }
+    Offboard::VelocityBodyYawspeed velocity{};
+    velocity.forward_m_s = v[0];
+    velocity.right_m_s = v[1];
+    velocity.down_m_s = v[2];
+    velocity.yawspeed_deg_s = v[3];
+    step.kind = MissionStep::Kind::Timed;
+    step.setpoint = Setpoint::make_velocity_body(velocity);
+  } else if (keyword == "attitude") {
+    if (!numbers(words, keyword, 5, v) || !seconds(v[4], step.duration)) {
+      return false;
+    }
+    if (v[3] < 0.0f || v[3] > 1.0f) {
+      return fail("thrust must be between 0 and 1");
+    }
+    Offboard::Attitude attitude{};
+    attitude.roll_deg = v[0];
+    attitude.pitch_deg = v[1];
+    attitude.yaw_deg = v[2];
+    attitude.thrust_value = v[3];
+    step.kind = MissionStep::Kind::Timed;
+    step.setpoint = Setpoint::make_attitude(attitude);
+  } else if (keyword == "hold") {
+    if (!numbers(words, keyword, 1, v) || !seconds(v[0], step.duration)) {
+      return false;
+    }
+    step.kind = MissionStep::Kind::Hold;
+  } else if (keyword == "external") {
+    if (!numbers(words, keyword, 1, v) || !seconds(v[0], step.duration)) {
+      return false;
+    }
+    step.kind = MissionStep::Kind::External;
+  } else {
+    return fail("unknown segment '" + keyword + "'");
+  }
+  plan.steps.push_back(std::move(step));
+  return true;
+}
+
+bool Parser::parse(std::istream &input, MissionPlan &plan) {
+  std::string text;
+  while (std::getline(input, text)) {
+    ++_line;
+    std::istringstream words(text.substr(0, text.find('#')));
+    std::string keyword;
+    if (!(words >> keyword)) {
+      continue;
+    }
+
+    if (keyword == "name") {
+      if (!(words >> plan.name)) {
+        return fail("name needs a value");
+      }
+    } else if (keyword == "tolerance" || keyword == "limit" ||
+               keyword == "ramp") {
+      if (!plan.steps.empty()) {
+        return fail("settings must come before the first segment");
+      }
+      if (!setting(keyword, words, plan)) {
+        return false;
+      }
+    } else if (!segment(keyword, words, plan)) {
+      return false;
+    }
+  }
+
+  if (!_landed) {
+    return fail("a plan ends with land");
+  }
+  plan.steps.shrink_to_fit();
+  return true;
+}
+
+} // namespace
+
+bool parse_mission_plan(std::istream &input, const std::string &source,
+                        MissionPlan &plan) {
+  MissionPlan parsed{};
+  Parser parser{source};
+  if (!parser.parse(input, parsed)) {
+    return false;
+  }
+  plan = std::move(parsed);
+  return true;
+}
+
+bool load_mission_plan(const std::string &path, MissionPlan &plan) {
+  std::ifstream file(path);
+  if (!file) {
+    std::cerr << "Cannot open mission plan " << path << '\n';
+    return false;
+  }
+  return parse_mission_plan(file, path, plan);
+}
+
+const char *to_string(MissionStep::Kind kind) {
+  switch (kind) {
+  case MissionStep::Kind::TakeOff:
+    return "takeoff";
+  case MissionStep::Kind::Waypoints:
+    return "waypoints";
+  case MissionStep::Kind::Timed:
+    return "timed";
+  case MissionStep::Kind::Hold:
+    return "hold";
+  case MissionStep::Kind::External:
+    return "external";
+  case MissionStep::Kind::Land:
+    return "land";
+  }
+  return "unknown";
+}
+
+void print_mission_plan(const MissionPlan &plan) {
+  std::cout << "Mission plan " << (plan.name.empty() ? "(unnamed)" : plan.name)
+            << ", " << plan.steps.size() << " steps:\n";
+  for (size_t i = 0; i < plan.steps.size(); ++i) {
+    const auto &step = plan.steps[i];
+    std::cout << "  " << i + 1 << ". " << to_string(step.kind);
+    if (step.kind == MissionStep::Kind::Waypoints) {
+      std::cout << ", " << step.waypoints.size() << " waypoints";
+    }
+    if (step.duration.count() > 0) {
+      std::cout << ", " << step.duration.count() << " ms";
+    }
+    std::cout << " (line " << step.line << ")\n";
+  }
+}
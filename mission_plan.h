@@ -0,0 +1,88 @@
+//
+// Mission plans loaded from a text file instead of compiled in.
+//
+// A plan file is a list of segments, one per line, with '#' comments:
+//
+//   name <name>
+//   tolerance position_m|speed_m_s|settle_timeout_ms|max_sample_age_ms <v>
+//   limit max_speed_m_s|max_acceleration_m_s2|max_yaw_rate_deg_s <v>
+//   ramp max_acceleration_m_s2|max_jerk_m_s3 <v>
+//   takeoff
+//   position <north_m> <east_m> <down_m> <yaw_deg>
+//   velocity_ned <north_m_s> <east_m_s> <down_m_s> <yaw_deg> <seconds>
+//   velocity_body <forward_m_s> <right_m_s> <down_m_s> <yawspeed_deg_s> <s>
+//   attitude <roll_deg> <pitch_deg> <yaw_deg> <thrust> <seconds>
+//   hold <seconds>
+//   external <seconds>
+//   land
+//
+// Settings come before the first segment. A plan starts with takeoff and
+// ends with land; everything in between is flown in offboard. Consecutive
+// position lines are one sequenced flight through those waypoints. Limits
+// shape the trajectories between waypoints, ramp settings the jerk-limited
+// ramps velocity segments are flown with (velocity_ramp.h). An
+// external segment follows the setpoints other processes publish on the
+// shared-memory setpoint ring (shm_bus.h).
+//
+// Loading validates the whole file and compiles it into one array of
+// steps, with every setpoint built and every waypoint list allocated, so
+// flying the plan never parses. Waypoint steps still plan their
+// trajectories when they start, since the first leg begins wherever the
+// vehicle is; that allocates on the mission thread, never on the
+// streaming thread.
+//
+
+#pragma once
+
+#include <chrono>
+#include <istream>
+#include <string>
+#include <vector>
+
+#include "setpoint.h"
+#include "trajectory.h"
+#include "velocity_ramp.h"
+#include "waypoint_sequencer.h"
+
+struct MissionStep {
+  enum class Kind {
+    TakeOff,
+    Waypoints,
+    // Stream `setpoint` for `duration`.
+    Timed,
+    // Hold the position reached for `duration`.
+    Hold,
+    // Follow the shared-memory setpoint ring for `duration`.
+    External,
+    Land,
+  };
+
+  Kind kind{Kind::Hold};
+  std::vector<Waypoint> waypoints{};
+  Setpoint setpoint{};
+  std::chrono::milliseconds duration{0};
+  // Line of the plan file the step starts on.
+  unsigned line{0};
+};
+
+struct MissionPlan {
+  std::string name{};
+  ConvergenceTolerances tolerances{};
+  TrajectoryLimits limits{};
+  RampLimits ramp{};
+  std::vector<MissionStep> steps{};
+};
+
+// Parse and validate a plan. Errors are printed as `source:line: message`.
+//
+// returns false on the first error; `plan` is left unchanged then.
+bool parse_mission_plan(std::istream &input, const std::string &source,
+                        MissionPlan &plan);
+
+// parse_mission_plan() on the file at `path`.
+bool load_mission_plan(const std::string &path, MissionPlan &plan);
+
+const char *to_string(MissionStep::Kind kind);
+
+// Print one line per step.
+void print_mission_plan(const MissionPlan &plan);
@@ -5,58 +5,39 @@
 
 #include <chrono>
 #include <cmath>
-#include <future>
+#include <cstdlib>
 #include <iostream>
 #include <thread>
+#include <vector>
 
 #include <mavsdk/mavsdk.h>
 #include <mavsdk/plugins/action/action.h>
 #include <mavsdk/plugins/offboard/offboard.h>
 #include <mavsdk/plugins/telemetry/telemetry.h>
 
+#include "cascade_controller.h"
+#include "failsafe_watchdog.h"
+#include "metrics.h"
+#include "mission_lifecycle.h"
+#include "offboard_core.h"
+#include "rate_profile.h"
+#include "realtime.h"
+#include "setpoint_streamer.h"
+#include "vehicle_state.h"
+
 using namespace mavsdk;
 using std::chrono::milliseconds;
 using std::chrono::seconds;
 using std::this_thread::sleep_for;
 
 void usage(const std::string &bin_name) {
-  std::cerr
-      << "Usage : " << bin_name << " <connection_url>\n"
-      << "Connection URL format should be :\n"
-      << " For TCP : tcp://[server_host][:server_port]\n"
-      << " For UDP : udp://[bind_host][:bind_port]\n"
-      << " For Serial : serial:///path/to/serial/dev[:baudrate]\n"
-      << "For example, to connect to the simulator use URL: udp://:14540\n";
-}
-
-std::shared_ptr<System> get_system(Mavsdk &mavsdk) {
-  std::cout << "Waiting to discover system...\n";
-  auto prom = std::promise<std::shared_ptr<System>>{};
-  auto fut = prom.get_future();
-
-  // We wait for new systems to be discovered, once we find one that has an
-  // autopilot, we decide to use it.
-  mavsdk.subscribe_on_new_system([&mavsdk, &prom]() {
-    auto system = mavsdk.systems().back();
-
-    if (system->has_autopilot()) {
-      std::cout << "Discovered autopilot\n";
-
-      // Unsubscribe again as we only want to find one system.
-      mavsdk.subscribe_on_new_system(nullptr);
-      prom.set_value(system);
-    }
-  });
-
-  // We usually receive heartbeats at 1Hz, therefore we should find a
-  // system after around 3 seconds max, surely.
-  if (fut.wait_for(seconds(3)) == std::future_status::timeout) {
-    std::cerr << "No autopilot found.\n";
-    return {};
-  }
-
-  // Get discovered system now.
-  return fut.get();
+  print_usage(bin_name,
+              std::string("[cascade [setpoint_rate_hz] ") + realtime_usage +
+                  "]");
+  std::cerr << "Without arguments a constant attitude is sent. With cascade "
+               "the vehicle takes off and the companion-side position "
+               "controller flies a 1 m step north and back on attitude "
+               "setpoints\n";
 }
 
 //
@@ -113,21 +94,145 @@ bool offb_ctrl_attitude(mavsdk::Offboard &offboard) {
   return true;
 }
 
+//
+// Does Offboard position control with the companion-side cascaded
+// controller, sending attitude setpoints on every streamer tick.
+//
+// returns true if everything went well in Offboard control.
+//
+bool offb_ctrl_cascade(mavsdk::Offboard &offboard, const VehicleState &state,
+                       SetpointStreamer &streamer) {
+  std::cout << "Starting Offboard cascaded position control\n";
+
+  const auto sample = state.read();
+  if (!sample.has_position() || !sample.has_attitude()) {
+    std::cerr << "No vehicle state to control on\n";
+    return false;
+  }
+  Waypoint hold{};
+  hold.north_m = sample.state.position_velocity.position.north_m;
+  hold.east_m = sample.state.position_velocity.position.east_m;
+  hold.down_m = sample.state.position_velocity.position.down_m;
+  hold.yaw_deg = sample.state.attitude.yaw_deg;
+  CascadeSource controller{state, hold};
+
+  // Stream it before starting offboard, otherwise it will be rejected.
+  Offboard::Attitude level{};
+  level.yaw_deg = hold.yaw_deg;
+  level.thrust_value = CascadeGains{}.hover_thrust;
+  if (!streamer.start(Setpoint::make_attitude(level))) {
+    return false;
+  }
+
+  Offboard::Result offboard_result = offboard.start();
+  if (offboard_result != Offboard::Result::Success) {
+    std::cerr << "Offboard start failed: " << offboard_result << '\n';
+    streamer.stop();
+    return false;
+  }
+  std::cout << "Offboard started\n";
+
+  streamer.drive(controller);
+  std::cout << "Hold position\n";
+  sleep_for(seconds(5));
+
+  std::cout << "Go 1 m north\n";
+  Waypoint north = hold;
+  north.north_m += 1.0f;
+  controller.set_target(north);
+  sleep_for(seconds(8));
+
+  std::cout << "Go back\n";
+  controller.set_target(hold);
+  sleep_for(seconds(8));
+
+  // Hand over to a plain position setpoint before the controller goes away.
+  Offboard::PositionNedYaw position{};
+  position.north_m = hold.north_m;
+  position.east_m = hold.east_m;
+  position.down_m = hold.down_m;
+  position.yaw_deg = hold.yaw_deg;
+  streamer.set_target_and_wait(Setpoint::make_position_ned(position));
+
+  offboard_result = offboard.stop();
+  streamer.stop();
+  if (offboard_result != Offboard::Result::Success) {
+    std::cerr << "Offboard stop failed: " << offboard_result << '\n';
+    return false;
+  }
+  std::cout << "Offboard stopped\n";
+
+  const auto stats = controller.stats();
+  std::cout << "Controller ran " << stats.steps << " steps at "
+            << streamer.rate_hz() << " Hz, " << stats.stale_steps
+            << " without fresh state, slowest step "
+            << stats.max_step_time.count() << " ns\n";
+
+  return true;
+}
+
+//
+// Takes off, flies offb_ctrl_cascade() and lands.
+//
+// returns true if everything went well.
+//
+bool fly_cascade(Action &action, Offboard &offboard, Telemetry &telemetry,
+                 double setpoint_rate_hz, const RealtimeOptions &realtime) {
+  auto lifecycle = MissionLifecycle{action, telemetry};
+  auto streamer = SetpointStreamer{offboard, setpoint_rate_hz};
+  streamer.set_thread_options(realtime.control);
+  VehicleState state;
+  state.attach(telemetry);
+
+  const RateProfile profile = control_rate_profile();
+  DefaultRateRestorer restorer{telemetry, profile};
+  if (!lifecycle.prepare(rate_requests(profile)) || !lifecycle.take_off()) {
+    return false;
+  }
+  FailsafeWatchdog watchdog{action, state, streamer};
+  watchdog.set_thread_options(realtime.watchdog);
+  watchdog.watch_rc(telemetry);
+  watchdog.start();
+  const bool flown = offb_ctrl_cascade(offboard, state, streamer);
+  watchdog.stop();
+  print_failsafe(watchdog.stats());
+  print_jitter("Setpoint streamer", streamer.jitter());
+  print_jitter("Failsafe watchdog", watchdog.jitter());
+  std::cout << "Metrics:\n";
+  print_metrics(metrics());
+  // After a failsafe, landing still follows.
+  if (!flown && !watchdog.triggered()) {
+    return false;
+  }
+  if (!lifecycle.land()) {
+    return false;
+  }
+  print_timings(lifecycle.timings());
+  return true;
+}
+
 int main(int argc, char **argv) {
-  if (argc != 2) {
+  ConnectionOptions options;
+  std::vector<std::string> arguments;
+  RealtimeOptions realtime;
+  if (!parse_arguments(argc, argv, options, arguments) ||
+      !parse_realtime_arguments(arguments, realtime) ||
+      arguments.size() > 2 ||
+      (!arguments.empty() && arguments[0] != "cascade")) {
     usage(argv[0]);
     return 1;
   }
+  if (realtime.lock_memory && !lock_memory()) {
+    return 1;
+  }
 
-  Mavsdk mavsdk;
-  ConnectionResult connection_result = mavsdk.add_any_connection(argv[1]);
-
-  if (connection_result != ConnectionResult::Success) {
-    std::cerr << "Connection failed: " << connection_result << '\n';
+  MetricsExporter exporter{metrics(), options.metrics_target};
+  if (!exporter.start()) {
     return 1;
   }
 
-  auto system = get_system(mavsdk);
+  Mavsdk mavsdk;
+  auto system = connect(mavsdk, options);
   if (!system) {
     return 1;
   }
@@ -137,11 +242,24 @@ int main(int argc, char **argv) {
   auto offboard = Offboard{system};
   auto telemetry = Telemetry{system};
 
-  // while (!telemetry.health_all_ok()) {
-  //   std::cout << "Waiting for system to be ready\n";
-  //   sleep_for(seconds(1));
-  // }
+  if (!arguments.empty()) {
+    const double setpoint_rate_hz =
+        arguments.size() == 2 ? std::strtod(arguments[1].c_str(), nullptr)
+                              : SetpointStreamer::max_rate_hz;
+    return fly_cascade(action, offboard, telemetry, setpoint_rate_hz,
+                       realtime)
+               ? 0
+               : 1;
+  }
+
+  // Arm on the health update that makes the vehicle ready.
+  auto lifecycle = MissionLifecycle{action, telemetry};
+  if (!lifecycle.prepare({})) {
+    print_readiness(lifecycle.readiness());
+    return 1;
+  }
   std::cout << "System is ready\n";
+  print_readiness(lifecycle.readiness());
 
   const auto arm_result = action.arm();
   if (arm_result != Action::Result::Success) {
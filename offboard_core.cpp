@@ -0,0 +1,198 @@
+#include "offboard_core.h"
+
+#include <condition_variable>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <utility>
+
+using namespace mavsdk;
+
+namespace {
+
+std::shared_ptr<System> find_autopilot(Mavsdk &mavsdk, uint8_t system_id) {
+  for (auto &system : mavsdk.systems()) {
+    if (system->has_autopilot() &&
+        (system_id == 0 || system->get_system_id() == system_id)) {
+      return system;
+    }
+  }
+  return {};
+}
+
+bool parse_number(const std::string &text, unsigned long max,
+                  unsigned long &value) {
+  char *end = nullptr;
+  value = std::strtoul(text.c_str(), &end, 10);
+  return !text.empty() && *end == '\0' && value <= max;
+}
+
+} // namespace
+
+void print_usage(const std::string &bin_name, const std::string &arguments) {
+  std::cerr
+      << "Usage : " << bin_name
+      << " <connection_url> [--sysid <id>] [--discovery-timeout-ms <ms>]"
+         " [--metrics <target>]"
+      << (arguments.empty() ? "" : " ") << arguments << '\n'
+      << "Connection URL format should be :\n"
+      << " For TCP : tcp://[server_host][:server_port]\n"
+      << " For UDP : udp://[bind_host][:bind_port]\n"
+      << " For Serial : serial:///path/to/serial/dev[:baudrate]\n"
+      << "For example, to connect to the simulator use URL: udp://:14540\n"
+      << "Without --sysid the first autopilot found is used, discovery "
+         "gives up after "
+      << ConnectionOptions::default_discovery_timeout.count()
+      << " ms by default\n"
+      << "Metrics go to statsd://<host>:<port> or to a binary log if the "
+         "target is a file\n";
+}
+
+bool parse_arguments(int argc, char **argv, ConnectionOptions &options,
+                     std::vector<std::string> &arguments) {
+  arguments.clear();
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string argument = argv[i];
+
+    if (argument == "--sysid" || argument == "--discovery-timeout-ms") {
+      unsigned long value = 0;
+      if (i + 1 >= argc) {
+        std::cerr << argument << " needs a value\n";
+        return false;
+      }
+      if (argument == "--sysid") {
+        if (!parse_number(argv[++i], 255, value) || value == 0) {
+          std::cerr << "System id must be between 1 and 255\n";
+          return false;
+        }
+        options.system_id = static_cast<uint8_t>(value);
+      } else {
+        if (!parse_number(argv[++i], 3600000, value)) {
+          std::cerr << "Invalid discovery timeout\n";
+          return false;
+        }
+        options.discovery_timeout = std::chrono::milliseconds(value);
+      }
+    } else if (argument == "--metrics") {
+      if (i + 1 >= argc) {
+        std::cerr << argument << " needs a value\n";
+        return false;
+      }
+      options.metrics_target = argv[++i];
+    } else if (options.connection_url.empty()) {
+      options.connection_url = argument;
+    } else {
+      arguments.push_back(argument);
+    }
+  }
+
+  return !options.connection_url.empty();
+}
+
+std::shared_ptr<System> get_system(Mavsdk &mavsdk,
+                                   const ConnectionOptions &options) {
+  std::cout << "Waiting to discover system...\n";
+
+  // Shared with the callback so a late notification after we gave up does
+  // not touch a dead stack frame.
+  struct Discovery {
+    std::mutex mutex{};
+    std::condition_variable found_cv{};
+    std::shared_ptr<System> system{};
+  };
+  auto discovery = std::make_shared<Discovery>();
+
+  // We wait for new systems to be discovered, once we find one that has an
+  // autopilot, we decide to use it. Subscribe before looking at what is
+  // already known so no system can slip in between.
+  const uint8_t system_id = options.system_id;
+  mavsdk.subscribe_on_new_system([&mavsdk, discovery, system_id]() {
+    auto system = find_autopilot(mavsdk, system_id);
+    if (system) {
+      std::lock_guard<std::mutex> lock(discovery->mutex);
+      discovery->system = system;
+      discovery->found_cv.notify_all();
+    }
+  });
+
+  std::shared_ptr<System> system;
+  {
+    std::unique_lock<std::mutex> lock(discovery->mutex);
+    if (!discovery->system) {
+      // Heartbeats may already have arrived while the connection was set up.
+      discovery->system = find_autopilot(mavsdk, system_id);
+    }
+    discovery->found_cv.wait_for(lock, options.discovery_timeout, [&]() {
+      return discovery->system != nullptr;
+    });
+    system = discovery->system;
+  }
+
+  // Unsubscribe again as we only want to find one system.
+  mavsdk.subscribe_on_new_system(nullptr);
+
+  if (!system) {
+    std::cerr << "No autopilot found.\n";
+    return {};
+  }
+
+  std::cout << "Discovered autopilot with system id "
+            << static_cast<int>(system->get_system_id()) << '\n';
+  return system;
+}
+
+std::map<uint8_t, std::shared_ptr<System>>
+get_systems(Mavsdk &mavsdk, size_t count, const ConnectionOptions &options) {
+  std::cout << "Waiting to discover " << count << " systems...\n";
+
+  using Systems = std::map<uint8_t, std::shared_ptr<System>>;
+  struct Discovery {
+    std::mutex mutex{};
+    std::condition_variable found_cv{};
+    Systems systems{};
+  };
+  auto discovery = std::make_shared<Discovery>();
+
+  auto collect = [&mavsdk, discovery]() {
+    Systems autopilots;
+    for (auto &system : mavsdk.systems()) {
+      if (system->has_autopilot()) {
+        autopilots.emplace(system->get_system_id(), system);
+      }
+    }
+    std::lock_guard<std::mutex> lock(discovery->mutex);
+    discovery->systems = std::move(autopilots);
+    discovery->found_cv.notify_all();
+  };
+
+  mavsdk.subscribe_on_new_system(collect);
+  collect();
+
+  Systems systems;
+  {
+    std::unique_lock<std::mutex> lock(discovery->mutex);
+    discovery->found_cv.wait_for(lock, options.discovery_timeout, [&]() {
+      return discovery->systems.size() >= count;
+    });
+    systems = discovery->systems;
+  }
+
+  mavsdk.subscribe_on_new_system(nullptr);
+
+  std::cout << "Discovered " << systems.size() << " autopilots\n";
+  return systems;
+}
+
+std::shared_ptr<System> connect(Mavsdk &mavsdk,
+                                const ConnectionOptions &options) {
+  ConnectionResult connection_result =
+      mavsdk.add_any_connection(options.connection_url);
+
+  if (connection_result != ConnectionResult::Success) {
+    std::cerr << "Connection failed: " << connection_result << '\n';
+    return {};
+  }
+
+  return get_system(mavsdk, options);
+}
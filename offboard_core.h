@@ -0,0 +1,67 @@
+//
+// Connection and discovery shared by all offboard tools.
+//
+// Every tool takes a connection URL plus the shared discovery and metrics
+// flags:
+//
+//   <connection_url> [--sysid <id>] [--discovery-timeout-ms <ms>]
+//                    [--metrics <target>]
+//
+// and gets back the System to instantiate its plugins on.
+//
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <mavsdk/mavsdk.h>
+
+struct ConnectionOptions {
+  static constexpr std::chrono::milliseconds default_discovery_timeout{3000};
+
+  std::string connection_url{};
+  // 0 picks the first autopilot that is discovered.
+  uint8_t system_id{0};
+  std::chrono::milliseconds discovery_timeout{default_discovery_timeout};
+  // Where a MetricsExporter sends the metrics, empty for nowhere.
+  std::string metrics_target{};
+};
+
+// Print the shared usage text. `arguments` lists the tool-specific arguments
+// that follow the connection URL.
+void print_usage(const std::string &bin_name,
+                 const std::string &arguments = {});
+
+// Split the command line into connection options and the remaining
+// tool-specific arguments, in order.
+//
+// returns false if the connection URL is missing or a flag is malformed.
+bool parse_arguments(int argc, char **argv, ConnectionOptions &options,
+                     std::vector<std::string> &arguments);
+
+// Wait until an autopilot (with the requested system id, if any) is
+// discovered. Returns as soon as its first heartbeat is seen.
+//
+// returns nullptr on timeout.
+std::shared_ptr<mavsdk::System> get_system(mavsdk::Mavsdk &mavsdk,
+                                           const ConnectionOptions &options);
+
+// Wait until `count` autopilots are discovered. The system id option is
+// ignored, every autopilot is taken.
+//
+// returns the autopilots found, keyed by system id. On timeout this holds
+// fewer than `count` entries.
+std::map<uint8_t, std::shared_ptr<mavsdk::System>>
+get_systems(mavsdk::Mavsdk &mavsdk, size_t count,
+            const ConnectionOptions &options);
+
+// Add the connection and discover the system on it.
+//
+// returns nullptr if connecting or discovery failed.
+std::shared_ptr<mavsdk::System> connect(mavsdk::Mavsdk &mavsdk,
+                                        const ConnectionOptions &options);
@@ -0,0 +1,490 @@
+//
+// Benchmark of offboard command latency: how long a position, velocity or
+// attitude setpoint takes to show up in telemetry.
+//
+// Flies step and chirp setpoints in each control mode against SITL and
+// writes p50/p95/p99 latency, rise time and overshoot per mode as JSON.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <mavsdk/mavsdk.h>
+#include <mavsdk/plugins/action/action.h>
+#include <mavsdk/plugins/offboard/offboard.h>
+#include <mavsdk/plugins/telemetry/telemetry.h>
+
+#include "metrics.h"
+#include "offboard_core.h"
+#include "setpoint_streamer.h"
+
+using namespace mavsdk;
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+using std::this_thread::sleep_for;
+using Clock = std::chrono::steady_clock;
+
+// Setpoints are generated and sent from the bench thread itself so every send
+// is timestamped exactly, including each point of a chirp.
+constexpr double bench_rate_hz = 100.0;
+constexpr double telemetry_rate_hz = 100.0;
+constexpr float bench_altitude_m = 2.5f;
+constexpr float hover_thrust = 0.6f;
+constexpr unsigned steps_per_mode = 6;
+constexpr auto recover_time = seconds(5);
+
+void usage(const std::string &bin_name) {
+  print_usage(bin_name, "[report.json]");
+  std::cerr << "Only run this against a simulator, it flies aggressive "
+               "steps.\n";
+}
+
+//
+// Telemetry quantities compared against the commanded value of each mode.
+//
+enum class Channel {
+  NorthPosition,
+  NorthVelocity,
+  ForwardVelocity,
+  Roll,
+};
+constexpr size_t channel_count = 4;
+
+struct Sample {
+  Clock::time_point time;
+  float value;
+};
+
+//
+// Collects timestamped samples of every channel from telemetry callbacks.
+//
+class Observer {
+public:
+  explicit Observer(Telemetry &telemetry) : _telemetry(telemetry) {
+    for (auto &samples : _samples) {
+      samples.reserve(4096);
+    }
+
+    _telemetry.subscribe_position_velocity_ned(
+        [this](Telemetry::PositionVelocityNed state) {
+          const auto now = Clock::now();
+          std::lock_guard<std::mutex> lock(_mutex);
+
+          const float yaw_rad = _yaw_deg * static_cast<float>(M_PI) / 180.0f;
+          const float forward = state.velocity.north_m_s * std::cos(yaw_rad) +
+                                state.velocity.east_m_s * std::sin(yaw_rad);
+          add(Channel::NorthPosition, {now, state.position.north_m});
+          add(Channel::NorthVelocity, {now, state.velocity.north_m_s});
+          add(Channel::ForwardVelocity, {now, forward});
+        });
+
+    _telemetry.subscribe_attitude_euler([this](Telemetry::EulerAngle angle) {
+      const auto now = Clock::now();
+      std::lock_guard<std::mutex> lock(_mutex);
+      _yaw_deg = angle.yaw_deg;
+      add(Channel::Roll, {now, angle.roll_deg});
+    });
+  }
+
+  ~Observer() {
+    _telemetry.subscribe_position_velocity_ned(nullptr);
+    _telemetry.subscribe_attitude_euler(nullptr);
+  }
+
+  // Forget collected samples, keeping the latest value of each channel.
+  void clear() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto &samples : _samples) {
+      samples.clear();
+    }
+  }
+
+  float latest(Channel channel) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _latest[static_cast<size_t>(channel)];
+  }
+
+  std::vector<Sample> samples(Channel channel) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _samples[static_cast<size_t>(channel)];
+  }
+
+private:
+  void add(Channel channel, const Sample &sample) {
+    _samples[static_cast<size_t>(channel)].push_back(sample);
+    _latest[static_cast<size_t>(channel)] = sample.value;
+  }
+
+  Telemetry &_telemetry;
+  std::mutex _mutex{};
+  std::vector<Sample> _samples[channel_count]{};
+  float _latest[channel_count]{};
+  float _yaw_deg{0.0f};
+};
+
+//
+// One control mode under test.
+//
+struct ModeSpec {
+  const char *name;
+  Channel channel;
+  // Setpoint commanding `value` on the observed channel.
+  std::function<Setpoint(float value)> make;
+  // Time at the neutral setpoint before steps and chirp.
+  Clock::duration settle_duration;
+  float step;
+  Clock::duration step_duration;
+  float chirp_amplitude;
+  double chirp_start_hz;
+  double chirp_end_hz;
+  Clock::duration chirp_duration;
+};
+
+struct StepResult {
+  bool responded{false};
+  double latency_ms{0.0};
+  bool settled{false};
+  double rise_time_ms{0.0};
+  double overshoot_percent{0.0};
+};
+
+struct ModeReport {
+  const char *name{};
+  std::vector<StepResult> steps{};
+  double chirp_lag_ms{0.0};
+};
+
+double to_ms(Clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+//
+// Streams setpoints from `generate` at the bench rate for `duration`. The
+// generator gets the time since the start in seconds.
+//
+// returns the time the first setpoint was sent.
+//
+Clock::time_point drive(Offboard &offboard, Clock::duration duration,
+                        const std::function<Setpoint(double)> &generate) {
+  const auto period = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(1.0 / bench_rate_hz));
+  const auto start = Clock::now();
+  auto deadline = start;
+
+  while (deadline - start < duration) {
+    send_setpoint(offboard,
+                  generate(std::chrono::duration<double>(deadline - start)
+                               .count()));
+    deadline += period;
+    std::this_thread::sleep_until(deadline);
+  }
+  return start;
+}
+
+//
+// Latency is the time until the response covers 10% of the step, rise time
+// the time from 10% to 90%.
+//
+StepResult analyze_step(const std::vector<Sample> &samples,
+                        Clock::time_point sent, float initial, float target) {
+  StepResult result{};
+  const float delta = target - initial;
+  if (std::fabs(delta) < 1e-3f) {
+    return result;
+  }
+
+  Clock::time_point t10{};
+  float peak = 0.0f;
+  for (const auto &sample : samples) {
+    if (sample.time < sent) {
+      continue;
+    }
+    const float fraction = (sample.value - initial) / delta;
+    peak = std::max(peak, fraction);
+
+    if (!result.responded && fraction >= 0.1f) {
+      result.responded = true;
+      t10 = sample.time;
+      result.latency_ms = to_ms(t10 - sent);
+    }
+    if (result.responded && !result.settled && fraction >= 0.9f) {
+      result.settled = true;
+      result.rise_time_ms = to_ms(sample.time - t10);
+    }
+  }
+  result.overshoot_percent = std::max(0.0f, peak - 1.0f) * 100.0f;
+  return result;
+}
+
+double chirp_phase(const ModeSpec &mode, double t) {
+  const double duration_s =
+      std::chrono::duration<double>(mode.chirp_duration).count();
+  const double sweep = (mode.chirp_end_hz - mode.chirp_start_hz) / duration_s;
+  return 2.0 * M_PI * (mode.chirp_start_hz * t + 0.5 * sweep * t * t);
+}
+
+//
+// The chirp lag is the delay that best aligns the commanded and observed
+// signals, taken from the peak of their cross-correlation.
+//
+double analyze_chirp(const ModeSpec &mode, const std::vector<Sample> &samples,
+                     Clock::time_point sent) {
+  if (samples.empty()) {
+    return 0.0;
+  }
+
+  double mean = 0.0;
+  for (const auto &sample : samples) {
+    mean += sample.value;
+  }
+  mean /= static_cast<double>(samples.size());
+
+  double best_lag_ms = 0.0;
+  double best_correlation = -1e300;
+  for (double lag_ms = 0.0; lag_ms <= 500.0; lag_ms += 2.0) {
+    double correlation = 0.0;
+    for (const auto &sample : samples) {
+      const double t = to_ms(sample.time - sent) / 1000.0 - lag_ms / 1000.0;
+      if (t < 0.0) {
+        continue;
+      }
+      correlation += (sample.value - mean) * std::sin(chirp_phase(mode, t));
+    }
+    if (correlation > best_correlation) {
+      best_correlation = correlation;
+      best_lag_ms = lag_ms;
+    }
+  }
+  return best_lag_ms;
+}
+
+ModeReport run_mode(Offboard &offboard, Observer &observer,
+                    const ModeSpec &mode) {
+  std::cout << "Benchmarking " << mode.name << '\n';
+  ModeReport report{};
+  report.name = mode.name;
+
+  // Settle at the neutral setpoint first.
+  drive(offboard, mode.settle_duration,
+        [&mode](double) { return mode.make(0.0f); });
+
+  for (unsigned i = 0; i < steps_per_mode; ++i) {
+    const float target = i % 2 == 0 ? mode.step : 0.0f;
+    const float initial = observer.latest(mode.channel);
+
+    observer.clear();
+    const auto sent =
+        drive(offboard, mode.step_duration,
+              [&mode, target](double) { return mode.make(target); });
+    report.steps.push_back(
+        analyze_step(observer.samples(mode.channel), sent, initial, target));
+  }
+
+  drive(offboard, mode.settle_duration,
+        [&mode](double) { return mode.make(0.0f); });
+
+  observer.clear();
+  const auto sent =
+      drive(offboard, mode.chirp_duration, [&mode](double t) {
+        return mode.make(mode.chirp_amplitude *
+                         static_cast<float>(std::sin(chirp_phase(mode, t))));
+      });
+  report.chirp_lag_ms =
+      analyze_chirp(mode, observer.samples(mode.channel), sent);
+
+  return report;
+}
+
+double percentile(std::vector<double> values, double fraction) {
+  if (values.empty()) {
+    return 0.0;
+  }
+  std::sort(values.begin(), values.end());
+  const auto rank = static_cast<size_t>(
+      std::ceil(fraction * static_cast<double>(values.size())));
+  return values[std::min(values.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+void write_percentiles(std::ostream &out, const char *name,
+                       const std::vector<double> &values) {
+  out << "      \"" << name << "\": {\"p50\": " << percentile(values, 0.50)
+      << ", \"p95\": " << percentile(values, 0.95)
+      << ", \"p99\": " << percentile(values, 0.99) << "}";
+}
+
+void write_report(std::ostream &out, const std::string &connection_url,
+                  const std::vector<ModeReport> &reports) {
+  out << "{\n"
+      << "  \"connection\": \"" << connection_url << "\",\n"
+      << "  \"setpoint_rate_hz\": " << bench_rate_hz << ",\n"
+      << "  \"telemetry_rate_hz\": " << telemetry_rate_hz << ",\n"
+      << "  \"modes\": [\n";
+
+  for (size_t i = 0; i < reports.size(); ++i) {
+    const auto &report = reports[i];
+    std::vector<double> latency, rise_time, overshoot;
+    for (const auto &step : report.steps) {
+      if (step.responded) {
+        latency.push_back(step.latency_ms);
+        overshoot.push_back(step.overshoot_percent);
+      }
+      if (step.settled) {
+        rise_time.push_back(step.rise_time_ms);
+      }
+    }
+
+    out << "    {\n"
+        << "      \"mode\": \"" << report.name << "\",\n"
+        << "      \"steps\": " << report.steps.size() << ",\n"
+        << "      \"responded\": " << latency.size() << ",\n";
+    write_percentiles(out, "latency_ms", latency);
+    out << ",\n";
+    write_percentiles(out, "rise_time_ms", rise_time);
+    out << ",\n";
+    write_percentiles(out, "overshoot_percent", overshoot);
+    out << ",\n"
+        << "      \"chirp_lag_ms\": " << report.chirp_lag_ms << "\n"
+        << "    }" << (i + 1 < reports.size() ? "," : "") << '\n';
+  }
+
+  out << "  ]\n"
+      << "}\n";
+}
+
+int main(int argc, char **argv) {
+  ConnectionOptions options;
+  std::vector<std::string> arguments;
+  if (!parse_arguments(argc, argv, options, arguments) ||
+      arguments.size() > 1) {
+    usage(argv[0]);
+    return 1;
+  }
+  const std::string report_path =
+      arguments.empty() ? "offboard_latency_report.json" : arguments[0];
+
+  MetricsExporter exporter{metrics(), options.metrics_target};
+  if (!exporter.start()) {
+    return 1;
+  }
+
+  Mavsdk mavsdk;
+  auto system = connect(mavsdk, options);
+  if (!system) {
+    return 1;
+  }
+
+  // Instantiate plugins.
+  auto action = Action{system};
+  auto offboard = Offboard{system};
+  auto telemetry = Telemetry{system};
+
+  if (telemetry.set_rate_position_velocity_ned(telemetry_rate_hz) !=
+          Telemetry::Result::Success ||
+      telemetry.set_rate_attitude_euler(telemetry_rate_hz) !=
+          Telemetry::Result::Success) {
+    std::cerr << "Setting telemetry rates failed\n";
+    return 1;
+  }
+  Observer observer{telemetry};
+
+  const auto arm_result = action.arm();
+  if (arm_result != Action::Result::Success) {
+    std::cerr << "Arming failed: " << arm_result << '\n';
+    return 1;
+  }
+  std::cout << "Armed\n";
+
+  action.set_takeoff_altitude(bench_altitude_m);
+  const auto takeoff_result = action.takeoff();
+  if (takeoff_result != Action::Result::Success) {
+    std::cerr << "Takeoff failed: " << takeoff_result << '\n';
+    return 1;
+  }
+  sleep_for(seconds(8));
+
+  auto hold_position = [](float north_m) {
+    Offboard::PositionNedYaw position{};
+    position.north_m = north_m;
+    position.down_m = -bench_altitude_m;
+    return Setpoint::make_position_ned(position);
+  };
+
+  // Send it once before starting offboard, otherwise it will be rejected.
+  send_setpoint(offboard, hold_position(0.0f));
+  Offboard::Result offboard_result = offboard.start();
+  if (offboard_result != Offboard::Result::Success) {
+    std::cerr << "Offboard start failed: " << offboard_result << '\n';
+    return 1;
+  }
+
+  const std::vector<ModeSpec> modes = {
+      {"position_ned", Channel::NorthPosition, hold_position, seconds(5), 2.0f,
+       seconds(5), 0.5f, 0.1, 1.0, seconds(15)},
+      {"velocity_ned", Channel::NorthVelocity,
+       [](float value) {
+         Offboard::VelocityNedYaw velocity{};
+         velocity.north_m_s = value;
+         return Setpoint::make_velocity_ned(velocity);
+       },
+       seconds(3), 1.0f, seconds(3), 0.5f, 0.1, 1.0, seconds(10)},
+      {"velocity_body", Channel::ForwardVelocity,
+       [](float value) {
+         Offboard::VelocityBodyYawspeed velocity{};
+         velocity.forward_m_s = value;
+         return Setpoint::make_velocity_body(velocity);
+       },
+       seconds(3), 1.0f, seconds(3), 0.5f, 0.1, 1.0, seconds(10)},
+      {"attitude", Channel::Roll,
+       [](float value) {
+         Offboard::Attitude attitude{};
+         attitude.roll_deg = value;
+         attitude.thrust_value = hover_thrust;
+         return Setpoint::make_attitude(attitude);
+       },
+       seconds(1), 10.0f, milliseconds(800), 5.0f, 0.2, 2.0, seconds(5)},
+  };
+
+  std::vector<ModeReport> reports;
+  for (const auto &mode : modes) {
+    reports.push_back(run_mode(offboard, observer, mode));
+
+    // Fly back to the start before the next mode.
+    drive(offboard, recover_time, [&](double) { return hold_position(0.0f); });
+  }
+
+  offboard_result = offboard.stop();
+  if (offboard_result != Offboard::Result::Success) {
+    std::cerr << "Offboard stop failed: " << offboard_result << '\n';
+  }
+
+  write_report(std::cout, options.connection_url, reports);
+  std::ofstream report_file(report_path);
+  if (report_file) {
+    write_report(report_file, options.connection_url, reports);
+    std::cout << "Report written to " << report_path << '\n';
+  } else {
+    std::cerr << "Could not write report to " << report_path << '\n';
+  }
+
+  const auto land_result = action.land();
+  if (land_result != Action::Result::Success) {
+    std::cerr << "Landing failed: " << land_result << '\n';
+    return 1;
+  }
+
+  while (telemetry.in_air()) {
+    sleep_for(seconds(1));
+  }
+  std::cout << "Landed!\n";
+
+  return 0;
+}
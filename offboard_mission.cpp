@@ -0,0 +1,313 @@
+//
+// Example that flies a mission plan loaded from a file, so that changing
+// the mission needs no rebuild.
+//
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <mavsdk/mavsdk.h>
+#include <mavsdk/plugins/action/action.h>
+#include <mavsdk/plugins/offboard/offboard.h>
+#include <mavsdk/plugins/telemetry/telemetry.h>
+
+#include "failsafe_watchdog.h"
+#include "fence_guard.h"
+#include "link_monitor.h"
+#include "metrics.h"
+#include "mission_lifecycle.h"
+#include "mission_plan.h"
+#include "offboard_core.h"
+#include "rate_profile.h"
+#include "realtime.h"
+#include "setpoint_streamer.h"
+#include "shm_bus.h"
+#include "vehicle_state.h"
+#include "velocity_ramp.h"
+#include "waypoint_sequencer.h"
+
+using namespace mavsdk;
+using std::this_thread::sleep_for;
+
+void usage(const std::string &bin_name) {
+  print_usage(bin_name,
+              std::string("<mission_file> [setpoint_rate_hz] ") +
+                  fence_usage + " " + realtime_usage);
+  std::cerr << "The mission file format is described in mission_plan.h, "
+               "the fence file format in geofence.h\n";
+}
+
+// Check every position the plan flies to against `fence`.
+//
+// returns false if any of them breaches it.
+bool check_plan_against_fence(const MissionPlan &plan, const Geofence &fence) {
+  bool ok = true;
+  for (const auto &step : plan.steps) {
+    for (const auto &waypoint : step.waypoints) {
+      const Breach breach =
+          fence.check(waypoint.north_m, waypoint.east_m, waypoint.down_m);
+      if (breach != Breach::None) {
+        std::cerr << "Step on line " << step.line << ": waypoint ("
+                  << waypoint.north_m << ", " << waypoint.east_m << ", "
+                  << waypoint.down_m << ") is " << to_string(breach) << '\n';
+        ok = false;
+      }
+    }
+  }
+  return ok;
+}
+
+// Position setpoint holding where the vehicle is now.
+bool hold_here(const VehicleState &state, Setpoint &setpoint) {
+  const auto sample = state.read();
+  if (!sample.has_position() || !sample.has_attitude()) {
+    std::cerr << "No vehicle state to hold position on\n";
+    return false;
+  }
+  Offboard::PositionNedYaw position{};
+  position.north_m = sample.state.position_velocity.position.north_m;
+  position.east_m = sample.state.position_velocity.position.east_m;
+  position.down_m = sample.state.position_velocity.position.down_m;
+  position.yaw_deg = sample.state.attitude.yaw_deg;
+  setpoint = Setpoint::make_position_ned(position);
+  return true;
+}
+
+// Sleep for `duration`, or until `watchdog` triggers.
+//
+// returns false if the watchdog triggered.
+bool wait_unless_failsafe(const FailsafeWatchdog &watchdog,
+                          std::chrono::milliseconds duration) {
+  const auto end = std::chrono::steady_clock::now() + duration;
+  while (!watchdog.triggered() && std::chrono::steady_clock::now() < end) {
+    sleep_for(std::chrono::milliseconds(20));
+  }
+  return !watchdog.triggered();
+}
+
+//
+// Streams the setpoints published on the shared-memory setpoint ring for
+// `duration`, holding `hold` whenever the publisher goes quiet. Ends early
+// if `watchdog` triggers.
+//
+// returns false if the ring cannot be opened.
+//
+bool follow_external(const VehicleState &state, SetpointStreamer &streamer,
+                     const FailsafeWatchdog &watchdog,
+                     std::chrono::milliseconds duration, Setpoint hold) {
+  ShmSetpointSource source{default_setpoint_ring, hold};
+  if (!source.open()) {
+    return false;
+  }
+  streamer.drive(source);
+  wait_unless_failsafe(watchdog, duration);
+  // Off the source before it goes out of scope.
+  hold_here(state, hold);
+  streamer.set_target_and_wait(hold);
+
+  const auto stats = source.stats();
+  std::cout << "Followed " << stats.received << " external setpoints, "
+            << stats.sequence_gaps << " lost, " << stats.dropped
+            << " dropped, " << stats.invalid << " invalid, "
+            << stats.fallback_ticks << " ticks holding\n";
+  return true;
+}
+
+//
+// Flies the offboard steps of `plan`, everything between take-off and
+// landing. The plan ends as soon as `watchdog` triggers, and offboard is
+// not started at all if it already has.
+//
+// returns true if everything went well in Offboard control.
+//
+bool offb_ctrl_plan(Offboard &offboard, const VehicleState &state,
+                    SetpointStreamer &streamer,
+                    const FailsafeWatchdog &watchdog, const MissionPlan &plan) {
+  if (watchdog.triggered()) {
+    std::cerr << "Failsafe triggered, not entering offboard\n";
+    return false;
+  }
+  Setpoint hold{};
+  if (!hold_here(state, hold)) {
+    return false;
+  }
+
+  // Stream it before starting offboard, otherwise it will be rejected.
+  if (!streamer.start(hold)) {
+    return false;
+  }
+  Offboard::Result offboard_result = offboard.start();
+  if (offboard_result != Offboard::Result::Success) {
+    std::cerr << "Offboard start failed: " << offboard_result << '\n';
+    streamer.stop();
+    return false;
+  }
+  std::cout << "Offboard started\n";
+
+  WaypointSequencer sequencer{state, streamer, plan.tolerances};
+  sequencer.stop_on_failsafe(watchdog);
+  // Velocity segments are ramped to. A ramp picks up the vehicle's velocity
+  // when its segment follows other kinds of steps. Both outlive streaming.
+  VelocityRamp ned_ramp{VelocityRamp::Frame::Ned, plan.ramp, &state};
+  VelocityRamp body_ramp{VelocityRamp::Frame::Body, plan.ramp, &state};
+  bool ok = true;
+  for (size_t i = 0; ok && !watchdog.triggered() && i < plan.steps.size();
+       ++i) {
+    const auto &step = plan.steps[i];
+    switch (step.kind) {
+    case MissionStep::Kind::TakeOff:
+    case MissionStep::Kind::Land:
+      break;
+    case MissionStep::Kind::Waypoints:
+      std::cout << "Step " << i + 1 << ": fly " << step.waypoints.size()
+                << " waypoints\n";
+      print_legs(sequencer.fly(step.waypoints, plan.limits));
+      break;
+    case MissionStep::Kind::Timed:
+      std::cout << "Step " << i + 1 << ": stream for "
+                << step.duration.count() << " ms\n";
+      if (ned_ramp.set_target(step.setpoint)) {
+        streamer.drive(ned_ramp);
+      } else if (body_ramp.set_target(step.setpoint)) {
+        streamer.drive(body_ramp);
+      } else {
+        streamer.set_target(step.setpoint);
+      }
+      wait_unless_failsafe(watchdog, step.duration);
+      break;
+    case MissionStep::Kind::Hold:
+      std::cout << "Step " << i + 1 << ": hold for " << step.duration.count()
+                << " ms\n";
+      ok = hold_here(state, hold);
+      if (ok) {
+        streamer.set_target(hold);
+        wait_unless_failsafe(watchdog, step.duration);
+      }
+      break;
+    case MissionStep::Kind::External:
+      std::cout << "Step " << i + 1 << ": follow " << default_setpoint_ring
+                << " for " << step.duration.count() << " ms\n";
+      ok = hold_here(state, hold) &&
+           follow_external(state, streamer, watchdog, step.duration, hold);
+      break;
+    }
+  }
+
+  // Leave offboard holding where the plan ended.
+  if (watchdog.triggered()) {
+    std::cerr << "Failsafe triggered, plan ended\n";
+  }
+  if (ok && hold_here(state, hold)) {
+    streamer.set_target_and_wait(hold);
+  }
+  offboard_result = offboard.stop();
+  streamer.stop();
+  if (offboard_result != Offboard::Result::Success) {
+    std::cerr << "Offboard stop failed: " << offboard_result << '\n';
+    return false;
+  }
+  std::cout << "Offboard stopped\n";
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  ConnectionOptions options;
+  std::vector<std::string> arguments;
+  RealtimeOptions realtime;
+  Geofence fence;
+  if (!parse_arguments(argc, argv, options, arguments) ||
+      !parse_realtime_arguments(arguments, realtime) ||
+      !parse_fence_arguments(arguments, fence) || arguments.empty() ||
+      arguments.size() > 2) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  // Load before connecting, so a broken plan never gets near the vehicle.
+  const auto load_start = std::chrono::steady_clock::now();
+  MissionPlan plan{};
+  if (!load_mission_plan(arguments[0], plan) ||
+      !check_plan_against_fence(plan, fence)) {
+    return 1;
+  }
+  const auto load_time = std::chrono::steady_clock::now() - load_start;
+  print_mission_plan(plan);
+  std::cout << "Loaded in "
+            << std::chrono::duration<double, std::milli>(load_time).count()
+            << " ms\n";
+  if (realtime.lock_memory && !lock_memory()) {
+    return 1;
+  }
+
+  const double setpoint_rate_hz =
+      arguments.size() == 2 ? std::strtod(arguments[1].c_str(), nullptr)
+                            : SetpointStreamer::default_rate_hz;
+
+  MetricsExporter exporter{metrics(), options.metrics_target};
+  if (!exporter.start()) {
+    return 1;
+  }
+
+  Mavsdk mavsdk;
+  auto system = connect(mavsdk, options);
+  if (!system) {
+    return 1;
+  }
+
+  // Instantiate plugins.
+  auto action = Action{system};
+  auto offboard = Offboard{system};
+  auto telemetry = Telemetry{system};
+  VehicleState state;
+  state.attach(telemetry);
+
+  // External and velocity segments are only checked as they are flown.
+  FenceGuard guard{fence, state};
+  auto streamer = SetpointStreamer{offboard, setpoint_rate_hz};
+  streamer.set_thread_options(realtime.control);
+  streamer.set_guard(&guard);
+
+  auto lifecycle = MissionLifecycle{action, telemetry};
+
+  const RateProfile profile = control_rate_profile();
+  DefaultRateRestorer restorer{telemetry, profile};
+  if (!lifecycle.prepare(rate_requests(profile)) || !lifecycle.take_off()) {
+    return 1;
+  }
+  FailsafeWatchdog watchdog{action, state, streamer};
+  watchdog.set_thread_options(realtime.watchdog);
+  watchdog.watch_rc(telemetry);
+  // Link outages are ridden through: offboard is restarted once the link
+  // is back, and the watchdog leaves them to the autopilot meanwhile.
+  LinkMonitor link{state};
+  link.set_thread_options(realtime.watchdog);
+  link.resume_offboard(offboard, streamer, &watchdog);
+  watchdog.watch_link(link);
+  link.start();
+  watchdog.start();
+  const bool flown =
+      offb_ctrl_plan(offboard, state, streamer, watchdog, plan);
+  watchdog.stop();
+  link.stop();
+  print_failsafe(watchdog.stats());
+  print_link(link.stats());
+  print_fence(guard.stats());
+  print_jitter("Setpoint streamer", streamer.jitter());
+  print_jitter("Failsafe watchdog", watchdog.jitter());
+  std::cout << "Metrics:\n";
+  print_metrics(metrics());
+  // After a failsafe, landing still follows.
+  if (!flown && !watchdog.triggered()) {
+    return 1;
+  }
+  if (!lifecycle.land()) {
+    return 1;
+  }
+  std::cout << "Landed and disarmed\n";
+  print_timings(lifecycle.timings());
+
+  return 0;
+}
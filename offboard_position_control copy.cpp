@@ -15,51 +15,13 @@
 #include <mavsdk/plugins/offboard/offboard.h>
 #include <mavsdk/plugins/telemetry/telemetry.h>
 
+#include "offboard_core.h"
+
 using namespace mavsdk;
 using std::chrono::milliseconds;
 using std::chrono::seconds;
 using std::this_thread::sleep_for;
 
-void usage(const std::string &bin_name) {
-  std::cerr
-      << "Usage : " << bin_name << " <connection_url>\n"
-      << "Connection URL format should be :\n"
-      << " For TCP : tcp://[server_host][:server_port]\n"
-      << " For UDP : udp://[bind_host][:bind_port]\n"
-      << " For Serial : serial:///path/to/serial/dev[:baudrate]\n"
-      << "For example, to connect to the simulator use URL: udp://:14540\n";
-}
-
-std::shared_ptr<System> get_system(Mavsdk &mavsdk) {
-  std::cout << "Waiting to discover system...\n";
-  auto prom = std::promise<std::shared_ptr<System>>{};
-  auto fut = prom.get_future();
-
-  // We wait for new systems to be discovered, once we find one that has an
-  // autopilot, we decide to use it.
-  mavsdk.subscribe_on_new_system([&mavsdk, &prom]() {
-    auto system = mavsdk.systems().back();
-
-    if (system->has_autopilot()) {
-      std::cout << "Discovered autopilot\n";
-
-      // Unsubscribe again as we only want to find one system.
-      mavsdk.subscribe_on_new_system(nullptr);
-      prom.set_value(system);
-    }
-  });
-
-  // We usually receive heartbeats at 1Hz, therefore we should find a
-  // system after around 3 seconds max, surely.
-  if (fut.wait_for(seconds(3)) == std::future_status::timeout) {
-    std::cerr << "No autopilot found.\n";
-    return {};
-  }
-
-  // Get discovered system now.
-  return fut.get();
-}
-
 //
 // Does Offboard control using NED co-ordinates.
 //
@@ -249,20 +211,15 @@ bool offb_ctrl_attitude(mavsdk::Offboard &offboard) {
 }
 
 int main(int argc, char **argv) {
-  if (argc != 2) {
-    usage(argv[0]);
+  ConnectionOptions options;
+  std::vector<std::string> arguments;
+  if (!parse_arguments(argc, argv, options, arguments) || !arguments.empty()) {
+    print_usage(argv[0]);
     return 1;
   }
 
   Mavsdk mavsdk;
-  ConnectionResult connection_result = mavsdk.add_any_connection(argv[1]);
-
-  if (connection_result != ConnectionResult::Success) {
-    std::cerr << "Connection failed: " << connection_result << '\n';
-    return 1;
-  }
-
-  auto system = get_system(mavsdk);
+  auto system = connect(mavsdk, options);
   if (!system) {
     return 1;
   }
@@ -6,142 +6,315 @@
 
 #include <chrono>
 #include <cmath>
-#include <future>
+#include <cstdlib>
 #include <iostream>
 #include <thread>
+#include <vector>
 
 #include <mavsdk/mavsdk.h>
 #include <mavsdk/plugins/action/action.h>
 #include <mavsdk/plugins/offboard/offboard.h>
 #include <mavsdk/plugins/telemetry/telemetry.h>
 
+#include "failsafe_watchdog.h"
+#include "fence_guard.h"
+#include "link_monitor.h"
+#include "metrics.h"
+#include "mission_lifecycle.h"
+#include "offboard_core.h"
+#include "pipeline.h"
+#include "rate_profile.h"
+#include "realtime.h"
+#include "setpoint_streamer.h"
+#include "state_filter.h"
+#include "vehicle_state.h"
+#include "velocity_ramp.h"
+#include "waypoint_sequencer.h"
+
 using namespace mavsdk;
 using std::chrono::milliseconds;
 using std::chrono::seconds;
 using std::this_thread::sleep_for;
 
+// How long a velocity ramp may take to come to rest at the end.
+constexpr auto settle_timeout = seconds(10);
+
 void usage(const std::string &bin_name) {
-  std::cerr
-      << "Usage : " << bin_name << " <connection_url>\n"
-      << "Connection URL format should be :\n"
-      << " For TCP : tcp://[server_host][:server_port]\n"
-      << " For UDP : udp://[bind_host][:bind_port]\n"
-      << " For Serial : serial:///path/to/serial/dev[:baudrate]\n"
-      << "For example, to connect to the simulator use URL: udp://:14540\n";
+  print_usage(bin_name, std::string("[setpoint_rate_hz] ") + ramp_usage +
+                            " " + fence_usage + " " + filter_usage + " " +
+                            realtime_usage);
+  std::cerr << "Setpoints are streamed at " << SetpointStreamer::default_rate_hz
+            << " Hz unless a rate between " << SetpointStreamer::min_rate_hz
+            << " and " << SetpointStreamer::max_rate_hz << " Hz is given\n"
+            << "Velocity commands are ramped at up to "
+            << RampLimits{}.max_acceleration_m_s2 << " m/s^2 and "
+            << RampLimits{}.max_jerk_m_s3 << " m/s^3 unless limits are given\n"
+            << "Every setpoint is checked against the fence file, see "
+               "geofence.h\n"
+            << "--filter smooths position and velocity and predicts them to "
+               "every control tick, see state_filter.h\n";
 }
 
-std::shared_ptr<System> get_system(Mavsdk &mavsdk) {
-  std::cout << "Waiting to discover system...\n";
-  auto prom = std::promise<std::shared_ptr<System>>{};
-  auto fut = prom.get_future();
-
-  // We wait for new systems to be discovered, once we find one that has an
-  // autopilot, we decide to use it.
-  mavsdk.subscribe_on_new_system([&mavsdk, &prom]() {
-    auto system = mavsdk.systems().back();
-
-    if (system->has_autopilot()) {
-      std::cout << "Discovered autopilot\n";
-
-      // Unsubscribe again as we only want to find one system.
-      mavsdk.subscribe_on_new_system(nullptr);
-      prom.set_value(system);
-    }
-  });
-
-  // We usually receive heartbeats at 1Hz, therefore we should find a
-  // system after around 3 seconds max, surely.
-  if (fut.wait_for(seconds(3)) == std::future_status::timeout) {
-    std::cerr << "No autopilot found.\n";
-    return {};
+// Once the watchdog has handed the vehicle to the autopilot's Hold or Land,
+// offboard must not take it back.
+//
+// returns true, with a note, if the watchdog has triggered.
+bool failsafe_triggered(const FailsafeWatchdog &watchdog) {
+  if (!watchdog.triggered()) {
+    return false;
   }
-
-  // Get discovered system now.
-  return fut.get();
+  std::cerr << "Failsafe triggered, not entering offboard\n";
+  return true;
 }
 
+// Switch to offboard once the streamer runs, unless the watchdog has
+// triggered.
 //
-// Does Offboard control using NED co-ordinates.
-//
-// returns true if everything went well in Offboard control
-//
-bool offb_ctrl_ned(mavsdk::Offboard &offboard) {
-  std::cout << "Starting Offboard velocity control in NED coordinates\n";
-
-  // Send it once before starting offboard, otherwise it will be rejected.
-  const Offboard::VelocityNedYaw stay{};
-  offboard.set_velocity_ned(stay);
-
-  Offboard::Result offboard_result = offboard.start();
+// returns false if offboard could not be started; streaming is stopped then.
+bool enter_offboard(Offboard &offboard, SetpointStreamer &streamer,
+                    const FailsafeWatchdog &watchdog) {
+  if (failsafe_triggered(watchdog)) {
+    streamer.stop();
+    return false;
+  }
+  const Offboard::Result offboard_result = offboard.start();
   if (offboard_result != Offboard::Result::Success) {
     std::cerr << "Offboard start failed: " << offboard_result << '\n';
+    streamer.stop();
     return false;
   }
-
   std::cout << "Offboard started\n";
-  std::cout << "Turn to face East\n";
+  return true;
+}
 
-  // Go up
-  std::cout << "Go up 0.5 m east\n";
-  Offboard::PositionNedYaw position_msg{};
-  position_msg.down_m = -2.0f;
+// Stream `initial`, then switch to offboard.
+//
+// returns false if streaming or offboard could not be started, or if the
+// watchdog has triggered.
+bool start_offboard(Offboard &offboard, SetpointStreamer &streamer,
+                    const FailsafeWatchdog &watchdog,
+                    const Setpoint &initial) {
+  if (failsafe_triggered(watchdog)) {
+    return false;
+  }
+  // Stream it before starting offboard, otherwise it will be rejected.
+  return streamer.start(initial) &&
+         enter_offboard(offboard, streamer, watchdog);
+}
 
-  offboard.set_position_ned(position_msg);
-  sleep_for(seconds(4));
+// Leave offboard, stop streaming and report on the stream.
+//
+// returns false if offboard could not be stopped.
+bool stop_offboard(Offboard &offboard, SetpointStreamer &streamer) {
+  const Offboard::Result offboard_result = offboard.stop();
+  streamer.stop();
+  if (offboard_result != Offboard::Result::Success) {
+    std::cerr << "Offboard stop failed: " << offboard_result << '\n';
+    return false;
+  }
+  std::cout << "Offboard stopped\n";
 
-  // Go front
-  std::cout << "Go up 0.5 m east\n";
-  position_msg.north_m = 1.0f;
+  const auto stats = streamer.stats();
+  std::cout << "Streamed " << stats.ticks << " ticks at " << streamer.rate_hz()
+            << " Hz, " << stats.overruns << " deadline overruns, max lateness "
+            << stats.max_lateness.count() << " us\n"
+            << "Sent " << stats.sent << " setpoints, " << stats.coalesced
+            << " coalesced, " << stats.suppressed << " repeats suppressed, "
+            << stats.send_failures << " send failures\n";
+  return true;
+}
 
-  offboard.set_position_ned(position_msg);
-  sleep_for(seconds(4));
+struct VelocityStep {
+  const char *description;
+  Setpoint target;
+  std::chrono::milliseconds duration;
+};
 
-  // Go right
-  std::cout << "Go up 0.5 m east\n";
-  position_msg.east_m = 1.0f;
+//
+// Ramps through `steps` in offboard, each target held for its duration,
+// and comes to rest at `stay` afterwards. The steps end early once the
+// watchdog triggers.
+//
+// returns true if everything went well in Offboard control.
+//
+bool fly_velocity_steps(Offboard &offboard, SetpointStreamer &streamer,
+                        const FailsafeWatchdog &watchdog, VelocityRamp &ramp,
+                        FenceGuard &guard, const Setpoint &stay,
+                        const std::vector<VelocityStep> &steps) {
+  if (failsafe_triggered(watchdog)) {
+    return false;
+  }
+  // The ramp, the speed limit and the fence check make up the whole tick.
+  SpeedLimit speed_limit;
+  Pipeline pipeline{ramp, speed_limit, guard};
+  if (!streamer.start_pipeline(pipeline) ||
+      !enter_offboard(offboard, streamer, watchdog)) {
+    return false;
+  }
 
-  offboard.set_position_ned(position_msg);
-  sleep_for(seconds(4));
+  for (const auto &step : steps) {
+    std::cout << step.description << '\n';
+    ramp.set_target(step.target);
+    const auto end = std::chrono::steady_clock::now() + step.duration;
+    while (!watchdog.triggered() && std::chrono::steady_clock::now() < end) {
+      sleep_for(milliseconds(20));
+    }
+    if (watchdog.triggered()) {
+      std::cerr << "Failsafe triggered, velocity steps ended\n";
+      break;
+    }
+  }
 
-  // Go back
-  std::cout << "Go up 0.5 m east\n";
-  position_msg.north_m = 0.0f;
+  ramp.set_target(stay);
+  const auto deadline = std::chrono::steady_clock::now() + settle_timeout;
+  while (!ramp.settled() && !watchdog.triggered() &&
+         std::chrono::steady_clock::now() < deadline) {
+    sleep_for(milliseconds(20));
+  }
+  if (!ramp.settled() && !watchdog.triggered()) {
+    std::cerr << "Velocity did not ramp down in time\n";
+  }
 
-  offboard.set_position_ned(position_msg);
-  sleep_for(seconds(4));
+  // Streaming stops before the pipeline goes out of scope.
+  return stop_offboard(offboard, streamer);
+}
 
-  // Go left
-  std::cout << "Go up 0.5 m east\n";
-  position_msg.east_m = 0.0f;
 
-  offboard.set_position_ned(position_msg);
-  sleep_for(seconds(4));
+//
+// Does Offboard control using NED co-ordinates.
+//
+// Flies a 1 m square at 2 m altitude, moving on to the next corner as soon
+// as the vehicle has settled on the current one.
+//
+// returns true if everything went well in Offboard control
+//
+bool offb_ctrl_ned(mavsdk::Offboard &offboard, const VehicleState &state,
+                   SetpointStreamer &streamer,
+                   const FailsafeWatchdog &watchdog) {
+  std::cout << "Starting Offboard position control in NED coordinates\n";
+
+  const std::vector<Waypoint> square{
+      {0.0f, 0.0f, -2.0f, 0.0f}, {1.0f, 0.0f, -2.0f, 0.0f},
+      {1.0f, 1.0f, -2.0f, 0.0f}, {0.0f, 1.0f, -2.0f, 0.0f},
+      {0.0f, 0.0f, -2.0f, 0.0f},
+  };
+  WaypointSequencer sequencer{state, streamer};
+  sequencer.stop_on_failsafe(watchdog);
 
-  offboard_result = offboard.stop();
-  if (offboard_result != Offboard::Result::Success) {
-    std::cerr << "Offboard stop failed: " << offboard_result << '\n';
+  const Offboard::VelocityNedYaw stay{};
+  if (!start_offboard(offboard, streamer, watchdog,
+                      Setpoint::make_velocity_ned(stay))) {
     return false;
   }
-  std::cout << "Offboard stopped\n";
 
-  return true;
+  print_legs(sequencer.fly(square));
+
+  return stop_offboard(offboard, streamer);
+}
+
+//
+// Does Offboard velocity control using NED co-ordinates.
+//
+// Flies a survey pass out and back along north with a step east between,
+// with every velocity change ramped.
+//
+// returns true if everything went well in Offboard control
+//
+bool offb_ctrl_velocity_ned(mavsdk::Offboard &offboard,
+                            const VehicleState &state,
+                            SetpointStreamer &streamer,
+                            const FailsafeWatchdog &watchdog,
+                            FenceGuard &guard, const RampLimits &limits) {
+  std::cout << "Starting Offboard velocity control in NED coordinates\n";
+
+  const auto velocity = [](float north_m_s, float east_m_s) {
+    Offboard::VelocityNedYaw velocity{};
+    velocity.north_m_s = north_m_s;
+    velocity.east_m_s = east_m_s;
+    return Setpoint::make_velocity_ned(velocity);
+  };
+  const std::vector<VelocityStep> pass{
+      {"Fly north at 2 m/s", velocity(2.0f, 0.0f), milliseconds(4000)},
+      {"Step east", velocity(0.0f, 1.0f), milliseconds(2000)},
+      {"Fly south at 2 m/s", velocity(-2.0f, 0.0f), milliseconds(4000)},
+  };
+
+  VelocityRamp ramp{VelocityRamp::Frame::Ned, limits, &state};
+  return fly_velocity_steps(offboard, streamer, watchdog, ramp, guard,
+                            velocity(0.0f, 0.0f), pass);
+}
+
+//
+// Does Offboard control using body co-ordinates.
+// Body coordinates really means world coordinates rotated by the yaw of the
+// vehicle, so if the vehicle pitches down, the forward axis does still point
+// forward and not down into the ground.
+//
+// returns true if everything went well in Offboard control.
+//
+bool offb_ctrl_body(mavsdk::Offboard &offboard, const VehicleState &state,
+                    SetpointStreamer &streamer,
+                    const FailsafeWatchdog &watchdog, FenceGuard &guard,
+                    const RampLimits &limits) {
+  std::cout << "Starting Offboard velocity control in body coordinates\n";
+
+  const auto velocity = [](float forward_m_s, float right_m_s,
+                           float down_m_s, float yawspeed_deg_s) {
+    Offboard::VelocityBodyYawspeed velocity{};
+    velocity.forward_m_s = forward_m_s;
+    velocity.right_m_s = right_m_s;
+    velocity.down_m_s = down_m_s;
+    velocity.yawspeed_deg_s = yawspeed_deg_s;
+    return Setpoint::make_velocity_body(velocity);
+  };
+  const Setpoint stay = velocity(0.0f, 0.0f, 0.0f, 0.0f);
+  const std::vector<VelocityStep> pattern{
+      {"Turn clock-wise and climb", velocity(0.0f, 0.0f, -0.1f, 60.0f),
+       milliseconds(5000)},
+      {"Turn back anti-clockwise", velocity(0.0f, 0.0f, -0.1f, -60.0f),
+       milliseconds(5000)},
+      {"Wait for a bit", stay, milliseconds(2000)},
+      {"Fly a circle", velocity(5.0f, 0.0f, 0.0f, 30.0f), milliseconds(15000)},
+      {"Wait for a bit", stay, milliseconds(5000)},
+      {"Fly a circle sideways", velocity(5.0f, -5.0f, 0.0f, 30.0f),
+       milliseconds(15000)},
+  };
+
+  VelocityRamp ramp{VelocityRamp::Frame::Body, limits, &state};
+  return fly_velocity_steps(offboard, streamer, watchdog, ramp, guard, stay,
+                            pattern);
 }
 
 int main(int argc, char **argv) {
-  if (argc != 2) {
+  ConnectionOptions options;
+  std::vector<std::string> arguments;
+  RealtimeOptions realtime;
+  RampLimits ramp_limits;
+  Geofence fence;
+  FilterOptions filter;
+  if (!parse_arguments(argc, argv, options, arguments) ||
+      !parse_realtime_arguments(arguments, realtime) ||
+      !parse_ramp_arguments(arguments, ramp_limits) ||
+      !parse_fence_arguments(arguments, fence) ||
+      !parse_filter_arguments(arguments, filter) || arguments.size() > 1) {
     usage(argv[0]);
     return 1;
   }
+  if (realtime.lock_memory && !lock_memory()) {
+    return 1;
+  }
 
-  Mavsdk mavsdk;
-  ConnectionResult connection_result = mavsdk.add_any_connection(argv[1]);
+  const double setpoint_rate_hz =
+      arguments.empty() ? SetpointStreamer::default_rate_hz
+                        : std::strtod(arguments[0].c_str(), nullptr);
 
-  if (connection_result != ConnectionResult::Success) {
-    std::cerr << "Connection failed: " << connection_result << '\n';
+  MetricsExporter exporter{metrics(), options.metrics_target};
+  if (!exporter.start()) {
     return 1;
   }
 
-  auto system = get_system(mavsdk);
+  Mavsdk mavsdk;
+  auto system = connect(mavsdk, options);
   if (!system) {
     return 1;
   }
@@ -151,75 +324,82 @@ int main(int argc, char **argv) {
   auto offboard = Offboard{system};
   auto telemetry = Telemetry{system};
 
-  // while (!telemetry.health_all_ok()) {
-  //   std::cout << "Waiting for system to be ready\n";
-  //   sleep_for(seconds(1));
-  // }
-  std::cout << "System is ready\n";
+  // Control code reads position and attitude from here, never through the
+  // blocking telemetry getters.
+  VehicleState state;
+  if (filter.enabled) {
+    state.set_filter(filter);
+  }
+  state.attach(telemetry);
+
+  FenceGuard guard{fence, state};
+  auto streamer = SetpointStreamer{offboard, setpoint_rate_hz};
+  streamer.set_thread_options(realtime.control);
+  streamer.set_guard(&guard);
+
+  auto lifecycle = MissionLifecycle{action, telemetry};
 
-  const auto arm_result = action.arm();
-  if (arm_result != Action::Result::Success) {
-    std::cerr << "Arming failed: " << arm_result << '\n';
+  // The sequencer follows position_velocity_ned, landed state drives the
+  // take-off and landing events.
+  const RateProfile profile = control_rate_profile();
+  DefaultRateRestorer restorer{telemetry, profile};
+  if (!lifecycle.prepare(rate_requests(profile))) {
+    print_readiness(lifecycle.readiness());
     return 1;
   }
-  std::cout << "Armed\n";
+  std::cout << "System is ready\n";
+  print_readiness(lifecycle.readiness());
 
-  const auto takeoff_result = action.takeoff();
-  if (takeoff_result != Action::Result::Success) {
-    std::cerr << "Takeoff failed: " << takeoff_result << '\n';
+  if (!lifecycle.take_off()) {
     return 1;
   }
-
-  // auto in_air_promise = std::promise<void>{};
-  // auto in_air_future = in_air_promise.get_future();
-  // telemetry.subscribe_landed_state(
-  //     [&telemetry, &in_air_promise](Telemetry::LandedState state) {
-  //       if (state == Telemetry::LandedState::InAir) {
-  //         std::cout << "Taking off has finished\n.";
-  //         telemetry.subscribe_landed_state(nullptr);
-  //         in_air_promise.set_value();
-  //       }
-  //     });
-  // in_air_future.wait_for(seconds(10));
-  // if (in_air_future.wait_for(seconds(6)) == std::future_status::timeout) {
-  //   std::cerr << "Takeoff timed out.\n";
-  //   return 1;
-  // }
+  std::cout << "Taking off has finished\n";
 
   // //  using attitude control
   // if (!offb_ctrl_attitude(offboard)) {
   //   return 1;
   // }
 
-  sleep_for(seconds(8));
-
-  //  using local NED co-ordinates
-  if (!offb_ctrl_ned(offboard)) {
+  // Watches for telemetry dropouts and a stalled setpoint stream until the
+  // planned landing.
+  FailsafeWatchdog watchdog{action, state, streamer};
+  watchdog.set_thread_options(realtime.watchdog);
+  watchdog.watch_rc(telemetry);
+  // Link outages are ridden through: offboard is restarted once the link
+  // is back, and the watchdog leaves them to the autopilot meanwhile.
+  LinkMonitor link{state};
+  link.set_thread_options(realtime.watchdog);
+  link.resume_offboard(offboard, streamer, &watchdog);
+  watchdog.watch_link(link);
+  link.start();
+  watchdog.start();
+
+  //  using local NED co-ordinates, then velocities in NED and body. Each
+  // phase refuses to enter offboard once the watchdog has triggered.
+  const bool flown =
+      offb_ctrl_ned(offboard, state, streamer, watchdog) &&
+      offb_ctrl_velocity_ned(offboard, state, streamer, watchdog, guard,
+                             ramp_limits) &&
+      offb_ctrl_body(offboard, state, streamer, watchdog, guard, ramp_limits);
+  watchdog.stop();
+  link.stop();
+  print_failsafe(watchdog.stats());
+  print_link(link.stats());
+  print_fence(guard.stats());
+  print_jitter("Setpoint streamer", streamer.jitter());
+  print_jitter("Failsafe watchdog", watchdog.jitter());
+  std::cout << "Metrics:\n";
+  print_metrics(metrics());
+  // After a failsafe, landing still follows.
+  if (!flown && !watchdog.triggered()) {
     return 1;
   }
 
-  // //  using body co-ordinates
-  // if (!offb_ctrl_body(offboard)) {
-  //   return 1;
-  // }
-
-  const auto land_result = action.land();
-  if (land_result != Action::Result::Success) {
-    std::cerr << "Landing failed: " << land_result << '\n';
+  if (!lifecycle.land()) {
     return 1;
   }
-
-  // Check if vehicle is still in air
-  while (telemetry.in_air()) {
-    std::cout << "Vehicle is landing...\n";
-    sleep_for(seconds(1));
-  }
-  std::cout << "Landed!\n";
-
-  // We are relying on auto-disarming but let's keep watching the telemetry for
-  // a bit longer.
-  sleep_for(seconds(3));
-  std::cout << "Finished...\n";
+  std::cout << "Landed and disarmed\n";
+  print_timings(lifecycle.timings());
 
   return 0;
-}
\ No newline at end of file
+}
@@ -5,58 +5,73 @@
 
 #include <chrono>
 #include <cmath>
-#include <future>
 #include <iostream>
 #include <thread>
 
 #include <mavsdk/mavsdk.h>
-#include <mavsdk/plugins/action/action.h>
-#include <mavsdk/plugins/offboard/offboard.h>
 #include <mavsdk/plugins/telemetry/telemetry.h>
 
+#include "flight_recorder.h"
+#include "metrics.h"
+#include "offboard_core.h"
+#include "rate_profile.h"
+#include "telemetry_aggregator.h"
+
 using namespace mavsdk;
 using std::chrono::milliseconds;
 using std::chrono::seconds;
 using std::this_thread::sleep_for;
 
 void usage(const std::string &bin_name) {
-  std::cerr
-      << "Usage : " << bin_name << " <connection_url>\n"
-      << "Connection URL format should be :\n"
-      << " For TCP : tcp://[server_host][:server_port]\n"
-      << " For UDP : udp://[bind_host][:bind_port]\n"
-      << " For Serial : serial:///path/to/serial/dev[:baudrate]\n"
-      << "For example, to connect to the simulator use URL: udp://:14540\n";
+  print_usage(bin_name, std::string("[log_prefix] ") + aggregator_usage);
+  std::cerr << "With a log prefix telemetry is recorded to "
+               "<log_prefix>.NNNN.ofl instead of being printed. With a "
+               "window the fast streams are summarized per window for the "
+               "duration, one line per field: time, field, samples, min, "
+               "max, mean, stddev and rate per second\n";
 }
 
-std::shared_ptr<System> get_system(Mavsdk &mavsdk) {
-  std::cout << "Waiting to discover system...\n";
-  auto prom = std::promise<std::shared_ptr<System>>{};
-  auto fut = prom.get_future();
-
-  // We wait for new systems to be discovered, once we find one that has an
-  // autopilot, we decide to use it.
-  mavsdk.subscribe_on_new_system([&mavsdk, &prom]() {
-    auto system = mavsdk.systems().back();
-
-    if (system->has_autopilot()) {
-      std::cout << "Discovered autopilot\n";
-
-      // Unsubscribe again as we only want to find one system.
-      mavsdk.subscribe_on_new_system(nullptr);
-      prom.set_value(system);
+// Stream at the control rates and print only the window summaries.
+void aggregate(Telemetry &telemetry, const AggregatorOptions &options) {
+  const auto start = TelemetryAggregator::Clock::now();
+  TelemetryAggregator aggregator{start};
+
+  telemetry.subscribe_position_velocity_ned(
+      [&aggregator](Telemetry::PositionVelocityNed sample) {
+        aggregator.record(sample);
+      });
+  telemetry.subscribe_attitude_euler(
+      [&aggregator](Telemetry::EulerAngle sample) {
+        aggregator.record(sample);
+      });
+  telemetry.subscribe_position(
+      [&aggregator](Telemetry::Position sample) { aggregator.record(sample); });
+  telemetry.subscribe_gps_info(
+      [&aggregator](Telemetry::GpsInfo sample) { aggregator.record(sample); });
+  telemetry.subscribe_battery(
+      [&aggregator](Telemetry::Battery sample) { aggregator.record(sample); });
+
+  uint64_t lines = 0;
+  auto window_end = start;
+  while (window_end - start < options.duration) {
+    window_end += options.window;
+    std::this_thread::sleep_until(window_end);
+    const auto window = aggregator.take(window_end);
+    for (const auto &field : window.fields) {
+      lines += field.count > 0 ? 1 : 0;
     }
-  });
-
-  // We usually receive heartbeats at 1Hz, therefore we should find a
-  // system after around 3 seconds max, surely.
-  if (fut.wait_for(seconds(3)) == std::future_status::timeout) {
-    std::cerr << "No autopilot found.\n";
-    return {};
+    print_window(window, start, std::cout);
+    std::cout.flush();
   }
 
-  // Get discovered system now.
-  return fut.get();
+  telemetry.subscribe_position_velocity_ned(nullptr);
+  telemetry.subscribe_attitude_euler(nullptr);
+  telemetry.subscribe_position(nullptr);
+  telemetry.subscribe_gps_info(nullptr);
+  telemetry.subscribe_battery(nullptr);
+
+  std::cout << "Summarized " << aggregator.total_samples() << " samples in "
+            << lines << " lines\n";
 }
 
 //
@@ -66,20 +81,24 @@ std::shared_ptr<System> get_system(Mavsdk &mavsdk) {
 //
 
 int main(int argc, char **argv) {
-  if (argc != 2) {
+  ConnectionOptions options;
+  std::vector<std::string> arguments;
+  AggregatorOptions aggregator_options;
+  if (!parse_arguments(argc, argv, options, arguments) ||
+      !parse_aggregator_arguments(arguments, aggregator_options) ||
+      arguments.size() > 1 ||
+      (!arguments.empty() && aggregator_options.window.count() > 0)) {
     usage(argv[0]);
     return 1;
   }
 
-  Mavsdk mavsdk;
-  ConnectionResult connection_result = mavsdk.add_any_connection(argv[1]);
-
-  if (connection_result != ConnectionResult::Success) {
-    std::cerr << "Connection failed: " << connection_result << '\n';
+  MetricsExporter exporter{metrics(), options.metrics_target};
+  if (!exporter.start()) {
     return 1;
   }
 
-  auto system = get_system(mavsdk);
+  Mavsdk mavsdk;
+  auto system = connect(mavsdk, options);
   if (!system) {
     return 1;
   }
@@ -87,27 +106,78 @@ int main(int argc, char **argv) {
   // Instantiate plugins.
   auto telemetry = Telemetry{system};
 
+  // This prints every stream, so the ones outside the profile keep their
+  // default rates. Summaries are worth taking of the fast control streams.
+  auto profile = aggregator_options.window.count() > 0
+                     ? control_rate_profile()
+                     : monitor_rate_profile();
+  profile.disable_unused = false;
+  DefaultRateRestorer restorer{telemetry, profile};
+  if (!apply_rate_profile(telemetry, profile)) {
+    return 1;
+  }
+
   std::cout << "System is ready\n";
 
-  for (unsigned i = 0; i < 10; ++i) {
-    std::cout << "Position: " << telemetry.position() << '\n';
-    std::cout << "Home Position: " << telemetry.home() << '\n';
-    std::cout << "Attitude: " << telemetry.attitude_quaternion() << '\n';
-    std::cout << "Attitude: " << telemetry.attitude_euler() << '\n';
-    std::cout << "Angular velocity: "
-              << telemetry.attitude_angular_velocity_body() << '\n';
-    std::cout << "Fixed wing metrics: " << telemetry.fixedwing_metrics()
-              << '\n';
-    std::cout << "Ground Truth: " << telemetry.ground_truth() << '\n';
-    std::cout << "Velocity: " << telemetry.velocity_ned() << '\n';
-    std::cout << "GPS Info: " << telemetry.gps_info() << '\n';
-    std::cout << "Battery: " << telemetry.battery() << '\n';
-    std::cout << "Actuators: " << telemetry.actuator_control_target() << '\n';
-    std::cout << "Flight mode: " << telemetry.flight_mode() << '\n';
-    std::cout << "Landed state: " << telemetry.landed_state()
-              << "(in air: " << telemetry.in_air() << ")" << '\n';
-
-    sleep_for(std::chrono::milliseconds(500));
+  if (aggregator_options.window.count() > 0) {
+    aggregate(telemetry, aggregator_options);
+  } else if (!arguments.empty()) {
+    FlightRecorder recorder{arguments[0]};
+    if (!recorder.open()) {
+      return 1;
+    }
+
+    // Record every sample as it arrives instead of formatting snapshots.
+    telemetry.subscribe_position_velocity_ned(
+        [&recorder](Telemetry::PositionVelocityNed sample) {
+          recorder.record(sample);
+        });
+    telemetry.subscribe_attitude_quaternion(
+        [&recorder](Telemetry::Quaternion sample) { recorder.record(sample); });
+    telemetry.subscribe_attitude_euler(
+        [&recorder](Telemetry::EulerAngle sample) { recorder.record(sample); });
+    telemetry.subscribe_battery(
+        [&recorder](Telemetry::Battery sample) { recorder.record(sample); });
+    telemetry.subscribe_gps_info(
+        [&recorder](Telemetry::GpsInfo sample) { recorder.record(sample); });
+    telemetry.subscribe_position(
+        [&recorder](Telemetry::Position sample) { recorder.record(sample); });
+
+    sleep_for(seconds(5));
+
+    telemetry.subscribe_position_velocity_ned(nullptr);
+    telemetry.subscribe_attitude_quaternion(nullptr);
+    telemetry.subscribe_attitude_euler(nullptr);
+    telemetry.subscribe_battery(nullptr);
+    telemetry.subscribe_gps_info(nullptr);
+    telemetry.subscribe_position(nullptr);
+    recorder.close();
+
+    const auto stats = recorder.stats();
+    std::cout << "Recorded " << stats.records << " records, " << stats.bytes
+              << " bytes in " << stats.chunks << " chunks\n";
+  } else {
+    for (unsigned i = 0; i < 10; ++i) {
+      std::cout << "Position: " << telemetry.position() << '\n';
+      std::cout << "Home Position: " << telemetry.home() << '\n';
+      std::cout << "Attitude: " << telemetry.attitude_quaternion() << '\n';
+      std::cout << "Attitude: " << telemetry.attitude_euler() << '\n';
+      std::cout << "Angular velocity: "
+                << telemetry.attitude_angular_velocity_body() << '\n';
+      std::cout << "Fixed wing metrics: " << telemetry.fixedwing_metrics()
+                << '\n';
+      std::cout << "Ground Truth: " << telemetry.ground_truth() << '\n';
+      std::cout << "Velocity: " << telemetry.velocity_ned() << '\n';
+      std::cout << "GPS Info: " << telemetry.gps_info() << '\n';
+      std::cout << "Battery: " << telemetry.battery() << '\n';
+      std::cout << "Actuators: " << telemetry.actuator_control_target()
+                << '\n';
+      std::cout << "Flight mode: " << telemetry.flight_mode() << '\n';
+      std::cout << "Landed state: " << telemetry.landed_state()
+                << "(in air: " << telemetry.in_air() << ")" << '\n';
+
+      sleep_for(std::chrono::milliseconds(500));
+    }
   }
 
   // We are relying on auto-disarming but let's keep watching the telemetry for
@@ -5,58 +5,43 @@
 
 #include <chrono>
 #include <cmath>
-#include <future>
+#include <csignal>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
 #include <thread>
 
 #include <mavsdk/mavsdk.h>
-#include <mavsdk/plugins/action/action.h>
-#include <mavsdk/plugins/offboard/offboard.h>
 #include <mavsdk/plugins/telemetry/telemetry.h>
 
+#include "flight_recorder.h"
+#include "metrics.h"
+#include "offboard_core.h"
+#include "rate_profile.h"
+#include "telemetry_queue.h"
+
 using namespace mavsdk;
 using std::chrono::milliseconds;
 using std::chrono::seconds;
+using std::chrono::steady_clock;
 using std::this_thread::sleep_for;
 
-void usage(const std::string &bin_name) {
-  std::cerr
-      << "Usage : " << bin_name << " <connection_url>\n"
-      << "Connection URL format should be :\n"
-      << " For TCP : tcp://[server_host][:server_port]\n"
-      << " For UDP : udp://[bind_host][:bind_port]\n"
-      << " For Serial : serial:///path/to/serial/dev[:baudrate]\n"
-      << "For example, to connect to the simulator use URL: udp://:14540\n";
-}
-
-std::shared_ptr<System> get_system(Mavsdk &mavsdk) {
-  std::cout << "Waiting to discover system...\n";
-  auto prom = std::promise<std::shared_ptr<System>>{};
-  auto fut = prom.get_future();
-
-  // We wait for new systems to be discovered, once we find one that has an
-  // autopilot, we decide to use it.
-  mavsdk.subscribe_on_new_system([&mavsdk, &prom]() {
-    auto system = mavsdk.systems().back();
+// Requested stream rate unless one is given on the command line.
+constexpr double default_rate_hz = 100.0;
 
-    if (system->has_autopilot()) {
-      std::cout << "Discovered autopilot\n";
+// Samples are queued by the subscription callback and printed in batches.
+constexpr auto batch_period = milliseconds(100);
+constexpr auto report_period = seconds(1);
 
-      // Unsubscribe again as we only want to find one system.
-      mavsdk.subscribe_on_new_system(nullptr);
-      prom.set_value(system);
-    }
-  });
+// Set by SIGINT and SIGTERM, so that the log is closed before exiting.
+volatile std::sig_atomic_t stop_requested = 0;
 
-  // We usually receive heartbeats at 1Hz, therefore we should find a
-  // system after around 3 seconds max, surely.
-  if (fut.wait_for(seconds(3)) == std::future_status::timeout) {
-    std::cerr << "No autopilot found.\n";
-    return {};
-  }
+void request_stop(int) { stop_requested = 1; }
 
-  // Get discovered system now.
-  return fut.get();
+void usage(const std::string &bin_name) {
+  print_usage(bin_name, "[rate_hz] [log_prefix]");
+  std::cerr << "With a log prefix samples are recorded to "
+               "<log_prefix>.NNNN.ofl instead of being printed\n";
 }
 
 //
@@ -66,20 +51,33 @@ std::shared_ptr<System> get_system(Mavsdk &mavsdk) {
 //
 
 int main(int argc, char **argv) {
-  if (argc != 2) {
+  ConnectionOptions options;
+  std::vector<std::string> arguments;
+  if (!parse_arguments(argc, argv, options, arguments) ||
+      arguments.size() > 2) {
     usage(argv[0]);
     return 1;
   }
 
-  Mavsdk mavsdk;
-  ConnectionResult connection_result = mavsdk.add_any_connection(argv[1]);
+  const double rate_hz = arguments.empty()
+                             ? default_rate_hz
+                             : std::strtod(arguments[0].c_str(), nullptr);
 
-  if (connection_result != ConnectionResult::Success) {
-    std::cerr << "Connection failed: " << connection_result << '\n';
+  std::unique_ptr<FlightRecorder> recorder;
+  if (arguments.size() == 2) {
+    recorder = std::make_unique<FlightRecorder>(arguments[1]);
+    if (!recorder->open()) {
+      return 1;
+    }
+  }
+
+  MetricsExporter exporter{metrics(), options.metrics_target};
+  if (!exporter.start()) {
     return 1;
   }
 
-  auto system = get_system(mavsdk);
+  Mavsdk mavsdk;
+  auto system = connect(mavsdk, options);
   if (!system) {
     return 1;
   }
@@ -87,13 +85,73 @@ int main(int argc, char **argv) {
   // Instantiate plugins.
   auto telemetry = Telemetry{system};
 
-  std::cout << "System is ready\n";
+  // Only the position is needed, everything else is switched off.
+  RateProfile profile{};
+  profile.name = "read_position";
+  profile.rates = {{Stream::PositionVelocityNed, rate_hz}};
+  DefaultRateRestorer restorer{telemetry, profile};
+  if (!apply_rate_profile(telemetry, profile)) {
+    return 1;
+  }
 
-  for (;;) {
+  // Samples arrive on the MAVSDK callback thread and wait in the queue until
+  // the next batch is printed. When recording they are written straight from
+  // the callback so the record timestamp is the arrival time.
+  TelemetryQueue<Telemetry::PositionVelocityNed> queue;
+  Counter &received = metrics().counter("telemetry.position_velocity_ned");
+  telemetry.subscribe_position_velocity_ned(
+      [&queue, &recorder, &received](Telemetry::PositionVelocityNed sample) {
+        received.add();
+        queue.push(sample);
+        if (recorder) {
+          recorder->record(sample);
+        }
+      });
+
+  std::signal(SIGINT, request_stop);
+  std::signal(SIGTERM, request_stop);
+  std::cout << "System is ready\n";
 
-    std::cout << "Attitude euler: " << telemetry.position_velocity_ned()
-              << '\n';
+  auto last_report = steady_clock::now();
+  auto last_stats = queue.stats();
+
+  while (!stop_requested) {
+    sleep_for(batch_period);
+
+    queue.drain([&recorder](const Telemetry::PositionVelocityNed &sample) {
+      if (!recorder) {
+        std::cout << "Position velocity NED: " << sample << '\n';
+      }
+    });
+
+    const auto now = steady_clock::now();
+    if (now - last_report >= report_period) {
+      const auto stats = queue.stats();
+      const double elapsed_s =
+          std::chrono::duration<double>(now - last_report).count();
+      const auto fresh = (stats.received - stats.duplicates) -
+                         (last_stats.received - last_stats.duplicates);
+
+      std::cout << "Delivered " << fresh / elapsed_s << " Hz of "
+                << rate_hz << " Hz requested (received " << stats.received
+                << ", duplicates " << stats.duplicates << ", dropped "
+                << stats.dropped << ")\n";
+      if (recorder) {
+        const auto recorder_stats = recorder->stats();
+        std::cout << "Recorded " << recorder_stats.records << " records, "
+                  << recorder_stats.bytes << " bytes in "
+                  << recorder_stats.chunks << " chunks\n";
+      }
+
+      last_report = now;
+      last_stats = stats;
+    }
+  }
 
-    sleep_for(std::chrono::milliseconds(10));
+  // No more records once the chunk is truncated to its length.
+  telemetry.subscribe_position_velocity_ned(nullptr);
+  if (recorder) {
+    recorder->close();
   }
+  return 0;
 }
\ No newline at end of file
@@ -0,0 +1,469 @@
+//
+// Replays a recorded flight through the mission sequencing and the cascaded
+// controller in simulated time, no vehicle needed.
+//
+// Every parameter set flies the mission plan against the recorded telemetry
+// with the same leg rule as WaypointSequencer and the same CascadeSource as
+// offboard_attitude_control. Sweeps over several sets run in parallel, one
+// replay per core.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cascade_controller.h"
+#include "mission_plan.h"
+#include "replay.h"
+#include "trajectory.h"
+#include "vehicle_state.h"
+#include "waypoint_sequencer.h"
+
+using namespace mavsdk;
+using Clock = ReplayLog::Clock;
+
+// As often as WaypointSequencer checks for convergence.
+constexpr auto poll_period = std::chrono::milliseconds(20);
+
+void usage(const std::string &bin_name) {
+  std::cerr << "Usage : " << bin_name
+            << " <mission_file> <chunk.ofl> [<chunk.ofl> ...] [--rate <hz>]"
+               " [--skip-s <s>] [--sweep <name>=<value>[,<value>...]]...\n"
+            << "Replays the recorded flight from --skip-s seconds on, "
+               "control ticks at --rate Hz (default "
+            << SetpointStreamer::default_rate_hz << ")\n"
+            << "Every --sweep multiplies the parameter sets, which start "
+               "from the tolerances and limits of the plan. Parameters:\n"
+            << "  position_m speed_m_s settle_timeout_ms max_sample_age_ms\n"
+            << "  max_speed_m_s max_acceleration_m_s2 position_p velocity_p\n"
+            << "  velocity_i max_tilt_deg hover_thrust\n"
+            << "Take-off and landing are not replayed; timed and external "
+               "steps hold position for their duration\n";
+}
+
+struct ReplayParameters {
+  ConvergenceTolerances tolerances{};
+  TrajectoryLimits limits{};
+  CascadeGains gains{};
+  // The swept values, e.g. "position_m=0.1".
+  std::string label{};
+};
+
+struct Parameter {
+  const char *name;
+  void (*apply)(ReplayParameters &parameters, double value);
+};
+
+// Horizontal gains are swept together, the vertical ones are left alone.
+const Parameter parameters[] = {
+    {"position_m",
+     [](ReplayParameters &p, double v) {
+       p.tolerances.position_m = static_cast<float>(v);
+     }},
+    {"speed_m_s",
+     [](ReplayParameters &p, double v) {
+       p.tolerances.speed_m_s = static_cast<float>(v);
+     }},
+    {"settle_timeout_ms",
+     [](ReplayParameters &p, double v) {
+       p.tolerances.settle_timeout = std::chrono::milliseconds(
+           static_cast<std::chrono::milliseconds::rep>(v));
+     }},
+    {"max_sample_age_ms",
+     [](ReplayParameters &p, double v) {
+       p.tolerances.max_sample_age = std::chrono::milliseconds(
+           static_cast<std::chrono::milliseconds::rep>(v));
+     }},
+    {"max_speed_m_s",
+     [](ReplayParameters &p, double v) {
+       p.limits.max_speed_m_s = static_cast<float>(v);
+     }},
+    {"max_acceleration_m_s2",
+     [](ReplayParameters &p, double v) {
+       p.limits.max_acceleration_m_s2 = static_cast<float>(v);
+     }},
+    {"position_p",
+     [](ReplayParameters &p, double v) {
+       p.gains.position_p[0] = p.gains.position_p[1] = static_cast<float>(v);
+     }},
+    {"velocity_p",
+     [](ReplayParameters &p, double v) {
+       p.gains.velocity_p[0] = p.gains.velocity_p[1] = static_cast<float>(v);
+     }},
+    {"velocity_i",
+     [](ReplayParameters &p, double v) {
+       p.gains.velocity_i[0] = p.gains.velocity_i[1] = static_cast<float>(v);
+     }},
+    {"max_tilt_deg",
+     [](ReplayParameters &p, double v) {
+       p.gains.max_tilt_deg = static_cast<float>(v);
+     }},
+    {"hover_thrust",
+     [](ReplayParameters &p, double v) {
+       p.gains.hover_thrust = static_cast<float>(v);
+     }},
+};
+
+// Multiply `sets` by the values of one `<name>=<value>[,<value>...]` sweep.
+//
+// returns false if the sweep is malformed.
+bool add_sweep(const std::string &sweep, std::vector<ReplayParameters> &sets) {
+  const auto equals = sweep.find('=');
+  const std::string name = sweep.substr(0, equals);
+  const Parameter *parameter = nullptr;
+  for (const auto &candidate : parameters) {
+    if (name == candidate.name) {
+      parameter = &candidate;
+    }
+  }
+  if (equals == std::string::npos || !parameter) {
+    std::cerr << "Unknown sweep " << sweep << '\n';
+    return false;
+  }
+
+  std::vector<std::string> values;
+  std::istringstream list(sweep.substr(equals + 1));
+  for (std::string value; std::getline(list, value, ',');) {
+    char *end = nullptr;
+    std::strtod(value.c_str(), &end);
+    if (value.empty() || *end != '\0') {
+      std::cerr << "Invalid value " << value << " for " << name << '\n';
+      return false;
+    }
+    values.push_back(value);
+  }
+  if (values.empty()) {
+    std::cerr << "No values for " << name << '\n';
+    return false;
+  }
+
+  std::vector<ReplayParameters> swept;
+  swept.reserve(sets.size() * values.size());
+  for (const auto &set : sets) {
+    for (const auto &value : values) {
+      ReplayParameters next = set;
+      parameter->apply(next, std::strtod(value.c_str(), nullptr));
+      next.label += (next.label.empty() ? "" : " ") + name + '=' + value;
+      swept.push_back(next);
+    }
+  }
+  sets = swept;
+  return true;
+}
+
+struct ReplayResult {
+  std::vector<WaypointSequencer::Leg> legs{};
+  size_t converged{0};
+  // false if the log ended before the plan.
+  bool finished{false};
+  Clock::duration mission_time{};
+  uint64_t control_ticks{0};
+  uint64_t stale_steps{0};
+  // Ticks that commanded minimum or maximum thrust.
+  uint64_t saturated_ticks{0};
+  float max_tilt_deg{0.0f};
+  Clock::duration simulated{};
+  Clock::duration wall{};
+};
+
+//
+// Steps through the offboard part of a plan, one control tick at a time.
+//
+class PlanReplay {
+public:
+  PlanReplay(const MissionPlan &plan, const ReplayParameters &parameters,
+             const VehicleState &state)
+      : _plan(plan), _parameters(parameters), _state(state),
+        _controller(state, Waypoint{}, parameters.gains) {}
+
+  // returns false once the plan is done.
+  bool tick(Clock::time_point now) {
+    if (_mission_start == Clock::time_point{}) {
+      _mission_start = now;
+    }
+    while (!_started) {
+      if (_step == _plan.steps.size()) {
+        _result.finished = true;
+        _result.mission_time = now - _mission_start;
+        return false;
+      }
+      if (!start_step(now)) {
+        // Waiting for the first position.
+        return true;
+      }
+    }
+
+    const auto &step = _plan.steps[_step];
+    if (step.kind == MissionStep::Kind::Waypoints) {
+      Setpoint setpoint{};
+      _trajectories[_leg].sample(now - _leg_start, setpoint);
+      control(to_waypoint(setpoint.position_ned), now);
+
+      if (now - _last_poll >= poll_period) {
+        _last_poll = now;
+        if (_monitor->update(_state.read(now), now)) {
+          _result.legs.push_back(_monitor->leg());
+          _result.converged += _monitor->leg().converged ? 1 : 0;
+          if (++_leg < _trajectories.size()) {
+            start_leg(now);
+          } else {
+            next_step();
+          }
+        }
+      }
+    } else {
+      control(_hold, now);
+      if (now - _step_start >= step.duration) {
+        next_step();
+      }
+    }
+    return true;
+  }
+
+  ReplayResult result() {
+    const auto stats = _controller.stats();
+    _result.stale_steps = stats.stale_steps;
+    return _result;
+  }
+
+private:
+  static Waypoint to_waypoint(const Offboard::PositionNedYaw &position) {
+    return {position.north_m, position.east_m, position.down_m,
+            position.yaw_deg};
+  }
+
+  // returns false if the step cannot start yet.
+  bool start_step(Clock::time_point now) {
+    const auto &step = _plan.steps[_step];
+    // Timed and external setpoints are not replayed, but their time is, so
+    // that later steps start when they did in the recorded flight: they
+    // hold like a hold step.
+    if (step.kind == MissionStep::Kind::TakeOff ||
+        step.kind == MissionStep::Kind::Land) {
+      ++_step;
+      return true;
+    }
+
+    const auto sample = _state.read(now);
+    if (!sample.has_position()) {
+      return false;
+    }
+    Waypoint here{};
+    here.north_m = sample.state.position_velocity.position.north_m;
+    here.east_m = sample.state.position_velocity.position.east_m;
+    here.down_m = sample.state.position_velocity.position.down_m;
+    here.yaw_deg = sample.has_attitude() ? sample.state.attitude.yaw_deg : 0.0f;
+
+    _started = true;
+    _step_start = now;
+    _hold = here;
+    if (step.kind == MissionStep::Kind::Waypoints) {
+      // Planned up front from where the vehicle is, as fly() does.
+      _trajectories.clear();
+      Waypoint from = here;
+      for (const auto &waypoint : step.waypoints) {
+        _trajectories.emplace_back(std::vector<Waypoint>{from, waypoint},
+                                   _parameters.limits);
+        from = waypoint;
+      }
+      _leg = 0;
+      start_leg(now);
+    }
+    return true;
+  }
+
+  void start_leg(Clock::time_point now) {
+    const auto &waypoints = _plan.steps[_step].waypoints;
+    _leg_start = now;
+    _last_poll = now;
+    _monitor = std::make_unique<LegMonitor>(waypoints[_leg],
+                                            _trajectories[_leg], now,
+                                            _parameters.tolerances);
+  }
+
+  void next_step() {
+    _started = false;
+    ++_step;
+  }
+
+  void control(const Waypoint &target, Clock::time_point now) {
+    Setpoint setpoint{};
+    _controller.set_target(target);
+    _controller.next(now, setpoint);
+
+    const auto &attitude = setpoint.attitude;
+    ++_result.control_ticks;
+    _result.max_tilt_deg =
+        std::max({_result.max_tilt_deg, std::fabs(attitude.roll_deg),
+                  std::fabs(attitude.pitch_deg)});
+    if (attitude.thrust_value <= _parameters.gains.min_thrust ||
+        attitude.thrust_value >= _parameters.gains.max_thrust) {
+      ++_result.saturated_ticks;
+    }
+  }
+
+  const MissionPlan &_plan;
+  const ReplayParameters &_parameters;
+  const VehicleState &_state;
+  CascadeSource _controller;
+
+  size_t _step{0};
+  bool _started{false};
+  Clock::time_point _mission_start{};
+  Clock::time_point _step_start{};
+  Waypoint _hold{};
+
+  std::vector<Trajectory> _trajectories{};
+  size_t _leg{0};
+  Clock::time_point _leg_start{};
+  Clock::time_point _last_poll{};
+  std::unique_ptr<LegMonitor> _monitor{};
+
+  ReplayResult _result{};
+};
+
+ReplayResult evaluate(const ReplayLog &log, const MissionPlan &plan,
+                      const ReplayParameters &parameters, double rate_hz,
+                      Clock::duration skip) {
+  const auto start = std::chrono::steady_clock::now();
+
+  VehicleState state;
+  PlanReplay run{plan, parameters, state};
+  const uint64_t ticks =
+      replay(log, state, rate_hz,
+             [&run](Clock::time_point tick) { return run.tick(tick); }, skip);
+
+  ReplayResult result = run.result();
+  result.simulated = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(static_cast<double>(ticks) / rate_hz));
+  result.wall = std::chrono::steady_clock::now() - start;
+  return result;
+}
+
+void print_result(size_t index, const ReplayParameters &parameters,
+                  const ReplayResult &result) {
+  const double ticks = static_cast<double>(result.control_ticks);
+  std::cout << "Set " << index + 1
+            << (parameters.label.empty() ? "" : " (" + parameters.label + ")")
+            << ": " << result.converged << '/' << result.legs.size()
+            << " legs converged, ";
+  if (result.finished) {
+    std::cout << "mission "
+              << std::chrono::duration<double>(result.mission_time).count()
+              << " s, ";
+  } else {
+    std::cout << "log ended first, ";
+  }
+  std::cout << "max tilt " << result.max_tilt_deg << " deg, thrust saturated "
+            << (ticks > 0 ? 100.0 * result.saturated_ticks / ticks : 0.0)
+            << " %, " << result.stale_steps << " stale steps, replayed "
+            << std::chrono::duration<double>(result.simulated).count()
+            << " s in "
+            << std::chrono::duration<double>(result.wall).count() << " s\n";
+}
+
+int main(int argc, char **argv) {
+  std::vector<std::string> files;
+  std::vector<std::string> sweeps;
+  double rate_hz = SetpointStreamer::default_rate_hz;
+  double skip_s = 0.0;
+  for (int i = 1; i < argc; ++i) {
+    const std::string argument = argv[i];
+    if (argument == "--rate" || argument == "--skip-s" ||
+        argument == "--sweep") {
+      if (i + 1 >= argc) {
+        std::cerr << argument << " needs a value\n";
+        usage(argv[0]);
+        return 1;
+      }
+      const std::string value = argv[++i];
+      if (argument == "--sweep") {
+        sweeps.push_back(value);
+      } else if (argument == "--rate") {
+        rate_hz = std::strtod(value.c_str(), nullptr);
+      } else {
+        skip_s = std::strtod(value.c_str(), nullptr);
+      }
+    } else {
+      files.push_back(argument);
+    }
+  }
+  if (files.size() < 2 || rate_hz <= 0.0 || skip_s < 0.0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  MissionPlan plan{};
+  if (!load_mission_plan(files[0], plan)) {
+    return 1;
+  }
+
+  std::vector<ReplayParameters> sets(1);
+  sets[0].tolerances = plan.tolerances;
+  sets[0].limits = plan.limits;
+  for (const auto &sweep : sweeps) {
+    if (!add_sweep(sweep, sets)) {
+      return 1;
+    }
+  }
+
+  const auto load_start = std::chrono::steady_clock::now();
+  ReplayLog log{};
+  if (!load_replay_log({files.begin() + 1, files.end()}, log)) {
+    return 1;
+  }
+  std::cout << "Loaded " << log.events.size() << " samples, "
+            << std::chrono::duration<double>(log.duration()).count()
+            << " s of flight, in "
+            << std::chrono::duration<double>(
+                   std::chrono::steady_clock::now() - load_start)
+                   .count()
+            << " s\n";
+
+  const auto skip = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(skip_s));
+
+  // The log and the plan are shared read-only, each replay has its own
+  // vehicle state and controller.
+  std::vector<ReplayResult> results(sets.size());
+  std::atomic<size_t> next{0};
+  const auto worker = [&]() {
+    for (size_t i = next.fetch_add(1); i < sets.size();
+         i = next.fetch_add(1)) {
+      results[i] = evaluate(log, plan, sets[i], rate_hz, skip);
+    }
+  };
+
+  const unsigned workers = static_cast<unsigned>(std::min<size_t>(
+      std::max(1u, std::thread::hardware_concurrency()), sets.size()));
+  const auto sweep_start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < workers; ++i) {
+    threads.emplace_back(worker);
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  const double sweep_s = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - sweep_start)
+                             .count();
+
+  for (size_t i = 0; i < sets.size(); ++i) {
+    print_result(i, sets[i], results[i]);
+  }
+  if (sets.size() == 1) {
+    print_legs(results[0].legs);
+  }
+  std::cout << sets.size() << " parameter sets on " << workers
+            << " threads in " << sweep_s << " s\n";
+
+  return 0;
+}
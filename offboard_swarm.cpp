@@ -0,0 +1,295 @@
+//
+// Drives several vehicles from one process: every vehicle flies the NED
+// square of offboard_position_control on its own thread.
+//
+// With --sweep nothing is armed. Setpoints are only streamed to 1, 2, 4, ...
+// vehicles in turn to show how the setpoint rate and telemetry delivery hold
+// up as the vehicle count grows.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <mavsdk/mavsdk.h>
+#include <mavsdk/plugins/action/action.h>
+#include <mavsdk/plugins/offboard/offboard.h>
+#include <mavsdk/plugins/telemetry/telemetry.h>
+
+#include "metrics.h"
+#include "offboard_core.h"
+#include "vehicle_fleet.h"
+
+using namespace mavsdk;
+using std::chrono::seconds;
+using std::this_thread::sleep_for;
+
+constexpr double telemetry_rate_hz = 50.0;
+constexpr auto sweep_duration = seconds(10);
+
+void usage(const std::string &bin_name) {
+  print_usage(bin_name,
+              std::string("<vehicle_count> [--sweep] [--separation <m>] ") +
+                  fence_usage + " [extra_connection_url ...]");
+  std::cerr << "PX4 SITL instances usually need one URL each, for example "
+               "udp://:14540 udp://:14541\n"
+            << "With --separation setpoints that come closer than that to "
+               "another vehicle are held back, which needs all vehicles in "
+               "one local frame\n";
+}
+
+//
+// Flies the NED square of offb_ctrl_ned() on one vehicle.
+//
+// returns true if everything went well.
+//
+bool fly_square(Vehicle &vehicle) {
+  const auto arm_result = vehicle.action.arm();
+  if (arm_result != Action::Result::Success) {
+    std::ostringstream message;
+    message << "Arming failed: " << arm_result;
+    vehicle.log(message.str());
+    return false;
+  }
+
+  const auto takeoff_result = vehicle.action.takeoff();
+  if (takeoff_result != Action::Result::Success) {
+    std::ostringstream message;
+    message << "Takeoff failed: " << takeoff_result;
+    vehicle.log(message.str());
+    return false;
+  }
+  sleep_for(seconds(8));
+
+  // Stream it before starting offboard, otherwise it will be rejected.
+  if (!vehicle.streamer.start(
+          Setpoint::make_velocity_ned(Offboard::VelocityNedYaw{}))) {
+    return false;
+  }
+  if (vehicle.offboard.start() != Offboard::Result::Success) {
+    vehicle.log("Offboard start failed");
+    vehicle.streamer.stop();
+    return false;
+  }
+  vehicle.log("Offboard started");
+
+  const float square[][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}, {0, 0}};
+  for (const auto &corner : square) {
+    Offboard::PositionNedYaw position{};
+    position.north_m = corner[0];
+    position.east_m = corner[1];
+    position.down_m = -2.0f;
+    vehicle.streamer.set_target(Setpoint::make_position_ned(position));
+    sleep_for(seconds(4));
+  }
+
+  vehicle.offboard.stop();
+  vehicle.streamer.stop();
+
+  if (vehicle.action.land() != Action::Result::Success) {
+    vehicle.log("Landing failed");
+    return false;
+  }
+  while (vehicle.telemetry.in_air()) {
+    sleep_for(seconds(1));
+  }
+  vehicle.log("Landed");
+
+  return true;
+}
+
+//
+// Streams a neutral setpoint without arming, for measuring only.
+//
+bool stream_only(Vehicle &vehicle) {
+  vehicle.position_arrivals.reset();
+  if (!vehicle.streamer.start(
+          Setpoint::make_velocity_ned(Offboard::VelocityNedYaw{}))) {
+    return false;
+  }
+  sleep_for(sweep_duration);
+  vehicle.streamer.stop();
+  return true;
+}
+
+struct ScalingRow {
+  size_t vehicles{0};
+  double min_setpoint_hz{0.0};
+  double mean_setpoint_hz{0.0};
+  // Repeats held back until a heartbeat, per vehicle.
+  double mean_suppressed_hz{0.0};
+  uint64_t overruns{0};
+  int64_t max_lateness_us{0};
+  double min_telemetry_hz{0.0};
+  double mean_telemetry_hz{0.0};
+  int64_t max_telemetry_gap_us{0};
+};
+
+ScalingRow measure(VehicleFleet &fleet, const std::map<uint8_t, bool> &ran,
+                   double duration_s) {
+  ScalingRow row{};
+  row.vehicles = ran.size();
+  row.min_setpoint_hz = 1e9;
+  row.min_telemetry_hz = 1e9;
+
+  for (const auto &entry : ran) {
+    Vehicle &vehicle = fleet.at(entry.first);
+    const auto streamer = vehicle.streamer.stats();
+    const auto arrivals = vehicle.position_arrivals.stats();
+
+    // What went on the link, not the ticks: repeats and superseded targets
+    // never reach the vehicle.
+    const double setpoint_hz = static_cast<double>(streamer.sent) / duration_s;
+    const double suppressed_hz =
+        static_cast<double>(streamer.suppressed) / duration_s;
+    const double telemetry_hz =
+        static_cast<double>(arrivals.samples) / duration_s;
+
+    row.min_setpoint_hz = std::min(row.min_setpoint_hz, setpoint_hz);
+    row.mean_setpoint_hz += setpoint_hz / static_cast<double>(ran.size());
+    row.mean_suppressed_hz += suppressed_hz / static_cast<double>(ran.size());
+    row.overruns += streamer.overruns;
+    row.max_lateness_us =
+        std::max<int64_t>(row.max_lateness_us, streamer.max_lateness.count());
+    row.min_telemetry_hz = std::min(row.min_telemetry_hz, telemetry_hz);
+    row.mean_telemetry_hz += telemetry_hz / static_cast<double>(ran.size());
+    row.max_telemetry_gap_us =
+        std::max<int64_t>(row.max_telemetry_gap_us, arrivals.max_gap.count());
+  }
+  return row;
+}
+
+void print_scaling(const std::vector<ScalingRow> &rows, double rate_hz) {
+  std::cout << "Setpoints ticked at " << rate_hz << " Hz, telemetry at "
+            << telemetry_rate_hz << " Hz\n"
+            << "vehicles  sent Hz min/mean  suppressed Hz  overruns  "
+               "max late us  telemetry Hz min/mean  max gap ms\n"
+            << std::fixed << std::setprecision(1);
+
+  for (const auto &row : rows) {
+    std::cout << std::setw(8) << row.vehicles << "  " << std::setw(7)
+              << row.min_setpoint_hz << '/' << std::setw(8)
+              << row.mean_setpoint_hz << "  " << std::setw(13)
+              << row.mean_suppressed_hz << "  " << std::setw(8) << row.overruns
+              << "  " << std::setw(11) << row.max_lateness_us << "  "
+              << std::setw(10) << row.min_telemetry_hz << '/' << std::setw(10)
+              << row.mean_telemetry_hz << "  " << std::setw(10)
+              << row.max_telemetry_gap_us / 1000.0 << '\n';
+  }
+}
+
+int main(int argc, char **argv) {
+  ConnectionOptions options;
+  std::vector<std::string> arguments;
+  Geofence fence;
+  if (!parse_arguments(argc, argv, options, arguments) ||
+      !parse_fence_arguments(arguments, fence) || arguments.empty()) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  const auto vehicle_count =
+      static_cast<size_t>(std::strtoul(arguments[0].c_str(), nullptr, 10));
+  if (vehicle_count == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  bool sweep = false;
+  float separation_m = 0.0f;
+  std::vector<std::string> connection_urls{options.connection_url};
+  for (size_t i = 1; i < arguments.size(); ++i) {
+    if (arguments[i] == "--sweep") {
+      sweep = true;
+    } else if (arguments[i] == "--separation") {
+      if (i + 1 >= arguments.size()) {
+        std::cerr << "--separation needs a value\n";
+        return 1;
+      }
+      separation_m = std::strtof(arguments[++i].c_str(), nullptr);
+    } else {
+      connection_urls.push_back(arguments[i]);
+    }
+  }
+
+  MetricsExporter exporter{metrics(), options.metrics_target};
+  if (!exporter.start()) {
+    return 1;
+  }
+
+  Mavsdk mavsdk;
+  for (const auto &url : connection_urls) {
+    ConnectionResult connection_result = mavsdk.add_any_connection(url);
+    if (connection_result != ConnectionResult::Success) {
+      std::cerr << "Connection to " << url << " failed: " << connection_result
+                << '\n';
+      return 1;
+    }
+  }
+
+  const auto systems = get_systems(mavsdk, vehicle_count, options);
+  if (systems.size() < vehicle_count) {
+    std::cerr << "Only found " << systems.size() << " of " << vehicle_count
+              << " autopilots\n";
+    return 1;
+  }
+
+  VehicleFleet fleet{systems, SetpointStreamer::default_rate_hz};
+  if (!fleet.guard(fence, separation_m)) {
+    return 1;
+  }
+  fleet.for_each([](Vehicle &vehicle) {
+    if (vehicle.telemetry.set_rate_position_velocity_ned(telemetry_rate_hz) !=
+        Telemetry::Result::Success) {
+      vehicle.log("Setting telemetry rate failed");
+    }
+  });
+
+  if (sweep) {
+    std::vector<ScalingRow> rows;
+    for (size_t count = 1;; count = std::min(count * 2, fleet.size())) {
+      std::cout << "Streaming to " << count << " vehicles\n";
+      const auto ran = fleet.run(stream_only, count);
+      rows.push_back(measure(fleet, ran,
+                             std::chrono::duration<double>(sweep_duration)
+                                 .count()));
+      if (count == fleet.size()) {
+        break;
+      }
+    }
+    print_scaling(rows, SetpointStreamer::default_rate_hz);
+    return 0;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  const auto results = fleet.run(fly_square);
+  const double duration_s =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+
+  bool all_succeeded = true;
+  for (const auto &result : results) {
+    all_succeeded = all_succeeded && result.second;
+  }
+  fleet.for_each([](Vehicle &vehicle) {
+    const auto stats = vehicle.guard->stats();
+    std::ostringstream message;
+    message << "Geofence: " << stats.checks << " setpoints checked, "
+            << stats.breaches << " held back";
+    if (stats.breaches > 0) {
+      message << ", last one " << to_string(stats.last_breach);
+    }
+    vehicle.log(message.str());
+  });
+  std::cout << (all_succeeded ? "All missions succeeded" : "Missions failed")
+            << " in " << duration_s << " s\n";
+
+  return all_succeeded ? 0 : 1;
+}
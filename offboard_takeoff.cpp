@@ -4,73 +4,38 @@
 
 #include <chrono>
 #include <cstdint>
-#include <future>
 #include <iostream>
 #include <mavsdk/mavsdk.h>
 #include <mavsdk/plugins/action/action.h>
 #include <mavsdk/plugins/telemetry/telemetry.h>
 #include <memory>
 #include <thread>
+#include <vector>
+
+#include "metrics.h"
+#include "mission_lifecycle.h"
+#include "offboard_core.h"
+#include "rate_profile.h"
 
 using namespace mavsdk;
 using std::chrono::seconds;
 using std::this_thread::sleep_for;
 
-void usage(const std::string &bin_name) {
-  std::cerr
-      << "Usage : " << bin_name << " <connection_url>\n"
-      << "Connection URL format should be :\n"
-      << " For TCP : tcp://[server_host][:server_port]\n"
-      << " For UDP : udp://[bind_host][:bind_port]\n"
-      << " For Serial : serial:///path/to/serial/dev[:baudrate]\n"
-      << "For example, to connect to the simulator use URL: udp://:14540\n";
-}
-
-std::shared_ptr<System> get_system(Mavsdk &mavsdk) {
-  std::cout << "Waiting to discover system...\n";
-  auto prom = std::promise<std::shared_ptr<System>>{};
-  auto fut = prom.get_future();
-
-  // We wait for new systems to be discovered, once we find one that has an
-  // autopilot, we decide to use it.
-  mavsdk.subscribe_on_new_system([&mavsdk, &prom]() {
-    auto system = mavsdk.systems().back();
-
-    if (system->has_autopilot()) {
-      std::cout << "Discovered autopilot\n";
-
-      // Unsubscribe again as we only want to find one system.
-      mavsdk.subscribe_on_new_system(nullptr);
-      prom.set_value(system);
-    }
-  });
-
-  // We usually receive heartbeats at 1Hz, therefore we should find a
-  // system after around 3 seconds max, surely.
-  if (fut.wait_for(seconds(3)) == std::future_status::timeout) {
-    std::cerr << "No autopilot found.\n";
-    return {};
-  }
-
-  // Get discovered system now.
-  return fut.get();
-}
-
 int main(int argc, char **argv) {
-  if (argc != 2) {
-    usage(argv[0]);
+  ConnectionOptions options;
+  std::vector<std::string> arguments;
+  if (!parse_arguments(argc, argv, options, arguments) || !arguments.empty()) {
+    print_usage(argv[0]);
     return 1;
   }
 
-  Mavsdk mavsdk;
-  ConnectionResult connection_result = mavsdk.add_any_connection(argv[1]);
-
-  if (connection_result != ConnectionResult::Success) {
-    std::cerr << "Connection failed: " << connection_result << '\n';
+  MetricsExporter exporter{metrics(), options.metrics_target};
+  if (!exporter.start()) {
     return 1;
   }
 
-  auto system = get_system(mavsdk);
+  Mavsdk mavsdk;
+  auto system = connect(mavsdk, options);
   if (!system) {
     return 1;
   }
@@ -79,38 +44,30 @@ int main(int argc, char **argv) {
   auto telemetry = Telemetry{system};
   auto action = Action{system};
 
-  // We want to listen to the altitude of the drone at 1 Hz.
-  const auto set_rate_result = telemetry.set_rate_position(1.0);
-  if (set_rate_result != Telemetry::Result::Success) {
-    std::cerr << "Setting rate failed: " << set_rate_result << '\n';
-    return 1;
-  }
+  auto lifecycle = MissionLifecycle{action, telemetry};
+
+  // We want to listen to the altitude of the drone at 1 Hz. The landed
+  // state drives the take-off and landing events.
+  RateProfile profile{};
+  profile.name = "takeoff";
+  profile.rates = {{Stream::Position, 1.0}, {Stream::LandedState, 10.0}};
 
   // Set up callback to monitor altitude while the vehicle is in flight
   telemetry.subscribe_position([](Telemetry::Position position) {
     std::cout << "Altitude: " << position.relative_altitude_m << " m\n";
   });
 
-  // // Check until vehicle is ready to arm
-  // while (telemetry.health_all_ok() != true) {
-  //   std::cout << "Vehicle is getting ready to arm\n";
-  //   sleep_for(seconds(1));
-  // }
-
-  // Arm vehicle
-  std::cout << "Arming...\n";
-  const Action::Result arm_result = action.arm();
+  DefaultRateRestorer restorer{telemetry, profile};
 
-  if (arm_result != Action::Result::Success) {
-    std::cerr << "Arming failed: " << arm_result << '\n';
+  // Rates, health and home position are waited for at the same time.
+  if (!lifecycle.prepare(rate_requests(profile))) {
+    print_readiness(lifecycle.readiness());
     return 1;
   }
+  print_readiness(lifecycle.readiness());
 
-  // Take off
   std::cout << "Taking off...\n";
-  const Action::Result takeoff_result = action.takeoff();
-  if (takeoff_result != Action::Result::Success) {
-    std::cerr << "Takeoff failed: " << takeoff_result << '\n';
+  if (!lifecycle.take_off()) {
     return 1;
   }
 
@@ -118,23 +75,14 @@ int main(int argc, char **argv) {
   sleep_for(seconds(8));
 
   std::cout << "Landing...\n";
-  const Action::Result land_result = action.land();
-  if (land_result != Action::Result::Success) {
-    std::cerr << "Land failed: " << land_result << '\n';
+  if (!lifecycle.land()) {
     return 1;
   }
-
-  // Check if vehicle is still in air
-  while (telemetry.in_air()) {
-    std::cout << "Vehicle is landing...\n";
-    sleep_for(seconds(1));
-  }
   std::cout << "Landed!\n";
+  print_timings(lifecycle.timings());
 
-  // We are relying on auto-disarming but let's keep watching the telemetry for
-  // a bit longer.
-  sleep_for(seconds(3));
+  telemetry.subscribe_position(nullptr);
   std::cout << "Finished...\n";
 
   return 0;
-}
\ No newline at end of file
+}
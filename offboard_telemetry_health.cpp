@@ -5,60 +5,26 @@
 
 #include <chrono>
 #include <cmath>
-#include <future>
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
+#include <optional>
 #include <thread>
 
 #include <mavsdk/mavsdk.h>
-#include <mavsdk/plugins/action/action.h>
-#include <mavsdk/plugins/mocap/mocap.h>
-#include <mavsdk/plugins/offboard/offboard.h>
 #include <mavsdk/plugins/telemetry/telemetry.h>
 
+#include "metrics.h"
+#include "offboard_core.h"
+#include "rate_profile.h"
+#include "readiness_monitor.h"
+
 using namespace mavsdk;
 using std::chrono::milliseconds;
 using std::chrono::seconds;
 using std::this_thread::sleep_for;
 
-void usage(const std::string &bin_name) {
-  std::cerr
-      << "Usage : " << bin_name << " <connection_url>\n"
-      << "Connection URL format should be :\n"
-      << " For TCP : tcp://[server_host][:server_port]\n"
-      << " For UDP : udp://[bind_host][:bind_port]\n"
-      << " For Serial : serial:///path/to/serial/dev[:baudrate]\n"
-      << "For example, to connect to the simulator use URL: udp://:14540\n";
-}
-
-std::shared_ptr<System> get_system(Mavsdk &mavsdk) {
-  std::cout << "Waiting to discover system...\n";
-  auto prom = std::promise<std::shared_ptr<System>>{};
-  auto fut = prom.get_future();
-
-  // We wait for new systems to be discovered, once we find one that has an
-  // autopilot, we decide to use it.
-  mavsdk.subscribe_on_new_system([&mavsdk, &prom]() {
-    auto system = mavsdk.systems().back();
-
-    if (system->has_autopilot()) {
-      std::cout << "Discovered autopilot\n";
-
-      // Unsubscribe again as we only want to find one system.
-      mavsdk.subscribe_on_new_system(nullptr);
-      prom.set_value(system);
-    }
-  });
-
-  // We usually receive heartbeats at 1Hz, therefore we should find a
-  // system after around 3 seconds max, surely.
-  if (fut.wait_for(seconds(3)) == std::future_status::timeout) {
-    std::cerr << "No autopilot found.\n";
-    return {};
-  }
-
-  // Get discovered system now.
-  return fut.get();
-}
+constexpr auto readiness_timeout = seconds(30);
 
 // Check telemetry health
 void print_health(Telemetry::Health health) {
@@ -88,29 +54,61 @@ void print_rc_status(Telemetry::RcStatus rc_status) {
   std::cout << "RC RSSI: " << rc_status.signal_strength_percent << '\n';
 }
 
+void usage(const std::string &bin_name) {
+  print_usage(bin_name, "[control|monitor]");
+  std::cerr << "Given a rate profile, it is applied first and the delivered "
+               "stream rates are checked against it. Then the health flags "
+               "are timed until the vehicle is ready to arm\n";
+}
+
 int main(int argc, char **argv) {
-  if (argc != 2) {
+  ConnectionOptions options;
+  std::vector<std::string> arguments;
+  if (!parse_arguments(argc, argv, options, arguments) ||
+      arguments.size() > 1) {
     usage(argv[0]);
     return 1;
   }
 
-  Mavsdk mavsdk;
-  ConnectionResult connection_result = mavsdk.add_any_connection(argv[1]);
+  RateProfile profile{};
+  if (!arguments.empty()) {
+    if (arguments[0] == "control") {
+      profile = control_rate_profile();
+    } else if (arguments[0] == "monitor") {
+      profile = monitor_rate_profile();
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
 
-  if (connection_result != ConnectionResult::Success) {
-    std::cerr << "Connection failed: " << connection_result << '\n';
+  MetricsExporter exporter{metrics(), options.metrics_target};
+  if (!exporter.start()) {
     return 1;
   }
 
-  auto system = get_system(mavsdk);
+  Mavsdk mavsdk;
+  auto system = connect(mavsdk, options);
   if (!system) {
     return 1;
   }
 
   // Instantiate plugins.
   auto telemetry = Telemetry{system};
-  auto mocap = Mocap{system};
   std::cout << "System is ready\n";
+
+  std::optional<DefaultRateRestorer> restorer;
+  // Measured before subscribing below, measuring takes over the streams.
+  if (!profile.rates.empty()) {
+    restorer.emplace(telemetry, profile);
+    if (!apply_rate_profile(telemetry, profile)) {
+      return 1;
+    }
+    std::cout << "Rate profile " << profile.name << ":\n";
+    if (!print_delivered_rates(measure_rates(telemetry, profile))) {
+      std::cerr << "Some streams are slower than requested\n";
+    }
+  }
   sleep_for(seconds(1));
 
   // // // Send mocap command to Mavsdk
@@ -143,17 +141,36 @@ int main(int argc, char **argv) {
   //   sleep_for(std::chrono::milliseconds(50));
   // }
 
-  // Subscribe telemetry health
-  telemetry.subscribe_health(std::bind(&print_health, std::placeholders::_1));
-  telemetry.subscribe_rc_status(
-      std::bind(&print_rc_status, std::placeholders::_1));
-  sleep_for(std::chrono::seconds(3));
+  // Time every health flag until the vehicle is ready, or give up.
+  std::mutex mutex;
+  std::condition_variable ready;
+  ReadinessMonitor readiness;
+  Telemetry::Health health{};
+  Telemetry::RcStatus rc_status{};
+  telemetry.subscribe_health([&](Telemetry::Health update) {
+    std::lock_guard<std::mutex> lock(mutex);
+    health = update;
+    if (readiness.update(update)) {
+      ready.notify_all();
+    }
+  });
+  telemetry.subscribe_rc_status([&](Telemetry::RcStatus update) {
+    std::lock_guard<std::mutex> lock(mutex);
+    rc_status = update;
+  });
 
-  sleep_for(std::chrono::milliseconds(500));
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    ready.wait_for(lock, readiness_timeout,
+                   [&readiness]() { return readiness.ready(); });
+  }
+  telemetry.subscribe_health(nullptr);
+  telemetry.subscribe_rc_status(nullptr);
 
-  // We are relying on auto-disarming but let's keep watching the telemetry for
-  // a bit longer.
-  sleep_for(seconds(1));
+  std::lock_guard<std::mutex> lock(mutex);
+  print_health(health);
+  print_rc_status(rc_status);
+  print_readiness(readiness);
   std::cout << "Finished...\n";
 
   return 0;
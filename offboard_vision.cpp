@@ -5,115 +5,173 @@
 
 #include <chrono>
 #include <cmath>
-#include <future>
+#include <cstdlib>
 #include <iostream>
 #include <thread>
 
 #include <mavsdk/mavsdk.h>
-#include <mavsdk/plugins/action/action.h>
 #include <mavsdk/plugins/mocap/mocap.h>
-#include <mavsdk/plugins/offboard/offboard.h>
 #include <mavsdk/plugins/telemetry/telemetry.h>
 
+#include "metrics.h"
+#include "offboard_core.h"
+#include "realtime.h"
+#include "time_sync.h"
+#include "vision_bridge.h"
+
 using namespace mavsdk;
 using std::chrono::milliseconds;
 using std::chrono::seconds;
 using std::this_thread::sleep_for;
 
-void usage(const std::string &bin_name) {
-  std::cerr
-      << "Usage : " << bin_name << " <connection_url>\n"
-      << "Connection URL format should be :\n"
-      << " For TCP : tcp://[server_host][:server_port]\n"
-      << " For UDP : udp://[bind_host][:bind_port]\n"
-      << " For Serial : serial:///path/to/serial/dev[:baudrate]\n"
-      << "For example, to connect to the simulator use URL: udp://:14540\n";
-}
-
-std::shared_ptr<System> get_system(Mavsdk &mavsdk) {
-  std::cout << "Waiting to discover system...\n";
-  auto prom = std::promise<std::shared_ptr<System>>{};
-  auto fut = prom.get_future();
+constexpr unsigned jitter_report_period_s = 10;
+// HIGHRES_IMU carries the autopilot's microsecond boot time, which is what
+// the clocks are aligned on.
+constexpr double time_sync_rate_hz = 50.0;
 
-  // We wait for new systems to be discovered, once we find one that has an
-  // autopilot, we decide to use it.
-  mavsdk.subscribe_on_new_system([&mavsdk, &prom]() {
-    auto system = mavsdk.systems().back();
+uint64_t monotonic_time_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
 
-    if (system->has_autopilot()) {
-      std::cout << "Discovered autopilot\n";
+void usage(const std::string &bin_name) {
+  print_usage(bin_name,
+              std::string("[pose_port | --shm <ring> [--busy-poll]] "
+                          "[--capture-latency-ms <ms>] ") +
+                  realtime_usage);
+  std::cerr << "Poses are received as UDP datagrams on port "
+            << VisionBridge::default_port
+            << " unless another port is given, or read from a shared-memory "
+               "ring such as "
+            << default_pose_ring << " (see shm_records.h)\n"
+            << "Estimates are stamped in autopilot time with the arrival "
+               "time of each pose, less the source's capture latency\n";
+}
 
-      // Unsubscribe again as we only want to find one system.
-      mavsdk.subscribe_on_new_system(nullptr);
-      prom.set_value(system);
+// Take --shm <ring>, --busy-poll and --capture-latency-ms <ms> out of
+// `arguments`.
+//
+// returns false if an option has no value.
+bool parse_source_arguments(std::vector<std::string> &arguments,
+                            std::string &ring, bool &busy_poll,
+                            std::chrono::microseconds &capture_latency) {
+  std::vector<std::string> remaining;
+  for (size_t i = 0; i < arguments.size(); ++i) {
+    if (arguments[i] == "--busy-poll") {
+      busy_poll = true;
+    } else if (arguments[i] == "--shm" ||
+               arguments[i] == "--capture-latency-ms") {
+      if (i + 1 >= arguments.size()) {
+        std::cerr << arguments[i] << " needs a value\n";
+        return false;
+      }
+      if (arguments[i] == "--shm") {
+        ring = arguments[++i];
+      } else {
+        capture_latency = std::chrono::microseconds(static_cast<int64_t>(
+            std::strtod(arguments[++i].c_str(), nullptr) * 1000.0));
+      }
+    } else {
+      remaining.push_back(arguments[i]);
     }
-  });
-
-  // We usually receive heartbeats at 1Hz, therefore we should find a
-  // system after around 3 seconds max, surely.
-  if (fut.wait_for(seconds(3)) == std::future_status::timeout) {
-    std::cerr << "No autopilot found.\n";
-    return {};
   }
-
-  // Get discovered system now.
-  return fut.get();
+  arguments = remaining;
+  return true;
 }
 
 int main(int argc, char **argv) {
-  if (argc != 2) {
+  ConnectionOptions options;
+  std::vector<std::string> arguments;
+  RealtimeOptions realtime;
+  std::string ring;
+  bool busy_poll = false;
+  std::chrono::microseconds capture_latency{0};
+  if (!parse_arguments(argc, argv, options, arguments) ||
+      !parse_realtime_arguments(arguments, realtime) ||
+      !parse_source_arguments(arguments, ring, busy_poll, capture_latency) ||
+      arguments.size() > (ring.empty() ? 1u : 0u)) {
     usage(argv[0]);
     return 1;
   }
+  if (realtime.lock_memory && !lock_memory()) {
+    return 1;
+  }
 
-  Mavsdk mavsdk;
-  ConnectionResult connection_result = mavsdk.add_any_connection(argv[1]);
+  const auto pose_port =
+      arguments.empty() ? VisionBridge::default_port
+                        : static_cast<uint16_t>(
+                              std::strtoul(arguments[0].c_str(), nullptr, 10));
 
-  if (connection_result != ConnectionResult::Success) {
-    std::cerr << "Connection failed: " << connection_result << '\n';
+  MetricsExporter exporter{metrics(), options.metrics_target};
+  if (!exporter.start()) {
     return 1;
   }
 
-  auto system = get_system(mavsdk);
+  Mavsdk mavsdk;
+  auto system = connect(mavsdk, options);
   if (!system) {
     return 1;
   }
 
   // Instantiate plugins.
-  auto telemetry = Telemetry{system};
   auto vision = Mocap{system};
+  auto telemetry = Telemetry{system};
   std::cout << "System is ready\n";
-  sleep_for(seconds(1));
-
-  // // Send mocap command to Mavsdk
-  Mocap::VisionPositionEstimate vision_msg;
-
-  vision_msg.time_usec = 0;
 
-  vision_msg.position_body.x_m = 1.2;
-  vision_msg.position_body.y_m = 3.4;
-  vision_msg.position_body.z_m = -5.6;
-
-  vision_msg.angle_body.roll_rad = 0.0;
-  vision_msg.angle_body.pitch_rad = 0.0;
-  vision_msg.angle_body.yaw_rad = 1.0;
-
-  std::vector<float> v = {NAN};
-  vision_msg.pose_covariance.covariance_matrix = v;
-
-  // Set posiiton from mocap
-  for (;;) {
-    Mocap::Result result = vision.set_vision_position_estimate(vision_msg);
-    std::cout << "Position sent" << result << std::endl;
-    sleep_for(std::chrono::milliseconds(30));
+  TimeSync time_sync;
+  telemetry.subscribe_imu([&time_sync](Telemetry::Imu imu) {
+    time_sync.add_sample(imu.timestamp_us, monotonic_time_us());
+  });
+  if (telemetry.set_rate_imu(time_sync_rate_hz) !=
+      Telemetry::Result::Success) {
+    std::cerr << "Setting IMU rate failed, time sync may be slow\n";
   }
 
-  sleep_for(std::chrono::milliseconds(500));
+  // Forward every pose as it arrives from the external source.
+  VisionBridge bridge{vision, pose_port};
+  bridge.set_thread_options(realtime.io);
+  bridge.set_time_sync(time_sync);
+  bridge.set_capture_latency(capture_latency);
+  if (!ring.empty()) {
+    bridge.use_shared_memory(ring, busy_poll);
+  }
+  if (!bridge.start()) {
+    return 1;
+  }
+  if (ring.empty()) {
+    std::cout << "Forwarding poses from UDP port " << pose_port << '\n';
+  } else {
+    std::cout << "Forwarding poses from shared memory " << ring << '\n';
+  }
 
-  // We are relying on auto-disarming but let's keep watching the telemetry for
-  // a bit longer.
-  sleep_for(seconds(1));
-  std::cout << "Finished...\n";
+  auto last_stats = bridge.stats();
+  for (unsigned second = 1;; ++second) {
+    sleep_for(seconds(1));
+
+    const auto stats = bridge.stats();
+    const auto sent = stats.sent - last_stats.sent;
+    const auto mean_latency_us =
+        sent > 0 ? (stats.latency_sum_us - last_stats.latency_sum_us) / sent
+                 : 0;
+
+    std::cout << "Poses: " << sent << " Hz sent, "
+              << stats.received - last_stats.received << " Hz received, "
+              << stats.send_failures << " send failures, " << stats.malformed
+              << " malformed, " << stats.sequence_gaps
+              << " lost, latency mean " << mean_latency_us << " us max "
+              << stats.latency_max_us << " us, " << stats.unsynced
+              << " unsynced\n";
+
+    last_stats = stats;
+
+    if (second % jitter_report_period_s == 0) {
+      print_jitter("Vision bridge", bridge.jitter());
+      print_time_sync(time_sync.estimate());
+      std::cout << "Metrics:\n";
+      print_metrics(metrics());
+    }
+  }
 
   return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,109 @@
+//
+// Setpoint pipelines composed at compile time.
+//
+// A pipeline is one setpoint source followed by any number of stages that
+// may rewrite the setpoint, filters and guards alike, all fixed as template
+// arguments:
+//
+//   Pipeline<VelocityRamp, SpeedLimit, FenceGuard> pipeline{ramp, limit,
+//                                                           fence_guard};
+//   streamer.start_pipeline(pipeline);
+//
+// Every stage is called by its qualified name, so even stages that also
+// implement SetpointSource or SetpointGuard are called directly rather than
+// through their vtable, and the stages defined in headers inline into the
+// streaming loop. The transmit stage is the streamer's own. A tool that
+// needs to switch sources at run time keeps using drive() and set_guard()
+// instead; pipeline_bench measures what that costs per tick.
+//
+// A source has next(tick, setpoint) and a stage admit(tick, setpoint), the
+// signatures of SetpointSource and SetpointGuard, whether or not it derives
+// from them.
+//
+
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <tuple>
+
+#include "setpoint.h"
+#include "setpoint_streamer.h"
+
+template <typename Source, typename... Stages> class Pipeline {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // The stages must outlive the pipeline.
+  explicit Pipeline(Source &source, Stages &...stages)
+      : _source(source), _stages(stages...) {}
+
+  void tick(Clock::time_point tick, Setpoint &setpoint) {
+    _source.Source::next(tick, setpoint);
+    std::apply(
+        [tick, &setpoint](auto &...stage) {
+          (admit(stage, tick, setpoint), ...);
+        },
+        _stages);
+  }
+
+private:
+  template <typename Stage>
+  static void admit(Stage &stage, Clock::time_point tick, Setpoint &setpoint) {
+    stage.Stage::admit(tick, setpoint);
+  }
+
+  Source &_source;
+  std::tuple<Stages &...> _stages;
+};
+
+struct SpeedLimits {
+  // The PX4 defaults of MPC_XY_VEL_MAX, MPC_Z_VEL_MAX_UP and
+  // MPC_Z_VEL_MAX_DN, i.e. what the autopilot would cap to anyway.
+  float max_speed_xy_m_s{12.0f};
+  float max_speed_up_m_s{3.0f};
+  float max_speed_down_m_s{1.5f};
+};
+
+//
+// Caps the velocity of velocity setpoints, keeping the horizontal
+// direction. Other setpoints pass unchanged. Also usable as a streamer
+// guard.
+//
+class SpeedLimit final : public SetpointGuard {
+public:
+  explicit SpeedLimit(const SpeedLimits &limits = {}) : _limits(limits) {}
+
+  void admit(std::chrono::steady_clock::time_point,
+             Setpoint &setpoint) override {
+    switch (setpoint.type) {
+    case Setpoint::Type::VelocityNed:
+    case Setpoint::Type::PositionVelocityNed:
+      limit(setpoint.velocity_ned.north_m_s, setpoint.velocity_ned.east_m_s,
+            setpoint.velocity_ned.down_m_s);
+      break;
+    case Setpoint::Type::VelocityBody:
+      limit(setpoint.velocity_body.forward_m_s,
+            setpoint.velocity_body.right_m_s,
+            setpoint.velocity_body.down_m_s);
+      break;
+    case Setpoint::Type::PositionNed:
+    case Setpoint::Type::Attitude:
+      break;
+    }
+  }
+
+private:
+  void limit(float &x_m_s, float &y_m_s, float &down_m_s) const {
+    const float speed_xy = std::sqrt(x_m_s * x_m_s + y_m_s * y_m_s);
+    if (speed_xy > _limits.max_speed_xy_m_s) {
+      const float scale = _limits.max_speed_xy_m_s / speed_xy;
+      x_m_s *= scale;
+      y_m_s *= scale;
+    }
+    down_m_s = std::fmax(-_limits.max_speed_up_m_s,
+                         std::fmin(down_m_s, _limits.max_speed_down_m_s));
+  }
+
+  const SpeedLimits _limits;
+};
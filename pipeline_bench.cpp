@@ -0,0 +1,150 @@
+//
+// Per-tick cost of a template pipeline against the same stages behind
+// virtual calls, no vehicle needed.
+//
+// Each configuration runs twice over the same simulated ticks: once as a
+// Pipeline, once the way a run-time configured loop would, with the source
+// and the stages behind SetpointSource and SetpointGuard pointers. The
+// light configuration isolates the dispatch, the tool configuration is what
+// offboard_position_control streams in its velocity phases. The transmit
+// stage is the same for both and left out.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "fence_guard.h"
+#include "geofence.h"
+#include "pipeline.h"
+#include "vehicle_state.h"
+#include "velocity_ramp.h"
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t default_ticks = 2000000;
+constexpr unsigned rounds = 5;
+constexpr auto tick_period = std::chrono::milliseconds(10);
+
+//
+// Sweeps the commanded north velocity with the tick count, so no stage
+// sees the same setpoint twice in a row.
+//
+class SweepSource : public SetpointSource {
+public:
+  void next(Clock::time_point, Setpoint &setpoint) override {
+    setpoint.type = Setpoint::Type::VelocityNed;
+    setpoint.velocity_ned.north_m_s =
+        static_cast<float>(_count++ % 4096) * 0.01f - 20.0f;
+    setpoint.velocity_ned.down_m_s = -2.0f;
+  }
+
+private:
+  uint64_t _count{0};
+};
+
+// Sink for the setpoints, so the loops cannot be optimized away.
+float checksum(const Setpoint &setpoint) {
+  return setpoint.velocity_ned.north_m_s + setpoint.velocity_ned.down_m_s +
+         setpoint.position_ned.north_m;
+}
+
+template <typename Tick>
+double ns_per_tick(size_t ticks, float &sum, Tick &&tick) {
+  Setpoint setpoint{};
+  auto time = Clock::now();
+  const auto start = Clock::now();
+  for (size_t i = 0; i < ticks; ++i) {
+    time += tick_period;
+    tick(time, setpoint);
+    sum += checksum(setpoint);
+  }
+  return std::chrono::duration<double, std::nano>(Clock::now() - start)
+             .count() /
+         static_cast<double>(ticks);
+}
+
+double dynamic_ns_per_tick(size_t ticks, float &sum, SetpointSource &source,
+                           const std::vector<SetpointGuard *> &stages) {
+  return ns_per_tick(ticks, sum,
+                     [&](Clock::time_point time, Setpoint &setpoint) {
+                       source.next(time, setpoint);
+                       for (SetpointGuard *stage : stages) {
+                         stage->admit(time, setpoint);
+                       }
+                     });
+}
+
+// Best of a few rounds of each, alternating.
+template <typename Pipeline>
+void compare(const char *name, size_t ticks, Pipeline &pipeline,
+             SetpointSource &source,
+             const std::vector<SetpointGuard *> &stages) {
+  float sum = 0.0f;
+  double templated = 1e9;
+  double dynamic = 1e9;
+  for (unsigned round = 0; round < rounds; ++round) {
+    templated = std::min(
+        templated, ns_per_tick(ticks, sum,
+                               [&](Clock::time_point time, Setpoint &setpoint) {
+                                 pipeline.tick(time, setpoint);
+                               }));
+    dynamic = std::min(dynamic, dynamic_ns_per_tick(ticks, sum, source,
+                                                    stages));
+  }
+  std::cout << name << ": template " << templated << " ns, virtual "
+            << dynamic << " ns per tick, difference " << dynamic - templated
+            << " ns (checksum " << sum << ")\n";
+}
+
+int main(int argc, char **argv) {
+  if (argc > 2) {
+    std::cerr << "Usage : " << argv[0] << " [ticks]\n";
+    return 1;
+  }
+  const size_t ticks =
+      argc == 2 ? static_cast<size_t>(std::strtoul(argv[1], nullptr, 10))
+                : default_ticks;
+
+  {
+    SweepSource source;
+    SpeedLimit first;
+    SpeedLimit second{SpeedLimits{5.0f, 1.0f, 1.0f}};
+    SpeedLimit third{SpeedLimits{2.0f, 0.5f, 0.5f}};
+    Pipeline pipeline{source, first, second, third};
+    compare("Source and three speed limits", ticks, pipeline, source,
+            {&first, &second, &third});
+  }
+
+  {
+    Fence field{};
+    field.shape = Fence::Shape::Cylinder;
+    field.radius_m = 1000.0f;
+    field.min_altitude_m = -1000.0f;
+    field.max_altitude_m = 1000.0f;
+    Geofence fence;
+    if (!fence.compile({field}, 50.0f)) {
+      return 1;
+    }
+    VehicleState state;
+    mavsdk::Telemetry::PositionVelocityNed position_velocity{};
+    position_velocity.position.down_m = -5.0f;
+    state.update(position_velocity);
+    // The bench ticks run ahead of the clock; keep the state valid anyway.
+    FenceGuard guard{fence, state, std::chrono::milliseconds(1000),
+                     std::chrono::hours(24)};
+
+    VelocityRamp ramp{VelocityRamp::Frame::Ned};
+    mavsdk::Offboard::VelocityNedYaw velocity{};
+    velocity.north_m_s = 2.0f;
+    ramp.set_target(Setpoint::make_velocity_ned(velocity));
+    SpeedLimit speed_limit;
+    Pipeline pipeline{ramp, speed_limit, guard};
+    compare("Ramp, speed limit and fence guard", ticks, pipeline, ramp,
+            {&speed_limit, &guard});
+  }
+
+  return 0;
+}
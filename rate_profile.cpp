@@ -0,0 +1,344 @@
+#include "rate_profile.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+
+using namespace mavsdk;
+
+namespace {
+
+struct StreamInfo {
+  Stream stream;
+  const char *name;
+  // The MAVLink message MAVSDK sets the interval of for this stream.
+  uint16_t message_id;
+  // SYS_STATUS and HOME_POSITION also feed the health flags, so they stay on.
+  bool can_disable;
+};
+
+// In the order of the Stream enum.
+constexpr StreamInfo stream_infos[] = {
+    {Stream::Position, "position", 33, true},
+    {Stream::Home, "home", 242, false},
+    {Stream::InAir, "in_air", 245, true},
+    {Stream::LandedState, "landed_state", 245, true},
+    {Stream::AttitudeQuaternion, "attitude_quaternion", 31, true},
+    {Stream::AttitudeEuler, "attitude_euler", 30, true},
+    {Stream::VelocityNed, "velocity_ned", 33, true},
+    {Stream::Imu, "imu", 105, true},
+    {Stream::GpsInfo, "gps_info", 24, true},
+    {Stream::Battery, "battery", 1, false},
+    {Stream::RcStatus, "rc_status", 65, true},
+    {Stream::ActuatorControlTarget, "actuator_control_target", 140, true},
+    {Stream::ActuatorOutputStatus, "actuator_output_status", 375, true},
+    {Stream::Odometry, "odometry", 331, true},
+    {Stream::PositionVelocityNed, "position_velocity_ned", 32, true},
+    {Stream::GroundTruth, "ground_truth", 115, true},
+    {Stream::FixedwingMetrics, "fixedwing_metrics", 74, true},
+    {Stream::DistanceSensor, "distance_sensor", 132, true},
+};
+
+const StreamInfo &info(Stream stream) {
+  return stream_infos[static_cast<size_t>(stream)];
+}
+
+// MAVSDK turns a negative rate into a message interval of -1, which stops
+// the message altogether, and a zero rate into an interval of 0, which
+// restores the autopilot's default.
+constexpr double disabled_rate_hz = -1.0;
+constexpr double default_rate_hz = 0.0;
+
+void set_rate_async(Telemetry &telemetry, Stream stream, double rate_hz,
+                    const Telemetry::ResultCallback &callback) {
+  switch (stream) {
+  case Stream::Position:
+    return telemetry.set_rate_position_async(rate_hz, callback);
+  case Stream::Home:
+    return telemetry.set_rate_home_async(rate_hz, callback);
+  case Stream::InAir:
+    return telemetry.set_rate_in_air_async(rate_hz, callback);
+  case Stream::LandedState:
+    return telemetry.set_rate_landed_state_async(rate_hz, callback);
+  case Stream::AttitudeQuaternion:
+    return telemetry.set_rate_attitude_quaternion_async(rate_hz, callback);
+  case Stream::AttitudeEuler:
+    return telemetry.set_rate_attitude_euler_async(rate_hz, callback);
+  case Stream::VelocityNed:
+    return telemetry.set_rate_velocity_ned_async(rate_hz, callback);
+  case Stream::Imu:
+    return telemetry.set_rate_imu_async(rate_hz, callback);
+  case Stream::GpsInfo:
+    return telemetry.set_rate_gps_info_async(rate_hz, callback);
+  case Stream::Battery:
+    return telemetry.set_rate_battery_async(rate_hz, callback);
+  case Stream::RcStatus:
+    return telemetry.set_rate_rc_status_async(rate_hz, callback);
+  case Stream::ActuatorControlTarget:
+    return telemetry.set_rate_actuator_control_target_async(rate_hz, callback);
+  case Stream::ActuatorOutputStatus:
+    return telemetry.set_rate_actuator_output_status_async(rate_hz, callback);
+  case Stream::Odometry:
+    return telemetry.set_rate_odometry_async(rate_hz, callback);
+  case Stream::PositionVelocityNed:
+    return telemetry.set_rate_position_velocity_ned_async(rate_hz, callback);
+  case Stream::GroundTruth:
+    return telemetry.set_rate_ground_truth_async(rate_hz, callback);
+  case Stream::FixedwingMetrics:
+    return telemetry.set_rate_fixedwing_metrics_async(rate_hz, callback);
+  case Stream::DistanceSensor:
+    return telemetry.set_rate_distance_sensor_async(rate_hz, callback);
+  }
+}
+
+// Adapt a sample-less callback to a subscription of `Sample`s. An empty
+// callback unsubscribes.
+template <typename Sample>
+std::function<void(Sample)> on_any(const std::function<void()> &on_sample) {
+  if (!on_sample) {
+    return nullptr;
+  }
+  return [on_sample](Sample) { on_sample(); };
+}
+
+void subscribe(Telemetry &telemetry, Stream stream,
+               const std::function<void()> &on_sample) {
+  switch (stream) {
+  case Stream::Position:
+    return telemetry.subscribe_position(on_any<Telemetry::Position>(on_sample));
+  case Stream::Home:
+    return telemetry.subscribe_home(on_any<Telemetry::Position>(on_sample));
+  case Stream::InAir:
+    return telemetry.subscribe_in_air(on_any<bool>(on_sample));
+  case Stream::LandedState:
+    return telemetry.subscribe_landed_state(
+        on_any<Telemetry::LandedState>(on_sample));
+  case Stream::AttitudeQuaternion:
+    return telemetry.subscribe_attitude_quaternion(
+        on_any<Telemetry::Quaternion>(on_sample));
+  case Stream::AttitudeEuler:
+    return telemetry.subscribe_attitude_euler(
+        on_any<Telemetry::EulerAngle>(on_sample));
+  case Stream::VelocityNed:
+    return telemetry.subscribe_velocity_ned(
+        on_any<Telemetry::VelocityNed>(on_sample));
+  case Stream::Imu:
+    return telemetry.subscribe_imu(on_any<Telemetry::Imu>(on_sample));
+  case Stream::GpsInfo:
+    return telemetry.subscribe_gps_info(on_any<Telemetry::GpsInfo>(on_sample));
+  case Stream::Battery:
+    return telemetry.subscribe_battery(on_any<Telemetry::Battery>(on_sample));
+  case Stream::RcStatus:
+    return telemetry.subscribe_rc_status(
+        on_any<Telemetry::RcStatus>(on_sample));
+  case Stream::ActuatorControlTarget:
+    return telemetry.subscribe_actuator_control_target(
+        on_any<Telemetry::ActuatorControlTarget>(on_sample));
+  case Stream::ActuatorOutputStatus:
+    return telemetry.subscribe_actuator_output_status(
+        on_any<Telemetry::ActuatorOutputStatus>(on_sample));
+  case Stream::Odometry:
+    return telemetry.subscribe_odometry(
+        on_any<Telemetry::Odometry>(on_sample));
+  case Stream::PositionVelocityNed:
+    return telemetry.subscribe_position_velocity_ned(
+        on_any<Telemetry::PositionVelocityNed>(on_sample));
+  case Stream::GroundTruth:
+    return telemetry.subscribe_ground_truth(
+        on_any<Telemetry::GroundTruth>(on_sample));
+  case Stream::FixedwingMetrics:
+    return telemetry.subscribe_fixedwing_metrics(
+        on_any<Telemetry::FixedwingMetrics>(on_sample));
+  case Stream::DistanceSensor:
+    return telemetry.subscribe_distance_sensor(
+        on_any<Telemetry::DistanceSensor>(on_sample));
+  }
+}
+
+// The streams `profile` switches off: those that can be, unless listed or
+// sharing their message with a listed one.
+std::vector<Stream> disabled_streams(const RateProfile &profile) {
+  std::vector<Stream> disabled;
+  if (!profile.disable_unused) {
+    return disabled;
+  }
+  std::set<uint16_t> used_messages;
+  for (const auto &rate : profile.rates) {
+    used_messages.insert(info(rate.stream).message_id);
+  }
+  for (const auto &stream : stream_infos) {
+    if (stream.can_disable &&
+        used_messages.insert(stream.message_id).second) {
+      disabled.push_back(stream.stream);
+    }
+  }
+  return disabled;
+}
+
+// Send all `requests` at once and wait for the results.
+//
+// returns false if a request failed or not all were answered in time.
+bool run_requests(Telemetry &telemetry,
+                  const std::vector<MissionLifecycle::RateRequest> &requests,
+                  const std::string &name, std::chrono::milliseconds timeout) {
+  // Shared with the callbacks, which may still arrive after a timeout.
+  struct Pending {
+    std::mutex mutex{};
+    std::condition_variable done{};
+    size_t outstanding{0};
+    size_t failed{0};
+  };
+  auto pending = std::make_shared<Pending>();
+
+  pending->outstanding = requests.size();
+  for (const auto &request : requests) {
+    request(telemetry, [pending](Telemetry::Result result) {
+      {
+        std::lock_guard<std::mutex> lock(pending->mutex);
+        --pending->outstanding;
+        if (result != Telemetry::Result::Success) {
+          std::cerr << "Setting rate failed: " << result << '\n';
+          ++pending->failed;
+        }
+      }
+      pending->done.notify_all();
+    });
+  }
+
+  std::unique_lock<std::mutex> lock(pending->mutex);
+  if (!pending->done.wait_for(lock, timeout, [&pending]() {
+        return pending->outstanding == 0;
+      })) {
+    std::cerr << "Rate profile " << name << " timed out\n";
+    return false;
+  }
+  return pending->failed == 0;
+}
+
+// Not every autopilot sends every message, so a rejected request for a
+// stream that is not listed is not an error.
+MissionLifecycle::RateRequest optional_rate_request(Stream stream,
+                                                    double rate_hz) {
+  return [stream, rate_hz](Telemetry &telemetry,
+                           const Telemetry::ResultCallback &callback) {
+    set_rate_async(telemetry, stream, rate_hz, [callback](Telemetry::Result) {
+      callback(Telemetry::Result::Success);
+    });
+  };
+}
+
+} // namespace
+
+const char *to_string(Stream stream) { return info(stream).name; }
+
+RateProfile control_rate_profile() {
+  RateProfile profile{};
+  profile.name = "control";
+  profile.rates = {
+      {Stream::PositionVelocityNed, 100.0},
+      {Stream::AttitudeEuler, 100.0},
+      {Stream::LandedState, 10.0},
+      {Stream::Battery, 1.0},
+      // Often enough for the failsafe watchdog to notice RC loss within
+      // its max_rc_loss.
+      {Stream::RcStatus, 5.0},
+  };
+  return profile;
+}
+
+RateProfile monitor_rate_profile() {
+  RateProfile profile{};
+  profile.name = "monitor";
+  profile.rates = {
+      {Stream::PositionVelocityNed, 10.0}, {Stream::AttitudeQuaternion, 10.0},
+      {Stream::AttitudeEuler, 10.0},       {Stream::Position, 5.0},
+      {Stream::LandedState, 2.0},          {Stream::GpsInfo, 1.0},
+      {Stream::Battery, 1.0},              {Stream::RcStatus, 1.0},
+  };
+  return profile;
+}
+
+std::vector<MissionLifecycle::RateRequest>
+rate_requests(const RateProfile &profile) {
+  std::vector<MissionLifecycle::RateRequest> requests;
+  for (const auto &rate : profile.rates) {
+    requests.push_back([rate](Telemetry &telemetry,
+                              const Telemetry::ResultCallback &callback) {
+      set_rate_async(telemetry, rate.stream, rate.rate_hz, callback);
+    });
+  }
+  for (const Stream stream : disabled_streams(profile)) {
+    requests.push_back(optional_rate_request(stream, disabled_rate_hz));
+  }
+  return requests;
+}
+
+bool apply_rate_profile(Telemetry &telemetry, const RateProfile &profile,
+                        std::chrono::milliseconds timeout) {
+  return run_requests(telemetry, rate_requests(profile), profile.name,
+                      timeout);
+}
+
+bool restore_default_rates(Telemetry &telemetry, const RateProfile &profile,
+                           std::chrono::milliseconds timeout) {
+  std::vector<MissionLifecycle::RateRequest> requests;
+  for (const auto &rate : profile.rates) {
+    requests.push_back(optional_rate_request(rate.stream, default_rate_hz));
+  }
+  for (const Stream stream : disabled_streams(profile)) {
+    requests.push_back(optional_rate_request(stream, default_rate_hz));
+  }
+  return run_requests(telemetry, requests, profile.name + " restore",
+                      timeout);
+}
+
+DefaultRateRestorer::~DefaultRateRestorer() {
+  restore_default_rates(_telemetry, _profile);
+}
+
+std::vector<DeliveredRate> measure_rates(Telemetry &telemetry,
+                                         const RateProfile &profile,
+                                         std::chrono::milliseconds window) {
+  std::vector<std::atomic<uint64_t>> samples(profile.rates.size());
+  for (size_t i = 0; i < profile.rates.size(); ++i) {
+    auto &count = samples[i];
+    subscribe(telemetry, profile.rates[i].stream, [&count]() {
+      count.fetch_add(1, std::memory_order_relaxed);
+    });
+  }
+
+  std::this_thread::sleep_for(window);
+
+  for (const auto &rate : profile.rates) {
+    subscribe(telemetry, rate.stream, nullptr);
+  }
+
+  const double window_s = std::chrono::duration<double>(window).count();
+  std::vector<DeliveredRate> delivered;
+  for (size_t i = 0; i < profile.rates.size(); ++i) {
+    delivered.push_back({profile.rates[i].stream, profile.rates[i].rate_hz,
+                         static_cast<double>(samples[i].load()) / window_s});
+  }
+  return delivered;
+}
+
+bool print_delivered_rates(const std::vector<DeliveredRate> &rates,
+                           double tolerance) {
+  bool all_ok = true;
+  std::cout << std::fixed << std::setprecision(1);
+  for (const auto &rate : rates) {
+    const bool ok = rate.delivered_hz >= tolerance * rate.requested_hz;
+    all_ok = all_ok && ok;
+    std::cout << std::left << std::setw(24) << to_string(rate.stream)
+              << std::right << std::setw(7) << rate.requested_hz
+              << " Hz requested " << std::setw(7) << rate.delivered_hz
+              << " Hz delivered" << (ok ? "" : "  <- short") << '\n';
+  }
+  std::cout << std::defaultfloat;
+  return all_ok;
+}
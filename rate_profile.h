@@ -0,0 +1,126 @@
+//
+// Telemetry rate profiles.
+//
+// A tool declares the streams it needs and the rate of each. Applying the
+// profile requests those rates and, unless told otherwise, switches off
+// every other stream that can be switched off, so a slow link (serial
+// telemetry radios in particular) only carries what is actually used.
+// measure_rates() checks what the autopilot really delivers.
+//
+// The rates stay set on the autopilot after the tool exits, for every later
+// user of the link, until they are restored: tools keep a
+// DefaultRateRestorer for the profile they applied, which hands every
+// stream the profile touched back to the autopilot's default rate. A tool
+// that is killed leaves its rates in place.
+//
+
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <mavsdk/plugins/telemetry/telemetry.h>
+
+#include "mission_lifecycle.h"
+
+enum class Stream {
+  Position,
+  Home,
+  InAir,
+  LandedState,
+  AttitudeQuaternion,
+  AttitudeEuler,
+  VelocityNed,
+  Imu,
+  GpsInfo,
+  Battery,
+  RcStatus,
+  ActuatorControlTarget,
+  ActuatorOutputStatus,
+  Odometry,
+  PositionVelocityNed,
+  GroundTruth,
+  FixedwingMetrics,
+  DistanceSensor,
+};
+
+const char *to_string(Stream stream);
+
+struct StreamRate {
+  Stream stream;
+  double rate_hz;
+};
+
+struct RateProfile {
+  std::string name{};
+  std::vector<StreamRate> rates{};
+  // Switch off the streams that are neither listed nor share their MAVLink
+  // message with a listed one.
+  bool disable_unused{true};
+};
+
+// Offboard control: fast position and attitude, slow battery and RC.
+RateProfile control_rate_profile();
+// Monitoring and logging: everything the read tools show, at a modest rate.
+RateProfile monitor_rate_profile();
+
+// The requests that apply `profile`, for MissionLifecycle::prepare().
+std::vector<MissionLifecycle::RateRequest>
+rate_requests(const RateProfile &profile);
+
+// Apply `profile` (all requests in parallel) and wait for the results.
+//
+// returns false if a requested rate was rejected or not acknowledged in
+// time.
+bool apply_rate_profile(
+    mavsdk::Telemetry &telemetry, const RateProfile &profile,
+    std::chrono::milliseconds timeout = std::chrono::seconds(5));
+
+// Set every stream `profile` lists or switches off back to the autopilot's
+// default rate (a message interval of 0). Rejections are ignored, like
+// those of the requests that switch streams off.
+//
+// returns false if the requests were not all answered in time.
+bool restore_default_rates(
+    mavsdk::Telemetry &telemetry, const RateProfile &profile,
+    std::chrono::milliseconds timeout = std::chrono::seconds(2));
+
+// Calls restore_default_rates() for `profile` on destruction. Declared
+// before the profile is applied, it hands the streams back at their
+// default rates however the tool exits, early failures included. Must not
+// outlive `telemetry`.
+class DefaultRateRestorer {
+public:
+  DefaultRateRestorer(mavsdk::Telemetry &telemetry, const RateProfile &profile)
+      : _telemetry(telemetry), _profile(profile) {}
+  ~DefaultRateRestorer();
+
+  DefaultRateRestorer(const DefaultRateRestorer &) = delete;
+  DefaultRateRestorer &operator=(const DefaultRateRestorer &) = delete;
+
+private:
+  mavsdk::Telemetry &_telemetry;
+  const RateProfile _profile;
+};
+
+struct DeliveredRate {
+  Stream stream;
+  double requested_hz;
+  double delivered_hz;
+};
+
+// Count the samples of every stream in `profile` for `window`.
+//
+// This subscribes to the streams itself and so replaces, and afterwards
+// clears, any other subscription to them: run it before subscribing.
+std::vector<DeliveredRate>
+measure_rates(mavsdk::Telemetry &telemetry, const RateProfile &profile,
+              std::chrono::milliseconds window = std::chrono::seconds(3));
+
+// Print `rates`, flagging streams that fall short of `tolerance` times
+// their requested rate.
+//
+// returns true if no stream falls short.
+bool print_delivered_rates(const std::vector<DeliveredRate> &rates,
+                           double tolerance = 0.8);
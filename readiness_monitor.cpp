@@ -0,0 +1,154 @@
+#include "readiness_monitor.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+using namespace mavsdk;
+
+namespace {
+
+double ms_of(ReadinessMonitor::Clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+} // namespace
+
+std::vector<ReadinessMonitor::Flag> ReadinessMonitor::default_required() {
+  return {Flag::GyrometerCalibration, Flag::AccelerometerCalibration,
+          Flag::MagnetometerCalibration, Flag::LocalPosition, Flag::Armable};
+}
+
+ReadinessMonitor::ReadinessMonitor(const std::vector<Flag> &required,
+                                   Clock::time_point start) {
+  for (const auto flag : required) {
+    _required |= bit(flag);
+  }
+  this->start(start);
+}
+
+void ReadinessMonitor::start(Clock::time_point now) {
+  _ok = 0;
+  _start = now;
+  _time_to_ready = {};
+  _flags = {};
+}
+
+bool ReadinessMonitor::update(const Telemetry::Health &health,
+                              Clock::time_point now) {
+  const std::array<bool, flag_count> values{
+      health.is_gyrometer_calibration_ok,
+      health.is_accelerometer_calibration_ok,
+      health.is_magnetometer_calibration_ok,
+      health.is_local_position_ok,
+      health.is_global_position_ok,
+      health.is_home_position_ok,
+      health.is_armable,
+  };
+
+  const bool was_ready = ready();
+  _ok = 0;
+  for (size_t i = 0; i < flag_count; ++i) {
+    FlagState &state = _flags[i];
+    if (values[i] && !state.came_up) {
+      state.came_up = true;
+      state.time_to_ok = now - _start;
+    } else if (!values[i] && state.ok) {
+      ++state.drops;
+    }
+    state.ok = values[i];
+    _ok |= values[i] ? 1u << i : 0u;
+  }
+
+  if (!ready() || was_ready) {
+    return false;
+  }
+  if (_time_to_ready == Clock::duration{}) {
+    _time_to_ready = now - _start;
+  }
+  return true;
+}
+
+std::vector<ReadinessMonitor::Flag> ReadinessMonitor::missing() const {
+  std::vector<Flag> flags;
+  for (size_t i = 0; i < flag_count; ++i) {
+    const auto flag = static_cast<Flag>(i);
+    if (is_required(flag) && !_flags[i].ok) {
+      flags.push_back(flag);
+    }
+  }
+  return flags;
+}
+
+const char *to_string(ReadinessMonitor::Flag flag) {
+  switch (flag) {
+  case ReadinessMonitor::Flag::GyrometerCalibration:
+    return "gyro calibration";
+  case ReadinessMonitor::Flag::AccelerometerCalibration:
+    return "accel calibration";
+  case ReadinessMonitor::Flag::MagnetometerCalibration:
+    return "mag calibration";
+  case ReadinessMonitor::Flag::LocalPosition:
+    return "local position";
+  case ReadinessMonitor::Flag::GlobalPosition:
+    return "global position";
+  case ReadinessMonitor::Flag::HomePosition:
+    return "home position";
+  case ReadinessMonitor::Flag::Armable:
+    return "armable";
+  }
+  return "unknown";
+}
+
+void print_readiness(const ReadinessMonitor &readiness) {
+  std::vector<ReadinessMonitor::Flag> flags;
+  for (size_t i = 0; i < ReadinessMonitor::flag_count; ++i) {
+    flags.push_back(static_cast<ReadinessMonitor::Flag>(i));
+  }
+  // Required flags first, each group slowest first; flags that never came
+  // up count as slowest.
+  const auto slower = [&readiness](ReadinessMonitor::Flag a,
+                                   ReadinessMonitor::Flag b) {
+    const auto &x = readiness.flag(a);
+    const auto &y = readiness.flag(b);
+    if (readiness.is_required(a) != readiness.is_required(b)) {
+      return readiness.is_required(a);
+    }
+    if (x.came_up != y.came_up) {
+      return !x.came_up;
+    }
+    return x.time_to_ok > y.time_to_ok;
+  };
+  std::stable_sort(flags.begin(), flags.end(), slower);
+
+  const bool was_ready =
+      readiness.ready() ||
+      readiness.time_to_ready() > ReadinessMonitor::Clock::duration{};
+  if (was_ready) {
+    std::cout << "Ready after " << ms_of(readiness.time_to_ready()) << " ms"
+              << (readiness.ready() ? "" : ", not ready now") << '\n';
+  } else {
+    std::cout << "Not ready\n";
+  }
+  const auto precision = std::cout.precision();
+  std::cout << std::fixed << std::setprecision(0);
+  for (const auto flag : flags) {
+    const auto &state = readiness.flag(flag);
+    std::cout << "  " << std::left << std::setw(18) << to_string(flag)
+              << std::right << (readiness.is_required(flag) ? " required "
+                                                            : " optional ");
+    if (state.came_up) {
+      std::cout << std::setw(7) << ms_of(state.time_to_ok) << " ms";
+    } else {
+      std::cout << "  never up";
+    }
+    if (!state.ok && state.came_up) {
+      std::cout << ", down now";
+    }
+    if (state.drops > 0) {
+      std::cout << ", dropped " << state.drops << "x";
+    }
+    std::cout << '\n';
+  }
+  std::cout << std::defaultfloat << std::setprecision(precision);
+}
@@ -0,0 +1,89 @@
+//
+// Pre-arm readiness from the health flags.
+//
+// The monitor is fed every Telemetry::Health update and turns ready on the
+// first update that has all required flags set, so arming can follow that
+// edge instead of a polling loop. It keeps, per flag, how long the flag
+// took to come up and how often it dropped again, which shows which sensor
+// holds up arming.
+//
+// The monitor does not subscribe itself, since a second health
+// subscription would replace the first; the owner of the subscription feeds
+// it and serializes the calls.
+//
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include <mavsdk/plugins/telemetry/telemetry.h>
+
+class ReadinessMonitor {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  enum class Flag {
+    GyrometerCalibration,
+    AccelerometerCalibration,
+    MagnetometerCalibration,
+    LocalPosition,
+    GlobalPosition,
+    HomePosition,
+    Armable,
+  };
+  static constexpr size_t flag_count = 7;
+
+  struct FlagState {
+    bool ok{false};
+    bool came_up{false};
+    // From start() until the flag was first set.
+    Clock::duration time_to_ok{};
+    // Times the flag was cleared again after being set.
+    unsigned drops{0};
+  };
+
+  // What offboard flight needs: calibrated sensors, a local position and
+  // the autopilot's own pre-arm checks.
+  static std::vector<Flag> default_required();
+
+  explicit ReadinessMonitor(const std::vector<Flag> &required =
+                                default_required(),
+                            Clock::time_point start = Clock::now());
+
+  // Start timing the flags over again.
+  void start(Clock::time_point now = Clock::now());
+
+  // returns true on the update that makes the vehicle ready.
+  bool update(const mavsdk::Telemetry::Health &health,
+              Clock::time_point now = Clock::now());
+
+  bool ready() const { return (_ok & _required) == _required; }
+  bool is_required(Flag flag) const { return _required & bit(flag); }
+  // From start() until the vehicle was first ready, zero if it never was.
+  Clock::duration time_to_ready() const { return _time_to_ready; }
+  const FlagState &flag(Flag flag) const {
+    return _flags[static_cast<size_t>(flag)];
+  }
+  // Required flags that are not set right now.
+  std::vector<Flag> missing() const;
+
+private:
+  static uint32_t bit(Flag flag) {
+    return 1u << static_cast<uint32_t>(flag);
+  }
+
+  uint32_t _required{0};
+  uint32_t _ok{0};
+  Clock::time_point _start{};
+  Clock::duration _time_to_ready{};
+  std::array<FlagState, flag_count> _flags{};
+};
+
+const char *to_string(ReadinessMonitor::Flag flag);
+
+// Print the time to ready and, per flag, its time to come up, slowest
+// required flag first.
+void print_readiness(const ReadinessMonitor &readiness);
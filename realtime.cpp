@@ -0,0 +1,197 @@
+#include "realtime.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+// Enough for the loops and the MAVSDK calls they make.
+constexpr size_t stack_prefault_bytes = 256 * 1024;
+
+bool parse_int(const std::string &text, long min, long max, int &value) {
+  char *end = nullptr;
+  const long parsed = std::strtol(text.c_str(), &end, 10);
+  if (text.empty() || *end != '\0' || parsed < min || parsed > max) {
+    return false;
+  }
+  value = static_cast<int>(parsed);
+  return true;
+}
+
+void prefault_stack() {
+  unsigned char stack[stack_prefault_bytes];
+  // Volatile writes, so that the compiler cannot drop the touches.
+  volatile unsigned char *page = stack;
+  for (size_t i = 0; i < stack_prefault_bytes; i += 4096) {
+    page[i] = 0;
+  }
+}
+
+} // namespace
+
+const char *const realtime_usage =
+    "[--rt-priority <1-98>] [--rt-cpu <n>] [--io-cpu <n>] [--mlockall]";
+
+bool parse_realtime_arguments(std::vector<std::string> &arguments,
+                              RealtimeOptions &options) {
+  std::vector<std::string> remaining;
+  for (size_t i = 0; i < arguments.size(); ++i) {
+    const std::string &argument = arguments[i];
+
+    if (argument == "--mlockall") {
+      options.lock_memory = true;
+      options.control.prefault_stack = true;
+      options.watchdog.prefault_stack = true;
+      options.io.prefault_stack = true;
+    } else if (argument == "--rt-priority" || argument == "--rt-cpu" ||
+               argument == "--io-cpu") {
+      if (i + 1 >= arguments.size()) {
+        std::cerr << argument << " needs a value\n";
+        return false;
+      }
+      const std::string &value = arguments[++i];
+      if (argument == "--rt-priority") {
+        if (!parse_int(value, 1, 98, options.control.priority)) {
+          std::cerr << "Real-time priority must be between 1 and 98\n";
+          return false;
+        }
+        // I/O threads feed the control loop but must not preempt it.
+        options.watchdog.priority = options.control.priority + 1;
+        options.io.priority = options.control.priority - 1;
+      } else if (argument == "--rt-cpu") {
+        if (!parse_int(value, 0, 1023, options.control.cpu)) {
+          std::cerr << "Invalid CPU " << value << '\n';
+          return false;
+        }
+        options.watchdog.cpu = options.control.cpu;
+      } else if (!parse_int(value, 0, 1023, options.io.cpu)) {
+        std::cerr << "Invalid CPU " << value << '\n';
+        return false;
+      }
+    } else {
+      remaining.push_back(argument);
+    }
+  }
+  arguments = remaining;
+  return true;
+}
+
+bool apply_thread_options(const ThreadOptions &options,
+                          const std::string &thread_name) {
+  bool applied = true;
+#if defined(__linux__)
+  if (options.cpu >= 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(options.cpu, &cpus);
+    const int error = pthread_setaffinity_np(pthread_self(), sizeof(cpus),
+                                             &cpus);
+    if (error != 0) {
+      std::cerr << thread_name << ": cannot pin to CPU " << options.cpu
+                << ": " << std::strerror(error) << '\n';
+      applied = false;
+    }
+  }
+  if (options.priority > 0) {
+    sched_param param{};
+    param.sched_priority = options.priority;
+    const int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (error != 0) {
+      std::cerr << thread_name << ": runs without real-time priority: "
+                << std::strerror(error) << '\n';
+      applied = false;
+    }
+  }
+#else
+  if (options.cpu >= 0 || options.priority > 0) {
+    std::cerr << thread_name
+              << ": real-time options are only supported on Linux\n";
+    applied = false;
+  }
+#endif
+  if (options.prefault_stack) {
+    prefault_stack();
+  }
+  return applied;
+}
+
+bool lock_memory() {
+#if defined(__linux__)
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0) {
+    return true;
+  }
+  std::cerr << "Cannot lock memory: " << std::strerror(errno) << '\n';
+#else
+  std::cerr << "Locking memory is only supported on Linux\n";
+#endif
+  return false;
+}
+
+void JitterHistogram::record(Clock::duration lateness) {
+  const int64_t us =
+      std::chrono::duration_cast<std::chrono::microseconds>(lateness).count();
+  size_t bucket = 0;
+  while (bucket < bounds_us.size() && us >= bounds_us[bucket]) {
+    ++bucket;
+  }
+  _counts[bucket].fetch_add(1, std::memory_order_relaxed);
+  if (us > _max_us.load(std::memory_order_relaxed)) {
+    _max_us.store(us, std::memory_order_relaxed);
+  }
+}
+
+void JitterHistogram::reset() {
+  for (auto &count : _counts) {
+    count.store(0, std::memory_order_relaxed);
+  }
+  _max_us.store(0, std::memory_order_relaxed);
+}
+
+JitterHistogram::Counts JitterHistogram::counts() const {
+  Counts counts{};
+  for (size_t i = 0; i < bucket_count; ++i) {
+    counts[i] = _counts[i].load(std::memory_order_relaxed);
+  }
+  return counts;
+}
+
+void print_jitter(const std::string &name, const JitterHistogram &jitter) {
+  const auto counts = jitter.counts();
+  uint64_t total = 0;
+  for (const auto count : counts) {
+    total += count;
+  }
+  std::cout << name << " wake-up lateness over " << total
+            << " loops, max " << jitter.max().count() << " us:\n";
+  if (total == 0) {
+    return;
+  }
+
+  const auto precision = std::cout.precision();
+  std::cout << std::fixed << std::setprecision(2);
+  for (size_t i = 0; i < counts.size(); ++i) {
+    if (counts[i] == 0) {
+      continue;
+    }
+    std::cout << "  ";
+    if (i < JitterHistogram::bounds_us.size()) {
+      std::cout << "< " << std::setw(6) << JitterHistogram::bounds_us[i];
+    } else {
+      std::cout << ">= " << std::setw(5) << JitterHistogram::bounds_us.back();
+    }
+    std::cout << " us " << std::setw(10) << counts[i] << std::setw(8)
+              << 100.0 * static_cast<double>(counts[i]) /
+                     static_cast<double>(total)
+              << " %\n";
+  }
+  std::cout << std::defaultfloat << std::setprecision(precision);
+}
@@ -0,0 +1,101 @@
+//
+// Real-time options for the control and I/O threads.
+//
+// On a companion computer the offboard threads share cores with camera and
+// logging processes. Each thread can run under SCHED_FIFO, be pinned to a
+// CPU and touch its stack up front, and the process can lock its memory,
+// so that neither the scheduler nor a page fault delays a tick.
+//
+// Every looping thread records its wake-up lateness in a JitterHistogram,
+// which makes the effect of the options measurable on target hardware: run
+// once without and once with them and compare.
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct ThreadOptions {
+  // SCHED_FIFO priority from 1 to 99, 0 keeps the default scheduler.
+  int priority{0};
+  // CPU to pin the thread to, -1 leaves it free.
+  int cpu{-1};
+  // Touch the stack up front, so that the loop never faults on it.
+  bool prefault_stack{false};
+};
+
+// The watchdog runs real-time even without options: above the MAVSDK
+// threads, below what the kernel needs for itself.
+constexpr int default_watchdog_priority = 80;
+
+struct RealtimeOptions {
+  // Setpoint streaming.
+  ThreadOptions control{};
+  // The failsafe watchdog, one priority above the control thread once
+  // --rt-priority is given.
+  ThreadOptions watchdog{default_watchdog_priority, -1, false};
+  // Sensor bridges such as the vision bridge.
+  ThreadOptions io{};
+  // mlockall() the process, current and future pages.
+  bool lock_memory{false};
+};
+
+// Usage text of the flags parse_realtime_arguments() takes.
+extern const char *const realtime_usage;
+
+// Take the real-time flags out of the tool-specific `arguments`:
+//
+//   --rt-priority <1-98>  --rt-cpu <n>  --io-cpu <n>  --mlockall
+//
+// --mlockall also prefaults the stacks of the configured threads.
+//
+// returns false if a flag is malformed.
+bool parse_realtime_arguments(std::vector<std::string> &arguments,
+                              RealtimeOptions &options);
+
+// Apply `options` to the calling thread. What cannot be applied, e.g. for
+// lack of CAP_SYS_NICE, is reported under `thread_name` and skipped.
+//
+// returns true if everything was applied.
+bool apply_thread_options(const ThreadOptions &options,
+                          const std::string &thread_name);
+
+// returns false if the memory could not be locked.
+bool lock_memory();
+
+//
+// Histogram of loop wake-up lateness in fixed microsecond buckets. Written
+// by one loop thread and readable from any thread at any time.
+//
+class JitterHistogram {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // Upper bounds of the buckets in microseconds; the last one is open.
+  static constexpr std::array<int64_t, 10> bounds_us{
+      10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000};
+  static constexpr size_t bucket_count = bounds_us.size() + 1;
+
+  using Counts = std::array<uint64_t, bucket_count>;
+
+  void record(Clock::duration lateness);
+  void reset();
+
+  Counts counts() const;
+  std::chrono::microseconds max() const {
+    return std::chrono::microseconds(
+        _max_us.load(std::memory_order_relaxed));
+  }
+
+private:
+  std::array<std::atomic<uint64_t>, bucket_count> _counts{};
+  std::atomic<int64_t> _max_us{0};
+};
+
+// Print one line per non-empty bucket, with the share of samples in it.
+void print_jitter(const std::string &name, const JitterHistogram &jitter);
@@ -0,0 +1,99 @@
+#include "replay.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "flight_log_reader.h"
+
+using namespace mavsdk;
+
+namespace fr = flight_record;
+
+bool load_replay_log(const std::vector<std::string> &chunk_paths,
+                     ReplayLog &log) {
+  log = {};
+  for (const auto &path : chunk_paths) {
+    const long count = fr::read_chunk(
+        path, [&log](const fr::RecordHeader &header, const char *data,
+                     uint64_t) {
+          ReplayLog::Event event{};
+          event.time = ReplayLog::Clock::time_point(
+              std::chrono::microseconds(header.timestamp_us));
+
+          fr::PositionVelocityNed position_velocity{};
+          fr::EulerAngle attitude{};
+          if (header.type ==
+                  static_cast<uint16_t>(fr::RecordType::PositionVelocityNed) &&
+              fr::read_payload(header, data, position_velocity)) {
+            auto &position = event.position_velocity.position;
+            auto &velocity = event.position_velocity.velocity;
+            position.north_m = position_velocity.north_m;
+            position.east_m = position_velocity.east_m;
+            position.down_m = position_velocity.down_m;
+            velocity.north_m_s = position_velocity.north_m_s;
+            velocity.east_m_s = position_velocity.east_m_s;
+            velocity.down_m_s = position_velocity.down_m_s;
+          } else if (header.type ==
+                         static_cast<uint16_t>(fr::RecordType::EulerAngle) &&
+                     fr::read_payload(header, data, attitude)) {
+            event.is_position = false;
+            event.attitude.roll_deg = attitude.roll_deg;
+            event.attitude.pitch_deg = attitude.pitch_deg;
+            event.attitude.yaw_deg = attitude.yaw_deg;
+            event.attitude.timestamp_us = attitude.autopilot_timestamp_us;
+          } else {
+            ++log.ignored_records;
+            return;
+          }
+          log.events.push_back(event);
+        });
+    if (count < 0) {
+      return false;
+    }
+  }
+
+  if (log.events.empty()) {
+    std::cerr << "No position or attitude records to replay\n";
+    return false;
+  }
+  // Callbacks on different MAVSDK threads may have recorded slightly out of
+  // order.
+  std::stable_sort(log.events.begin(), log.events.end(),
+                   [](const ReplayLog::Event &a, const ReplayLog::Event &b) {
+                     return a.time < b.time;
+                   });
+  return true;
+}
+
+uint64_t replay(const ReplayLog &log, VehicleState &state, double rate_hz,
+                const ReplayTick &tick, ReplayLog::Clock::duration skip) {
+  using Clock = ReplayLog::Clock;
+  if (log.events.empty() || rate_hz <= 0.0) {
+    return 0;
+  }
+
+  const auto period = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(1.0 / rate_hz));
+  const auto start = log.events.front().time + skip;
+  const auto end = log.events.back().time;
+
+  // Samples before the start still fill the cache, as they would have
+  // before the code under test started.
+  size_t next = 0;
+  uint64_t ticks = 0;
+  for (auto now = start; now <= end; now += period) {
+    for (; next < log.events.size() && log.events[next].time <= now; ++next) {
+      const auto &event = log.events[next];
+      if (event.is_position) {
+        state.update(event.position_velocity, event.time);
+      } else {
+        state.update(event.attitude, event.time);
+      }
+    }
+    ++ticks;
+    if (!tick(now)) {
+      break;
+    }
+  }
+  return ticks;
+}
@@ -0,0 +1,68 @@
+//
+// Replay of recorded flights in simulated time.
+//
+// A flight recorder log is loaded into memory once and then fed into a
+// VehicleState at the recorded arrival times, while a tick callback runs the
+// control code at its rate in between. Time is whatever the log says and
+// nothing sleeps, so a replay runs as fast as the code under test: minutes
+// of flight take well under a second. The log is read-only during a replay
+// and can be shared by any number of replays running in parallel.
+//
+// A replay is open loop: the vehicle flies as recorded, whatever the code
+// under test commands.
+//
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <mavsdk/plugins/telemetry/telemetry.h>
+
+#include "vehicle_state.h"
+
+struct ReplayLog {
+  using Clock = VehicleState::Clock;
+
+  struct Event {
+    // Arrival time on the recording machine's steady clock.
+    Clock::time_point time{};
+    // Otherwise an attitude.
+    bool is_position{true};
+    mavsdk::Telemetry::PositionVelocityNed position_velocity{};
+    mavsdk::Telemetry::EulerAngle attitude{};
+  };
+
+  // In time order.
+  std::vector<Event> events{};
+  // Records VehicleState does not take, such as battery or GPS.
+  uint64_t ignored_records{0};
+
+  Clock::duration duration() const {
+    return events.empty() ? Clock::duration{}
+                          : events.back().time - events.front().time;
+  }
+};
+
+// Load the position_velocity_ned and attitude_euler records of the chunks of
+// one recording.
+//
+// returns false if a chunk is unreadable or no record was usable.
+bool load_replay_log(const std::vector<std::string> &chunk_paths,
+                     ReplayLog &log);
+
+// Called with the nominal time of a control tick. returns false to stop.
+using ReplayTick = std::function<bool(ReplayLog::Clock::time_point tick)>;
+
+// Replay `log` into `state`, starting `skip` into the log, and call `tick`
+// every 1 / `rate_hz` of simulated time once every sample up to that time
+// has been delivered.
+//
+// returns the number of ticks, up to the end of the log or the tick that
+// returned false.
+uint64_t replay(const ReplayLog &log, VehicleState &state, double rate_hz,
+                const ReplayTick &tick,
+                ReplayLog::Clock::duration skip = {});
@@ -0,0 +1,67 @@
+//
+// Sequence lock for small trivially copyable values.
+//
+// One writer at a time publishes values, any number of readers copy the
+// latest one without taking a lock and without ever making the writer wait.
+// A reader only retries if it overlapped a write, which is a copy of a few
+// words. The value is stored as relaxed atomic words, so concurrent reads
+// and writes are well defined.
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+template <typename T> class Seqlock {
+public:
+  static_assert(std::is_trivially_copyable<T>::value,
+                "Seqlock values are copied word by word");
+
+  Seqlock() { write(T{}); }
+
+  Seqlock(const Seqlock &) = delete;
+  Seqlock &operator=(const Seqlock &) = delete;
+
+  // Writers must not overlap each other.
+  void write(const T &value) {
+    std::array<uint64_t, word_count> words{};
+    std::memcpy(words.data(), &value, sizeof(T));
+
+    const uint64_t sequence = _sequence.load(std::memory_order_relaxed);
+    _sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < word_count; ++i) {
+      _words[i].store(words[i], std::memory_order_relaxed);
+    }
+    _sequence.store(sequence + 2, std::memory_order_release);
+  }
+
+  // returns the number of retries needed to get a consistent copy.
+  unsigned read(T &value) const {
+    std::array<uint64_t, word_count> words{};
+    for (unsigned retries = 0;; ++retries) {
+      const uint64_t before = _sequence.load(std::memory_order_acquire);
+      if (before & 1) {
+        continue;
+      }
+      for (size_t i = 0; i < word_count; ++i) {
+        words[i] = _words[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (_sequence.load(std::memory_order_relaxed) == before) {
+        std::memcpy(static_cast<void *>(&value), words.data(), sizeof(T));
+        return retries;
+      }
+    }
+  }
+
+private:
+  static constexpr size_t word_count = (sizeof(T) + 7) / 8;
+
+  alignas(64) std::atomic<uint64_t> _sequence{0};
+  std::array<std::atomic<uint64_t>, word_count> _words{};
+};
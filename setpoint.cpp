@@ -0,0 +1,59 @@
+#include "setpoint.h"
+
+using namespace mavsdk;
+
+Setpoint Setpoint::make_position_ned(const Offboard::PositionNedYaw &position) {
+  Setpoint setpoint{};
+  setpoint.type = Type::PositionNed;
+  setpoint.position_ned = position;
+  return setpoint;
+}
+
+Setpoint Setpoint::make_velocity_ned(const Offboard::VelocityNedYaw &velocity) {
+  Setpoint setpoint{};
+  setpoint.type = Type::VelocityNed;
+  setpoint.velocity_ned = velocity;
+  return setpoint;
+}
+
+Setpoint
+Setpoint::make_velocity_body(const Offboard::VelocityBodyYawspeed &velocity) {
+  Setpoint setpoint{};
+  setpoint.type = Type::VelocityBody;
+  setpoint.velocity_body = velocity;
+  return setpoint;
+}
+
+Setpoint
+Setpoint::make_position_velocity_ned(const Offboard::PositionNedYaw &position,
+                                     const Offboard::VelocityNedYaw &velocity) {
+  Setpoint setpoint{};
+  setpoint.type = Type::PositionVelocityNed;
+  setpoint.position_ned = position;
+  setpoint.velocity_ned = velocity;
+  return setpoint;
+}
+
+Setpoint Setpoint::make_attitude(const Offboard::Attitude &attitude) {
+  Setpoint setpoint{};
+  setpoint.type = Type::Attitude;
+  setpoint.attitude = attitude;
+  return setpoint;
+}
+
+Offboard::Result send_setpoint(Offboard &offboard, const Setpoint &setpoint) {
+  switch (setpoint.type) {
+  case Setpoint::Type::PositionNed:
+    return offboard.set_position_ned(setpoint.position_ned);
+  case Setpoint::Type::VelocityNed:
+    return offboard.set_velocity_ned(setpoint.velocity_ned);
+  case Setpoint::Type::VelocityBody:
+    return offboard.set_velocity_body(setpoint.velocity_body);
+  case Setpoint::Type::PositionVelocityNed:
+    return offboard.set_position_velocity_ned(setpoint.position_ned,
+                                              setpoint.velocity_ned);
+  case Setpoint::Type::Attitude:
+    return offboard.set_attitude(setpoint.attitude);
+  }
+  return Offboard::Result::Unknown;
+}
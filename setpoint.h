@@ -0,0 +1,42 @@
+//
+// Offboard setpoints as plain values, shared by the streamer and the
+// transmit stage.
+//
+
+#pragma once
+
+#include <mavsdk/plugins/offboard/offboard.h>
+
+//
+// One offboard setpoint of any of the supported control types.
+//
+struct Setpoint {
+  enum class Type {
+    PositionNed,
+    VelocityNed,
+    VelocityBody,
+    PositionVelocityNed,
+    Attitude,
+  };
+
+  Type type{Type::VelocityNed};
+  mavsdk::Offboard::PositionNedYaw position_ned{};
+  mavsdk::Offboard::VelocityNedYaw velocity_ned{};
+  mavsdk::Offboard::VelocityBodyYawspeed velocity_body{};
+  mavsdk::Offboard::Attitude attitude{};
+
+  static Setpoint
+  make_position_ned(const mavsdk::Offboard::PositionNedYaw &position);
+  static Setpoint
+  make_velocity_ned(const mavsdk::Offboard::VelocityNedYaw &velocity);
+  static Setpoint
+  make_velocity_body(const mavsdk::Offboard::VelocityBodyYawspeed &velocity);
+  static Setpoint
+  make_position_velocity_ned(const mavsdk::Offboard::PositionNedYaw &position,
+                             const mavsdk::Offboard::VelocityNedYaw &velocity);
+  static Setpoint make_attitude(const mavsdk::Offboard::Attitude &attitude);
+};
+
+// Send `setpoint` with the Offboard call matching its type.
+mavsdk::Offboard::Result send_setpoint(mavsdk::Offboard &offboard,
+                                       const Setpoint &setpoint);
@@ -0,0 +1,156 @@
+#include "setpoint_streamer.h"
+
+#include <iostream>
+
+#include "trajectory.h"
+
+using namespace mavsdk;
+
+namespace {
+
+// How long start() waits for the first tick in periods.
+constexpr int first_tick_periods = 5;
+
+} // namespace
+
+SetpointStreamer::SetpointStreamer(Offboard &offboard, double rate_hz,
+                                   std::chrono::milliseconds heartbeat_period)
+    : _rate_hz(rate_hz),
+      _period(std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double>(1.0 / rate_hz))),
+      _transmitter(offboard, heartbeat_period),
+      _lateness_metric(metrics().histogram("streamer.lateness")),
+      _overruns_metric(metrics().counter("streamer.overruns")) {}
+
+SetpointStreamer::~SetpointStreamer() { stop(); }
+
+bool SetpointStreamer::start(const Setpoint &initial) {
+  if (!prepare_start()) {
+    return false;
+  }
+  set_target(initial);
+  _thread = std::thread(&SetpointStreamer::run, this);
+  wait_for_first_tick();
+  return true;
+}
+
+bool SetpointStreamer::prepare_start() {
+  if (!(_rate_hz >= min_rate_hz && _rate_hz <= max_rate_hz)) {
+    std::cerr << "Setpoint rate " << _rate_hz << " Hz out of range ["
+              << min_rate_hz << ", " << max_rate_hz << "]\n";
+    return false;
+  }
+
+  if (_running.exchange(true)) {
+    std::cerr << "Setpoint streamer already running\n";
+    return false;
+  }
+
+  _ticks.store(0);
+  _target_writes.store(0);
+  _targets_coalesced.store(0);
+  _transmitter.reset();
+  _overruns.store(0);
+  _max_lateness_us.store(0);
+  _jitter.reset();
+  return true;
+}
+
+void SetpointStreamer::wait_for_first_tick() const {
+  // The autopilot refuses to start offboard before a setpoint has arrived,
+  // and callers start it as soon as this returns.
+  const auto deadline = Clock::now() + first_tick_periods * _period;
+  while (_ticks.load() < 1 && Clock::now() < deadline) {
+    std::this_thread::sleep_for(_period / 4);
+  }
+}
+
+void SetpointStreamer::stop() {
+  _running.store(false);
+  if (_thread.joinable()) {
+    _thread.join();
+  }
+}
+
+void SetpointStreamer::set_target(const Setpoint &setpoint) {
+  // Only the streaming thread submits, after the guard.
+  Target target{};
+  target.setpoint = setpoint;
+  write_target(target);
+}
+
+void SetpointStreamer::write_target(const Target &target) {
+  _mailbox.write(target);
+  _target_writes.fetch_add(1, std::memory_order_release);
+}
+
+void SetpointStreamer::set_target_and_wait(const Setpoint &setpoint) {
+  const uint64_t ticks = _ticks.load();
+  set_target(setpoint);
+
+  // The tick in flight may still use the previous target, the one after it
+  // has read the new one.
+  while (_running.load() && _ticks.load() < ticks + 2) {
+    std::this_thread::sleep_for(_period / 4);
+  }
+}
+
+void SetpointStreamer::follow(const Trajectory &trajectory) {
+  Target target{};
+  target.trajectory = &trajectory;
+  target.start = Clock::now();
+  write_target(target);
+}
+
+void SetpointStreamer::drive(SetpointSource &source) {
+  Target target{};
+  target.source = &source;
+  write_target(target);
+}
+
+SetpointStreamer::Stats SetpointStreamer::stats() const {
+  Stats stats{};
+  const auto transmitter = _transmitter.stats();
+  stats.ticks = _ticks.load(std::memory_order_relaxed);
+  stats.sent = transmitter.sent;
+  stats.coalesced = transmitter.coalesced +
+                    _targets_coalesced.load(std::memory_order_relaxed);
+  stats.suppressed = transmitter.suppressed;
+  stats.send_failures = transmitter.send_failures;
+  stats.overruns = _overruns.load(std::memory_order_relaxed);
+  stats.max_lateness = std::chrono::microseconds(
+      _max_lateness_us.load(std::memory_order_relaxed));
+  return stats;
+}
+
+void SetpointStreamer::run() {
+  Target target{};
+  SetpointGuard *const guard = _guard;
+  uint64_t writes_seen = 0;
+
+  loop([this, &target, &writes_seen, guard](Clock::time_point tick,
+                                            Setpoint &setpoint) {
+    // Counted before the read, so a write racing it is left for the next
+    // tick rather than counted twice.
+    const uint64_t writes = _target_writes.load(std::memory_order_acquire);
+    _mailbox.read(target);
+    if (writes > writes_seen + 1) {
+      // All but the newest were replaced before any tick read them.
+      _targets_coalesced.fetch_add(writes - writes_seen - 1,
+                                   std::memory_order_relaxed);
+    }
+    writes_seen = writes;
+    if (target.trajectory) {
+      // Sample at the nominal tick time so that wake-up jitter does not show
+      // up in the setpoints.
+      target.trajectory->sample(tick - target.start, setpoint);
+    } else if (target.source) {
+      target.source->next(tick, setpoint);
+    } else {
+      setpoint = target.setpoint;
+    }
+    if (guard) {
+      guard->admit(tick, setpoint);
+    }
+  });
+}
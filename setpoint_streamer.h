@@ -0,0 +1,229 @@
+//
+// Fixed-rate offboard setpoint streaming.
+//
+// A dedicated thread wakes on absolute deadlines and sends the latest
+// setpoint to the autopilot, so the offboard heartbeat rate no longer depends
+// on what the mission code happens to be doing. Mission code only writes
+// targets, it never sleeps on the control path. Each tick is one transmit
+// window of a SetpointTransmitter, which drops superseded setpoints and
+// sends unchanged ones at the heartbeat rate only.
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#include <mavsdk/plugins/offboard/offboard.h>
+
+#include "mailbox.h"
+#include "metrics.h"
+#include "realtime.h"
+#include "setpoint.h"
+#include "setpoint_transmitter.h"
+
+class Trajectory;
+
+//
+// Computes a fresh setpoint on every tick of the streaming thread, e.g. a
+// controller closing the loop on the vehicle state.
+//
+class SetpointSource {
+public:
+  virtual ~SetpointSource() = default;
+
+  // Called on the streaming thread with the nominal time of the tick.
+  virtual void next(std::chrono::steady_clock::time_point tick,
+                    Setpoint &setpoint) = 0;
+};
+
+//
+// Vets every setpoint on the streaming thread before it is transmitted,
+// e.g. against a geofence.
+//
+class SetpointGuard {
+public:
+  virtual ~SetpointGuard() = default;
+
+  // May replace `setpoint` with a safer one. Must not block.
+  virtual void admit(std::chrono::steady_clock::time_point tick,
+                     Setpoint &setpoint) = 0;
+};
+
+class SetpointStreamer {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr double min_rate_hz = 50.0;
+  static constexpr double max_rate_hz = 250.0;
+  static constexpr double default_rate_hz = 100.0;
+
+  struct Stats {
+    uint64_t ticks{0};
+    // Setpoints that went on the link.
+    uint64_t sent{0};
+    // Targets replaced before a tick read them, and setpoints superseded
+    // before their transmit window.
+    uint64_t coalesced{0};
+    // Repeats of the last setpoint sent, held back until a heartbeat.
+    uint64_t suppressed{0};
+    uint64_t send_failures{0};
+    // Ticks where sending finished after the next deadline had passed.
+    uint64_t overruns{0};
+    // Worst wake-up delay past a deadline.
+    std::chrono::microseconds max_lateness{0};
+  };
+
+  SetpointStreamer(mavsdk::Offboard &offboard,
+                   double rate_hz = default_rate_hz,
+                   std::chrono::milliseconds heartbeat_period =
+                       SetpointTransmitter::default_heartbeat_period);
+  ~SetpointStreamer();
+
+  SetpointStreamer(const SetpointStreamer &) = delete;
+  SetpointStreamer &operator=(const SetpointStreamer &) = delete;
+
+  // Takes effect on the next start().
+  void set_thread_options(const ThreadOptions &options) {
+    _thread_options = options;
+  }
+
+  // Pass every setpoint through `guard` from the next start() on. The guard
+  // must outlive streaming.
+  void set_guard(SetpointGuard *guard) { _guard = guard; }
+
+  // Start streaming `initial` until a new target is written. Stats are
+  // reset on every start. Returns once the first tick has sent its
+  // setpoint, or a few periods have passed, so that offboard can be started
+  // right after.
+  //
+  // returns false if the rate is out of range or the streamer already runs.
+  bool start(const Setpoint &initial);
+
+  // Start streaming what `pipeline` computes on every tick (see
+  // pipeline.h), until stopped. Its tick() is compiled into the streaming
+  // loop, so no stage costs an indirect call. Targets and the guard set
+  // here are ignored meanwhile; guards go into the pipeline instead. The
+  // pipeline must outlive streaming. Waits for the first tick like start().
+  //
+  // returns false like start().
+  template <typename Pipeline> bool start_pipeline(Pipeline &pipeline) {
+    if (!prepare_start()) {
+      return false;
+    }
+    _thread = std::thread([this, &pipeline]() {
+      loop([&pipeline](Clock::time_point tick, Setpoint &setpoint) {
+        pipeline.tick(tick, setpoint);
+      });
+    });
+    wait_for_first_tick();
+    return true;
+  }
+  void stop();
+  bool is_running() const { return _running.load(); }
+
+  // Replace the target that is sent on the next tick. Never blocks.
+  void set_target(const Setpoint &setpoint);
+  // Like set_target(), but only returns once the streaming thread has moved
+  // on to `setpoint`, so that a trajectory followed before can be destroyed.
+  void set_target_and_wait(const Setpoint &setpoint);
+
+  // Send the current setpoint on the next tick even if it is unchanged,
+  // e.g. to prime offboard mode again after a link outage. Never blocks.
+  void resend() { _transmitter.resend(); }
+
+  // Follow `trajectory` from now on, one table lookup per tick, until a new
+  // target is set. The trajectory must stay alive until then or until the
+  // streamer is stopped. Never blocks.
+  void follow(const Trajectory &trajectory);
+
+  // Ask `source` for the setpoint of every tick from now on, until a new
+  // target is set. Same lifetime rule as for follow(). Never blocks.
+  void drive(SetpointSource &source);
+
+  double rate_hz() const { return _rate_hz; }
+  // Cheap enough to poll as a heartbeat.
+  uint64_t ticks() const { return _ticks.load(std::memory_order_relaxed); }
+  Stats stats() const;
+  const JitterHistogram &jitter() const { return _jitter; }
+
+private:
+  struct Target {
+    Setpoint setpoint{};
+    // Sampled instead of `setpoint` if set.
+    const Trajectory *trajectory{nullptr};
+    SetpointSource *source{nullptr};
+    Clock::time_point start{};
+  };
+
+  // Checks the rate, marks the streamer running and resets the stats.
+  bool prepare_start();
+  void wait_for_first_tick() const;
+  void write_target(const Target &target);
+  void run();
+
+  // The fixed-rate loop around `produce`, which is called with the nominal
+  // tick time and fills in the setpoint to transmit.
+  template <typename Produce> void loop(Produce &&produce);
+
+  const double _rate_hz;
+  const Clock::duration _period;
+
+  Mailbox<Target> _mailbox{};
+  SetpointTransmitter _transmitter;
+  std::atomic<bool> _running{false};
+  ThreadOptions _thread_options{};
+  SetpointGuard *_guard{nullptr};
+  std::thread _thread{};
+
+  std::atomic<uint64_t> _ticks{0};
+  // Targets written since start(), and those never read by a tick.
+  std::atomic<uint64_t> _target_writes{0};
+  std::atomic<uint64_t> _targets_coalesced{0};
+  std::atomic<uint64_t> _overruns{0};
+  std::atomic<int64_t> _max_lateness_us{0};
+  JitterHistogram _jitter{};
+  LatencyHistogram &_lateness_metric;
+  Counter &_overruns_metric;
+};
+
+template <typename Produce> void SetpointStreamer::loop(Produce &&produce) {
+  apply_thread_options(_thread_options, "Setpoint streamer");
+
+  Setpoint setpoint{};
+  auto deadline = Clock::now();
+
+  while (_running.load(std::memory_order_relaxed)) {
+    produce(deadline, setpoint);
+    _transmitter.submit(setpoint);
+    _transmitter.flush(deadline);
+    _ticks.fetch_add(1, std::memory_order_relaxed);
+
+    // Deadlines advance by a whole period from the previous deadline rather
+    // than from "now", so the rate does not drift with the send time.
+    deadline += _period;
+    const auto now = Clock::now();
+    if (now >= deadline) {
+      // We missed at least one tick. Skip the missed deadlines instead of
+      // bursting out stale setpoints to catch up.
+      _overruns.fetch_add(1, std::memory_order_relaxed);
+      _overruns_metric.add();
+      const auto missed = (now - deadline) / _period + 1;
+      deadline += missed * _period;
+    }
+
+    std::this_thread::sleep_until(deadline);
+
+    const auto lateness = Clock::now() - deadline;
+    _jitter.record(lateness);
+    _lateness_metric.record(lateness);
+    const auto lateness_us =
+        std::chrono::duration_cast<std::chrono::microseconds>(lateness)
+            .count();
+    if (lateness_us > _max_lateness_us.load(std::memory_order_relaxed)) {
+      _max_lateness_us.store(lateness_us, std::memory_order_relaxed);
+    }
+  }
+}
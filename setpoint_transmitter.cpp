@@ -0,0 +1,109 @@
+#include "setpoint_transmitter.h"
+
+using namespace mavsdk;
+
+bool same_command(const Setpoint &a, const Setpoint &b) {
+  if (a.type != b.type) {
+    return false;
+  }
+  switch (a.type) {
+  case Setpoint::Type::PositionNed:
+    return a.position_ned == b.position_ned;
+  case Setpoint::Type::VelocityNed:
+    return a.velocity_ned == b.velocity_ned;
+  case Setpoint::Type::VelocityBody:
+    return a.velocity_body == b.velocity_body;
+  case Setpoint::Type::PositionVelocityNed:
+    return a.position_ned == b.position_ned &&
+           a.velocity_ned == b.velocity_ned;
+  case Setpoint::Type::Attitude:
+    return a.attitude == b.attitude;
+  }
+  return false;
+}
+
+SetpointTransmitter::SetpointTransmitter(
+    Offboard &offboard, std::chrono::milliseconds heartbeat_period)
+    : _offboard(offboard), _heartbeat_period(heartbeat_period),
+      _sent_metric(metrics().counter("setpoint.sent")),
+      _send_failures_metric(metrics().counter("setpoint.send_failures")),
+      _send_time_metric(metrics().histogram("setpoint.send_time")) {}
+
+void SetpointTransmitter::submit(const Setpoint &setpoint) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  Slot &slot = _slots[static_cast<size_t>(setpoint.type)];
+  if (slot.fresh) {
+    ++_stats.coalesced;
+  }
+  slot.pending = setpoint;
+  slot.fresh = true;
+  _active = setpoint.type;
+  _have_active = true;
+  ++_stats.submitted;
+}
+
+void SetpointTransmitter::flush(Clock::time_point now) {
+  Setpoint setpoint{};
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_have_active) {
+      return;
+    }
+
+    // Only the type submitted last goes out: sending an older setpoint of
+    // another type after it would switch the autopilot back to that type.
+    for (size_t i = 0; i < type_count; ++i) {
+      Slot &slot = _slots[i];
+      if (slot.fresh && i != static_cast<size_t>(_active)) {
+        slot.fresh = false;
+        ++_stats.coalesced;
+      }
+    }
+
+    Slot &slot = _slots[static_cast<size_t>(_active)];
+    const bool heartbeat_due =
+        !slot.ever_sent || now - slot.sent_at >= _heartbeat_period;
+    if (slot.fresh) {
+      slot.fresh = false;
+      if (!heartbeat_due && same_command(slot.pending, slot.last_sent)) {
+        ++_stats.suppressed;
+        return;
+      }
+      slot.last_sent = slot.pending;
+    } else if (!heartbeat_due) {
+      return;
+    }
+    slot.ever_sent = true;
+    slot.sent_at = now;
+    setpoint = slot.last_sent;
+    ++_stats.sent;
+  }
+
+  // Send outside the lock so that a slow link never blocks submit().
+  const auto start = Clock::now();
+  const auto result = send_setpoint(_offboard, setpoint);
+  _send_time_metric.record(Clock::now() - start);
+  _sent_metric.add();
+  if (result != Offboard::Result::Success) {
+    _send_failures_metric.add();
+    std::lock_guard<std::mutex> lock(_mutex);
+    ++_stats.send_failures;
+  }
+}
+
+void SetpointTransmitter::reset() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _slots = {};
+  _have_active = false;
+  _stats = {};
+}
+
+void SetpointTransmitter::resend() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _slots[static_cast<size_t>(_active)].ever_sent = false;
+}
+
+SetpointTransmitter::Stats SetpointTransmitter::stats() const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _stats;
+}
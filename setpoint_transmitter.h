@@ -0,0 +1,94 @@
+//
+// Coalescing transmit stage in front of Offboard.
+//
+// Setpoints are submitted as fast as the mission logic likes and kept in
+// one slot per control type. Every transmit window flush() sends only the
+// newest setpoint of each type, so a congested link never carries a stale
+// setpoint ahead of a fresh one. A setpoint identical to the last one sent
+// is only repeated at the heartbeat period, which keeps offboard mode alive
+// without spending the link on copies.
+//
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+#include <mavsdk/plugins/offboard/offboard.h>
+
+#include "metrics.h"
+#include "setpoint.h"
+
+// Whether the two setpoints command the same thing: same type and same
+// values for that type.
+bool same_command(const Setpoint &a, const Setpoint &b);
+
+class SetpointTransmitter {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // PX4 drops out of offboard below 2 Hz; repeat at 5 Hz for some margin.
+  static constexpr std::chrono::milliseconds default_heartbeat_period{200};
+
+  struct Stats {
+    uint64_t submitted{0};
+    uint64_t sent{0};
+    // Replaced by a newer setpoint of the same type before being sent.
+    uint64_t coalesced{0};
+    // Identical to the last one sent and not due for a heartbeat.
+    uint64_t suppressed{0};
+    uint64_t send_failures{0};
+  };
+
+  explicit SetpointTransmitter(
+      mavsdk::Offboard &offboard,
+      std::chrono::milliseconds heartbeat_period = default_heartbeat_period);
+
+  SetpointTransmitter(const SetpointTransmitter &) = delete;
+  SetpointTransmitter &operator=(const SetpointTransmitter &) = delete;
+
+  // Thread-safe and never sends.
+  void submit(const Setpoint &setpoint);
+
+  // Send what is due in this window. Called from one thread only.
+  void flush(Clock::time_point now = Clock::now());
+
+  // Forget what was sent, so the next flush sends right away.
+  void reset();
+
+  // Send the active setpoint in the next window even if it is not due.
+  // Thread-safe.
+  void resend();
+
+  Stats stats() const;
+
+private:
+  static constexpr size_t type_count = 5;
+
+  struct Slot {
+    Setpoint pending{};
+    bool fresh{false};
+    Setpoint last_sent{};
+    bool ever_sent{false};
+    Clock::time_point sent_at{};
+  };
+
+  bool send(Slot &slot, Clock::time_point now);
+
+  mavsdk::Offboard &_offboard;
+  const Clock::duration _heartbeat_period;
+
+  mutable std::mutex _mutex{};
+  std::array<Slot, type_count> _slots{};
+  // Type of the latest submission, kept alive by heartbeats.
+  Setpoint::Type _active{Setpoint::Type::VelocityNed};
+  bool _have_active{false};
+  Stats _stats{};
+
+  // Shared by all transmitters.
+  Counter &_sent_metric;
+  Counter &_send_failures_metric;
+  LatencyHistogram &_send_time_metric;
+};
@@ -0,0 +1,151 @@
+#include "shm_bus.h"
+
+#include <cmath>
+#include <cstddef>
+
+using namespace mavsdk;
+
+namespace {
+
+// returns the number of values a record of `type` uses, 0 if the type is
+// unknown.
+size_t value_count(uint16_t type) {
+  switch (type) {
+  case ShmSetpoint::PositionNed:
+  case ShmSetpoint::VelocityNed:
+  case ShmSetpoint::VelocityBody:
+  case ShmSetpoint::Attitude:
+    return 4;
+  case ShmSetpoint::PositionVelocityNed:
+    return 7;
+  }
+  return 0;
+}
+
+} // namespace
+
+bool to_setpoint(const ShmSetpoint &record, float max_tilt_deg,
+                 Setpoint &setpoint) {
+  const float *v = record.values;
+  // The publisher is another process; nothing it sends is trusted.
+  const size_t count = value_count(record.type);
+  if (count == 0) {
+    return false;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    if (!std::isfinite(v[i])) {
+      return false;
+    }
+  }
+  // The fence guard passes attitudes through, so their tilt is bounded
+  // here.
+  if (record.type == ShmSetpoint::Attitude &&
+      (std::fabs(v[0]) > max_tilt_deg || std::fabs(v[1]) > max_tilt_deg ||
+       !(v[3] >= 0.0f && v[3] <= 1.0f))) {
+    return false;
+  }
+
+  switch (record.type) {
+  case ShmSetpoint::PositionNed: {
+    Offboard::PositionNedYaw position{};
+    position.north_m = v[0];
+    position.east_m = v[1];
+    position.down_m = v[2];
+    position.yaw_deg = v[3];
+    setpoint = Setpoint::make_position_ned(position);
+    return true;
+  }
+  case ShmSetpoint::VelocityNed: {
+    Offboard::VelocityNedYaw velocity{};
+    velocity.north_m_s = v[0];
+    velocity.east_m_s = v[1];
+    velocity.down_m_s = v[2];
+    velocity.yaw_deg = v[3];
+    setpoint = Setpoint::make_velocity_ned(velocity);
+    return true;
+  }
+  case ShmSetpoint::VelocityBody: {
+    Offboard::VelocityBodyYawspeed velocity{};
+    velocity.forward_m_s = v[0];
+    velocity.right_m_s = v[1];
+    velocity.down_m_s = v[2];
+    velocity.yawspeed_deg_s = v[3];
+    setpoint = Setpoint::make_velocity_body(velocity);
+    return true;
+  }
+  case ShmSetpoint::PositionVelocityNed: {
+    Offboard::PositionNedYaw position{};
+    position.north_m = v[0];
+    position.east_m = v[1];
+    position.down_m = v[2];
+    position.yaw_deg = v[3];
+    Offboard::VelocityNedYaw velocity{};
+    velocity.north_m_s = v[4];
+    velocity.east_m_s = v[5];
+    velocity.down_m_s = v[6];
+    velocity.yaw_deg = v[3];
+    setpoint = Setpoint::make_position_velocity_ned(position, velocity);
+    return true;
+  }
+  case ShmSetpoint::Attitude: {
+    Offboard::Attitude attitude{};
+    attitude.roll_deg = v[0];
+    attitude.pitch_deg = v[1];
+    attitude.yaw_deg = v[2];
+    attitude.thrust_value = v[3];
+    setpoint = Setpoint::make_attitude(attitude);
+    return true;
+  }
+  }
+  return false;
+}
+
+ShmSetpointSource::ShmSetpointSource(const std::string &ring,
+                                     const Setpoint &fallback,
+                                     std::chrono::milliseconds max_age,
+                                     float max_tilt_deg)
+    : _ring(ring, ShmRing<ShmSetpoint>::Role::Consumer), _fallback(fallback),
+      _max_age(max_age), _max_tilt_deg(max_tilt_deg),
+      _latency_metric(metrics().histogram("shm.setpoint_latency")) {}
+
+void ShmSetpointSource::next(Clock::time_point tick, Setpoint &setpoint) {
+  if (_ring.is_open()) {
+    const auto now = Clock::now();
+    _ring.drain([&](const ShmSetpoint &record) {
+      _received.fetch_add(1, std::memory_order_relaxed);
+      if (_has_sequence && record.sequence > _last_sequence + 1) {
+        _sequence_gaps.fetch_add(record.sequence - _last_sequence - 1,
+                                 std::memory_order_relaxed);
+      }
+      _last_sequence = record.sequence;
+      _has_sequence = true;
+
+      const Clock::time_point published{std::chrono::duration_cast<
+          Clock::duration>(std::chrono::nanoseconds(record.publish_time_ns))};
+      _latency_metric.record(now - published);
+      if (!to_setpoint(record, _max_tilt_deg, _latest)) {
+        _invalid.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      _arrived = now;
+      _have_latest = true;
+    });
+  }
+
+  if (_have_latest && tick - _arrived <= _max_age) {
+    setpoint = _latest;
+  } else {
+    setpoint = _fallback;
+    _fallback_ticks.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+ShmSetpointSource::Stats ShmSetpointSource::stats() const {
+  Stats stats{};
+  stats.received = _received.load(std::memory_order_relaxed);
+  stats.invalid = _invalid.load(std::memory_order_relaxed);
+  stats.sequence_gaps = _sequence_gaps.load(std::memory_order_relaxed);
+  stats.fallback_ticks = _fallback_ticks.load(std::memory_order_relaxed);
+  stats.dropped = _ring.is_open() ? _ring.dropped() : 0;
+  return stats;
+}
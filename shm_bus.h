@@ -0,0 +1,84 @@
+//
+// Offboard ends of the shared-memory bus.
+//
+// Perception processes publish ShmSetpoint records on a ShmRing, and a
+// ShmSetpointSource run by the setpoint streamer consumes them on its own
+// thread: every tick drains what was published since the last one, in
+// place, and sends the newest setpoint. Poses go to the vision bridge the
+// same way (VisionBridge::use_shared_memory()).
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "cascade_controller.h"
+#include "metrics.h"
+#include "setpoint_streamer.h"
+#include "shm_records.h"
+#include "shm_ring.h"
+
+// returns false if the record has an unknown type, a value that is not
+// finite, or an attitude with a roll or pitch beyond `max_tilt_deg` or a
+// thrust outside [0, 1]; `setpoint` is left alone then.
+bool to_setpoint(const ShmSetpoint &record, float max_tilt_deg,
+                 Setpoint &setpoint);
+
+class ShmSetpointSource : public SetpointSource {
+public:
+  using Clock = SetpointStreamer::Clock;
+
+  static constexpr std::chrono::milliseconds default_max_age{200};
+
+  struct Stats {
+    uint64_t received{0};
+    // Rejected by to_setpoint() and not used.
+    uint64_t invalid{0};
+    // Setpoints the publisher numbered but that never arrived.
+    uint64_t sequence_gaps{0};
+    // Ticks that sent `fallback` for lack of a fresh setpoint.
+    uint64_t fallback_ticks{0};
+    // Dropped by the publisher on a full ring.
+    uint64_t dropped{0};
+  };
+
+  // Send `fallback` until the first setpoint arrives, and again whenever
+  // the newest one arrived longer than `max_age` ago, so that a dead
+  // publisher never leaves the vehicle on its last velocity. Age is
+  // measured from arrival, as the publisher's own timestamps are not
+  // trusted. Attitudes tilted beyond `max_tilt_deg` are rejected.
+  ShmSetpointSource(const std::string &ring, const Setpoint &fallback,
+                    std::chrono::milliseconds max_age = default_max_age,
+                    float max_tilt_deg = CascadeGains{}.max_tilt_deg);
+
+  // returns false if the ring cannot be opened.
+  bool open() { return _ring.open(); }
+
+  void next(Clock::time_point tick, Setpoint &setpoint) override;
+
+  Stats stats() const;
+
+private:
+  ShmRing<ShmSetpoint> _ring;
+  const Setpoint _fallback;
+  const Clock::duration _max_age;
+  const float _max_tilt_deg;
+
+  // Only touched by the streaming thread.
+  Setpoint _latest{};
+  // When the newest valid setpoint was drained.
+  Clock::time_point _arrived{};
+  bool _have_latest{false};
+  uint32_t _last_sequence{0};
+  bool _has_sequence{false};
+
+  std::atomic<uint64_t> _received{0};
+  std::atomic<uint64_t> _invalid{0};
+  std::atomic<uint64_t> _sequence_gaps{0};
+  std::atomic<uint64_t> _fallback_ticks{0};
+
+  LatencyHistogram &_latency_metric;
+};
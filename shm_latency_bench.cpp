@@ -0,0 +1,147 @@
+//
+// Cross-process latency of the shared-memory pose ring, no vehicle needed.
+//
+// A forked consumer busy-polls the ring the way the vision bridge does with
+// --busy-poll, while the parent publishes poses at a perception-like rate.
+// The consumer reports the distribution of the time from publishing to
+// reading against a budget.
+//
+
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "metrics.h"
+#include "shm_records.h"
+#include "shm_ring.h"
+
+using Clock = std::chrono::steady_clock;
+
+constexpr unsigned default_count = 20000;
+constexpr double default_budget_us = 10.0;
+constexpr auto publish_period = std::chrono::microseconds(500);
+// Marks the end of the run.
+constexpr uint32_t last_sequence = UINT32_MAX;
+
+uint64_t monotonic_time_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             Clock::now().time_since_epoch())
+      .count();
+}
+
+int consume(const std::string &name, int ready_fd, unsigned count,
+            double budget_us) {
+  ShmRing<ShmPose> ring{name, ShmRing<ShmPose>::Role::Consumer};
+  if (!ring.open()) {
+    return 1;
+  }
+  const char ready = 1;
+  if (write(ready_fd, &ready, 1) != 1) {
+    return 1;
+  }
+  close(ready_fd);
+
+  LatencyHistogram latency;
+  bool done = false;
+  uint64_t received = 0;
+  while (!done) {
+    if (ring.drain([&](const ShmPose &record) {
+          const uint64_t now_ns = monotonic_time_ns();
+          if (record.pose.sequence == last_sequence) {
+            done = true;
+            return;
+          }
+          const uint64_t published_ns = record.publish_time_ns;
+          latency.record_ns(now_ns > published_ns ? now_ns - published_ns : 0);
+          ++received;
+        }) == 0) {
+      cpu_relax();
+    }
+  }
+
+  LatencyHistogram::Counts counts;
+  latency.counts(counts);
+  const double p99_us = static_cast<double>(percentile_ns(counts, 0.99)) /
+                        1000.0;
+  std::cout << "Received " << received << " of " << count << " poses, "
+            << ring.dropped() << " dropped by the publisher\n"
+            << "Publish to read: p50 "
+            << static_cast<double>(percentile_ns(counts, 0.50)) / 1000.0
+            << " us, p99 " << p99_us << " us, max "
+            << static_cast<double>(latency.max_ns()) / 1000.0 << " us\n";
+  if (p99_us > budget_us) {
+    std::cerr << "p99 latency exceeds the " << budget_us << " us budget\n";
+    return 1;
+  }
+  std::cout << "Within the " << budget_us << " us budget\n";
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc > 3) {
+    std::cerr << "Usage : " << argv[0] << " [count] [budget_us]\n";
+    return 1;
+  }
+  const unsigned count =
+      argc >= 2 ? static_cast<unsigned>(std::strtoul(argv[1], nullptr, 10))
+                : default_count;
+  const double budget_us =
+      argc == 3 ? std::strtod(argv[2], nullptr) : default_budget_us;
+
+  const std::string name =
+      std::string(default_pose_ring) + "_bench_" + std::to_string(getpid());
+  int ready[2];
+  if (pipe(ready) != 0) {
+    std::cerr << "Could not create a pipe\n";
+    return 1;
+  }
+
+  const pid_t consumer = fork();
+  if (consumer < 0) {
+    std::cerr << "Could not fork the consumer\n";
+    return 1;
+  }
+  if (consumer == 0) {
+    close(ready[0]);
+    _exit(consume(name, ready[1], count, budget_us));
+  }
+  close(ready[1]);
+
+  // The consumer only sees what is published once it has opened the ring.
+  char byte = 0;
+  const bool consumer_ready = read(ready[0], &byte, 1) == 1;
+  close(ready[0]);
+
+  int status = 1;
+  ShmRing<ShmPose> ring{name, ShmRing<ShmPose>::Role::Producer};
+  if (consumer_ready && ring.open()) {
+    ShmPose record{};
+    auto deadline = Clock::now();
+    for (unsigned i = 0; i < count; ++i) {
+      deadline += publish_period;
+      std::this_thread::sleep_until(deadline);
+      record.pose.sequence = i;
+      record.pose.x_m = static_cast<float>(i);
+      record.publish_time_ns = monotonic_time_ns();
+      ring.try_push(record);
+    }
+    record.pose.sequence = last_sequence;
+    record.publish_time_ns = monotonic_time_ns();
+    while (!ring.try_push(record)) {
+      cpu_relax();
+    }
+  } else {
+    kill(consumer, SIGTERM);
+  }
+
+  waitpid(consumer, &status, 0);
+  remove_shm_ring(name);
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
@@ -0,0 +1,65 @@
+//
+// Records of the shared-memory bus between perception processes and the
+// offboard tools.
+//
+// Publishers write these into a ShmRing (shm_ring.h) and the vision bridge
+// or the setpoint streamer read them in place. Like flight_record.h this
+// header is free of MAVSDK, so external processes only need it and
+// shm_ring.h.
+//
+
+#pragma once
+
+#include <cstdint>
+
+// Rings under /dev/shm the offboard tools attach to by default.
+constexpr const char *default_pose_ring = "/offboard_poses";
+constexpr const char *default_setpoint_ring = "/offboard_setpoints";
+
+#pragma pack(push, 1)
+
+// Little-endian wire format of one pose sample, 28 bytes. Also the UDP
+// datagram of the vision bridge.
+struct PosePacket {
+  uint32_t sequence;
+  float x_m;
+  float y_m;
+  float z_m;
+  float roll_rad;
+  float pitch_rad;
+  float yaw_rad;
+};
+
+#pragma pack(pop)
+
+// Times are CLOCK_MONOTONIC nanoseconds, i.e. std::chrono::steady_clock on
+// Linux, which all processes on the machine share.
+struct ShmPose {
+  PosePacket pose;
+  uint32_t reserved;
+  uint64_t publish_time_ns;
+};
+
+struct ShmSetpoint {
+  // Numbered like Setpoint::Type.
+  enum Type : uint16_t {
+    PositionNed = 0,
+    VelocityNed = 1,
+    VelocityBody = 2,
+    PositionVelocityNed = 3,
+    Attitude = 4,
+  };
+
+  uint32_t sequence;
+  uint16_t type;
+  uint16_t reserved;
+  uint64_t publish_time_ns;
+  // By type:
+  //   PositionNed          north_m east_m down_m yaw_deg
+  //   VelocityNed          north_m_s east_m_s down_m_s yaw_deg
+  //   VelocityBody         forward_m_s right_m_s down_m_s yawspeed_deg_s
+  //   PositionVelocityNed  north_m east_m down_m yaw_deg
+  //                        north_m_s east_m_s down_m_s
+  //   Attitude             roll_deg pitch_deg yaw_deg thrust
+  float values[8];
+};
@@ -0,0 +1,124 @@
+#include "shm_ring.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char ring_magic[8] = {'O', 'F', 'B', 'S', 'H', 'M', '0', '1'};
+
+// How long to wait for the creator to finish the header.
+constexpr auto attach_timeout = std::chrono::seconds(1);
+constexpr auto attach_poll = std::chrono::milliseconds(1);
+
+constexpr size_t records_offset =
+    (sizeof(ShmRingHeader) + alignof(std::max_align_t) - 1) /
+    alignof(std::max_align_t) * alignof(std::max_align_t);
+
+bool map(int fd, size_t bytes, ShmMapping &mapping) {
+  void *base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) {
+    return false;
+  }
+  mapping.header = static_cast<ShmRingHeader *>(base);
+  mapping.records = static_cast<unsigned char *>(base) + records_offset;
+  mapping.bytes = bytes;
+  return true;
+}
+
+} // namespace
+
+bool map_shm_ring(const std::string &name, uint32_t record_size,
+                  uint32_t capacity, ShmMapping &mapping) {
+  const size_t bytes =
+      records_offset + static_cast<size_t>(record_size) * capacity;
+
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0660);
+  if (fd >= 0) {
+    const bool mapped = ftruncate(fd, static_cast<off_t>(bytes)) == 0 &&
+                        map(fd, bytes, mapping);
+    ::close(fd);
+    if (!mapped) {
+      std::cerr << "Could not set up shared memory " << name << ": "
+                << std::strerror(errno) << '\n';
+      shm_unlink(name.c_str());
+      return false;
+    }
+    ShmRingHeader *header = new (mapping.header) ShmRingHeader{};
+    std::memcpy(header->magic, ring_magic, sizeof(ring_magic));
+    header->record_size = record_size;
+    header->capacity = capacity;
+    header->ready.store(1, std::memory_order_release);
+    return true;
+  }
+
+  if (errno != EEXIST) {
+    std::cerr << "Could not create shared memory " << name << ": "
+              << std::strerror(errno) << '\n';
+    return false;
+  }
+  fd = shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0) {
+    std::cerr << "Could not open shared memory " << name << ": "
+              << std::strerror(errno) << '\n';
+    return false;
+  }
+
+  // The creator may still be sizing the segment.
+  const auto deadline = std::chrono::steady_clock::now() + attach_timeout;
+  struct stat status {};
+  while (fstat(fd, &status) == 0 && static_cast<size_t>(status.st_size) <
+                                        records_offset &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(attach_poll);
+  }
+  const bool sized = static_cast<size_t>(status.st_size) == bytes;
+  const bool mapped = sized && map(fd, bytes, mapping);
+  ::close(fd);
+  if (!mapped) {
+    std::cerr << "Shared memory " << name << " has "
+              << (sized ? "no mapping" : "another size") << ", remove /dev/shm"
+              << name << " if it is left over from another version\n";
+    return false;
+  }
+
+  while (mapping.header->ready.load(std::memory_order_acquire) == 0 &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(attach_poll);
+  }
+  const ShmRingHeader &header = *mapping.header;
+  if (header.ready.load(std::memory_order_acquire) == 0 ||
+      std::memcmp(header.magic, ring_magic, sizeof(ring_magic)) != 0 ||
+      header.record_size != record_size || header.capacity != capacity) {
+    std::cerr << "Shared memory " << name
+              << " holds another kind of ring\n";
+    unmap_shm_ring(mapping);
+    return false;
+  }
+  return true;
+}
+
+void unmap_shm_ring(ShmMapping &mapping) {
+  if (mapping.header) {
+    munmap(mapping.header, mapping.bytes);
+  }
+  mapping = {};
+}
+
+bool remove_shm_ring(const std::string &name) {
+  if (shm_unlink(name.c_str()) == 0 || errno == ENOENT) {
+    return true;
+  }
+  std::cerr << "Could not remove shared memory " << name << ": "
+            << std::strerror(errno) << '\n';
+  return false;
+}
@@ -0,0 +1,168 @@
+//
+// Single-producer single-consumer ring in POSIX shared memory.
+//
+// The cross-process sibling of SpscRing: a segment under /dev/shm holds a
+// small header and a power-of-two array of fixed-size records. Each side
+// owns one index, so publishing and consuming are a few atomic operations
+// on shared cache lines, with no syscall and no serialization. The consumer
+// reads records in place. When the ring is full the publisher drops the
+// new record and counts it, it never waits for the consumer.
+//
+// Whichever side opens first creates and initializes the segment, the other
+// attaches to it. The segment outlives both so that either can restart;
+// remove_shm_ring() deletes it.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+                  std::atomic<uint32_t>::is_always_lock_free,
+              "shared-memory rings need address-free atomics");
+
+// Start of every segment.
+struct ShmRingHeader {
+  char magic[8];
+  uint32_t record_size;
+  uint32_t capacity;
+  // Set last by the creator, once the rest of the header is valid.
+  std::atomic<uint32_t> ready;
+
+  // Written by the producer only.
+  alignas(64) std::atomic<uint64_t> head;
+  std::atomic<uint64_t> dropped;
+  // Written by the consumer only.
+  alignas(64) std::atomic<uint64_t> tail;
+};
+
+struct ShmMapping {
+  ShmRingHeader *header{nullptr};
+  unsigned char *records{nullptr};
+  size_t bytes{0};
+};
+
+// Create or attach to the segment `name` (e.g. "/offboard_poses") for
+// `capacity` records of `record_size` bytes.
+//
+// returns false if the segment cannot be mapped or was created for another
+// record size or capacity.
+bool map_shm_ring(const std::string &name, uint32_t record_size,
+                  uint32_t capacity, ShmMapping &mapping);
+void unmap_shm_ring(ShmMapping &mapping);
+
+// returns false if the segment could not be removed.
+bool remove_shm_ring(const std::string &name);
+
+// Hint to the CPU that the caller is spinning on a ring.
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+template <typename Record> class ShmRing {
+  static_assert(std::is_trivially_copyable<Record>::value,
+                "shared-memory records must be trivially copyable");
+
+public:
+  enum class Role { Producer, Consumer };
+
+  static constexpr uint32_t default_capacity = 256;
+
+  ShmRing(std::string name, Role role, uint32_t capacity = default_capacity)
+      : _name(std::move(name)), _role(role), _capacity(capacity),
+        _mask(capacity - 1) {}
+  ~ShmRing() { close(); }
+
+  ShmRing(const ShmRing &) = delete;
+  ShmRing &operator=(const ShmRing &) = delete;
+
+  // A consumer starts with the records published from now on and skips
+  // whatever an earlier consumer left behind.
+  //
+  // returns false if the capacity is not a power of two or the segment
+  // cannot be mapped.
+  bool open() {
+    if (_mapping.header) {
+      return true;
+    }
+    if (_capacity < 2 || (_capacity & _mask) != 0) {
+      return false;
+    }
+    if (!map_shm_ring(_name, sizeof(Record), _capacity, _mapping)) {
+      return false;
+    }
+    if (_role == Role::Consumer) {
+      _mapping.header->tail.store(
+          _mapping.header->head.load(std::memory_order_acquire),
+          std::memory_order_release);
+    }
+    return true;
+  }
+
+  void close() { unmap_shm_ring(_mapping); }
+  bool is_open() const { return _mapping.header != nullptr; }
+
+  // Producer only.
+  //
+  // returns false if the ring is full and `record` was dropped.
+  bool try_push(const Record &record) {
+    ShmRingHeader &header = *_mapping.header;
+    const uint64_t head = header.head.load(std::memory_order_relaxed);
+    if (head - header.tail.load(std::memory_order_acquire) >= _capacity) {
+      header.dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    slot(head) = record;
+    header.head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only. Hand up to `max_count` records to `consume` in FIFO
+  // order, as references into the segment, and release them in one go.
+  //
+  // returns the number of records consumed.
+  template <typename Consume>
+  size_t drain(Consume &&consume, size_t max_count = SIZE_MAX) {
+    ShmRingHeader &header = *_mapping.header;
+    const uint64_t tail = header.tail.load(std::memory_order_relaxed);
+    const uint64_t available =
+        header.head.load(std::memory_order_acquire) - tail;
+    const size_t count =
+        available < max_count ? static_cast<size_t>(available) : max_count;
+    for (size_t i = 0; i < count; ++i) {
+      consume(static_cast<const Record &>(slot(tail + i)));
+    }
+    header.tail.store(tail + count, std::memory_order_release);
+    return count;
+  }
+
+  // Records the producer had to drop, over the lifetime of the segment.
+  uint64_t dropped() const {
+    return _mapping.header->dropped.load(std::memory_order_relaxed);
+  }
+  size_t size() const {
+    return static_cast<size_t>(
+        _mapping.header->head.load(std::memory_order_acquire) -
+        _mapping.header->tail.load(std::memory_order_acquire));
+  }
+
+private:
+  Record &slot(uint64_t index) {
+    return reinterpret_cast<Record *>(_mapping.records)[index & _mask];
+  }
+
+  const std::string _name;
+  const Role _role;
+  const uint32_t _capacity;
+  const uint32_t _mask;
+  ShmMapping _mapping{};
+};
@@ -0,0 +1,498 @@
+//
+// Runs missions against several SITL instances at once and reports on them.
+//
+// Launches `--instances K` simulators from a command template and works
+// through the queued missions with one worker per instance, so K missions
+// fly in parallel. Every mission is one of the offboard tools, started as
+// its own process on its instance's connection URL with its metrics logged
+// to a file. Per run the report has the exit status, the mission duration,
+// the waypoint errors the tool printed, the setpoint rate and the
+// percentiles of every latency histogram, from the metrics log.
+//
+// Budgets turn the report into a regression check: the runner fails if any
+// run failed, went over a budget, or has no histogram of a budgeted name in
+// its metrics log.
+//
+// Instance i listens on udp://:<base port + i>, as PX4 SITL started with
+// `-i i` does. In the simulator command, {instance} and {port} are
+// substituted. A mission is a tool path plus its arguments, split on
+// spaces; the connection URL, --metrics and a discovery timeout long
+// enough for the simulator to boot are added in front.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "metrics.h"
+
+extern char **environ;
+
+using Clock = std::chrono::steady_clock;
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+
+constexpr unsigned default_base_port = 14540;
+constexpr auto default_timeout = seconds(600);
+// Long enough for a simulator to boot and its EKF to settle.
+constexpr auto discovery_timeout = milliseconds(120000);
+constexpr auto poll_period = milliseconds(100);
+constexpr auto kill_grace = seconds(5);
+
+void usage(const std::string &bin_name) {
+  std::cerr << "Usage : " << bin_name
+            << " --instances <k> --sitl <command> --mission <tool [args]>... "
+               "[--repeat <n>] [--base-port <port>] [--timeout-s <s>] "
+               "[--budget <histogram>=<p99_us>]... [--out <dir>]\n"
+            << "e.g. --sitl 'cd ~/PX4-Autopilot && build/px4_sitl_default/"
+               "bin/px4 -i {instance} -d' --mission ./offboard_takeoff "
+               "--mission './offboard_position_control 100'\n";
+}
+
+struct Options {
+  unsigned instances{0};
+  std::string sitl_command{};
+  std::vector<std::string> missions{};
+  unsigned repeat{1};
+  unsigned base_port{default_base_port};
+  Clock::duration timeout{default_timeout};
+  // Worst-period p99 allowed per histogram.
+  std::map<std::string, double> budgets_us{};
+  std::string out_dir{"sitl_runs"};
+};
+
+struct HistogramSummary {
+  uint64_t count{0};
+  // Median over the export periods.
+  double p50_us{0.0};
+  // Worst over the export periods.
+  double p99_us{0.0};
+  double max_us{0.0};
+};
+
+struct RunReport {
+  unsigned run{0};
+  unsigned instance{0};
+  std::string mission{};
+  bool timed_out{false};
+  int exit_code{-1};
+  double duration_s{0.0};
+  unsigned legs{0};
+  double mean_error_m{0.0};
+  double max_error_m{0.0};
+  // Median over the export periods that sent anything.
+  double setpoint_rate_hz{0.0};
+  std::map<std::string, HistogramSummary> histograms{};
+  std::vector<std::string> over_budget{};
+  // Budgeted histograms the run's metrics log does not have.
+  std::vector<std::string> missing_budgets{};
+
+  bool passed() const {
+    return !timed_out && exit_code == 0 && over_budget.empty() &&
+           missing_budgets.empty();
+  }
+};
+
+std::vector<std::string> split(const std::string &line) {
+  std::vector<std::string> words;
+  std::istringstream stream(line);
+  std::string word;
+  while (stream >> word) {
+    words.push_back(word);
+  }
+  return words;
+}
+
+std::string substitute(std::string text, const std::string &key,
+                       const std::string &value) {
+  for (size_t at = text.find(key); at != std::string::npos;
+       at = text.find(key, at + value.size())) {
+    text.replace(at, key.size(), value);
+  }
+  return text;
+}
+
+// Spawn `arguments` with stdout and stderr going to `log_path`, in a new
+// process group so that the whole tree can be signalled.
+//
+// returns the pid, or -1 if spawning failed.
+pid_t spawn(const std::vector<std::string> &arguments,
+            const std::string &log_path) {
+  std::vector<char *> argv;
+  for (const auto &argument : arguments) {
+    argv.push_back(const_cast<char *>(argument.c_str()));
+  }
+  argv.push_back(nullptr);
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, log_path.c_str(),
+                                   O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+  posix_spawnattr_t attributes;
+  posix_spawnattr_init(&attributes);
+  posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP);
+  posix_spawnattr_setpgroup(&attributes, 0);
+
+  pid_t pid = -1;
+  const int error = posix_spawnp(&pid, argv[0], &actions, &attributes,
+                                 argv.data(), environ);
+  posix_spawn_file_actions_destroy(&actions);
+  posix_spawnattr_destroy(&attributes);
+  if (error != 0) {
+    std::cerr << "Could not start " << arguments[0] << ": "
+              << std::strerror(error) << '\n';
+    return -1;
+  }
+  return pid;
+}
+
+// returns the exit code, or -1 if the process did not exit in time or was
+// killed by a signal.
+int wait_for(pid_t pid, Clock::time_point deadline, bool &timed_out) {
+  timed_out = false;
+  int status = 0;
+  while (waitpid(pid, &status, WNOHANG) == 0) {
+    if (Clock::now() >= deadline) {
+      timed_out = true;
+      kill(-pid, SIGTERM);
+      const auto grace = Clock::now() + kill_grace;
+      while (waitpid(pid, &status, WNOHANG) == 0) {
+        if (Clock::now() >= grace) {
+          kill(-pid, SIGKILL);
+          waitpid(pid, &status, 0);
+          break;
+        }
+        std::this_thread::sleep_for(poll_period);
+      }
+      return -1;
+    }
+    std::this_thread::sleep_for(poll_period);
+  }
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+void stop_group(pid_t pid) {
+  bool timed_out = false;
+  kill(-pid, SIGINT);
+  if (wait_for(pid, Clock::now() + kill_grace, timed_out) < 0 && timed_out) {
+    std::cerr << "Simulator " << pid << " had to be killed\n";
+  }
+}
+
+// The waypoint errors print_legs() wrote to the run log.
+void read_legs(const std::string &log_path, RunReport &report) {
+  static const std::regex leg_line(
+      R"(^Leg [0-9]+ to .*, error ([-0-9.eE+]+) m,)");
+  std::ifstream log(log_path);
+  std::string line;
+  double sum = 0.0;
+  while (std::getline(log, line)) {
+    std::smatch match;
+    if (std::regex_search(line, match, leg_line)) {
+      const double error_m = std::strtod(match[1].str().c_str(), nullptr);
+      sum += error_m;
+      report.max_error_m = std::max(report.max_error_m, error_m);
+      ++report.legs;
+    }
+  }
+  if (report.legs > 0) {
+    report.mean_error_m = sum / report.legs;
+  }
+}
+
+double median(std::vector<double> values) {
+  if (values.empty()) {
+    return 0.0;
+  }
+  std::sort(values.begin(), values.end());
+  return values[values.size() / 2];
+}
+
+void read_metrics(const std::string &path, RunReport &report) {
+  MetricsLog log;
+  if (!read_metrics_log(path, log)) {
+    return;
+  }
+
+  if (const auto *sent = log.find("setpoint.sent")) {
+    std::vector<double> rates;
+    for (size_t i = 1; i < sent->samples.size(); ++i) {
+      const auto &sample = sent->samples[i];
+      const double period_s =
+          static_cast<double>(sample.time_ns - sent->samples[i - 1].time_ns) /
+          1e9;
+      if (sample.count > 0 && period_s > 0.0) {
+        rates.push_back(static_cast<double>(sample.count) / period_s);
+      }
+    }
+    report.setpoint_rate_hz = median(rates);
+  }
+
+  for (const auto &series : log.series) {
+    if (!series.histogram || series.samples.empty()) {
+      continue;
+    }
+    HistogramSummary summary{};
+    std::vector<double> p50s;
+    for (const auto &sample : series.samples) {
+      summary.count += sample.count;
+      if (sample.count == 0) {
+        continue;
+      }
+      p50s.push_back(static_cast<double>(sample.p50_ns) / 1000.0);
+      summary.p99_us =
+          std::max(summary.p99_us, static_cast<double>(sample.p99_ns) / 1000.0);
+    }
+    summary.p50_us = median(p50s);
+    summary.max_us =
+        static_cast<double>(series.samples.back().max_ns) / 1000.0;
+    if (summary.count > 0) {
+      report.histograms[series.name] = summary;
+    }
+  }
+}
+
+RunReport run_mission(const Options &options, unsigned run, unsigned instance,
+                      const std::string &mission) {
+  RunReport report{};
+  report.run = run;
+  report.instance = instance;
+  report.mission = mission;
+
+  const std::string prefix =
+      options.out_dir + "/run_" + std::to_string(run);
+  const std::string metrics_path = prefix + ".metrics";
+  const std::string log_path = prefix + ".log";
+  const auto words = split(mission);
+  std::vector<std::string> arguments{
+      words[0],
+      "udp://:" + std::to_string(options.base_port + instance),
+      "--discovery-timeout-ms",
+      std::to_string(discovery_timeout.count()),
+      "--metrics",
+      metrics_path};
+  arguments.insert(arguments.end(), words.begin() + 1, words.end());
+
+  const auto start = Clock::now();
+  const pid_t pid = spawn(arguments, log_path);
+  if (pid < 0) {
+    return report;
+  }
+  report.exit_code = wait_for(pid, start + options.timeout, report.timed_out);
+  report.duration_s =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  read_legs(log_path, report);
+  read_metrics(metrics_path, report);
+  for (const auto &budget : options.budgets_us) {
+    // A histogram that is not in the log, whether misspelt, renamed or
+    // never exported, cannot be shown to be within budget.
+    const auto histogram = report.histograms.find(budget.first);
+    if (histogram == report.histograms.end()) {
+      report.missing_budgets.push_back(budget.first);
+    } else if (histogram->second.p99_us > budget.second) {
+      report.over_budget.push_back(budget.first);
+    }
+  }
+  return report;
+}
+
+void write_report(std::ostream &out, const std::vector<RunReport> &reports,
+                  unsigned instances, double wall_s) {
+  out << "{\n"
+      << "  \"instances\": " << instances << ",\n"
+      << "  \"wall_time_s\": " << wall_s << ",\n"
+      << "  \"runs\": [\n";
+  for (size_t i = 0; i < reports.size(); ++i) {
+    const auto &report = reports[i];
+    out << "    {\n"
+        << "      \"run\": " << report.run << ",\n"
+        << "      \"instance\": " << report.instance << ",\n"
+        << "      \"mission\": \"" << report.mission << "\",\n"
+        << "      \"passed\": " << (report.passed() ? "true" : "false")
+        << ",\n"
+        << "      \"timed_out\": " << (report.timed_out ? "true" : "false")
+        << ",\n"
+        << "      \"exit_code\": " << report.exit_code << ",\n"
+        << "      \"duration_s\": " << report.duration_s << ",\n"
+        << "      \"legs\": " << report.legs << ",\n"
+        << "      \"mean_error_m\": " << report.mean_error_m << ",\n"
+        << "      \"max_error_m\": " << report.max_error_m << ",\n"
+        << "      \"setpoint_rate_hz\": " << report.setpoint_rate_hz << ",\n"
+        << "      \"over_budget\": [";
+    for (size_t j = 0; j < report.over_budget.size(); ++j) {
+      out << (j > 0 ? ", " : "") << '"' << report.over_budget[j] << '"';
+    }
+    out << "],\n"
+        << "      \"missing_budgets\": [";
+    for (size_t j = 0; j < report.missing_budgets.size(); ++j) {
+      out << (j > 0 ? ", " : "") << '"' << report.missing_budgets[j] << '"';
+    }
+    out << "],\n"
+        << "      \"histograms\": {";
+    size_t j = 0;
+    for (const auto &histogram : report.histograms) {
+      out << (j++ > 0 ? "," : "") << "\n        \"" << histogram.first
+          << "\": {\"count\": " << histogram.second.count
+          << ", \"p50_us\": " << histogram.second.p50_us
+          << ", \"p99_us\": " << histogram.second.p99_us
+          << ", \"max_us\": " << histogram.second.max_us << "}";
+    }
+    out << (report.histograms.empty() ? "" : "\n      ") << "}\n"
+        << "    }" << (i + 1 < reports.size() ? "," : "") << '\n';
+  }
+  out << "  ]\n"
+      << "}\n";
+}
+
+bool parse_options(int argc, char **argv, Options &options) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string argument = argv[i];
+    if (i + 1 >= argc) {
+      std::cerr << argument << " needs a value\n";
+      return false;
+    }
+    const std::string value = argv[++i];
+    if (argument == "--instances") {
+      options.instances =
+          static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+    } else if (argument == "--sitl") {
+      options.sitl_command = value;
+    } else if (argument == "--mission") {
+      if (split(value).empty()) {
+        std::cerr << "--mission needs a tool\n";
+        return false;
+      }
+      options.missions.push_back(value);
+    } else if (argument == "--repeat") {
+      options.repeat =
+          static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+    } else if (argument == "--base-port") {
+      options.base_port =
+          static_cast<unsigned>(std::strtoul(value.c_str(), nullptr, 10));
+    } else if (argument == "--timeout-s") {
+      options.timeout = std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double>(std::strtod(value.c_str(), nullptr)));
+    } else if (argument == "--budget") {
+      const auto equals = value.find('=');
+      if (equals == std::string::npos) {
+        std::cerr << "--budget takes <histogram>=<p99_us>\n";
+        return false;
+      }
+      options.budgets_us[value.substr(0, equals)] =
+          std::strtod(value.c_str() + equals + 1, nullptr);
+    } else if (argument == "--out") {
+      options.out_dir = value;
+    } else {
+      std::cerr << "Unknown argument " << argument << '\n';
+      return false;
+    }
+  }
+  if (options.instances == 0 || options.sitl_command.empty() ||
+      options.missions.empty() || options.repeat == 0 ||
+      options.timeout <= Clock::duration::zero()) {
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!parse_options(argc, argv, options)) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (mkdir(options.out_dir.c_str(), 0755) != 0 && errno != EEXIST) {
+    std::cerr << "Could not create " << options.out_dir << ": "
+              << std::strerror(errno) << '\n';
+    return 1;
+  }
+
+  std::vector<std::string> queue;
+  for (unsigned i = 0; i < options.repeat; ++i) {
+    queue.insert(queue.end(), options.missions.begin(),
+                 options.missions.end());
+  }
+
+  const auto start = Clock::now();
+  std::vector<RunReport> reports(queue.size());
+  std::atomic<size_t> next_run{0};
+  std::mutex print_mutex;
+
+  std::vector<std::thread> workers;
+  for (unsigned instance = 0; instance < options.instances; ++instance) {
+    workers.emplace_back([&, instance]() {
+      const std::string command = substitute(
+          substitute(options.sitl_command, "{instance}",
+                     std::to_string(instance)),
+          "{port}", std::to_string(options.base_port + instance));
+      const pid_t sitl = spawn(
+          {"/bin/sh", "-c", command},
+          options.out_dir + "/sitl_" + std::to_string(instance) + ".log");
+      if (sitl < 0) {
+        return;
+      }
+
+      for (size_t run = next_run++; run < queue.size(); run = next_run++) {
+        {
+          std::lock_guard<std::mutex> lock(print_mutex);
+          std::cout << "Run " << run << " on instance " << instance << ": "
+                    << queue[run] << '\n';
+        }
+        reports[run] = run_mission(options, static_cast<unsigned>(run),
+                                   instance, queue[run]);
+        std::lock_guard<std::mutex> lock(print_mutex);
+        const auto &report = reports[run];
+        std::cout << "Run " << run << (report.passed() ? " passed" : " failed")
+                  << " after " << report.duration_s << " s\n";
+      }
+      stop_group(sitl);
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  const double wall_s =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  unsigned passed = 0;
+  double mission_s = 0.0;
+  for (const auto &report : reports) {
+    passed += report.passed() ? 1 : 0;
+    mission_s += report.duration_s;
+  }
+  std::cout << passed << " of " << reports.size() << " runs passed, "
+            << mission_s << " s of missions in " << wall_s << " s on "
+            << options.instances << " instances\n";
+
+  const std::string report_path = options.out_dir + "/report.json";
+  std::ofstream report_file(report_path);
+  if (report_file) {
+    write_report(report_file, reports, options.instances, wall_s);
+    std::cout << "Report written to " << report_path << '\n';
+  } else {
+    std::cerr << "Could not write report to " << report_path << '\n';
+  }
+
+  return passed == reports.size() ? 0 : 1;
+}
@@ -0,0 +1,76 @@
+//
+// Bounded single-producer single-consumer ring buffer.
+//
+// The producer (typically a MAVSDK subscription callback) and the consumer
+// each own one index, so pushing and popping are wait-free and never
+// allocate. Capacity must be a power of two.
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+template <typename T, size_t Capacity> class SpscRing {
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                "SpscRing capacity must be a power of two");
+
+public:
+  SpscRing() = default;
+
+  SpscRing(const SpscRing &) = delete;
+  SpscRing &operator=(const SpscRing &) = delete;
+
+  // returns false if the ring is full and `value` was not stored.
+  bool try_push(const T &value) {
+    const size_t head = _head.load(std::memory_order_relaxed);
+    if (head - _tail.load(std::memory_order_acquire) == Capacity) {
+      return false;
+    }
+    _slots[head & mask] = value;
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // returns false if the ring is empty.
+  bool try_pop(T &value) {
+    const size_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail == _head.load(std::memory_order_acquire)) {
+      return false;
+    }
+    value = _slots[tail & mask];
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Hand up to `max_count` queued elements to `consume` in FIFO order and
+  // release their slots in one go.
+  //
+  // returns the number of elements consumed.
+  template <typename Consume>
+  size_t drain(Consume &&consume, size_t max_count = Capacity) {
+    const size_t tail = _tail.load(std::memory_order_relaxed);
+    const size_t available = _head.load(std::memory_order_acquire) - tail;
+    const size_t count = available < max_count ? available : max_count;
+    for (size_t i = 0; i < count; ++i) {
+      consume(_slots[(tail + i) & mask]);
+    }
+    _tail.store(tail + count, std::memory_order_release);
+    return count;
+  }
+
+  size_t size() const {
+    return _head.load(std::memory_order_acquire) -
+           _tail.load(std::memory_order_acquire);
+  }
+
+  static constexpr size_t capacity() { return Capacity; }
+
+private:
+  static constexpr size_t mask = Capacity - 1;
+
+  std::array<T, Capacity> _slots{};
+  alignas(64) std::atomic<size_t> _head{0};
+  alignas(64) std::atomic<size_t> _tail{0};
+};
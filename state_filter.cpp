@@ -0,0 +1,162 @@
+#include "state_filter.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+using namespace mavsdk;
+
+namespace {
+
+Float4 to_float4(const Telemetry::PositionNed &position) {
+  return Float4{{position.north_m, position.east_m, position.down_m, 0.0f}};
+}
+
+Float4 to_float4(const Telemetry::VelocityNed &velocity) {
+  return Float4{
+      {velocity.north_m_s, velocity.east_m_s, velocity.down_m_s, 0.0f}};
+}
+
+bool finite(const Float4 &value) {
+  return std::isfinite(value[0]) && std::isfinite(value[1]) &&
+         std::isfinite(value[2]);
+}
+
+float seconds_of(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration<float>(duration).count();
+}
+
+} // namespace
+
+const char *const filter_usage =
+    "[--filter [--filter-accel <m/s^2>] [--filter-latency-ms <ms>]]";
+
+bool parse_filter_arguments(std::vector<std::string> &arguments,
+                            FilterOptions &options) {
+  std::vector<std::string> remaining;
+  for (size_t i = 0; i < arguments.size(); ++i) {
+    const std::string &argument = arguments[i];
+
+    if (argument == "--filter") {
+      options.enabled = true;
+    } else if (argument == "--filter-accel" ||
+               argument == "--filter-latency-ms") {
+      if (i + 1 >= arguments.size()) {
+        std::cerr << argument << " needs a value\n";
+        return false;
+      }
+      const float value = std::strtof(arguments[++i].c_str(), nullptr);
+      if (argument == "--filter-accel") {
+        if (!(value > 0.0f)) {
+          std::cerr << argument << " must be positive\n";
+          return false;
+        }
+        options.acceleration_m_s2 = value;
+      } else {
+        if (!(value >= 0.0f && value <= 1000.0f)) {
+          std::cerr << argument << " must be between 0 and 1000\n";
+          return false;
+        }
+        options.latency = std::chrono::milliseconds(static_cast<int>(value));
+      }
+    } else {
+      remaining.push_back(argument);
+    }
+  }
+  arguments = remaining;
+  return true;
+}
+
+StateFilter::StateFilter(const FilterOptions &options)
+    : _options(options),
+      _acceleration_variance(
+          Float4::splat(options.acceleration_m_s2 * options.acceleration_m_s2)),
+      _position_variance(
+          Float4::splat(options.position_m * options.position_m)),
+      _velocity_variance(
+          Float4::splat(options.velocity_m_s * options.velocity_m_s)) {}
+
+void StateFilter::reset(const Float4 &position, const Float4 &velocity,
+                        Clock::time_point arrival) {
+  _estimate.position = position;
+  _estimate.velocity = velocity;
+  _estimate.time = arrival;
+  _estimate.valid = true;
+  _p00 = _position_variance;
+  _p01 = Float4::zero();
+  _p11 = _velocity_variance;
+  ++_resets;
+}
+
+bool StateFilter::correct(const Telemetry::PositionVelocityNed &sample,
+                          Clock::time_point arrival) {
+  const Float4 position = to_float4(sample.position);
+  const Float4 velocity = to_float4(sample.velocity);
+  if (!finite(position) || !finite(velocity)) {
+    return false;
+  }
+  const auto gap = arrival - _estimate.time;
+  if (!_estimate.valid || gap > _options.reset_after ||
+      gap < Clock::duration::zero()) {
+    reset(position, velocity, arrival);
+    return true;
+  }
+
+  // Predict to the arrival, with the covariance growing by the integrated
+  // white acceleration.
+  const float dt = seconds_of(gap);
+  const Float4 &q = _acceleration_variance;
+  Float4 x = _estimate.position + _estimate.velocity * dt;
+  Float4 v = _estimate.velocity;
+  Float4 p00 = _p00 + _p01 * (2.0f * dt) + _p11 * (dt * dt) +
+               q * (dt * dt * dt / 3.0f);
+  Float4 p01 = _p01 + _p11 * dt + q * (dt * dt / 2.0f);
+  Float4 p11 = _p11 + q * dt;
+
+  // Both states are measured: S = P + R, K = P S^-1.
+  const Float4 s00 = p00 + _position_variance;
+  const Float4 s11 = p11 + _velocity_variance;
+  const Float4 inverse_det =
+      Float4::splat(1.0f) / (s00 * s11 - p01 * p01);
+  const Float4 k00 = (p00 * s11 - p01 * p01) * inverse_det;
+  const Float4 k01 = (p01 * s00 - p00 * p01) * inverse_det;
+  const Float4 k10 = (p01 * s11 - p11 * p01) * inverse_det;
+  const Float4 k11 = (p11 * s00 - p01 * p01) * inverse_det;
+
+  const Float4 position_innovation = position - x;
+  const Float4 velocity_innovation = velocity - v;
+  x = x + k00 * position_innovation + k01 * velocity_innovation;
+  v = v + k10 * position_innovation + k11 * velocity_innovation;
+
+  // P = (I - K) P, kept symmetric by using the first row for p01.
+  const Float4 one = Float4::splat(1.0f);
+  _p00 = (one - k00) * p00 - k01 * p01;
+  _p01 = (one - k00) * p01 - k01 * p11;
+  _p11 = (one - k11) * p11 - k10 * p01;
+
+  _estimate.position = x;
+  _estimate.velocity = v;
+  _estimate.time = arrival;
+  return true;
+}
+
+Telemetry::PositionVelocityNed
+StateFilter::predict(const Estimate &estimate, Clock::time_point now) const {
+  auto ahead = now - estimate.time + _options.latency;
+  if (ahead < Clock::duration::zero()) {
+    ahead = Clock::duration::zero();
+  } else if (ahead > _options.max_prediction) {
+    ahead = _options.max_prediction;
+  }
+  const Float4 position = estimate.position + estimate.velocity *
+                                                  seconds_of(ahead);
+
+  Telemetry::PositionVelocityNed predicted{};
+  predicted.position.north_m = position[0];
+  predicted.position.east_m = position[1];
+  predicted.position.down_m = position[2];
+  predicted.velocity.north_m_s = estimate.velocity[0];
+  predicted.velocity.east_m_s = estimate.velocity[1];
+  predicted.velocity.down_m_s = estimate.velocity[2];
+  return predicted;
+}
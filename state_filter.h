@@ -0,0 +1,102 @@
+//
+// Kalman filter for the position_velocity_ned stream, predicted to the
+// reader's tick.
+//
+// Each axis is a constant velocity model driven by white acceleration
+// noise, and each sample measures both its position and its velocity. The
+// axes are independent, so the three of them share one 2x2 filter with
+// north, east and down in the lanes of Float4: a correction is a few
+// dozen lane-wise operations and no matrix is ever larger than the four
+// lanes. Nothing allocates.
+//
+// Corrections run when a sample arrives. Readers predict the last estimate
+// forward to their own time, plus the delivery latency if one is given,
+// so a controller ticking faster than telemetry arrives sees a position
+// that moves with every tick instead of one that jumps on every sample.
+//
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <mavsdk/plugins/telemetry/telemetry.h>
+
+#include "float4.h"
+
+struct FilterOptions {
+  bool enabled{false};
+  // Strength of the white acceleration driving the model. Higher tracks
+  // manoeuvres faster, lower smooths more.
+  float acceleration_m_s2{2.0f};
+  // Measurement noise of the position and velocity samples.
+  float position_m{0.05f};
+  float velocity_m_s{0.1f};
+  // Added to every prediction, for the time a sample spends between the
+  // estimator on the vehicle and its arrival here.
+  std::chrono::milliseconds latency{0};
+  // Predictions never reach further than this past the last sample, the
+  // estimate holds after that.
+  std::chrono::milliseconds max_prediction{200};
+  // A gap of this long between samples restarts the filter on the next.
+  std::chrono::milliseconds reset_after{1000};
+};
+
+// Usage text of the flags parse_filter_arguments() takes.
+extern const char *const filter_usage;
+
+// Takes the filter flags out of `arguments`; --filter enables it.
+//
+// returns false on a malformed value.
+bool parse_filter_arguments(std::vector<std::string> &arguments,
+                            FilterOptions &options);
+
+class StateFilter {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // Trivially copyable, so that it can be published through a seqlock.
+  struct Estimate {
+    Float4 position{};
+    Float4 velocity{};
+    // Arrival time of the last sample corrected with.
+    Clock::time_point time{};
+    bool valid{false};
+  };
+
+  explicit StateFilter(const FilterOptions &options = {});
+
+  // Correct the estimate with a sample that arrived at `arrival`. Samples
+  // with non-finite values are ignored.
+  //
+  // returns false if the sample was ignored.
+  bool correct(const mavsdk::Telemetry::PositionVelocityNed &sample,
+               Clock::time_point arrival);
+
+  const Estimate &estimate() const { return _estimate; }
+  // Corrections that started the filter over, the first one included.
+  uint64_t resets() const { return _resets; }
+
+  // Position and velocity of `estimate` at `now`. Needs no filter state
+  // beyond the options, so any thread may call it.
+  mavsdk::Telemetry::PositionVelocityNed
+  predict(const Estimate &estimate, Clock::time_point now) const;
+
+private:
+  void reset(const Float4 &position, const Float4 &velocity,
+             Clock::time_point arrival);
+
+  const FilterOptions _options;
+  const Float4 _acceleration_variance;
+  const Float4 _position_variance;
+  const Float4 _velocity_variance;
+
+  Estimate _estimate{};
+  // The symmetric covariance per axis, [p00 p01; p01 p11].
+  Float4 _p00{};
+  Float4 _p01{};
+  Float4 _p11{};
+  uint64_t _resets{0};
+};
@@ -0,0 +1,229 @@
+#include "telemetry_aggregator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+using namespace mavsdk;
+
+const char *const aggregator_usage = "[--window <s>] [--duration <s>]";
+
+bool parse_aggregator_arguments(std::vector<std::string> &arguments,
+                                AggregatorOptions &options) {
+  std::vector<std::string> remaining;
+  for (size_t i = 0; i < arguments.size(); ++i) {
+    const std::string &argument = arguments[i];
+
+    if (argument == "--window" || argument == "--duration") {
+      if (i + 1 >= arguments.size()) {
+        std::cerr << argument << " needs a value\n";
+        return false;
+      }
+      const double seconds = std::strtod(arguments[++i].c_str(), nullptr);
+      if (!(seconds > 0.0)) {
+        std::cerr << argument << " must be positive\n";
+        return false;
+      }
+      if (argument == "--window") {
+        options.window = std::chrono::milliseconds(
+            static_cast<int64_t>(std::ceil(seconds * 1000.0)));
+      } else {
+        options.duration = std::chrono::seconds(
+            static_cast<int64_t>(std::ceil(seconds)));
+      }
+    } else {
+      remaining.push_back(argument);
+    }
+  }
+  arguments = remaining;
+  return true;
+}
+
+TelemetryAggregator::TelemetryAggregator(Clock::time_point start)
+    : _start(start) {}
+
+void TelemetryAggregator::add(Field field, double value,
+                              Clock::time_point now) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  add_locked(field, value, now);
+}
+
+void TelemetryAggregator::record(const Telemetry::PositionVelocityNed &sample,
+                                 Clock::time_point now) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  add_locked(Field::North, sample.position.north_m, now);
+  add_locked(Field::East, sample.position.east_m, now);
+  add_locked(Field::Down, sample.position.down_m, now);
+  add_locked(Field::VelocityNorth, sample.velocity.north_m_s, now);
+  add_locked(Field::VelocityEast, sample.velocity.east_m_s, now);
+  add_locked(Field::VelocityDown, sample.velocity.down_m_s, now);
+}
+
+void TelemetryAggregator::record(const Telemetry::EulerAngle &sample,
+                                 Clock::time_point now) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (std::isfinite(sample.roll_deg)) {
+    add_locked(Field::Roll, unwrap(_roll, sample.roll_deg), now);
+  }
+  add_locked(Field::Pitch, sample.pitch_deg, now);
+  if (std::isfinite(sample.yaw_deg)) {
+    add_locked(Field::Yaw, unwrap(_yaw, sample.yaw_deg), now);
+  }
+}
+
+void TelemetryAggregator::record(const Telemetry::Position &sample,
+                                 Clock::time_point now) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  add_locked(Field::RelativeAltitude, sample.relative_altitude_m, now);
+  add_locked(Field::AbsoluteAltitude, sample.absolute_altitude_m, now);
+}
+
+void TelemetryAggregator::record(const Telemetry::GpsInfo &sample,
+                                 Clock::time_point now) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  add_locked(Field::Satellites, sample.num_satellites, now);
+}
+
+void TelemetryAggregator::record(const Telemetry::Battery &sample,
+                                 Clock::time_point now) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  add_locked(Field::BatteryVoltage, sample.voltage_v, now);
+  add_locked(Field::BatteryRemaining, sample.remaining_percent, now);
+}
+
+TelemetryAggregator::Window TelemetryAggregator::take(Clock::time_point now) {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  Window window{};
+  window.start = _start;
+  window.end = now;
+  window.samples = _samples;
+  for (size_t i = 0; i < field_count; ++i) {
+    const Running &running = _running[i];
+    Summary &summary = window.fields[i];
+    summary.count = running.count;
+    if (running.count == 0) {
+      continue;
+    }
+    summary.min = running.min;
+    summary.max = running.max;
+    summary.mean = running.mean;
+    summary.stddev =
+        running.count > 1
+            ? std::sqrt(running.m2 / static_cast<double>(running.count - 1))
+            : 0.0;
+    summary.rate = running.m2_t > 0.0 ? running.c_tv / running.m2_t : 0.0;
+  }
+
+  _running = {};
+  _samples = 0;
+  _start = now;
+  return window;
+}
+
+uint64_t TelemetryAggregator::total_samples() const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _total_samples;
+}
+
+void TelemetryAggregator::add_locked(Field field, double value,
+                                     Clock::time_point now) {
+  if (!std::isfinite(value)) {
+    return;
+  }
+  const double t_s = std::chrono::duration<double>(now - _start).count();
+  Running &running = _running[static_cast<size_t>(field)];
+
+  if (running.count == 0) {
+    running.min = value;
+    running.max = value;
+  } else {
+    running.min = std::min(running.min, value);
+    running.max = std::max(running.max, value);
+  }
+
+  // Welford for the value alone and for its covariance with time, whose
+  // ratio to the variance of time is the least-squares slope.
+  ++running.count;
+  const double n = static_cast<double>(running.count);
+  const double dt = t_s - running.mean_t;
+  running.mean_t += dt / n;
+  const double dv = value - running.mean;
+  running.mean += dv / n;
+  running.m2 += dv * (value - running.mean);
+  running.m2_t += dt * (t_s - running.mean_t);
+  running.c_tv += dt * (value - running.mean);
+
+  ++_samples;
+  ++_total_samples;
+}
+
+double TelemetryAggregator::unwrap(Unwrapped &angle, double deg) {
+  if (!angle.valid) {
+    angle.valid = true;
+    angle.unwrapped_deg = deg;
+  } else {
+    angle.unwrapped_deg += std::remainder(deg - angle.last_deg, 360.0);
+  }
+  angle.last_deg = deg;
+  return angle.unwrapped_deg;
+}
+
+const char *to_string(TelemetryAggregator::Field field) {
+  switch (field) {
+  case TelemetryAggregator::Field::North:
+    return "north_m";
+  case TelemetryAggregator::Field::East:
+    return "east_m";
+  case TelemetryAggregator::Field::Down:
+    return "down_m";
+  case TelemetryAggregator::Field::VelocityNorth:
+    return "north_m_s";
+  case TelemetryAggregator::Field::VelocityEast:
+    return "east_m_s";
+  case TelemetryAggregator::Field::VelocityDown:
+    return "down_m_s";
+  case TelemetryAggregator::Field::Roll:
+    return "roll_deg";
+  case TelemetryAggregator::Field::Pitch:
+    return "pitch_deg";
+  case TelemetryAggregator::Field::Yaw:
+    return "yaw_deg";
+  case TelemetryAggregator::Field::RelativeAltitude:
+    return "relative_altitude_m";
+  case TelemetryAggregator::Field::AbsoluteAltitude:
+    return "absolute_altitude_m";
+  case TelemetryAggregator::Field::Satellites:
+    return "satellites";
+  case TelemetryAggregator::Field::BatteryVoltage:
+    return "battery_v";
+  case TelemetryAggregator::Field::BatteryRemaining:
+    return "battery_percent";
+  }
+  return "unknown";
+}
+
+void print_window(const TelemetryAggregator::Window &window,
+                  TelemetryAggregator::Clock::time_point start,
+                  std::ostream &out) {
+  const double end_s =
+      std::chrono::duration<double>(window.end - start).count();
+  const auto flags = out.flags();
+  const auto precision = out.precision();
+  out << std::fixed << std::setprecision(3);
+  for (size_t i = 0; i < TelemetryAggregator::field_count; ++i) {
+    const auto &summary = window.fields[i];
+    if (summary.count == 0) {
+      continue;
+    }
+    out << end_s << ' '
+        << to_string(static_cast<TelemetryAggregator::Field>(i)) << ' '
+        << summary.count << ' ' << summary.min << ' ' << summary.max << ' '
+        << summary.mean << ' ' << summary.stddev << ' ' << summary.rate
+        << '\n';
+  }
+  out.flags(flags);
+  out.precision(precision);
+}
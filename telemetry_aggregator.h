@@ -0,0 +1,148 @@
+//
+// Windowed statistics of telemetry fields, for long monitoring runs.
+//
+// Samples are fed straight from the subscription callbacks at whatever rate
+// the streams deliver. Each field keeps running statistics of the current
+// window, updated in constant time per sample with Welford's method:
+// count, min, max, mean, standard deviation and the rate of change, which
+// is the least-squares slope of the field over the window's arrival times.
+// take() closes the window and starts the next one, so only one summary
+// per field and window leaves the process, however fast the streams are.
+// The min and max still catch single-sample spikes.
+//
+// Roll and yaw are unwrapped across ±180 degrees so that crossing the wrap
+// does not show up as a spike. Their values then leave that range.
+//
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <mavsdk/plugins/telemetry/telemetry.h>
+
+struct AggregatorOptions {
+  // Zero means no aggregation.
+  std::chrono::milliseconds window{0};
+  std::chrono::seconds duration{60};
+};
+
+// Usage text of the flags parse_aggregator_arguments() takes.
+extern const char *const aggregator_usage;
+
+// Take --window <s> and --duration <s> out of the tool-specific
+// `arguments`.
+//
+// returns false if a value is missing or not positive.
+bool parse_aggregator_arguments(std::vector<std::string> &arguments,
+                                AggregatorOptions &options);
+
+class TelemetryAggregator {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  enum class Field {
+    North,
+    East,
+    Down,
+    VelocityNorth,
+    VelocityEast,
+    VelocityDown,
+    Roll,
+    Pitch,
+    Yaw,
+    RelativeAltitude,
+    AbsoluteAltitude,
+    Satellites,
+    BatteryVoltage,
+    BatteryRemaining,
+  };
+  static constexpr size_t field_count = 14;
+
+  struct Summary {
+    uint64_t count{0};
+    double min{0.0};
+    double max{0.0};
+    double mean{0.0};
+    double stddev{0.0};
+    // Per second, zero with fewer than two samples at distinct times.
+    double rate{0.0};
+  };
+
+  struct Window {
+    Clock::time_point start{};
+    Clock::time_point end{};
+    std::array<Summary, field_count> fields{};
+    uint64_t samples{0};
+  };
+
+  explicit TelemetryAggregator(Clock::time_point start = Clock::now());
+
+  // Thread-safe, may be called straight from subscription callbacks.
+  // Non-finite values, which MAVSDK uses for unknown fields, are skipped.
+  void add(Field field, double value, Clock::time_point now = Clock::now());
+  void record(const mavsdk::Telemetry::PositionVelocityNed &sample,
+              Clock::time_point now = Clock::now());
+  void record(const mavsdk::Telemetry::EulerAngle &sample,
+              Clock::time_point now = Clock::now());
+  void record(const mavsdk::Telemetry::Position &sample,
+              Clock::time_point now = Clock::now());
+  void record(const mavsdk::Telemetry::GpsInfo &sample,
+              Clock::time_point now = Clock::now());
+  void record(const mavsdk::Telemetry::Battery &sample,
+              Clock::time_point now = Clock::now());
+
+  // Close the current window at `now` and start the next one.
+  Window take(Clock::time_point now = Clock::now());
+
+  // Samples added since construction.
+  uint64_t total_samples() const;
+
+private:
+  // Statistics of one field over the current window. Times are seconds
+  // from the window start.
+  struct Running {
+    uint64_t count;
+    double min;
+    double max;
+    double mean;
+    double m2;
+    double mean_t;
+    double m2_t;
+    double c_tv;
+  };
+
+  // An angle followed across the ±180 degree wrap.
+  struct Unwrapped {
+    bool valid;
+    double last_deg;
+    double unwrapped_deg;
+  };
+
+  void add_locked(Field field, double value, Clock::time_point now);
+  static double unwrap(Unwrapped &angle, double deg);
+
+  mutable std::mutex _mutex{};
+  Clock::time_point _start;
+  std::array<Running, field_count> _running{};
+  uint64_t _samples{0};
+  uint64_t _total_samples{0};
+
+  // Carried across windows.
+  Unwrapped _roll{};
+  Unwrapped _yaw{};
+};
+
+const char *to_string(TelemetryAggregator::Field field);
+
+// One line per field that had samples:
+// `<seconds since start> <field> n min max mean stddev rate`.
+void print_window(const TelemetryAggregator::Window &window,
+                  TelemetryAggregator::Clock::time_point start,
+                  std::ostream &out);
@@ -0,0 +1,72 @@
+//
+// Queue between a telemetry subscription callback and a batch consumer.
+//
+// Every sample delivered by MAVSDK is pushed into a bounded SPSC ring. Samples
+// that repeat the previous one are counted as duplicates and not queued again,
+// samples that find the ring full are counted as dropped. Together with the
+// receive count this gives the rate at which fresh data actually arrives.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "spsc_ring.h"
+
+template <typename T, size_t Capacity = 256> class TelemetryQueue {
+public:
+  struct Stats {
+    uint64_t received{0};
+    uint64_t duplicates{0};
+    uint64_t dropped{0};
+    uint64_t consumed{0};
+  };
+
+  // Producer side, call from the subscription callback only.
+  void push(const T &sample) {
+    _received.fetch_add(1, std::memory_order_relaxed);
+
+    if (_has_last && sample == _last) {
+      _duplicates.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    _last = sample;
+    _has_last = true;
+
+    if (!_ring.try_push(sample)) {
+      _dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  // Consumer side, hands every queued sample to `consume`.
+  //
+  // returns the number of samples in the batch.
+  template <typename Consume> size_t drain(Consume &&consume) {
+    const size_t count = _ring.drain(consume);
+    _consumed.fetch_add(count, std::memory_order_relaxed);
+    return count;
+  }
+
+  Stats stats() const {
+    Stats stats{};
+    stats.received = _received.load(std::memory_order_relaxed);
+    stats.duplicates = _duplicates.load(std::memory_order_relaxed);
+    stats.dropped = _dropped.load(std::memory_order_relaxed);
+    stats.consumed = _consumed.load(std::memory_order_relaxed);
+    return stats;
+  }
+
+private:
+  SpscRing<T, Capacity> _ring{};
+
+  // Only touched by the producer.
+  T _last{};
+  bool _has_last{false};
+
+  std::atomic<uint64_t> _received{0};
+  std::atomic<uint64_t> _duplicates{0};
+  std::atomic<uint64_t> _dropped{0};
+  std::atomic<uint64_t> _consumed{0};
+};
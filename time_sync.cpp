@@ -0,0 +1,119 @@
+#include "time_sync.h"
+
+#include <cmath>
+#include <iostream>
+
+TimeSync::TimeSync(std::chrono::microseconds bucket_period, size_t bucket_count)
+    : _bucket_period_us(static_cast<uint64_t>(bucket_period.count())),
+      _bucket_count(bucket_count < 1 ? 1 : bucket_count) {
+  _buckets.reserve(_bucket_count);
+}
+
+void TimeSync::add_sample(uint64_t autopilot_us, uint64_t local_us) {
+  // A clock that jumps back by more than reordering explains means the
+  // autopilot rebooted and everything learned so far is wrong.
+  if (autopilot_us + _bucket_period_us < _last_autopilot_us) {
+    _buckets.clear();
+    _has_current = false;
+    ++_resets;
+    Estimate estimate{};
+    estimate.samples = _samples;
+    estimate.resets = _resets;
+    _estimate.write(estimate);
+  }
+  _last_autopilot_us = autopilot_us;
+  ++_samples;
+
+  const double offset_us = static_cast<double>(
+      static_cast<int64_t>(autopilot_us) - static_cast<int64_t>(local_us));
+
+  if (_has_current && local_us - _current_start_us >= _bucket_period_us) {
+    if (_buckets.size() == _bucket_count) {
+      _buckets.erase(_buckets.begin());
+    }
+    _buckets.push_back(_current);
+    _has_current = false;
+    refit();
+  }
+
+  // Any delay only makes the offset look smaller.
+  if (!_has_current) {
+    _current = Bucket{local_us, offset_us};
+    _current_start_us = local_us;
+    _has_current = true;
+  } else if (offset_us > _current.offset_us) {
+    _current = Bucket{local_us, offset_us};
+  }
+}
+
+void TimeSync::refit() {
+  Estimate estimate{};
+  estimate.valid = true;
+  estimate.reference_us = _buckets.back().local_us;
+  estimate.samples = _samples;
+  estimate.resets = _resets;
+
+  // Relative to the newest bucket, which keeps the numbers small.
+  const double count = static_cast<double>(_buckets.size());
+  double mean_x = 0.0;
+  double mean_y = 0.0;
+  for (const auto &bucket : _buckets) {
+    mean_x += static_cast<double>(static_cast<int64_t>(bucket.local_us -
+                                                       estimate.reference_us));
+    mean_y += bucket.offset_us;
+  }
+  mean_x /= count;
+  mean_y /= count;
+
+  double sxx = 0.0;
+  double sxy = 0.0;
+  for (const auto &bucket : _buckets) {
+    const double x = static_cast<double>(static_cast<int64_t>(
+                         bucket.local_us - estimate.reference_us)) -
+                     mean_x;
+    sxx += x * x;
+    sxy += x * (bucket.offset_us - mean_y);
+  }
+  // Drift needs a few buckets spread over time to mean anything.
+  const double slope = _buckets.size() >= 3 && sxx > 0.0 ? sxy / sxx : 0.0;
+  estimate.offset_us = mean_y - slope * mean_x;
+  estimate.drift_ppm = slope * 1e6;
+
+  double squares = 0.0;
+  for (const auto &bucket : _buckets) {
+    const double x = static_cast<double>(
+        static_cast<int64_t>(bucket.local_us - estimate.reference_us));
+    const double error = bucket.offset_us - (estimate.offset_us + slope * x);
+    squares += error * error;
+  }
+  estimate.residual_us = std::sqrt(squares / count);
+
+  _estimate.write(estimate);
+}
+
+bool TimeSync::to_autopilot(uint64_t local_us, uint64_t &autopilot_us) const {
+  const Estimate current = estimate();
+  if (!current.valid) {
+    return false;
+  }
+  const double elapsed_us = static_cast<double>(
+      static_cast<int64_t>(local_us - current.reference_us));
+  const double converted =
+      static_cast<double>(local_us) + current.offset_us +
+      current.drift_ppm * 1e-6 * elapsed_us;
+  autopilot_us =
+      converted > 0.0 ? static_cast<uint64_t>(std::llround(converted)) : 0;
+  return true;
+}
+
+void print_time_sync(const TimeSync::Estimate &estimate) {
+  if (!estimate.valid) {
+    std::cout << "Time sync: no estimate yet, " << estimate.samples
+              << " samples, " << estimate.resets << " resets\n";
+    return;
+  }
+  std::cout << "Time sync: offset " << estimate.offset_us / 1000.0
+            << " ms, drift " << estimate.drift_ppm << " ppm, residual "
+            << estimate.residual_us << " us, " << estimate.samples
+            << " samples, " << estimate.resets << " resets\n";
+}
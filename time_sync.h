@@ -0,0 +1,91 @@
+//
+// Offset and drift between the companion's monotonic clock and the
+// autopilot's boot clock.
+//
+// Every telemetry message that carries an autopilot timestamp is a sample:
+// the autopilot time it was stamped with against the local time it arrived.
+// The difference is the clock offset minus the transport delay, so within
+// each bucket of samples the one with the smallest delay, i.e. the largest
+// difference, is kept. A least-squares line through the last buckets gives
+// the offset now and how fast it drifts, which is what converts a local
+// capture time into the autopilot time the EKF expects. Only the variable
+// part of the delay is filtered out: the link's minimum delay stays in the
+// offset and makes converted times early by that much, typically a few
+// hundred microseconds on a serial link.
+//
+// Samples come from one thread, typically a telemetry callback. The estimate
+// is published through a seqlock and can be read from any thread.
+//
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "seqlock.h"
+
+class TimeSync {
+public:
+  struct Estimate {
+    bool valid{false};
+    // autopilot_us = local_us + offset_us + drift * (local_us - reference_us)
+    uint64_t reference_us{0};
+    double offset_us{0.0};
+    // Autopilot clock rate relative to ours, in parts per million.
+    double drift_ppm{0.0};
+    // RMS distance of the buckets from the fitted line.
+    double residual_us{0.0};
+    uint64_t samples{0};
+    // Times the autopilot clock went backwards, i.e. it rebooted.
+    uint64_t resets{0};
+  };
+
+  static constexpr std::chrono::milliseconds default_bucket_period{500};
+  static constexpr size_t default_bucket_count = 40;
+
+  explicit TimeSync(
+      std::chrono::microseconds bucket_period = default_bucket_period,
+      size_t bucket_count = default_bucket_count);
+
+  TimeSync(const TimeSync &) = delete;
+  TimeSync &operator=(const TimeSync &) = delete;
+
+  // `autopilot_us` is the autopilot's stamp on a message that arrived at
+  // `local_us` on the steady clock.
+  void add_sample(uint64_t autopilot_us, uint64_t local_us);
+
+  Estimate estimate() const {
+    Estimate estimate;
+    _estimate.read(estimate);
+    return estimate;
+  }
+
+  // returns false until the first bucket is complete.
+  bool to_autopilot(uint64_t local_us, uint64_t &autopilot_us) const;
+
+private:
+  struct Bucket {
+    uint64_t local_us;
+    double offset_us;
+  };
+
+  void refit();
+
+  const uint64_t _bucket_period_us;
+  const size_t _bucket_count;
+
+  // Only touched by the sampling thread. Complete buckets, oldest first.
+  std::vector<Bucket> _buckets;
+  Bucket _current{};
+  uint64_t _current_start_us{0};
+  bool _has_current{false};
+  uint64_t _last_autopilot_us{0};
+  uint64_t _samples{0};
+  uint64_t _resets{0};
+
+  Seqlock<Estimate> _estimate;
+};
+
+void print_time_sync(const TimeSync::Estimate &estimate);
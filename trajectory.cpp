@@ -0,0 +1,138 @@
+#include "trajectory.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Peak speed and peak acceleration of a rest-to-rest minimum-jerk move over
+// distance D in time T are 1.875 D/T and 5.7735 D/T^2.
+constexpr double min_jerk_peak_speed = 1.875;
+constexpr double min_jerk_peak_acceleration = 5.7735;
+
+double wrap_deg(double angle_deg) {
+  return std::remainder(angle_deg, 360.0);
+}
+
+struct Segment {
+  Waypoint from;
+  double delta[3];
+  double delta_yaw_deg;
+  double start_s;
+  double duration_s;
+};
+
+double segment_duration(const Segment &segment,
+                        const TrajectoryLimits &limits) {
+  const double distance =
+      std::sqrt(segment.delta[0] * segment.delta[0] +
+                segment.delta[1] * segment.delta[1] +
+                segment.delta[2] * segment.delta[2]);
+
+  double duration_s = 0.0;
+  if (distance > 0.0) {
+    duration_s = std::max(
+        min_jerk_peak_speed * distance / limits.max_speed_m_s,
+        std::sqrt(min_jerk_peak_acceleration * distance /
+                  limits.max_acceleration_m_s2));
+  }
+  return std::max(duration_s, min_jerk_peak_speed *
+                                  std::fabs(segment.delta_yaw_deg) /
+                                  limits.max_yaw_rate_deg_s);
+}
+
+} // namespace
+
+Trajectory::Trajectory(const std::vector<Waypoint> &waypoints,
+                       const TrajectoryLimits &limits, double sample_rate_hz)
+    : _period(std::chrono::duration_cast<SetpointStreamer::Clock::duration>(
+          std::chrono::duration<double>(1.0 / sample_rate_hz))) {
+  if (waypoints.empty()) {
+    return;
+  }
+
+  std::vector<Segment> segments;
+  double total_s = 0.0;
+  for (size_t i = 1; i < waypoints.size(); ++i) {
+    Segment segment{};
+    segment.from = waypoints[i - 1];
+    segment.delta[0] = waypoints[i].north_m - waypoints[i - 1].north_m;
+    segment.delta[1] = waypoints[i].east_m - waypoints[i - 1].east_m;
+    segment.delta[2] = waypoints[i].down_m - waypoints[i - 1].down_m;
+    segment.delta_yaw_deg =
+        wrap_deg(waypoints[i].yaw_deg - waypoints[i - 1].yaw_deg);
+    segment.start_s = total_s;
+    segment.duration_s = segment_duration(segment, limits);
+    if (segment.duration_s > 0.0) {
+      segments.push_back(segment);
+      total_s += segment.duration_s;
+    }
+  }
+
+  const double period_s = std::chrono::duration<double>(_period).count();
+  _samples = static_cast<size_t>(std::ceil(total_s / period_s)) + 1;
+  _duration = (_samples - 1) * _period;
+  _table.assign(ChannelCount * _samples, 0.0f);
+
+  const Waypoint &last = waypoints.back();
+  size_t current = 0;
+  for (size_t i = 0; i < _samples; ++i) {
+    const double t = static_cast<double>(i) * period_s;
+    while (current < segments.size() &&
+           t >= segments[current].start_s + segments[current].duration_s) {
+      ++current;
+    }
+
+    if (current == segments.size()) {
+      at(North, i) = last.north_m;
+      at(East, i) = last.east_m;
+      at(Down, i) = last.down_m;
+      at(Yaw, i) = static_cast<float>(wrap_deg(last.yaw_deg));
+      continue;
+    }
+
+    // s(tau) = 10 tau^3 - 15 tau^4 + 6 tau^5 runs from 0 to 1 with zero
+    // velocity and acceleration at both ends.
+    const Segment &segment = segments[current];
+    const double tau = (t - segment.start_s) / segment.duration_s;
+    const double tau2 = tau * tau;
+    const double s = tau2 * tau * (10.0 - 15.0 * tau + 6.0 * tau2);
+    const double ds =
+        30.0 * tau2 * (1.0 - 2.0 * tau + tau2) / segment.duration_s;
+
+    at(North, i) =
+        static_cast<float>(segment.from.north_m + s * segment.delta[0]);
+    at(East, i) =
+        static_cast<float>(segment.from.east_m + s * segment.delta[1]);
+    at(Down, i) =
+        static_cast<float>(segment.from.down_m + s * segment.delta[2]);
+    at(VelocityNorth, i) = static_cast<float>(ds * segment.delta[0]);
+    at(VelocityEast, i) = static_cast<float>(ds * segment.delta[1]);
+    at(VelocityDown, i) = static_cast<float>(ds * segment.delta[2]);
+    at(Yaw, i) = static_cast<float>(
+        wrap_deg(segment.from.yaw_deg + s * segment.delta_yaw_deg));
+  }
+}
+
+bool Trajectory::sample(SetpointStreamer::Clock::duration elapsed,
+                        Setpoint &setpoint) const {
+  if (_samples == 0) {
+    return false;
+  }
+
+  const auto ticks =
+      std::max<SetpointStreamer::Clock::rep>(0, elapsed / _period);
+  const size_t index = std::min(static_cast<size_t>(ticks), _samples - 1);
+
+  setpoint.type = Setpoint::Type::PositionVelocityNed;
+  setpoint.position_ned.north_m = at(North, index);
+  setpoint.position_ned.east_m = at(East, index);
+  setpoint.position_ned.down_m = at(Down, index);
+  setpoint.position_ned.yaw_deg = at(Yaw, index);
+  setpoint.velocity_ned.north_m_s = at(VelocityNorth, index);
+  setpoint.velocity_ned.east_m_s = at(VelocityEast, index);
+  setpoint.velocity_ned.down_m_s = at(VelocityDown, index);
+  setpoint.velocity_ned.yaw_deg = at(Yaw, index);
+
+  return elapsed < _duration;
+}
@@ -0,0 +1,81 @@
+//
+// Precomputed offboard trajectories.
+//
+// A Trajectory joins waypoints with rest-to-rest minimum-jerk segments and
+// samples them once, up front, into a table of position, velocity and yaw
+// setpoints at a fixed period. The table is a single allocation laid out as
+// one array per channel. Following a trajectory is then an index computation
+// per tick: no polynomial evaluation and no allocation on the streaming
+// thread.
+//
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+#include "setpoint_streamer.h"
+
+struct Waypoint {
+  float north_m{0.0f};
+  float east_m{0.0f};
+  float down_m{0.0f};
+  float yaw_deg{0.0f};
+};
+
+// Segment durations are stretched until every limit holds.
+struct TrajectoryLimits {
+  float max_speed_m_s{1.0f};
+  float max_acceleration_m_s2{1.0f};
+  float max_yaw_rate_deg_s{45.0f};
+};
+
+class Trajectory {
+public:
+  static constexpr double default_sample_rate_hz =
+      SetpointStreamer::max_rate_hz;
+
+  Trajectory() = default;
+  // Build the trajectory through `waypoints`, starting at rest on the first
+  // one and ending at rest on the last one.
+  explicit Trajectory(const std::vector<Waypoint> &waypoints,
+                      const TrajectoryLimits &limits = {},
+                      double sample_rate_hz = default_sample_rate_hz);
+
+  // Look up the setpoint `elapsed` after the start. Past the end the last
+  // sample is held.
+  //
+  // returns false once the trajectory is finished (or empty).
+  bool sample(SetpointStreamer::Clock::duration elapsed,
+              Setpoint &setpoint) const;
+
+  bool empty() const { return _samples == 0; }
+  size_t size() const { return _samples; }
+  SetpointStreamer::Clock::duration duration() const { return _duration; }
+
+private:
+  enum Channel {
+    North,
+    East,
+    Down,
+    VelocityNorth,
+    VelocityEast,
+    VelocityDown,
+    Yaw,
+    ChannelCount,
+  };
+
+  float &at(Channel channel, size_t index) {
+    return _table[channel * _samples + index];
+  }
+  float at(Channel channel, size_t index) const {
+    return _table[channel * _samples + index];
+  }
+
+  size_t _samples{0};
+  SetpointStreamer::Clock::duration _period{};
+  SetpointStreamer::Clock::duration _duration{};
+  // ChannelCount arrays of _samples floats each.
+  std::vector<float> _table{};
+};
@@ -0,0 +1,123 @@
+#include "vehicle_fleet.h"
+
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using namespace mavsdk;
+
+namespace {
+
+std::mutex log_mutex;
+
+int64_t now_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             ArrivalMonitor::Clock::now().time_since_epoch())
+      .count();
+}
+
+} // namespace
+
+void ArrivalMonitor::on_sample() {
+  const int64_t now = now_us();
+  const int64_t last = _last_us.exchange(now, std::memory_order_relaxed);
+  _samples.fetch_add(1, std::memory_order_relaxed);
+
+  if (last != 0 && now - last > _max_gap_us.load(std::memory_order_relaxed)) {
+    _max_gap_us.store(now - last, std::memory_order_relaxed);
+  }
+}
+
+ArrivalMonitor::Stats ArrivalMonitor::stats() const {
+  Stats stats{};
+  stats.samples = _samples.load(std::memory_order_relaxed);
+  stats.max_gap =
+      std::chrono::microseconds(_max_gap_us.load(std::memory_order_relaxed));
+  return stats;
+}
+
+void ArrivalMonitor::reset() {
+  _samples.store(0, std::memory_order_relaxed);
+  _last_us.store(0, std::memory_order_relaxed);
+  _max_gap_us.store(0, std::memory_order_relaxed);
+}
+
+Vehicle::Vehicle(std::shared_ptr<System> system_, double setpoint_rate_hz)
+    : system_id(system_->get_system_id()), system(system_), action(system_),
+      offboard(system_), telemetry(system_),
+      streamer(offboard, setpoint_rate_hz) {
+  telemetry.subscribe_position_velocity_ned(
+      [this](Telemetry::PositionVelocityNed position_velocity) {
+        position_arrivals.on_sample();
+        state.update(position_velocity);
+      });
+}
+
+Vehicle::~Vehicle() {
+  telemetry.subscribe_position_velocity_ned(nullptr);
+  streamer.stop();
+}
+
+void Vehicle::log(const std::string &message) const {
+  std::ostringstream line;
+  line << "[sysid " << static_cast<int>(system_id) << "] " << message << '\n';
+
+  std::lock_guard<std::mutex> lock(log_mutex);
+  std::cout << line.str();
+}
+
+VehicleFleet::VehicleFleet(
+    const std::map<uint8_t, std::shared_ptr<System>> &systems,
+    double setpoint_rate_hz) {
+  for (const auto &entry : systems) {
+    _vehicles.emplace(entry.first, std::make_unique<Vehicle>(
+                                       entry.second, setpoint_rate_hz));
+  }
+}
+
+bool VehicleFleet::guard(const Geofence &fence, float separation_m) {
+  if (separation_m > 0.0f && _vehicles.size() > TrafficTable::max_vehicles) {
+    std::cerr << "Can keep at most " << TrafficTable::max_vehicles
+              << " vehicles apart\n";
+    return false;
+  }
+  size_t slot = 0;
+  for (auto &entry : _vehicles) {
+    Vehicle &vehicle = *entry.second;
+    vehicle.guard = std::make_unique<FenceGuard>(fence, vehicle.state);
+    if (separation_m > 0.0f) {
+      vehicle.guard->set_traffic(_traffic, slot++, separation_m);
+    }
+    vehicle.streamer.set_guard(vehicle.guard.get());
+  }
+  return true;
+}
+
+std::map<uint8_t, bool> VehicleFleet::run(const Mission &mission,
+                                          size_t count) {
+  std::map<uint8_t, bool> results;
+  for (const auto &entry : _vehicles) {
+    if (results.size() == count) {
+      break;
+    }
+    results[entry.first] = false;
+  }
+
+  // One thread per vehicle: missions mostly wait on the vehicle, so they do
+  // not compete for cores, and a slow vehicle never delays another one.
+  std::vector<std::thread> threads;
+  threads.reserve(results.size());
+  for (auto &result : results) {
+    Vehicle &vehicle = *_vehicles.at(result.first);
+    bool &succeeded = result.second;
+    threads.emplace_back(
+        [&mission, &vehicle, &succeeded]() { succeeded = mission(vehicle); });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  return results;
+}
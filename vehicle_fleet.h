@@ -0,0 +1,114 @@
+//
+// Several vehicles driven from one process.
+//
+// A single Mavsdk instance discovers the autopilots, every Vehicle bundles
+// the plugins and the setpoint streamer of one of them, and VehicleFleet runs
+// a mission on each vehicle in parallel on its own thread. The MAVSDK I/O
+// threads are shared instead of being duplicated per drone.
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+
+#include <mavsdk/mavsdk.h>
+#include <mavsdk/plugins/action/action.h>
+#include <mavsdk/plugins/offboard/offboard.h>
+#include <mavsdk/plugins/telemetry/telemetry.h>
+
+#include "fence_guard.h"
+#include "geofence.h"
+#include "setpoint_streamer.h"
+#include "vehicle_state.h"
+
+//
+// Arrival statistics of one telemetry stream, updated from its callback.
+//
+class ArrivalMonitor {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Stats {
+    uint64_t samples{0};
+    std::chrono::microseconds max_gap{0};
+  };
+
+  void on_sample();
+  // Stats since the previous reset.
+  Stats stats() const;
+  void reset();
+
+private:
+  std::atomic<uint64_t> _samples{0};
+  std::atomic<int64_t> _last_us{0};
+  std::atomic<int64_t> _max_gap_us{0};
+};
+
+struct Vehicle {
+  Vehicle(std::shared_ptr<mavsdk::System> system, double setpoint_rate_hz);
+  ~Vehicle();
+
+  Vehicle(const Vehicle &) = delete;
+  Vehicle &operator=(const Vehicle &) = delete;
+
+  // Print `message` prefixed with the system id, in one piece even when
+  // several vehicles log at the same time.
+  void log(const std::string &message) const;
+
+  const uint8_t system_id;
+  std::shared_ptr<mavsdk::System> system;
+  mavsdk::Action action;
+  mavsdk::Offboard offboard;
+  mavsdk::Telemetry telemetry;
+  SetpointStreamer streamer;
+  // Arrivals of position_velocity_ned, subscribed for the vehicle lifetime.
+  ArrivalMonitor position_arrivals{};
+  // Fed from the same subscription, position and velocity only.
+  VehicleState state{};
+  // Set up by VehicleFleet::guard().
+  std::unique_ptr<FenceGuard> guard{};
+};
+
+class VehicleFleet {
+public:
+  // returns true if the mission succeeded.
+  using Mission = std::function<bool(Vehicle &vehicle)>;
+
+  VehicleFleet(
+      const std::map<uint8_t, std::shared_ptr<mavsdk::System>> &systems,
+      double setpoint_rate_hz);
+
+  size_t size() const { return _vehicles.size(); }
+
+  // Check the setpoints of every vehicle against `fence` and, with a
+  // positive `separation_m`, against where the other vehicles are heading.
+  // Keeping vehicles apart needs all of them in one local frame. Before any
+  // mission runs.
+  //
+  // returns false if there are too many vehicles to keep apart.
+  bool guard(const Geofence &fence, float separation_m = 0.0f);
+
+  // Run `mission` on the first `count` vehicles (all by default), each on
+  // its own thread, and wait for all of them.
+  //
+  // returns the mission result of every vehicle, keyed by system id.
+  std::map<uint8_t, bool> run(const Mission &mission, size_t count = SIZE_MAX);
+
+  Vehicle &at(uint8_t system_id) { return *_vehicles.at(system_id); }
+
+  template <typename Visit> void for_each(Visit &&visit) {
+    for (auto &entry : _vehicles) {
+      visit(*entry.second);
+    }
+  }
+
+private:
+  std::map<uint8_t, std::unique_ptr<Vehicle>> _vehicles{};
+  TrafficTable _traffic{};
+};
@@ -0,0 +1,104 @@
+#include "vehicle_state.h"
+
+using namespace mavsdk;
+
+namespace {
+
+VehicleState::Clock::duration age(VehicleState::Clock::time_point arrival,
+                                  VehicleState::Clock::time_point now) {
+  if (arrival == VehicleState::Clock::time_point{}) {
+    return VehicleState::Clock::duration::max();
+  }
+  return now - arrival;
+}
+
+} // namespace
+
+VehicleState::VehicleState()
+    : _position_interval_metric(
+          metrics().histogram("telemetry.position_interval")),
+      _attitude_interval_metric(
+          metrics().histogram("telemetry.attitude_interval")) {}
+
+VehicleState::~VehicleState() { detach(); }
+
+void VehicleState::set_filter(const FilterOptions &options) {
+  std::lock_guard<std::mutex> lock(_write_mutex);
+  _filter.emplace(options);
+}
+
+void VehicleState::attach(Telemetry &telemetry) {
+  detach();
+  _telemetry = &telemetry;
+  _telemetry->subscribe_position_velocity_ned(
+      [this](Telemetry::PositionVelocityNed sample) { update(sample); });
+  _telemetry->subscribe_attitude_euler(
+      [this](Telemetry::EulerAngle sample) { update(sample); });
+}
+
+void VehicleState::detach() {
+  if (!_telemetry) {
+    return;
+  }
+  _telemetry->subscribe_position_velocity_ned(nullptr);
+  _telemetry->subscribe_attitude_euler(nullptr);
+  _telemetry = nullptr;
+}
+
+void VehicleState::update(
+    const Telemetry::PositionVelocityNed &position_velocity,
+    Clock::time_point arrival) {
+  std::lock_guard<std::mutex> lock(_write_mutex);
+  if (_pending.position_time != Clock::time_point{}) {
+    _position_interval_metric.record(arrival - _pending.position_time);
+  }
+  _pending.position_velocity = position_velocity;
+  _pending.position_time = arrival;
+  if (_filter) {
+    if (_filter->correct(position_velocity, arrival)) {
+      _pending.position_estimate = _filter->estimate();
+      _filter_resets.store(_filter->resets(), std::memory_order_relaxed);
+    } else {
+      _filter_rejects.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  _snapshot.write(_pending);
+  _position_updates.fetch_add(1, std::memory_order_relaxed);
+}
+
+void VehicleState::update(const Telemetry::EulerAngle &attitude,
+                          Clock::time_point arrival) {
+  std::lock_guard<std::mutex> lock(_write_mutex);
+  if (_pending.attitude_time != Clock::time_point{}) {
+    _attitude_interval_metric.record(arrival - _pending.attitude_time);
+  }
+  _pending.attitude = attitude;
+  _pending.attitude_time = arrival;
+  _snapshot.write(_pending);
+  _attitude_updates.fetch_add(1, std::memory_order_relaxed);
+}
+
+VehicleState::Sample VehicleState::read(Clock::time_point now) const {
+  Sample sample{};
+  if (const unsigned retries = _snapshot.read(sample.state)) {
+    _read_retries.fetch_add(retries, std::memory_order_relaxed);
+  }
+  sample.measured = sample.state.position_velocity;
+  if (sample.state.position_estimate.valid) {
+    sample.state.position_velocity =
+        _filter->predict(sample.state.position_estimate, now);
+  }
+  sample.position_age = age(sample.state.position_time, now);
+  sample.attitude_age = age(sample.state.attitude_time, now);
+  return sample;
+}
+
+VehicleState::Stats VehicleState::stats() const {
+  Stats stats{};
+  stats.position_updates = _position_updates.load(std::memory_order_relaxed);
+  stats.attitude_updates = _attitude_updates.load(std::memory_order_relaxed);
+  stats.read_retries = _read_retries.load(std::memory_order_relaxed);
+  stats.filter_rejects = _filter_rejects.load(std::memory_order_relaxed);
+  stats.filter_resets = _filter_resets.load(std::memory_order_relaxed);
+  return stats;
+}
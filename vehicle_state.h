@@ -0,0 +1,117 @@
+//
+// Latest vehicle state, shared between telemetry callbacks and control loops.
+//
+// The position_velocity_ned and attitude_euler subscriptions write into a
+// seqlock, and control threads read a consistent position, velocity and
+// attitude with their arrival times without taking a lock, including none
+// of MAVSDK's. Every read also says how old each part of the state is, so a
+// stale stream can be caught before it is acted on.
+//
+// With set_filter(), position and velocity go through a StateFilter on
+// their way into the cache, and every read predicts the estimate to the
+// time of the read. The ages stay those of the samples.
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+
+#include <mavsdk/plugins/telemetry/telemetry.h>
+
+#include "metrics.h"
+#include "seqlock.h"
+#include "state_filter.h"
+
+class VehicleState {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Snapshot {
+    mavsdk::Telemetry::PositionVelocityNed position_velocity{};
+    mavsdk::Telemetry::EulerAngle attitude{};
+    // Only valid with a filter.
+    StateFilter::Estimate position_estimate{};
+    // Arrival times, default constructed until the first sample.
+    Clock::time_point position_time{};
+    Clock::time_point attitude_time{};
+  };
+
+  struct Sample {
+    // With a filter, state.position_velocity is the estimate at the time of
+    // the read.
+    Snapshot state{};
+    // The last position_velocity_ned sample as it arrived.
+    mavsdk::Telemetry::PositionVelocityNed measured{};
+    // Age of each part at the time of the read, max() if never received.
+    Clock::duration position_age{};
+    Clock::duration attitude_age{};
+
+    bool has_position() const {
+      return position_age != Clock::duration::max();
+    }
+    bool has_attitude() const {
+      return attitude_age != Clock::duration::max();
+    }
+  };
+
+  struct Stats {
+    uint64_t position_updates{0};
+    uint64_t attitude_updates{0};
+    // Reads that overlapped an update and copied again.
+    uint64_t read_retries{0};
+    // Samples the filter ignored or restarted on.
+    uint64_t filter_rejects{0};
+    uint64_t filter_resets{0};
+  };
+
+  VehicleState();
+  ~VehicleState();
+
+  VehicleState(const VehicleState &) = delete;
+  VehicleState &operator=(const VehicleState &) = delete;
+
+  // Filter the positions and velocities of all later updates. Call before
+  // attach(), and not again.
+  void set_filter(const FilterOptions &options);
+
+  // Feed the cache from the position_velocity_ned and attitude_euler
+  // subscriptions of `telemetry`, replacing any other subscription to them,
+  // until detach().
+  void attach(mavsdk::Telemetry &telemetry);
+  void detach();
+
+  // Updates may come from several threads.
+  void update(const mavsdk::Telemetry::PositionVelocityNed &position_velocity,
+              Clock::time_point arrival = Clock::now());
+  void update(const mavsdk::Telemetry::EulerAngle &attitude,
+              Clock::time_point arrival = Clock::now());
+
+  // Lock-free, callable from any number of threads.
+  Sample read(Clock::time_point now = Clock::now()) const;
+
+  Stats stats() const;
+
+private:
+  // Serializes the writers only, readers never take it.
+  std::mutex _write_mutex{};
+  Snapshot _pending{};
+  // Corrected by the writers, predicted by the readers.
+  std::optional<StateFilter> _filter{};
+  Seqlock<Snapshot> _snapshot{};
+
+  mavsdk::Telemetry *_telemetry{nullptr};
+
+  std::atomic<uint64_t> _position_updates{0};
+  std::atomic<uint64_t> _attitude_updates{0};
+  mutable std::atomic<uint64_t> _read_retries{0};
+  std::atomic<uint64_t> _filter_rejects{0};
+  std::atomic<uint64_t> _filter_resets{0};
+
+  // Time between two samples of a stream, shared by all vehicles.
+  LatencyHistogram &_position_interval_metric;
+  LatencyHistogram &_attitude_interval_metric;
+};
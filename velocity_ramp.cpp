@@ -0,0 +1,181 @@
+#include "velocity_ramp.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+using namespace mavsdk;
+
+namespace {
+
+constexpr float deg_to_rad = static_cast<float>(M_PI / 180.0);
+
+// Ticks further apart than this are a restart, not a step to integrate.
+constexpr float max_dt_s = 0.1f;
+// Close enough to the target to snap onto it.
+constexpr float settle_epsilon = 1e-3f;
+// Older vehicle velocities are not worth starting from.
+constexpr auto max_state_age = std::chrono::milliseconds(200);
+
+} // namespace
+
+const char *const ramp_usage = "[--max-accel <m/s^2>] [--max-jerk <m/s^3>]";
+
+bool parse_ramp_arguments(std::vector<std::string> &arguments,
+                          RampLimits &limits) {
+  std::vector<std::string> remaining;
+  for (size_t i = 0; i < arguments.size(); ++i) {
+    const std::string &argument = arguments[i];
+
+    if (argument == "--max-accel" || argument == "--max-jerk") {
+      if (i + 1 >= arguments.size()) {
+        std::cerr << argument << " needs a value\n";
+        return false;
+      }
+      const float value = std::strtof(arguments[++i].c_str(), nullptr);
+      if (!(value > 0.0f)) {
+        std::cerr << argument << " must be positive\n";
+        return false;
+      }
+      if (argument == "--max-accel") {
+        limits.max_acceleration_m_s2 = value;
+      } else {
+        limits.max_jerk_m_s3 = value;
+      }
+    } else {
+      remaining.push_back(argument);
+    }
+  }
+  arguments = remaining;
+  return true;
+}
+
+VelocityRamp::VelocityRamp(Frame frame, const RampLimits &limits,
+                           const VehicleState *state)
+    : _frame(frame),
+      _max_acceleration{{limits.max_acceleration_m_s2,
+                         limits.max_acceleration_m_s2,
+                         limits.max_acceleration_m_s2,
+                         limits.max_yaw_acceleration_deg_s2}},
+      _max_jerk{{limits.max_jerk_m_s3, limits.max_jerk_m_s3,
+                 limits.max_jerk_m_s3, limits.max_yaw_jerk_deg_s3}},
+      _state(state), _targets(Target{Float4::zero(), 0}),
+      _target{Float4::zero(), 0}, _velocity(Float4::zero()),
+      _acceleration(Float4::zero()) {}
+
+bool VelocityRamp::set_target(const Setpoint &setpoint) {
+  Target target{};
+  if (_frame == Frame::Ned && setpoint.type == Setpoint::Type::VelocityNed) {
+    const auto &velocity = setpoint.velocity_ned;
+    target.velocity = Float4{{velocity.north_m_s, velocity.east_m_s,
+                              velocity.down_m_s, velocity.yaw_deg}};
+  } else if (_frame == Frame::Body &&
+             setpoint.type == Setpoint::Type::VelocityBody) {
+    const auto &velocity = setpoint.velocity_body;
+    target.velocity = Float4{{velocity.forward_m_s, velocity.right_m_s,
+                              velocity.down_m_s, velocity.yawspeed_deg_s}};
+  } else {
+    return false;
+  }
+  target.generation =
+      _requested.fetch_add(1, std::memory_order_acq_rel) + 1;
+  _targets.write(target);
+  return true;
+}
+
+void VelocityRamp::restart() {
+  _velocity = Float4::zero();
+  _acceleration = Float4::zero();
+  if (!_state) {
+    return;
+  }
+  const auto sample = _state->read();
+  if (!sample.has_position() || sample.position_age > max_state_age) {
+    return;
+  }
+  const auto &velocity = sample.state.position_velocity.velocity;
+  if (_frame == Frame::Ned) {
+    _velocity = Float4{
+        {velocity.north_m_s, velocity.east_m_s, velocity.down_m_s, 0.0f}};
+    return;
+  }
+  // Body coordinates are NED rotated by the yaw only.
+  const float yaw_rad =
+      sample.has_attitude() ? sample.state.attitude.yaw_deg * deg_to_rad
+                            : 0.0f;
+  const float cos_yaw = std::cos(yaw_rad);
+  const float sin_yaw = std::sin(yaw_rad);
+  _velocity = Float4{
+      {velocity.north_m_s * cos_yaw + velocity.east_m_s * sin_yaw,
+       -velocity.north_m_s * sin_yaw + velocity.east_m_s * cos_yaw,
+       velocity.down_m_s, 0.0f}};
+}
+
+void VelocityRamp::next(Clock::time_point tick, Setpoint &setpoint) {
+  _targets.read(_target);
+
+  float dt_s = std::chrono::duration<float>(tick - _last_tick).count();
+  if (_last_tick == Clock::time_point{} || dt_s <= 0.0f || dt_s > max_dt_s) {
+    restart();
+    dt_s = 0.0f;
+  }
+  _last_tick = tick;
+
+  bool settled = true;
+  for (int i = 0; i < 4; ++i) {
+    if (_frame == Frame::Ned && i == 3) {
+      // NED targets carry a yaw angle, which the autopilot slews itself.
+      _velocity[3] = _target.velocity[3];
+      continue;
+    }
+    const float error = _target.velocity[i] - _velocity[i];
+    const float jerk_step = _max_jerk[i] * dt_s;
+    if (std::fabs(error) <= settle_epsilon &&
+        std::fabs(_acceleration[i]) <= jerk_step) {
+      _velocity[i] = _target.velocity[i];
+      _acceleration[i] = 0.0f;
+      continue;
+    }
+    settled = false;
+
+    // Shedding acceleration a at jerk j moves the velocity by a^2 / 2j, so
+    // this is the most acceleration that can still stop at the target. It
+    // is taken on the error left after this tick, otherwise the discrete
+    // steps lag the curve and arrive with acceleration to spare.
+    const float remaining = error - _acceleration[i] * dt_s;
+    const float braking =
+        std::sqrt(2.0f * _max_jerk[i] * std::fabs(remaining));
+    const float wanted =
+        std::copysign(std::min(_max_acceleration[i], braking), remaining);
+    _acceleration[i] += std::min(std::max(wanted - _acceleration[i],
+                                          -jerk_step),
+                                 jerk_step);
+
+    const float step = _acceleration[i] * dt_s;
+    if (step * error > 0.0f && std::fabs(step) >= std::fabs(error)) {
+      _velocity[i] = _target.velocity[i];
+      _acceleration[i] = 0.0f;
+    } else {
+      _velocity[i] += step;
+    }
+  }
+  if (settled) {
+    _settled.store(_target.generation, std::memory_order_release);
+  }
+
+  if (_frame == Frame::Ned) {
+    Offboard::VelocityNedYaw velocity{};
+    velocity.north_m_s = _velocity[0];
+    velocity.east_m_s = _velocity[1];
+    velocity.down_m_s = _velocity[2];
+    velocity.yaw_deg = _velocity[3];
+    setpoint = Setpoint::make_velocity_ned(velocity);
+  } else {
+    Offboard::VelocityBodyYawspeed velocity{};
+    velocity.forward_m_s = _velocity[0];
+    velocity.right_m_s = _velocity[1];
+    velocity.down_m_s = _velocity[2];
+    velocity.yawspeed_deg_s = _velocity[3];
+    setpoint = Setpoint::make_velocity_body(velocity);
+  }
+}
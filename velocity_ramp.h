@@ -0,0 +1,94 @@
+//
+// Jerk-limited velocity setpoints for the fixed-rate streamer.
+//
+// Mission code sets a target velocity in NED or body (FRD) coordinates and
+// the ramp moves the commanded velocity towards it on every tick of the
+// streaming thread, with the acceleration and its rate of change bounded on
+// each axis. Each tick is one incremental step from the previous command,
+// so a target can change at any time. The acceleration is wound down ahead
+// of the target so the command arrives without overshoot.
+//
+// A ramp starts from the velocity the vehicle state reports, or from rest
+// without a state, whenever it is driven after a pause.
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <mavsdk/plugins/offboard/offboard.h>
+
+#include "float4.h"
+#include "mailbox.h"
+#include "setpoint_streamer.h"
+#include "vehicle_state.h"
+
+struct RampLimits {
+  float max_acceleration_m_s2{1.0f};
+  float max_jerk_m_s3{2.0f};
+  // For the yaw rate of body targets.
+  float max_yaw_acceleration_deg_s2{90.0f};
+  float max_yaw_jerk_deg_s3{180.0f};
+};
+
+// Usage text of the flags parse_ramp_arguments() takes.
+extern const char *const ramp_usage;
+
+// Take --max-accel <m/s^2> and --max-jerk <m/s^3> out of the tool-specific
+// `arguments`.
+//
+// returns false if a value is missing or not positive.
+bool parse_ramp_arguments(std::vector<std::string> &arguments,
+                          RampLimits &limits);
+
+class VelocityRamp : public SetpointSource {
+public:
+  using Clock = SetpointStreamer::Clock;
+
+  enum class Frame { Ned, Body };
+
+  VelocityRamp(Frame frame, const RampLimits &limits = {},
+               const VehicleState *state = nullptr);
+
+  // Thread-safe, picked up on the next tick. Only targets of the ramp's
+  // frame are accepted. The yaw of NED targets is passed on as it is.
+  //
+  // returns false if `setpoint` is not a velocity in the ramp's frame.
+  bool set_target(const Setpoint &setpoint);
+
+  // Whether the command has reached the latest target and stopped
+  // accelerating.
+  bool settled() const {
+    return _settled.load(std::memory_order_acquire) ==
+           _requested.load(std::memory_order_acquire);
+  }
+
+  void next(Clock::time_point tick, Setpoint &setpoint) override;
+
+private:
+  struct Target {
+    Float4 velocity;
+    uint64_t generation;
+  };
+
+  void restart();
+
+  const Frame _frame;
+  const Float4 _max_acceleration;
+  const Float4 _max_jerk;
+  const VehicleState *const _state;
+
+  Mailbox<Target> _targets;
+  std::atomic<uint64_t> _requested{0};
+  std::atomic<uint64_t> _settled{0};
+
+  // Only touched by the streaming thread.
+  Target _target{};
+  Float4 _velocity{};
+  Float4 _acceleration{};
+  Clock::time_point _last_tick{};
+};
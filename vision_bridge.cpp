@@ -0,0 +1,232 @@
+#include "vision_bridge.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/sockios.h>
+#include <sys/ioctl.h>
+#endif
+
+using namespace mavsdk;
+
+namespace {
+
+uint64_t monotonic_time_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Time since the kernel received the last datagram on `socket`.
+//
+// returns false where receive timestamps are not available. The first call
+// only turns them on.
+bool receive_delay(int socket, std::chrono::microseconds &delay) {
+#if defined(__linux__)
+  timeval stamp{};
+  if (ioctl(socket, SIOCGSTAMP, &stamp) == 0) {
+    const auto received = std::chrono::seconds(stamp.tv_sec) +
+                          std::chrono::microseconds(stamp.tv_usec);
+    delay = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch() - received);
+    return true;
+  }
+#endif
+  (void)socket;
+  (void)delay;
+  return false;
+}
+
+} // namespace
+
+VisionBridge::VisionBridge(Mocap &mocap, uint16_t port)
+    : _mocap(mocap), _port(port), _sent_metric(metrics().counter("mocap.sent")),
+      _send_failures_metric(metrics().counter("mocap.send_failures")),
+      _latency_metric(metrics().histogram("mocap.latency")) {
+  // A NaN first element tells the autopilot the covariance is unknown. The
+  // buffer is set up once here and never resized afterwards.
+  _message.pose_covariance.covariance_matrix.assign(1, NAN);
+}
+
+VisionBridge::~VisionBridge() { stop(); }
+
+bool VisionBridge::start() {
+  if (_running.load()) {
+    return true;
+  }
+
+  if (!_ring_name.empty()) {
+    _ring = std::make_unique<ShmRing<ShmPose>>(
+        _ring_name, ShmRing<ShmPose>::Role::Consumer);
+    if (!_ring->open()) {
+      std::cerr << "Could not open pose ring " << _ring_name << '\n';
+      _ring.reset();
+      return false;
+    }
+    _running.store(true);
+    _jitter.reset();
+    _thread = std::thread(&VisionBridge::run_shared_memory, this);
+    return true;
+  }
+
+  _socket = socket(AF_INET, SOCK_DGRAM, 0);
+  if (_socket < 0) {
+    std::cerr << "Could not create pose socket: " << std::strerror(errno)
+              << '\n';
+    return false;
+  }
+
+  // Wake up regularly so stop() does not hang on a silent source.
+  timeval timeout{};
+  timeout.tv_usec = 100 * 1000;
+  setsockopt(_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(_port);
+  if (bind(_socket, reinterpret_cast<sockaddr *>(&address), sizeof(address)) !=
+      0) {
+    std::cerr << "Could not bind pose socket to port " << _port << ": "
+              << std::strerror(errno) << '\n';
+    close(_socket);
+    _socket = -1;
+    return false;
+  }
+
+  _running.store(true);
+  _jitter.reset();
+  _thread = std::thread(&VisionBridge::run, this);
+  return true;
+}
+
+void VisionBridge::stop() {
+  _running.store(false);
+  if (_thread.joinable()) {
+    _thread.join();
+  }
+  if (_socket >= 0) {
+    close(_socket);
+    _socket = -1;
+  }
+  _ring.reset();
+}
+
+VisionBridge::Stats VisionBridge::stats() const {
+  Stats stats{};
+  stats.received = _received.load(std::memory_order_relaxed);
+  stats.sent = _sent.load(std::memory_order_relaxed);
+  stats.send_failures = _send_failures.load(std::memory_order_relaxed);
+  stats.malformed = _malformed.load(std::memory_order_relaxed);
+  stats.sequence_gaps = _sequence_gaps.load(std::memory_order_relaxed);
+  stats.unsynced = _unsynced.load(std::memory_order_relaxed);
+  stats.latency_sum_us = _latency_sum_us.load(std::memory_order_relaxed);
+  stats.latency_max_us = _latency_max_us.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void VisionBridge::run() {
+  apply_thread_options(_thread_options, "Vision bridge");
+
+  PosePacket packet{};
+
+  while (_running.load(std::memory_order_relaxed)) {
+    const ssize_t length = recv(_socket, &packet, sizeof(packet), 0);
+    if (length < 0) {
+      // Timeout or interrupted, either way just check whether to stop.
+      continue;
+    }
+    const uint64_t ingest_time_us = monotonic_time_us();
+    uint64_t receive_time_us = ingest_time_us;
+    std::chrono::microseconds delay{};
+    if (receive_delay(_socket, delay)) {
+      _jitter.record(delay);
+      if (delay.count() > 0 &&
+          static_cast<uint64_t>(delay.count()) < ingest_time_us) {
+        receive_time_us -= static_cast<uint64_t>(delay.count());
+      }
+    }
+
+    _received.fetch_add(1, std::memory_order_relaxed);
+    if (length != static_cast<ssize_t>(sizeof(packet))) {
+      _malformed.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+
+    forward(packet, ingest_time_us, receive_time_us);
+  }
+}
+
+void VisionBridge::run_shared_memory() {
+  apply_thread_options(_thread_options, "Vision bridge");
+
+  while (_running.load(std::memory_order_relaxed)) {
+    const size_t count = _ring->drain([this](const ShmPose &record) {
+      const uint64_t ingest_time_us = monotonic_time_us();
+      const auto published = std::chrono::nanoseconds(record.publish_time_ns);
+      const auto now = std::chrono::steady_clock::now().time_since_epoch();
+      _jitter.record(now > published ? now - published
+                                     : std::chrono::nanoseconds(0));
+      _received.fetch_add(1, std::memory_order_relaxed);
+      forward(record.pose, ingest_time_us, record.publish_time_ns / 1000);
+    });
+    if (count > 0) {
+      continue;
+    }
+    if (_busy_poll) {
+      cpu_relax();
+    } else {
+      std::this_thread::sleep_for(idle_poll_period);
+    }
+  }
+}
+
+void VisionBridge::forward(const PosePacket &packet, uint64_t ingest_time_us,
+                           uint64_t capture_time_us) {
+  if (_has_sequence && packet.sequence > _last_sequence + 1) {
+    _sequence_gaps.fetch_add(packet.sequence - _last_sequence - 1,
+                             std::memory_order_relaxed);
+  }
+  _last_sequence = packet.sequence;
+  _has_sequence = true;
+
+  if (capture_time_us > _capture_latency_us) {
+    capture_time_us -= _capture_latency_us;
+  }
+  const TimeSync *time_sync = _time_sync.load(std::memory_order_acquire);
+  if (!time_sync ||
+      !time_sync->to_autopilot(capture_time_us, _message.time_usec)) {
+    _message.time_usec = capture_time_us;
+    _unsynced.fetch_add(1, std::memory_order_relaxed);
+  }
+  _message.position_body.x_m = packet.x_m;
+  _message.position_body.y_m = packet.y_m;
+  _message.position_body.z_m = packet.z_m;
+  _message.angle_body.roll_rad = packet.roll_rad;
+  _message.angle_body.pitch_rad = packet.pitch_rad;
+  _message.angle_body.yaw_rad = packet.yaw_rad;
+
+  if (_mocap.set_vision_position_estimate(_message) == Mocap::Result::Success) {
+    _sent.fetch_add(1, std::memory_order_relaxed);
+    _sent_metric.add();
+  } else {
+    _send_failures.fetch_add(1, std::memory_order_relaxed);
+    _send_failures_metric.add();
+  }
+
+  const uint64_t latency_us = monotonic_time_us() - ingest_time_us;
+  _latency_metric.record_ns(latency_us * 1000);
+  _latency_sum_us.fetch_add(latency_us, std::memory_order_relaxed);
+  if (latency_us > _latency_max_us.load(std::memory_order_relaxed)) {
+    _latency_max_us.store(latency_us, std::memory_order_relaxed);
+  }
+}
@@ -0,0 +1,138 @@
+//
+// Bridge from an external pose source (mocap / VRPN relay) to Mocap.
+//
+// Poses arrive as fixed-size UDP datagrams (PosePacket) and are forwarded to
+// the autopilot as VisionPositionEstimate the moment they are received, so
+// the estimate goes out at the source's native rate. The message and its
+// covariance buffer are built once and reused.
+//
+// Every estimate is stamped with the time the pose was captured: when the
+// kernel received the datagram, or the source published it on the ring, less
+// the source's own capture latency. With a TimeSync that time is converted
+// to the autopilot's clock, so the EKF can fuse the pose at the instant it
+// describes; without one, or before it has an estimate, the companion's
+// monotonic time is sent.
+//
+// A source on the same machine can publish on a shared-memory ring instead
+// (shm_records.h), which the bridge polls and reads in place: no socket, no
+// syscall and no copy per pose.
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <mavsdk/plugins/mocap/mocap.h>
+
+#include "metrics.h"
+#include "realtime.h"
+#include "shm_records.h"
+#include "shm_ring.h"
+#include "time_sync.h"
+
+class VisionBridge {
+public:
+  static constexpr uint16_t default_port = 5005;
+
+  struct Stats {
+    uint64_t received{0};
+    uint64_t sent{0};
+    uint64_t send_failures{0};
+    uint64_t malformed{0};
+    // Poses the source numbered but we never saw.
+    uint64_t sequence_gaps{0};
+    // Estimates stamped with companion time for want of a time sync.
+    uint64_t unsynced{0};
+    // Time from the datagram arriving to the estimate being handed off.
+    uint64_t latency_sum_us{0};
+    uint64_t latency_max_us{0};
+  };
+
+  VisionBridge(mavsdk::Mocap &mocap, uint16_t port = default_port);
+  ~VisionBridge();
+
+  VisionBridge(const VisionBridge &) = delete;
+  VisionBridge &operator=(const VisionBridge &) = delete;
+
+  // Takes effect on the next start().
+  void set_thread_options(const ThreadOptions &options) {
+    _thread_options = options;
+  }
+
+  // Take poses from the shared-memory `ring` instead of the UDP port, from
+  // the next start() on. With `busy_poll` the bridge spins on the ring and
+  // picks a pose up within microseconds, at the cost of a core; otherwise
+  // it sleeps for idle_poll_period whenever the ring is empty.
+  void use_shared_memory(const std::string &ring, bool busy_poll) {
+    _ring_name = ring;
+    _busy_poll = busy_poll;
+  }
+
+  static constexpr std::chrono::microseconds idle_poll_period{100};
+
+  // Stamp estimates in autopilot time from now on. `time_sync` must outlive
+  // the bridge.
+  void set_time_sync(const TimeSync &time_sync) {
+    _time_sync.store(&time_sync);
+  }
+
+  // Time from the source capturing a pose until it sends or publishes it,
+  // taken off every stamp. Takes effect on the next start().
+  void set_capture_latency(std::chrono::microseconds latency) {
+    _capture_latency_us = static_cast<uint64_t>(latency.count());
+  }
+
+  // Bind the UDP socket, or open the ring, and start forwarding.
+  //
+  // returns false if the socket or ring could not be set up.
+  bool start();
+  void stop();
+
+  Stats stats() const;
+  // From the kernel receiving a datagram, or the source publishing on the
+  // ring, until the bridge thread has it.
+  const JitterHistogram &jitter() const { return _jitter; }
+
+private:
+  void run();
+  void run_shared_memory();
+  void forward(const PosePacket &packet, uint64_t ingest_time_us,
+               uint64_t capture_time_us);
+
+  mavsdk::Mocap &_mocap;
+  const uint16_t _port;
+
+  int _socket{-1};
+  std::string _ring_name{};
+  bool _busy_poll{false};
+  std::unique_ptr<ShmRing<ShmPose>> _ring{};
+  std::atomic<const TimeSync *> _time_sync{nullptr};
+  uint64_t _capture_latency_us{0};
+  std::atomic<bool> _running{false};
+  ThreadOptions _thread_options{};
+  std::thread _thread{};
+
+  // Only touched by the bridge thread.
+  mavsdk::Mocap::VisionPositionEstimate _message{};
+  uint32_t _last_sequence{0};
+  bool _has_sequence{false};
+
+  std::atomic<uint64_t> _received{0};
+  std::atomic<uint64_t> _sent{0};
+  std::atomic<uint64_t> _send_failures{0};
+  std::atomic<uint64_t> _malformed{0};
+  std::atomic<uint64_t> _sequence_gaps{0};
+  std::atomic<uint64_t> _unsynced{0};
+  std::atomic<uint64_t> _latency_sum_us{0};
+  std::atomic<uint64_t> _latency_max_us{0};
+  JitterHistogram _jitter{};
+
+  Counter &_sent_metric;
+  Counter &_send_failures_metric;
+  LatencyHistogram &_latency_metric;
+};
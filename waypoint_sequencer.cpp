@@ -0,0 +1,155 @@
+#include "waypoint_sequencer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <thread>
+
+#include "failsafe_watchdog.h"
+
+using namespace mavsdk;
+
+namespace {
+
+// Convergence is checked on the cached state at about the rate the
+// position arrives.
+constexpr auto poll_period = std::chrono::milliseconds(20);
+
+float error_m(const Waypoint &target, const Telemetry::PositionNed &position) {
+  const float north = target.north_m - position.north_m;
+  const float east = target.east_m - position.east_m;
+  const float down = target.down_m - position.down_m;
+  return std::sqrt(north * north + east * east + down * down);
+}
+
+float speed_m_s(const Telemetry::VelocityNed &velocity) {
+  return std::sqrt(velocity.north_m_s * velocity.north_m_s +
+                   velocity.east_m_s * velocity.east_m_s +
+                   velocity.down_m_s * velocity.down_m_s);
+}
+
+} // namespace
+
+WaypointSequencer::WaypointSequencer(const VehicleState &state,
+                                     SetpointStreamer &streamer,
+                                     const ConvergenceTolerances &tolerances)
+    : _state(state), _streamer(streamer), _tolerances(tolerances) {}
+
+std::vector<WaypointSequencer::Leg>
+WaypointSequencer::fly(const std::vector<Waypoint> &waypoints,
+                       const TrajectoryLimits &limits) {
+  auto sample = _state.read();
+  for (auto waited = Clock::duration{};
+       !sample.has_position() && waited < std::chrono::seconds(1);
+       waited += poll_period) {
+    std::this_thread::sleep_for(poll_period);
+    sample = _state.read();
+  }
+  if (!sample.has_position()) {
+    std::cerr << "No position to start the sequence from\n";
+    return {};
+  }
+
+  Waypoint from{};
+  from.north_m = sample.state.position_velocity.position.north_m;
+  from.east_m = sample.state.position_velocity.position.east_m;
+  from.down_m = sample.state.position_velocity.position.down_m;
+  from.yaw_deg = sample.has_attitude() ? sample.state.attitude.yaw_deg : 0.0f;
+
+  // All legs are planned up front and stay alive until the streamer has
+  // moved off the last one.
+  std::vector<Trajectory> trajectories;
+  trajectories.reserve(waypoints.size());
+  for (const auto &waypoint : waypoints) {
+    trajectories.emplace_back(std::vector<Waypoint>{from, waypoint}, limits);
+    from = waypoint;
+  }
+
+  const auto triggered = [this]() {
+    return _watchdog && _watchdog->triggered();
+  };
+  std::vector<Leg> legs;
+  legs.reserve(waypoints.size());
+  for (size_t i = 0; i < waypoints.size() && !triggered(); ++i) {
+    const auto start = Clock::now();
+    _streamer.follow(trajectories[i]);
+
+    LegMonitor monitor{waypoints[i], trajectories[i], start, _tolerances};
+    for (;;) {
+      std::this_thread::sleep_for(poll_period);
+      const auto now = Clock::now();
+      if (monitor.update(_state.read(now), now) || triggered()) {
+        break;
+      }
+    }
+    legs.push_back(monitor.leg());
+  }
+
+  if (!waypoints.empty() && triggered()) {
+    // Off the trajectories before they go out of scope.
+    std::cerr << "Failsafe triggered, waypoints ended after " << legs.size()
+              << " legs\n";
+    const auto now = _state.read();
+    const auto &position = now.state.position_velocity.position;
+    Offboard::PositionNedYaw hold{};
+    hold.north_m = position.north_m;
+    hold.east_m = position.east_m;
+    hold.down_m = position.down_m;
+    hold.yaw_deg = now.has_attitude() ? now.state.attitude.yaw_deg
+                                      : waypoints.back().yaw_deg;
+    _streamer.set_target_and_wait(Setpoint::make_position_ned(hold));
+  } else if (!waypoints.empty()) {
+    Offboard::PositionNedYaw hold{};
+    hold.north_m = waypoints.back().north_m;
+    hold.east_m = waypoints.back().east_m;
+    hold.down_m = waypoints.back().down_m;
+    hold.yaw_deg = waypoints.back().yaw_deg;
+    _streamer.set_target_and_wait(Setpoint::make_position_ned(hold));
+  }
+
+  return legs;
+}
+
+LegMonitor::LegMonitor(const Waypoint &target, const Trajectory &trajectory,
+                       Clock::time_point start,
+                       const ConvergenceTolerances &tolerances)
+    : _tolerances(tolerances), _start(start),
+      _deadline(start + trajectory.duration() + tolerances.settle_timeout) {
+  _leg.target = target;
+}
+
+bool LegMonitor::update(const VehicleState::Sample &sample,
+                        Clock::time_point now) {
+  const auto &position_velocity = sample.state.position_velocity;
+
+  _leg.max_sample_age = std::max(_leg.max_sample_age, sample.position_age);
+  _leg.converged =
+      sample.position_age <= _tolerances.max_sample_age &&
+      error_m(_leg.target, position_velocity.position) <=
+          _tolerances.position_m &&
+      speed_m_s(position_velocity.velocity) <= _tolerances.speed_m_s;
+  _leg.duration = now - _start;
+  _leg.final_error_m = error_m(_leg.target, position_velocity.position);
+  return _leg.converged || now >= _deadline;
+}
+
+void print_legs(const std::vector<WaypointSequencer::Leg> &legs) {
+  double total_s = 0.0;
+  for (size_t i = 0; i < legs.size(); ++i) {
+    const auto &leg = legs[i];
+    const double duration_s =
+        std::chrono::duration<double>(leg.duration).count();
+    total_s += duration_s;
+
+    std::cout << "Leg " << i + 1 << " to (" << leg.target.north_m << ", "
+              << leg.target.east_m << ", " << leg.target.down_m << "): "
+              << (leg.converged ? "converged" : "timed out") << " after "
+              << duration_s << " s, error " << leg.final_error_m
+              << " m, oldest sample "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(
+                     leg.max_sample_age)
+                     .count()
+              << " ms\n";
+  }
+  std::cout << legs.size() << " legs in " << total_s << " s\n";
+}
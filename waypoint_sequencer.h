@@ -0,0 +1,100 @@
+//
+// Closed-loop waypoint sequencing.
+//
+// Every leg follows a minimum-jerk trajectory to the next waypoint, and the
+// sequencer moves on as soon as the vehicle state shows the vehicle has
+// settled there, within position and speed tolerances, instead of after a
+// fixed sleep. A timeout moves on regardless if the vehicle never settles.
+//
+
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+#include "setpoint_streamer.h"
+#include "trajectory.h"
+#include "vehicle_state.h"
+
+class FailsafeWatchdog;
+
+struct ConvergenceTolerances {
+  float position_m{0.15f};
+  float speed_m_s{0.1f};
+  // How long to wait for convergence past the end of a leg's trajectory.
+  std::chrono::milliseconds settle_timeout{5000};
+  // Older position samples never count as converged.
+  std::chrono::milliseconds max_sample_age{500};
+};
+
+class WaypointSequencer {
+public:
+  using Clock = SetpointStreamer::Clock;
+
+  struct Leg {
+    Waypoint target{};
+    // false if the leg ended on the settle timeout.
+    bool converged{false};
+    Clock::duration duration{};
+    float final_error_m{0.0f};
+    // Oldest position sample seen while checking for convergence.
+    Clock::duration max_sample_age{};
+  };
+
+  // `state` must be fed with position_velocity_ned samples.
+  WaypointSequencer(const VehicleState &state, SetpointStreamer &streamer,
+                    const ConvergenceTolerances &tolerances = {});
+
+  WaypointSequencer(const WaypointSequencer &) = delete;
+  WaypointSequencer &operator=(const WaypointSequencer &) = delete;
+
+  // End every later fly() as soon as `watchdog` triggers. It must outlive
+  // the sequencer.
+  void stop_on_failsafe(const FailsafeWatchdog &watchdog) {
+    _watchdog = &watchdog;
+  }
+
+  // Fly through `waypoints` in order, starting from the current position.
+  // The streamer must already be running; it holds the last waypoint
+  // afterwards, or the position where a failsafe ended the sequence.
+  //
+  // returns one entry per waypoint flown, fewer after a failsafe.
+  std::vector<Leg> fly(const std::vector<Waypoint> &waypoints,
+                       const TrajectoryLimits &limits = {});
+
+private:
+  const VehicleState &_state;
+  SetpointStreamer &_streamer;
+  const ConvergenceTolerances _tolerances;
+  const FailsafeWatchdog *_watchdog{nullptr};
+};
+
+//
+// When one leg is over. The rule is the same for live flights and replays,
+// so it only ever sees times passed in, never the clock.
+//
+class LegMonitor {
+public:
+  using Clock = WaypointSequencer::Clock;
+
+  // The leg follows `trajectory` to `target` from `start` on.
+  LegMonitor(const Waypoint &target, const Trajectory &trajectory,
+             Clock::time_point start,
+             const ConvergenceTolerances &tolerances = {});
+
+  // Check `sample`, read at `now`.
+  //
+  // returns true once the leg has converged or timed out.
+  bool update(const VehicleState::Sample &sample, Clock::time_point now);
+
+  const WaypointSequencer::Leg &leg() const { return _leg; }
+
+private:
+  const ConvergenceTolerances _tolerances;
+  const Clock::time_point _start;
+  const Clock::time_point _deadline;
+  WaypointSequencer::Leg _leg{};
+};
+
+// Print the per-leg report of WaypointSequencer::fly().
+void print_legs(const std::vector<WaypointSequencer::Leg> &legs);